@@ -0,0 +1,278 @@
+#pragma once
+
+// Small timing harness for the standalone benchmarks. Every case is timed
+// as a number of samples, each a batch of iterations long enough to read the
+// clock reliably, after a few warmup samples that are thrown away. Results
+// are per iteration: median, percentiles and the throughput at the median,
+// printed as a table and optionally written as JSON so runs can be compared
+// over time. Header only and platform neutral.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct BenchOptions {
+  BenchOptions()
+    : fWarmup(3)
+    , fRepetitions(15)
+    , fMinSampleSeconds(0.002)
+    , fFilter(nullptr)
+    , fJsonPath(nullptr)
+  {
+  }
+
+  int fWarmup;               // Samples run and dropped before timing
+  int fRepetitions;          // Timed samples
+  double fMinSampleSeconds;  // Iterations per sample are picked to take at least this long
+  const char* fFilter;       // Only cases whose name contains this, or nullptr for all
+  const char* fJsonPath;     // Where to write the results, or nullptr
+
+  // Takes the harness options out of argv, leaving the rest in order.
+  // Returns false on a bad value.
+  bool Parse(int& aArgc, char** aArgv)
+  {
+    int out = 1;
+    for (int i = 1; i < aArgc; i++) {
+      const char* arg = aArgv[i];
+      bool hasValue = i + 1 < aArgc;
+      if (!strcmp(arg, "--json") && hasValue) {
+        fJsonPath = aArgv[++i];
+      } else if (!strcmp(arg, "--filter") && hasValue) {
+        fFilter = aArgv[++i];
+      } else if (!strcmp(arg, "--warmup") && hasValue) {
+        fWarmup = atoi(aArgv[++i]);
+        if (fWarmup < 0) {
+          return false;
+        }
+      } else if (!strcmp(arg, "--repetitions") && hasValue) {
+        fRepetitions = atoi(aArgv[++i]);
+        if (fRepetitions < 1) {
+          return false;
+        }
+      } else if (!strcmp(arg, "--min-sample-ms") && hasValue) {
+        fMinSampleSeconds = atof(aArgv[++i]) / 1000.0;
+        if (!(fMinSampleSeconds > 0.0)) {
+          return false;
+        }
+      } else {
+        aArgv[out++] = aArgv[i];
+      }
+    }
+    aArgc = out;
+    return true;
+  }
+
+  static const char* Usage()
+  {
+    return "[--json out.json] [--filter text] [--warmup N] [--repetitions N] [--min-sample-ms N]";
+  }
+};
+
+struct BenchResult {
+  std::string fName;
+  int fWarmup;
+  int fRepetitions;
+  uint64_t fIterationsPerSample;
+  // Per iteration, over the timed samples.
+  double fMinNs;
+  double fMedianNs;
+  double fP90Ns;
+  double fP99Ns;
+  double fMaxNs;
+  // Work done by one iteration, 0 if it does not apply.
+  uint64_t fBytes;
+  uint64_t fPixels;
+
+  double BytesPerSecond() const { return fBytes * 1e9 / fMedianNs; }
+  double PixelsPerSecond() const { return fPixels * 1e9 / fMedianNs; }
+};
+
+// Keeps the compiler from dropping work whose result is otherwise unused.
+static inline void
+BenchDoNotOptimize(const void* aPointer)
+{
+#if defined(__GNUC__)
+  __asm__ __volatile__("" : : "r"(aPointer) : "memory");
+#else
+  static const void* volatile sSink;
+  sSink = aPointer;
+#endif
+}
+
+class BenchRunner {
+public:
+  explicit BenchRunner(const BenchOptions& aOptions)
+    : mOptions(aOptions)
+  {
+  }
+
+  /**
+   * Times aBody, which does one iteration of the case per call.
+   *
+   * @param aBytes Bytes one iteration reads and writes, for bytes/s.
+   * @param aPixels Pixels one iteration produces, for pixels/s.
+   */
+  template<typename Body>
+  void Run(const std::string& aName, uint64_t aBytes, uint64_t aPixels, Body aBody)
+  {
+    if (mOptions.fFilter && aName.find(mOptions.fFilter) == std::string::npos) {
+      return;
+    }
+
+    // Grow the batch until one takes long enough, which also warms up the
+    // caches and the branch predictors before the first warmup sample.
+    uint64_t iterations = 1;
+    for (;;) {
+      double seconds = TimeSample(aBody, iterations);
+      if (seconds >= mOptions.fMinSampleSeconds || iterations >= (1ull << 40)) {
+        break;
+      }
+      uint64_t scale = seconds > 0.0 ? (uint64_t)(mOptions.fMinSampleSeconds / seconds * 1.2) + 1 : 16;
+      iterations *= std::min<uint64_t>(std::max<uint64_t>(scale, 2), 16);
+    }
+
+    for (int i = 0; i < mOptions.fWarmup; i++) {
+      TimeSample(aBody, iterations);
+    }
+
+    std::vector<double> samples(mOptions.fRepetitions);
+    for (size_t i = 0; i < samples.size(); i++) {
+      samples[i] = TimeSample(aBody, iterations) * 1e9 / iterations;
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result;
+    result.fName = aName;
+    result.fWarmup = mOptions.fWarmup;
+    result.fRepetitions = mOptions.fRepetitions;
+    result.fIterationsPerSample = iterations;
+    result.fMinNs = samples.front();
+    result.fMedianNs = Percentile(samples, 0.5);
+    result.fP90Ns = Percentile(samples, 0.9);
+    result.fP99Ns = Percentile(samples, 0.99);
+    result.fMaxNs = samples.back();
+    result.fBytes = aBytes;
+    result.fPixels = aPixels;
+    mResults.push_back(result);
+    Print(result);
+  }
+
+  const std::vector<BenchResult>& Results() const { return mResults; }
+
+  static void PrintHeader()
+  {
+    printf("%-52s %12s %12s %12s %10s %10s\n",
+           "case", "median", "p90", "p99", "MB/s", "Mpixels/s");
+  }
+
+  // Writes every result so far to the JSON path of the options, if any.
+  // Returns false if the file cannot be written.
+  bool WriteJson(const char* aSuite) const
+  {
+    if (!mOptions.fJsonPath) {
+      return true;
+    }
+    FILE* out = fopen(mOptions.fJsonPath, "w");
+    if (!out) {
+      return false;
+    }
+    fprintf(out, "{\n  \"suite\": \"%s\",\n  \"timestamp\": %lld,\n", aSuite, (long long)time(nullptr));
+    fprintf(out, "  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"results\": [",
+            mOptions.fWarmup, mOptions.fRepetitions);
+    for (size_t i = 0; i < mResults.size(); i++) {
+      const BenchResult& r = mResults[i];
+      fprintf(out, "%s\n    {\"name\": \"", i ? "," : "");
+      WriteEscaped(out, r.fName);
+      fprintf(out, "\", \"iterations_per_sample\": %llu, "
+                   "\"min_ns\": %.1f, \"median_ns\": %.1f, \"p90_ns\": %.1f, "
+                   "\"p99_ns\": %.1f, \"max_ns\": %.1f, "
+                   "\"bytes\": %llu, \"pixels\": %llu, "
+                   "\"bytes_per_second\": %.0f, \"pixels_per_second\": %.0f}",
+              (unsigned long long)r.fIterationsPerSample,
+              r.fMinNs, r.fMedianNs, r.fP90Ns, r.fP99Ns, r.fMaxNs,
+              (unsigned long long)r.fBytes, (unsigned long long)r.fPixels,
+              r.BytesPerSecond(), r.PixelsPerSecond());
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return fclose(out) == 0;
+  }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  template<typename Body>
+  static double TimeSample(Body& aBody, uint64_t aIterations)
+  {
+    Clock::time_point start = Clock::now();
+    for (uint64_t i = 0; i < aIterations; i++) {
+      aBody();
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  // Nearest rank on sorted samples, so with few samples the high
+  // percentiles are the slowest sample.
+  static double Percentile(const std::vector<double>& aSorted, double aFraction)
+  {
+    size_t rank = (size_t)(aFraction * aSorted.size() + 0.999999);
+    rank = std::min(std::max(rank, (size_t)1), aSorted.size());
+    return aSorted[rank - 1];
+  }
+
+  static const char* FormatNs(char* aBuffer, size_t aSize, double aNs)
+  {
+    if (aNs >= 1e6) {
+      snprintf(aBuffer, aSize, "%.2f ms", aNs / 1e6);
+    } else if (aNs >= 1e3) {
+      snprintf(aBuffer, aSize, "%.2f us", aNs / 1e3);
+    } else {
+      snprintf(aBuffer, aSize, "%.1f ns", aNs);
+    }
+    return aBuffer;
+  }
+
+  static void Print(const BenchResult& aResult)
+  {
+    char median[32], p90[32], p99[32];
+    printf("%-52s %12s %12s %12s", aResult.fName.c_str(),
+           FormatNs(median, sizeof(median), aResult.fMedianNs),
+           FormatNs(p90, sizeof(p90), aResult.fP90Ns),
+           FormatNs(p99, sizeof(p99), aResult.fP99Ns));
+    if (aResult.fBytes) {
+      printf(" %10.0f", aResult.BytesPerSecond() / 1e6);
+    } else {
+      printf(" %10s", "-");
+    }
+    if (aResult.fPixels) {
+      printf(" %10.1f", aResult.PixelsPerSecond() / 1e6);
+    } else {
+      printf(" %10s", "-");
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+
+  static void WriteEscaped(FILE* aOut, const std::string& aText)
+  {
+    for (size_t i = 0; i < aText.size(); i++) {
+      char c = aText[i];
+      if (c == '"' || c == '\\') {
+        fputc('\\', aOut);
+        fputc(c, aOut);
+      } else if ((unsigned char)c < 0x20) {
+        fprintf(aOut, "\\u%04x", c);
+      } else {
+        fputc(c, aOut);
+      }
+    }
+  }
+
+  BenchOptions mOptions;
+  std::vector<BenchResult> mResults;
+};
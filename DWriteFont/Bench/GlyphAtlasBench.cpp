@@ -0,0 +1,213 @@
+// Standalone benchmark for GlyphAtlas packing and eviction. Platform neutral,
+// see ReadMe.txt for how to build it.
+//
+// Simulates frames of text drawing: every frame touches a working set of
+// glyphs that slowly drifts through a large glyph vocabulary, plus a few
+// random glyphs. Reports packing efficiency and evictions per frame, and
+// checks that every glyph read back from the atlas still has its own pixels.
+// Also fills every page within one frame and checks that no glyph handed
+// out earlier in the frame moved.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "../GlyphAtlas.h"
+
+static const int kPageSize = 1024;
+static const int kMaxPages = 4;
+static const int kBytesPerPixel = 4;
+static const int kVocabulary = 40000;
+static const int kWorkingSet = 3000;
+static const int kGlyphsPerFrame = 2500;
+static const int kFrames = 2000;
+static const int kDriftPerFrame = 20;
+
+static uint32_t
+Mix(uint32_t aValue)
+{
+  aValue ^= aValue >> 16;
+  aValue *= 0x7feb352d;
+  aValue ^= aValue >> 15;
+  aValue *= 0x846ca68b;
+  aValue ^= aValue >> 16;
+  return aValue;
+}
+
+// Glyph sizes roughly like 9-30px text: mostly small, some tall.
+static void
+GlyphSize(uint32_t aGlyph, int32_t* aOutWidth, int32_t* aOutHeight)
+{
+  uint32_t h = Mix(aGlyph);
+  *aOutWidth = 4 + (int32_t)(h % 24);
+  *aOutHeight = 8 + (int32_t)((h >> 8) % 28);
+}
+
+static uint8_t
+GlyphByte(uint32_t aGlyph)
+{
+  return (uint8_t)(Mix(aGlyph * 31 + 7) | 1);
+}
+
+static AtlasKey
+MakeKey(uint32_t aGlyph)
+{
+  AtlasKey key;
+  memset(&key, 0, sizeof(key));
+  key.fGlyph.fFaceId = 1 + aGlyph / 65536;
+  key.fGlyph.fEmSize = 13.0f;
+  key.fGlyph.fPixelsPerDip = 1.0f;
+  key.fGlyph.fGlyphIndex = (uint16_t)(aGlyph & 0xFFFF);
+  key.fVariant = 0;
+  return key;
+}
+
+static bool
+CheckPixels(const GlyphAtlas& aAtlas, const AtlasEntry& aEntry, uint8_t aExpected)
+{
+  const uint8_t* pixels = aAtlas.PagePixels(aEntry.fPage);
+  const int32_t stride = aAtlas.PageStride();
+  for (int32_t y = aEntry.fRect.fTop; y < aEntry.fRect.fBottom; y++) {
+    const uint8_t* row = pixels + y * stride + aEntry.fRect.fLeft * kBytesPerPixel;
+    for (int32_t x = 0; x < aEntry.fRect.Width() * kBytesPerPixel; x++) {
+      if (row[x] != aExpected) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Inserts glyphs into a small atlas in one frame until every page is full,
+// then keeps inserting. Entries of the frame must keep their page, rect and
+// pixels until the next BeginFrame.
+static bool
+CheckFullFrame()
+{
+  GlyphAtlas atlas(128, kBytesPerPixel, 2);
+  std::vector<uint8_t> glyphBits(64 * 64 * kBytesPerPixel);
+  std::vector<uint32_t> glyphs;
+  std::vector<AtlasEntry> entries;
+
+  // A frame of older glyphs first, so the full frame has something to evict.
+  atlas.BeginFrame();
+  uint32_t glyph = 0;
+  for (int i = 0; i < 40; i++, glyph++) {
+    int32_t width, height;
+    GlyphSize(glyph, &width, &height);
+    memset(glyphBits.data(), GlyphByte(glyph), glyphBits.size());
+    AtlasEntry entry;
+    atlas.Insert(MakeKey(glyph), width, height, glyphBits.data(), width * kBytesPerPixel, &entry);
+  }
+
+  atlas.BeginFrame();
+  int failures = 0;
+  for (; failures < 20; glyph++) {
+    int32_t width, height;
+    GlyphSize(glyph, &width, &height);
+    memset(glyphBits.data(), GlyphByte(glyph), glyphBits.size());
+    AtlasEntry entry;
+    if (!atlas.Insert(MakeKey(glyph), width, height, glyphBits.data(), width * kBytesPerPixel,
+                      &entry)) {
+      failures++;
+      continue;
+    }
+    glyphs.push_back(glyph);
+    entries.push_back(entry);
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < entries.size(); i++) {
+    AtlasEntry now;
+    const IntRect& was = entries[i].fRect;
+    if (!atlas.Lookup(MakeKey(glyphs[i]), &now) || now.fPage != entries[i].fPage ||
+        now.fRect.fLeft != was.fLeft || now.fRect.fTop != was.fTop ||
+        now.fRect.fRight != was.fRight || now.fRect.fBottom != was.fBottom ||
+        !CheckPixels(atlas, now, GlyphByte(glyphs[i]))) {
+      printf("FAIL: glyph %u moved or lost within its frame\n", glyphs[i]);
+      ok = false;
+    }
+  }
+  printf("Full frame: %zu glyphs inserted, %d did not fit, %s\n",
+         entries.size(), failures, ok ? "none moved" : "FAILED");
+  return ok;
+}
+
+int
+main()
+{
+  GlyphAtlas atlas(kPageSize, kBytesPerPixel, kMaxPages);
+  std::vector<uint8_t> glyphBits(64 * 64 * kBytesPerPixel);
+
+  uint32_t random = 12345;
+  double efficiencySum = 0;
+  double densitySum = 0;
+  uint32_t maxFrameEvictions = 0;
+  uint64_t lookups = 0;
+  uint64_t hits = 0;
+  int errors = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < kFrames; frame++) {
+    atlas.BeginFrame();
+    uint32_t windowStart = (uint32_t)(frame * kDriftPerFrame) % kVocabulary;
+
+    for (int i = 0; i < kGlyphsPerFrame; i++) {
+      random = Mix(random + i);
+      uint32_t glyph = (random % 10) == 0
+                     ? random % kVocabulary
+                     : (windowStart + (random >> 4) % kWorkingSet) % kVocabulary;
+
+      AtlasKey key = MakeKey(glyph);
+      AtlasEntry entry;
+      lookups++;
+      if (atlas.Lookup(key, &entry)) {
+        hits++;
+      } else {
+        int32_t width, height;
+        GlyphSize(glyph, &width, &height);
+        memset(glyphBits.data(), GlyphByte(glyph), glyphBits.size());
+        if (!atlas.Insert(key, width, height, glyphBits.data(), width * kBytesPerPixel, &entry)) {
+          continue;
+        }
+      }
+
+      // Checking every glyph is slow, sample a few per frame.
+      if ((i % 97) == 0 && !CheckPixels(atlas, entry, GlyphByte(glyph))) {
+        errors++;
+      }
+    }
+
+    efficiencySum += atlas.PackingEfficiency();
+    densitySum += atlas.PackedDensity();
+    if (atlas.Stats().fFrameEvictions > maxFrameEvictions) {
+      maxFrameEvictions = atlas.Stats().fFrameEvictions;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+  const AtlasStats& stats = atlas.Stats();
+  printf("GlyphAtlas: %d frames, %d glyphs/frame, %dx%d pages, up to %d pages\n",
+         kFrames, kGlyphsPerFrame, kPageSize, kPageSize, kMaxPages);
+  printf("  hit rate:               %.2f%%\n", 100.0 * hits / lookups);
+  printf("  inserts:                %llu (%llu failed)\n",
+         (unsigned long long)stats.fInserts, (unsigned long long)stats.fFailedInserts);
+  printf("  packing efficiency:     %.2f%% of page area (avg), %.2f%% now\n",
+         100.0 * efficiencySum / kFrames, 100.0 * atlas.PackingEfficiency());
+  printf("  packed density:         %.2f%% of area under skyline (avg)\n",
+         100.0 * densitySum / kFrames);
+  printf("  evictions per frame:    %.2f avg, %u max\n",
+         (double)stats.fEvictions / kFrames, maxFrameEvictions);
+  printf("  page resets:            %llu\n", (unsigned long long)stats.fPageResets);
+  printf("  compactions:            %llu\n", (unsigned long long)stats.fCompactions);
+  printf("  time per frame:         %.3f ms\n", ms / kFrames);
+  printf("  pixel check errors:     %d\n", errors);
+
+  if (!CheckFullFrame()) {
+    errors++;
+  }
+  return errors ? 1 : 0;
+}
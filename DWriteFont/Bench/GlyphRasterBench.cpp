@@ -0,0 +1,592 @@
+// Benchmark and accuracy report for the CPU glyph rasterizer. Platform
+// neutral, see ReadMe.txt for how to build it.
+//
+//   GlyphRasterBench font.ttf
+//
+// Checks that every AccumulateCoverage version gives the same bytes and
+// times them, then reports glyphs per second by ppem for A8 and 3x1 ClearType
+// masks, on their own and composited into runs in the RGB layout
+// GetAlphaTexture hands to ConvertToBGRA, and a cold page rasterized by
+// GlyphRasterBatch on 1 to 16 threads. Finally every mask is compared
+// against a reference rendered with 16x16 supersampling of the same outline,
+// plus a circle made of cubics against the exact circle. Fails if the
+// accumulation versions disagree or the batch's masks differ from serially
+// rasterized ones.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../CoverageRasterizer.h"
+#include "../GlyphRasterBatch.h"
+#include "../GlyphRasterizer.h"
+#include "../TrueTypeRasterizer.h"
+
+static const int kSupersample = 16;
+static const int kSubpixelOrigins = GlyphKey::kSubpixelSteps;
+static const double kMinSeconds = 0.25;
+static const float kPpems[] = { 8, 10, 12, 14, 16, 20, 24, 32, 48, 72, 96 };
+static const float kErrorPpems[] = { 9, 12, 16, 24, 48 };
+static const char kRunText[] = "The quick brown fox jumps over the lazy dog. 0123456789";
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double
+SecondsSince(Clock::time_point aStart)
+{
+  return std::chrono::duration<double>(Clock::now() - aStart).count();
+}
+
+static uint32_t
+Mix(uint32_t aValue)
+{
+  aValue ^= aValue >> 16;
+  aValue *= 0x7feb352d;
+  aValue ^= aValue >> 15;
+  aValue *= 0x846ca68b;
+  aValue ^= aValue >> 16;
+  return aValue;
+}
+
+struct NamedAccumulate {
+  const char* fName;
+  AccumulateCoverageProc fProc;
+  bool fSupported;
+};
+
+static std::vector<NamedAccumulate>
+GetAccumulateProcs()
+{
+  std::vector<NamedAccumulate> procs;
+  NamedAccumulate scalar = { "scalar", AccumulateCoverage_Scalar, true };
+  procs.push_back(scalar);
+#if defined(DW_CPU_X86)
+  NamedAccumulate sse2 = { "SSE2", AccumulateCoverage_SSE2, HasCpuFeature(CPU_FEATURE_SSE2) };
+  procs.push_back(sse2);
+#endif
+  return procs;
+}
+
+// Random signed areas, with whole rows summing to zero like real outlines
+// most of the time so the totals stay in a realistic range.
+static void
+FillArea(std::vector<float>& aArea, int32_t aWidth, int32_t aHeight, uint32_t aSeed)
+{
+  aArea.assign((size_t)aWidth * aHeight + 2, 0.0f);
+  for (int32_t y = 0; y < aHeight; y++) {
+    float rowSum = 0.0f;
+    for (int32_t x = 0; x + 1 < aWidth; x++) {
+      float value = ((int32_t)(Mix(aSeed++) & 0xFFFF) - 0x8000) / 65536.0f;
+      aArea[(size_t)y * aWidth + x] = value;
+      rowSum += value;
+    }
+    if (Mix(aSeed++) & 3) {
+      aArea[(size_t)y * aWidth + aWidth - 1] = -rowSum;
+    }
+  }
+}
+
+static bool
+CheckAccumulate()
+{
+  std::vector<NamedAccumulate> procs = GetAccumulateProcs();
+  std::vector<float> area;
+  std::vector<uint8_t> expected, actual;
+  bool ok = true;
+
+  // Every width around the block sizes, padded strides included.
+  for (int32_t width = 1; width <= 40 && ok; width++) {
+    for (int32_t height = 1; height <= 5; height++) {
+      int32_t stride = width + (height & 1) * 3;
+      FillArea(area, width, height, (uint32_t)(width * 131 + height));
+      expected.assign((size_t)stride * height, 0xCD);
+      AccumulateCoverage_Scalar(area.data(), width, height, expected.data(), stride);
+      for (size_t p = 1; p < procs.size(); p++) {
+        if (!procs[p].fSupported) {
+          continue;
+        }
+        actual.assign((size_t)stride * height, 0xCD);
+        procs[p].fProc(area.data(), width, height, actual.data(), stride);
+        if (actual != expected) {
+          printf("FAIL: %s differs from scalar at %dx%d\n", procs[p].fName, width, height);
+          ok = false;
+        }
+      }
+    }
+  }
+
+  // Throughput on a glyph sized buffer, 3x wide like ClearType.
+  const int32_t width = 3 * 24;
+  const int32_t height = 32;
+  FillArea(area, width, height, 7);
+  actual.resize((size_t)width * height);
+  printf("Accumulation, %dx%d buffer:\n", width, height);
+  for (size_t p = 0; p < procs.size(); p++) {
+    if (!procs[p].fSupported) {
+      printf("  %-8s not supported\n", procs[p].fName);
+      continue;
+    }
+    uint64_t pixels = 0;
+    Clock::time_point start = Clock::now();
+    do {
+      for (int i = 0; i < 1000; i++) {
+        procs[p].fProc(area.data(), width, height, actual.data(), width);
+      }
+      pixels += 1000ull * width * height;
+    } while (SecondsSince(start) < kMinSeconds);
+    printf("  %-8s %8.0f Mpixels/s\n", procs[p].fName, pixels / SecondsSince(start) / 1e6);
+  }
+  printf("\n");
+  return ok;
+}
+
+static double
+GlyphsPerSecond(TrueTypeRasterizer& aRasterizer, const std::vector<uint16_t>& aGlyphs,
+                GlyphMaskFormat aFormat)
+{
+  uint64_t glyphs = 0;
+  Clock::time_point start = Clock::now();
+  do {
+    for (size_t i = 0; i < aGlyphs.size(); i++) {
+      float originX = (float)(i % kSubpixelOrigins) / kSubpixelOrigins;
+      delete aRasterizer.RasterizeGlyph(aGlyphs[i], originX, aFormat);
+    }
+    glyphs += aGlyphs.size();
+  } while (SecondsSince(start) < kMinSeconds);
+  return glyphs / SecondsSince(start);
+}
+
+// Whole runs with nothing cached, composited like GetAlphaTexture does.
+static double
+RunGlyphsPerSecond(TrueTypeRasterizer& aRasterizer, const TrueTypeFont& aFont, float aPpem)
+{
+  std::vector<uint16_t> glyphs;
+  std::vector<float> advances;
+  for (const char* c = kRunText; *c; c++) {
+    glyphs.push_back(aFont.GetGlyphIndex((uint8_t)*c));
+    advances.push_back((float)aFont.GetDesignAdvance(glyphs.back()) * aPpem /
+                       aFont.DesignUnitsPerEm());
+  }
+
+  std::vector<PlacedGlyph> placed;
+  std::vector<uint8_t> image;
+  uint64_t count = 0;
+  Clock::time_point start = Clock::now();
+  do {
+    GlyphCache cache(0);
+    GetGlyphRunMasks(aRasterizer, cache, GLYPH_MASK_CLEARTYPE_3x1, glyphs.data(),
+                     advances.data(), nullptr, (uint32_t)glyphs.size(), false, placed);
+    IntRect bounds = GetGlyphRunBounds(placed);
+    image.resize((size_t)bounds.Width() * bounds.Height() * 3);
+    CompositeGlyphRun(placed, bounds, 3, image.data());
+    count += glyphs.size();
+  } while (SecondsSince(start) < kMinSeconds);
+  return count / SecondsSince(start);
+}
+
+static bool
+SameMask(const GlyphMask& aA, const GlyphMask& aB)
+{
+  return aA.fLeft == aB.fLeft && aA.fTop == aB.fTop && aA.fWidth == aB.fWidth &&
+         aA.fHeight == aB.fHeight && aA.fBytesPerPixel == aB.fBytesPerPixel &&
+         (aA.ByteSize() == 0 || memcmp(aA.fBits, aB.fBits, aA.ByteSize()) == 0);
+}
+
+// The first paint of a page with nothing cached: a run of kRunText at every
+// ppem, queued together and rasterized by GlyphRasterBatch on aThreads. Then
+// one more page is rasterized into a cache that keeps everything and each of
+// its masks checked against GetGlyphRunMasks on a rasterizer of its own,
+// clearing *aOutMatches on any difference.
+static double
+ColdPageGlyphsPerSecond(const TrueTypeFont& aFont, int aThreads, bool* aOutMatches)
+{
+  std::vector<std::unique_ptr<TrueTypeRasterizer>> rasterizers;
+  std::vector<std::vector<uint16_t>> glyphs;
+  std::vector<std::vector<float>> advances;
+  for (size_t p = 0; p < sizeof(kPpems) / sizeof(kPpems[0]); p++) {
+    rasterizers.emplace_back(new TrueTypeRasterizer(&aFont, kPpems[p]));
+    glyphs.emplace_back();
+    advances.emplace_back();
+    for (const char* c = kRunText; *c; c++) {
+      glyphs.back().push_back(aFont.GetGlyphIndex((uint8_t)*c));
+      advances.back().push_back((float)aFont.GetDesignAdvance(glyphs.back().back()) *
+                                kPpems[p] / aFont.DesignUnitsPerEm());
+    }
+  }
+
+  WorkStealingPool pool(aThreads);
+  GlyphRasterBatch batch(&pool);
+  uint64_t count = 0;
+  Clock::time_point start = Clock::now();
+  do {
+    GlyphCache cache(0);
+    for (size_t r = 0; r < rasterizers.size(); r++) {
+      batch.AddRun(*rasterizers[r], cache, GLYPH_MASK_CLEARTYPE_3x1, glyphs[r].data(),
+                   advances[r].data(), nullptr, (uint32_t)glyphs[r].size(), false);
+    }
+    count += batch.PendingCount();
+    batch.Rasterize(cache);
+  } while (SecondsSince(start) < kMinSeconds);
+  double rate = count / SecondsSince(start);
+
+  GlyphCache batchCache(SIZE_MAX);
+  for (size_t r = 0; r < rasterizers.size(); r++) {
+    batch.AddRun(*rasterizers[r], batchCache, GLYPH_MASK_CLEARTYPE_3x1, glyphs[r].data(),
+                 advances[r].data(), nullptr, (uint32_t)glyphs[r].size(), false);
+  }
+  batch.Rasterize(batchCache);
+  for (size_t r = 0; r < rasterizers.size(); r++) {
+    TrueTypeRasterizer serial(&aFont, kPpems[r]);
+    GlyphCache serialCache(SIZE_MAX);
+    std::vector<PlacedGlyph> placed;
+    std::vector<GlyphKey> keys;
+    GetGlyphRunMasks(serial, serialCache, GLYPH_MASK_CLEARTYPE_3x1, glyphs[r].data(),
+                     advances[r].data(), nullptr, (uint32_t)glyphs[r].size(), false,
+                     placed, &keys);
+    for (size_t g = 0; g < keys.size(); g++) {
+      GlyphMaskRef mask = batchCache.Lookup(keys[g]);
+      if (!mask || !SameMask(*mask, *placed[g].fMask)) {
+        printf("FAIL: GlyphRasterBatch on %d threads differs from serial for glyph %u at ppem %g\n",
+               aThreads, glyphs[r][g], kPpems[r]);
+        *aOutMatches = false;
+        return rate;
+      }
+    }
+  }
+  return rate;
+}
+
+struct Edge {
+  double fX0, fY0, fX1, fY1;
+};
+
+// Exact enough reference: lines from curves cut into many pieces, sampled
+// kSupersample x kSupersample times per pixel with the non-zero rule.
+static void
+RenderReference(const std::vector<Edge>& aEdges, int32_t aWidth, int32_t aHeight,
+                std::vector<uint8_t>& aOut)
+{
+  aOut.assign((size_t)aWidth * aHeight, 0);
+  std::vector<int32_t> hits((size_t)aWidth);
+  std::vector<std::pair<double, int> > crossings;
+  for (int32_t y = 0; y < aHeight; y++) {
+    std::fill(hits.begin(), hits.end(), 0);
+    for (int sy = 0; sy < kSupersample; sy++) {
+      double sampleY = y + (sy + 0.5) / kSupersample;
+      crossings.clear();
+      for (size_t e = 0; e < aEdges.size(); e++) {
+        const Edge& edge = aEdges[e];
+        double top = std::min(edge.fY0, edge.fY1);
+        double bottom = std::max(edge.fY0, edge.fY1);
+        if (sampleY < top || sampleY >= bottom) {
+          continue;
+        }
+        double t = (sampleY - edge.fY0) / (edge.fY1 - edge.fY0);
+        crossings.push_back(std::make_pair(edge.fX0 + t * (edge.fX1 - edge.fX0),
+                                           edge.fY1 > edge.fY0 ? 1 : -1));
+      }
+      std::sort(crossings.begin(), crossings.end());
+
+      size_t next = 0;
+      int winding = 0;
+      for (int32_t x = 0; x < aWidth; x++) {
+        for (int sx = 0; sx < kSupersample; sx++) {
+          double sampleX = x + (sx + 0.5) / kSupersample;
+          while (next < crossings.size() && crossings[next].first < sampleX) {
+            winding += crossings[next++].second;
+          }
+          hits[x] += winding != 0;
+        }
+      }
+    }
+    for (int32_t x = 0; x < aWidth; x++) {
+      aOut[(size_t)y * aWidth + x] =
+        (uint8_t)((hits[x] * 255 + kSupersample * kSupersample / 2) / (kSupersample * kSupersample));
+    }
+  }
+}
+
+static void
+AddQuad(std::vector<Edge>& aEdges, double aX0, double aY0, double aX1, double aY1,
+        double aX2, double aY2)
+{
+  const int kPieces = 64;
+  double x = aX0, y = aY0;
+  for (int i = 1; i <= kPieces; i++) {
+    double t = (double)i / kPieces;
+    double mt = 1.0 - t;
+    double nextX = mt * mt * aX0 + 2 * mt * t * aX1 + t * t * aX2;
+    double nextY = mt * mt * aY0 + 2 * mt * t * aY1 + t * t * aY2;
+    Edge edge = { x, y, nextX, nextY };
+    aEdges.push_back(edge);
+    x = nextX;
+    y = nextY;
+  }
+}
+
+// The outline of aGlyph in the coordinates TrueTypeRasterizer fills aMask
+// with, contours split the same way.
+static void
+GetReferenceEdges(const GlyphOutline& aOutline, float aScale, float aOriginX,
+                  const GlyphMask& aMask, int aSubpixels, std::vector<Edge>& aEdges)
+{
+  aEdges.clear();
+  std::vector<double> xs(aOutline.fPoints.size()), ys(aOutline.fPoints.size());
+  for (size_t i = 0; i < aOutline.fPoints.size(); i++) {
+    xs[i] = ((double)aOutline.fPoints[i].fX * aScale + aOriginX - aMask.fLeft) * aSubpixels;
+    ys[i] = -(double)aOutline.fPoints[i].fY * aScale - aMask.fTop;
+  }
+
+  const std::vector<GlyphOutline::Point>& points = aOutline.fPoints;
+  uint32_t first = 0;
+  for (size_t c = 0; c < aOutline.fContourEnds.size(); c++) {
+    uint32_t last = aOutline.fContourEnds[c];
+
+    // Start on an on curve point, making one up if there is none at the ends.
+    double startX, startY;
+    uint32_t begin = first;
+    uint32_t end = last + 1;
+    if (points[first].fOnCurve) {
+      startX = xs[first];
+      startY = ys[first];
+      begin = first + 1;
+    } else if (points[last].fOnCurve) {
+      startX = xs[last];
+      startY = ys[last];
+      end = last;
+    } else {
+      startX = 0.5 * (xs[first] + xs[last]);
+      startY = 0.5 * (ys[first] + ys[last]);
+    }
+
+    double x = startX, y = startY, controlX = 0.0, controlY = 0.0;
+    bool hasControl = false;
+    for (uint32_t i = begin; i < end; i++) {
+      if (points[i].fOnCurve) {
+        if (hasControl) {
+          AddQuad(aEdges, x, y, controlX, controlY, xs[i], ys[i]);
+        } else {
+          Edge edge = { x, y, xs[i], ys[i] };
+          aEdges.push_back(edge);
+        }
+        x = xs[i];
+        y = ys[i];
+        hasControl = false;
+      } else {
+        if (hasControl) {
+          double midX = 0.5 * (controlX + xs[i]);
+          double midY = 0.5 * (controlY + ys[i]);
+          AddQuad(aEdges, x, y, controlX, controlY, midX, midY);
+          x = midX;
+          y = midY;
+        }
+        controlX = xs[i];
+        controlY = ys[i];
+        hasControl = true;
+      }
+    }
+    if (hasControl) {
+      AddQuad(aEdges, x, y, controlX, controlY, startX, startY);
+    } else {
+      Edge edge = { x, y, startX, startY };
+      aEdges.push_back(edge);
+    }
+    first = last + 1;
+  }
+}
+
+struct ErrorStats {
+  uint64_t fPixels;
+  uint64_t fEdgePixels;   // Pixels where either side has some coverage
+  uint64_t fTotalError;
+  uint64_t fOver16;
+  int fMaxError;
+
+  ErrorStats() : fPixels(0), fEdgePixels(0), fTotalError(0), fOver16(0), fMaxError(0) { }
+
+  void Add(const uint8_t* aActual, const uint8_t* aReference, size_t aCount) {
+    for (size_t i = 0; i < aCount; i++) {
+      int error = abs((int)aActual[i] - (int)aReference[i]);
+      fPixels++;
+      fEdgePixels += (aActual[i] || aReference[i]) && (aActual[i] != 255 || aReference[i] != 255);
+      fTotalError += error;
+      fOver16 += error > 16;
+      fMaxError = std::max(fMaxError, error);
+    }
+  }
+
+  void Print(const char* aLabel) const {
+    printf("  %-18s %9llu px   mean %5.2f   mean on edges %5.2f   > 16: %6.3f%%   max %3d\n",
+           aLabel, (unsigned long long)fPixels,
+           fPixels ? (double)fTotalError / fPixels : 0.0,
+           fEdgePixels ? (double)fTotalError / fEdgePixels : 0.0,
+           fPixels ? 100.0 * fOver16 / fPixels : 0.0, fMaxError);
+  }
+};
+
+// Applies TrueTypeRasterizer's ClearType filter to a reference row set.
+static void
+FilterClearType(const std::vector<uint8_t>& aSubpixels, int32_t aWidth, int32_t aHeight,
+                std::vector<uint8_t>& aOut)
+{
+  static const int kWeights[5] = { 1, 2, 3, 2, 1 };
+  aOut.resize(aSubpixels.size());
+  for (int32_t y = 0; y < aHeight; y++) {
+    for (int32_t x = 0; x < aWidth; x++) {
+      int sum = 0;
+      for (int k = -2; k <= 2; k++) {
+        if (x + k >= 0 && x + k < aWidth) {
+          sum += kWeights[k + 2] * aSubpixels[(size_t)y * aWidth + x + k];
+        }
+      }
+      aOut[(size_t)y * aWidth + x] = (uint8_t)((sum + 4) / 9);
+    }
+  }
+}
+
+static void
+ReportGlyphErrors(const TrueTypeFont& aFont, const std::vector<uint16_t>& aGlyphs)
+{
+  GlyphOutline outline;
+  std::vector<Edge> edges;
+  std::vector<uint8_t> reference, filtered;
+
+  printf("Error against %dx%d supersampled references, in 1/255 coverage:\n",
+         kSupersample, kSupersample);
+  for (size_t p = 0; p < sizeof(kErrorPpems) / sizeof(kErrorPpems[0]); p++) {
+    float ppem = kErrorPpems[p];
+    float scale = ppem / aFont.DesignUnitsPerEm();
+    TrueTypeRasterizer rasterizer(&aFont, ppem);
+    ErrorStats a8, clearType;
+
+    for (size_t g = 0; g < aGlyphs.size(); g++) {
+      if (!aFont.GetGlyphOutline(aGlyphs[g], outline) || outline.fPoints.empty()) {
+        continue;
+      }
+      float originX = (float)(g % kSubpixelOrigins) / kSubpixelOrigins;
+
+      GlyphMask* mask = rasterizer.RasterizeGlyph(aGlyphs[g], originX, GLYPH_MASK_A8);
+      if (!mask->IsEmpty()) {
+        GetReferenceEdges(outline, scale, originX, *mask, 1, edges);
+        RenderReference(edges, mask->fWidth, mask->fHeight, reference);
+        a8.Add(mask->fBits, reference.data(), reference.size());
+      }
+      delete mask;
+
+      mask = rasterizer.RasterizeGlyph(aGlyphs[g], originX, GLYPH_MASK_CLEARTYPE_3x1);
+      if (!mask->IsEmpty()) {
+        GetReferenceEdges(outline, scale, originX, *mask, 3, edges);
+        RenderReference(edges, mask->fWidth * 3, mask->fHeight, reference);
+        FilterClearType(reference, mask->fWidth * 3, mask->fHeight, filtered);
+        clearType.Add(mask->fBits, filtered.data(), filtered.size());
+      }
+      delete mask;
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "%g ppem A8", ppem);
+    a8.Print(label);
+    snprintf(label, sizeof(label), "%g ppem 3x1", ppem);
+    clearType.Print(label);
+  }
+
+  // A circle out of four cubics, which is within 0.03% of round, against the
+  // true circle.
+  const float kRadius = 20.0f;
+  const float kCenter = 22.5f;
+  const int32_t kSize = 46;
+  const float k = 0.5522847f * kRadius;
+  CoverageRasterizer coverage;
+  coverage.Reset(kSize, kSize);
+  coverage.DrawCubic(kCenter + kRadius, kCenter, kCenter + kRadius, kCenter + k,
+                     kCenter + k, kCenter + kRadius, kCenter, kCenter + kRadius);
+  coverage.DrawCubic(kCenter, kCenter + kRadius, kCenter - k, kCenter + kRadius,
+                     kCenter - kRadius, kCenter + k, kCenter - kRadius, kCenter);
+  coverage.DrawCubic(kCenter - kRadius, kCenter, kCenter - kRadius, kCenter - k,
+                     kCenter - k, kCenter - kRadius, kCenter, kCenter - kRadius);
+  coverage.DrawCubic(kCenter, kCenter - kRadius, kCenter + k, kCenter - kRadius,
+                     kCenter + kRadius, kCenter - k, kCenter + kRadius, kCenter);
+  std::vector<uint8_t> actual((size_t)kSize * kSize);
+  coverage.Accumulate(actual.data(), kSize);
+
+  reference.assign(actual.size(), 0);
+  for (int32_t y = 0; y < kSize; y++) {
+    for (int32_t x = 0; x < kSize; x++) {
+      int hits = 0;
+      for (int sy = 0; sy < kSupersample; sy++) {
+        for (int sx = 0; sx < kSupersample; sx++) {
+          double dx = x + (sx + 0.5) / kSupersample - kCenter;
+          double dy = y + (sy + 0.5) / kSupersample - kCenter;
+          hits += dx * dx + dy * dy < kRadius * kRadius;
+        }
+      }
+      reference[(size_t)y * kSize + x] =
+        (uint8_t)((hits * 255 + kSupersample * kSupersample / 2) / (kSupersample * kSupersample));
+    }
+  }
+  ErrorStats circle;
+  circle.Add(actual.data(), reference.data(), actual.size());
+  circle.Print("cubic circle");
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc != 2) {
+    fprintf(stderr, "usage: GlyphRasterBench font.ttf\n");
+    return 1;
+  }
+
+  TrueTypeFont font;
+  if (!font.LoadFile(argv[1])) {
+    fprintf(stderr, "%s is not a TrueType font we can read\n", argv[1]);
+    return 1;
+  }
+
+  bool ok = CheckAccumulate();
+
+  // Printable ASCII, what most UI text is made of.
+  std::vector<uint16_t> glyphs;
+  for (uint32_t c = 0x21; c < 0x7F; c++) {
+    uint16_t glyph = font.GetGlyphIndex(c);
+    if (glyph) {
+      glyphs.push_back(glyph);
+    }
+  }
+
+  printf("Rasterization, %zu glyphs at %d subpixel origins, glyphs/s:\n",
+         glyphs.size(), kSubpixelOrigins);
+  printf("  ppem         A8        3x1   3x1 runs\n");
+  for (size_t p = 0; p < sizeof(kPpems) / sizeof(kPpems[0]); p++) {
+    TrueTypeRasterizer rasterizer(&font, kPpems[p]);
+    double a8 = GlyphsPerSecond(rasterizer, glyphs, GLYPH_MASK_A8);
+    double clearType = GlyphsPerSecond(rasterizer, glyphs, GLYPH_MASK_CLEARTYPE_3x1);
+    double runs = RunGlyphsPerSecond(rasterizer, font, kPpems[p]);
+    printf("  %4g %10.0f %10.0f %10.0f\n", kPpems[p], a8, clearType, runs);
+  }
+  printf("\n");
+
+  printf("Cold page, every ppem, 3x1 glyphs/s:\n");
+  const int maxThreads = std::min(16, std::max(1, (int)std::thread::hardware_concurrency()));
+  double oneThread = 0.0;
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    double rate = ColdPageGlyphsPerSecond(font, threads, &ok);
+    oneThread = threads == 1 ? rate : oneThread;
+    printf("  %2d threads %10.0f   %.2fx\n", threads, rate, rate / oneThread);
+  }
+  printf("\n");
+
+  ReportGlyphErrors(font, glyphs);
+
+  if (!ok) {
+    printf("FAILED\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,118 @@
+// Standalone benchmark for BuildMaskGammaTablesFast. Platform neutral, see
+// ReadMe.txt for how to build it.
+//
+// Sweeps contrast and gamma the way a calibration run would, checks every
+// table set against SkMaskGamma's exact builder and reports table sets built
+// per second by both.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "../MaskGammaBuilder.h"
+#include "../MaskGammaRegistry.h"
+
+struct Settings {
+  float fContrast;
+  float fPaintGamma;
+  float fDeviceGamma;
+};
+
+static const int kTableBytes = (1 << SkMaskGamma::MAX_LUM_BITS) * 256;
+
+typedef void (*BuildProc)(uint8_t (*aTables)[256], int aLumBits,
+                          float aContrast, float aPaintGamma, float aDeviceGamma);
+
+static void
+BuildExact(uint8_t (*aTables)[256], int aLumBits,
+           float aContrast, float aPaintGamma, float aDeviceGamma)
+{
+  SkMaskGamma gamma(aContrast, aPaintGamma, aDeviceGamma);
+  memcpy(aTables, gamma.getGammaTables(), (size_t)(1 << aLumBits) * 256);
+}
+
+// Builds every table set of the sweep into aOut, returns sets per second.
+static double
+Run(BuildProc aProc, const std::vector<Settings>& aSweep, std::vector<uint8_t>& aOut)
+{
+  aOut.assign(aSweep.size() * kTableBytes, 0);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < aSweep.size(); i++) {
+    aProc((uint8_t (*)[256])&aOut[i * kTableBytes], SkMaskGamma::MAX_LUM_BITS,
+          aSweep[i].fContrast, aSweep[i].fPaintGamma, aSweep[i].fDeviceGamma);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return aSweep.size() / std::chrono::duration<double>(end - start).count();
+}
+
+int
+main()
+{
+  std::vector<Settings> sweep;
+  for (int c = 0; c <= 20; c++) {
+    for (int p = 10; p <= 30; p++) {
+      for (int d = 10; d <= 30; d++) {
+        Settings settings = { c / 20.0f, p / 10.0f, d / 10.0f };
+        sweep.push_back(settings);
+      }
+    }
+  }
+
+  printf("Mask gamma tables: %zu settings, %d tables of 256 each\n",
+         sweep.size(), 1 << SkMaskGamma::MAX_LUM_BITS);
+
+  std::vector<uint8_t> exact;
+  double exactRate = Run(BuildExact, sweep, exact);
+  printf("  exact builder:          %8.0f sets/s\n", exactRate);
+
+  // Without SSE2 or AVX2 the dispatched builder is the exact one.
+  struct Variant {
+    const char* fName;
+    BuildProc fProc;
+    bool fSupported;
+    bool fMayBeExact;
+  };
+  Variant variants[] = {
+    { "fast, scalar", BuildMaskGammaTablesFast_Scalar, true, false },
+#if defined(DW_CPU_X86)
+    { "fast, SSE2", BuildMaskGammaTablesFast_SSE2, HasCpuFeature(CPU_FEATURE_SSE2), false },
+    { "fast, AVX2", BuildMaskGammaTablesFast_AVX2, HasCpuFeature(CPU_FEATURE_AVX2), false },
+#endif
+    { "fast, dispatched", BuildMaskGammaTablesFast, true, true },
+  };
+
+  bool ok = true;
+  std::vector<uint8_t> reference;
+  for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+    if (!variants[v].fSupported) {
+      continue;
+    }
+
+    std::vector<uint8_t> fast;
+    double rate = Run(variants[v].fProc, sweep, fast);
+
+    // Distance modulo 256, entries wrap like SkToU8 at both ends.
+    size_t differing = 0;
+    int maxDiff = 0;
+    for (size_t b = 0; b < exact.size(); b++) {
+      int diff = abs(exact[b] - fast[b]);
+      diff = diff > 128 ? 256 - diff : diff;
+      differing += diff != 0;
+      maxDiff = diff > maxDiff ? diff : maxDiff;
+    }
+
+    // Every fast version must produce the same bytes.
+    bool matches = reference.empty() || reference == fast ||
+                   (variants[v].fMayBeExact && exact == fast);
+    if (reference.empty()) {
+      reference = fast;
+    }
+
+    printf("  %-22s  %8.0f sets/s (%4.1fx), %zu of %zu entries differ, max by %d%s\n",
+           variants[v].fName, rate, rate / exactRate, differing, exact.size(), maxDiff,
+           matches ? "" : ", DOES NOT MATCH the other versions");
+    ok = ok && maxDiff <= 1 && matches;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,886 @@
+// Micro benchmarks for the kernels of the text pipeline, from the glyph run
+// to the BGRA pixels handed to D2D. Platform neutral, see ReadMe.txt for how
+// to build it.
+//
+//   PipelineBench [--json out.json] [--filter text] [--warmup N]
+//                 [--repetitions N] [--min-sample-ms N]
+//
+// Covers what D2DSetup runs per draw: ConvertToBGRA for every combination of
+// its flags and for colored text, BlendSkiaGrayscale and the A8 grayscale
+// path that replaced it, BlitDirectly, building mask gamma tables and
+// picking PreBlend tables, and building glyph runs: mapping text to glyphs
+// and advances, and compositing the cached glyph masks of a run.
+// CompositeMask blends 3x1, LCD16 and A8 masks onto a destination, and
+// drawing runs end to end into a CpuRenderSurface gives the headless
+// baseline. A full page of text through the TiledCompositor on 1 to 16
+// threads shows how compositing scales. LuminanceToAlpha and BlendLayer are
+// timed against their scalar versions, and a luminance masked block drawn
+// through a CpuRenderSurface layer. Also what a TRACE_ZONE costs with
+// tracing on and off.
+// Before timing anything, every SIMD kernel and the one dispatch picks is
+// checked against its scalar version over random and text like masks of
+// every tail width, and the run fails on any difference. So it does if the
+// tiled page comes out different from the same page on a CpuRenderSurface.
+// Masks come in three sizes: one glyph, a line of UI text and a block of
+// text. The glyph sources are synthetic so the numbers do not depend on a
+// font file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchHarness.h"
+#include "../FontGlyphMap.h"
+#include "../GlyphRasterizer.h"
+#include "../MaskCompositor.h"
+#include "../MaskConvert.h"
+#include "../MaskGammaRegistry.h"
+#include "../RenderSurface.h"
+#include "../TiledCompositor.h"
+#include "../Trace.h"
+
+struct MaskSize {
+  const char* fName;
+  int fWidth;
+  int fHeight;
+};
+
+static const MaskSize kMaskSizes[] = {
+  { "glyph 12x18", 12, 18 },
+  { "line 320x24", 320, 24 },
+  { "block 1024x256", 1024, 256 },
+};
+
+// The gamma settings D2DSetup uses for its LUT and its GDI LUT.
+static const float kContrast = 1.0f;
+static const float kGamma = 1.8f;
+static const float kGdiGamma = 2.3f;
+
+static const uint32_t kBlack = 0xFF000000;
+static const uint32_t kTextColor = 0xFF2060C0;
+static const uint32_t kBackground = 0xFFF0F0E0;
+
+static const char kRunText[] = "The quick brown fox jumps over the lazy dog. 0123456789";
+static const float kRunEmSizes[] = { 12, 16, 32 };
+
+static uint32_t
+Mix(uint32_t aValue)
+{
+  aValue ^= aValue >> 16;
+  aValue *= 0x7feb352d;
+  aValue ^= aValue >> 15;
+  aValue *= 0x846ca68b;
+  aValue ^= aValue >> 16;
+  return aValue;
+}
+
+// Coverage with the make up of rendered text: mostly empty, some solid
+// stems and the rest antialiased edges.
+static void
+FillCoverage(std::vector<uint8_t>& aOut, size_t aSize, uint32_t aSeed)
+{
+  aOut.resize(aSize);
+  for (size_t i = 0; i < aSize; i++) {
+    uint32_t r = Mix(aSeed + (uint32_t)i);
+    uint32_t kind = r % 10;
+    aOut[i] = kind < 6 ? 0 : kind < 8 ? 0xFF : (uint8_t)(r >> 8);
+  }
+}
+
+// Design advances like a proportional Latin font, glyph i for code point i.
+class SyntheticGlyphSource : public GlyphMapSource {
+public:
+  void GetGlyphIndices(const uint32_t* aCodePoints, uint32_t aCount, uint16_t* aOutGlyphs) override
+  {
+    for (uint32_t i = 0; i < aCount; i++) {
+      aOutGlyphs[i] = aCodePoints[i] < kGlyphCount ? (uint16_t)aCodePoints[i] : 0;
+    }
+  }
+
+  void GetDesignAdvances(const uint16_t* aGlyphs, uint32_t aCount, int32_t* aOutAdvances) override
+  {
+    for (uint32_t i = 0; i < aCount; i++) {
+      aOutAdvances[i] = 1000 + (int32_t)(Mix(aGlyphs[i]) % 1000);
+    }
+  }
+
+  static const uint32_t kGlyphCount = 1024;
+  static const uint16_t kUnitsPerEm = 2048;
+};
+
+// Masks about the size real glyphs have at the given size, so compositing
+// moves as many bytes as it would for text.
+class SyntheticRasterizer : public GlyphRasterizer {
+public:
+  explicit SyntheticRasterizer(float aEmSize)
+    : mEmSize(aEmSize)
+  {
+  }
+
+  void GetKeyTemplate(GlyphMaskFormat aFormat, GlyphKey* aOutKey) override
+  {
+    aOutKey->fFaceId = 1;
+    aOutKey->fEmSize = mEmSize;
+    aOutKey->fPixelsPerDip = 1.0f;
+    aOutKey->fGlyphIndex = 0;
+    aOutKey->fRenderingMode = 0;
+    aOutKey->fMeasuringMode = 0;
+    aOutKey->fTextureType = (uint8_t)aFormat;
+    aOutKey->fSubpixelX = 0;
+  }
+
+  GlyphMask* RasterizeGlyph(uint16_t aGlyph, float aOriginX, GlyphMaskFormat aFormat) override
+  {
+    GlyphMask* mask = new GlyphMask();
+    mask->fBytesPerPixel = GlyphMaskBytesPerPixel(aFormat);
+    if (aGlyph == ' ') {
+      return mask;
+    }
+    mask->fLeft = -1;
+    mask->fTop = -(int32_t)(mEmSize * 0.75f) - 1;
+    mask->fWidth = (int32_t)(mEmSize * (0.4f + (Mix(aGlyph) % 40) / 100.0f)) + 3;
+    mask->fHeight = (int32_t)(mEmSize * 0.75f) + 2;
+    std::vector<uint8_t> coverage;
+    FillCoverage(coverage, mask->ByteSize(), aGlyph * 7919u + (uint32_t)(aOriginX * 4));
+    mask->fBits = (uint8_t*)malloc(mask->ByteSize());
+    memcpy(mask->fBits, coverage.data(), mask->ByteSize());
+    return mask;
+  }
+
+private:
+  float mEmSize;
+};
+
+// Random bytes, for parity checks that should see every value.
+static void
+FillRandom(std::vector<uint8_t>& aOut, size_t aSize, uint32_t aSeed)
+{
+  aOut.resize(aSize);
+  for (size_t i = 0; i < aSize; i++) {
+    aOut[i] = (uint8_t)Mix(aSeed + (uint32_t)i);
+  }
+}
+
+// Random premultiplied BGRA, every channel at most the alpha.
+static void
+FillPremultiplied(std::vector<uint8_t>& aOut, int aCount, uint32_t aSeed)
+{
+  aOut.resize((size_t)aCount * 4);
+  for (int i = 0; i < aCount; i++) {
+    uint32_t r = Mix(aSeed + (uint32_t)i);
+    uint32_t alpha = (r >> 24) % 3 ? r >> 24 : (r >> 24) & 1 ? 0xFF : 0;
+    for (int c = 0; c < 3; c++) {
+      aOut[4 * i + c] = (uint8_t)(((r >> (8 * c)) & 0xFF) * alpha / 255);
+    }
+    aOut[4 * i + 3] = (uint8_t)alpha;
+  }
+}
+
+// A kernel version the parity checks compare with the scalar one.
+template <typename Proc>
+struct KernelVersion {
+  const char* fName;
+  Proc fProc;
+  bool fSupported;
+};
+
+template <typename Proc>
+static void
+AddVersion(std::vector<KernelVersion<Proc>>& aVersions, const char* aName, Proc aProc,
+           bool aSupported)
+{
+  KernelVersion<Proc> version = { aName, aProc, aSupported };
+  aVersions.push_back(version);
+}
+
+// Runs every supported version of a kernel into a buffer of aOutSize bytes
+// prefilled with a guard value, aVersions[0] being the scalar reference, and
+// reports any version whose bytes differ, tail and guard bytes included.
+template <typename Proc, typename Call>
+static bool
+CompareVersions(const char* aKernel, const std::vector<KernelVersion<Proc>>& aVersions,
+                size_t aOutSize, const std::string& aCase, const Call& aCall)
+{
+  std::vector<uint8_t> expected(aOutSize, 0xCD);
+  aCall(aVersions[0].fProc, expected.data());
+  std::vector<uint8_t> actual;
+  bool ok = true;
+  for (size_t v = 1; v < aVersions.size(); v++) {
+    if (!aVersions[v].fSupported) {
+      continue;
+    }
+    actual.assign(aOutSize, 0xCD);
+    aCall(aVersions[v].fProc, actual.data());
+    if (actual != expected) {
+      printf("FAIL: %s %s differs from scalar, %s\n", aKernel, aVersions[v].fName, aCase.c_str());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// Widths that cover every tail after the 16 and 32 pixel blocks, and a couple
+// of long rows.
+static std::vector<int>
+GetParityWidths()
+{
+  std::vector<int> widths;
+  for (int width = 1; width <= 67; width++) {
+    widths.push_back(width);
+  }
+  widths.push_back(1000);
+  widths.push_back(1023);
+  return widths;
+}
+
+// Checks that every SIMD kernel, and the one dispatch picks, gives the same
+// bytes as its scalar version over random and text like masks. Returns false
+// on any difference.
+static bool
+CheckKernels()
+{
+  SkMaskGammaRef gamma = MaskGammaRegistry::Get(kContrast, kGamma, kGamma);
+  SkMaskGamma::PreBlend blackPreBlend = SkMaskGamma::preBlend(gamma, kBlack);
+  SkMaskGamma::PreBlend colorPreBlend = SkMaskGamma::preBlend(gamma, kTextColor);
+  const bool ssse3 = HasCpuFeature(CPU_FEATURE_SSSE3);
+  const bool avx2 = HasCpuFeature(CPU_FEATURE_AVX2);
+  (void)ssse3;
+  (void)avx2;
+
+  std::vector<KernelVersion<ConvertClearTypeProc>> convert;
+  AddVersion(convert, "scalar", &ConvertClearType_Scalar, true);
+#if defined(DW_CPU_X86)
+  AddVersion(convert, "SSSE3", &ConvertClearType_SSSE3, ssse3);
+  AddVersion(convert, "AVX2", &ConvertClearType_AVX2, avx2);
+#endif
+#if defined(DW_CPU_NEON)
+  AddVersion(convert, "NEON", &ConvertClearType_NEON, HasCpuFeature(CPU_FEATURE_NEON));
+#endif
+  AddVersion(convert, "dispatched", GetConvertClearTypeProc(), true);
+
+  std::vector<KernelVersion<PackLCD16Proc>> pack;
+  AddVersion(pack, "scalar", &PackLCD16_Scalar, true);
+  std::vector<KernelVersion<ConvertLCD16Proc>> convertLCD16;
+  AddVersion(convertLCD16, "scalar", &ConvertLCD16_Scalar, true);
+  std::vector<KernelVersion<BlendClearTypeProc>> blendClearType;
+  AddVersion(blendClearType, "scalar", &BlendClearType_Scalar, true);
+  std::vector<KernelVersion<BlendA8Proc>> blendA8;
+  AddVersion(blendA8, "scalar", &BlendA8_Scalar, true);
+  std::vector<KernelVersion<BlendLCD16Proc>> blendLCD16;
+  AddVersion(blendLCD16, "scalar", &BlendLCD16_Scalar, true);
+  std::vector<KernelVersion<LuminanceToAlphaProc>> luminance;
+  AddVersion(luminance, "scalar", &LuminanceToAlpha_Scalar, true);
+  std::vector<KernelVersion<BlendLayerProc>> blendLayer;
+  AddVersion(blendLayer, "scalar", &BlendLayer_Scalar, true);
+#if defined(DW_CPU_X86)
+  AddVersion(pack, "SSSE3", &PackLCD16_SSSE3, ssse3);
+  AddVersion(convertLCD16, "SSSE3", &ConvertLCD16_SSSE3, ssse3);
+  AddVersion(blendClearType, "SSSE3", &BlendClearType_SSSE3, ssse3);
+  AddVersion(blendClearType, "AVX2", &BlendClearType_AVX2, avx2);
+  AddVersion(blendA8, "SSSE3", &BlendA8_SSSE3, ssse3);
+  AddVersion(blendA8, "AVX2", &BlendA8_AVX2, avx2);
+  AddVersion(blendLCD16, "SSSE3", &BlendLCD16_SSSE3, ssse3);
+  AddVersion(blendLCD16, "AVX2", &BlendLCD16_AVX2, avx2);
+  AddVersion(luminance, "SSSE3", &LuminanceToAlpha_SSSE3, ssse3);
+  AddVersion(luminance, "AVX2", &LuminanceToAlpha_AVX2, avx2);
+  AddVersion(blendLayer, "SSSE3", &BlendLayer_SSSE3, ssse3);
+  AddVersion(blendLayer, "AVX2", &BlendLayer_AVX2, avx2);
+#endif
+  AddVersion(pack, "dispatched", GetPackLCD16Proc(), true);
+  AddVersion(convertLCD16, "dispatched", GetConvertLCD16Proc(), true);
+  AddVersion(blendClearType, "dispatched", GetBlendClearTypeProc(), true);
+  AddVersion(blendA8, "dispatched", GetBlendA8Proc(), true);
+  AddVersion(blendLCD16, "dispatched", GetBlendLCD16Proc(), true);
+  AddVersion(luminance, "dispatched", GetLuminanceToAlphaProc(), true);
+  AddVersion(blendLayer, "dispatched", GetBlendLayerProc(), true);
+
+  const SkMaskGamma::PreBlend* tableSets[] = { nullptr, &blackPreBlend, &colorPreBlend };
+  const uint32_t foregrounds[] = { kBlack, kTextColor, 0x80FF4020, 0x00123456 };
+  const uint32_t backgrounds[] = { 0xFFFFFFFF, kBackground, 0xFF000000 };
+  const MaskBlendMode modes[] = { MASK_BLEND_SRC_OVER, MASK_BLEND_SKIA_LCD16 };
+
+  bool ok = true;
+  std::vector<uint8_t> rgb, a8, dest, layer;
+  std::vector<uint16_t> lcd16;
+  for (int width : GetParityWidths()) {
+    for (int fill = 0; fill < 2; fill++) {
+      const uint32_t seed = (uint32_t)(width * 7 + fill);
+      // Room for kernels that read a little past the last pixel.
+      if (fill) {
+        FillRandom(rgb, (size_t)width * 3 + 16, seed);
+        FillRandom(a8, (size_t)width + 16, seed + 1);
+      } else {
+        FillCoverage(rgb, (size_t)width * 3 + 16, seed);
+        FillCoverage(a8, (size_t)width + 16, seed + 1);
+      }
+      FillPremultiplied(dest, width, seed + 2);
+      FillPremultiplied(layer, width, seed + 3);
+      lcd16.resize((size_t)width);
+      PackLCD16_Scalar(rgb.data(), lcd16.data(), width, nullptr, nullptr, nullptr);
+      const size_t bgraSize = (size_t)width * 4 + 16;
+      const std::string widthCase = "width " + std::to_string(width) +
+                                    (fill ? " random" : " coverage");
+
+      for (const SkMaskGamma::PreBlend* tables : tableSets) {
+        const uint8_t* tableR = tables ? tables->fR : nullptr;
+        const uint8_t* tableG = tables ? tables->fG : nullptr;
+        const uint8_t* tableB = tables ? tables->fB : nullptr;
+        const std::string tableCase = widthCase + (tables ? " lut" : " nolut");
+
+        for (int quantize = 0; quantize < 2; quantize++) {
+          const std::string caseName = tableCase + (quantize ? " convert" : "");
+          ok &= CompareVersions("ConvertClearType", convert, bgraSize, caseName,
+                                [&](ConvertClearTypeProc aProc, uint8_t* aOut) {
+            aProc(rgb.data(), aOut, width, tableR, tableG, tableB, quantize != 0);
+          });
+
+          // The compiled tables against the step by step scalar kernel.
+          CompositeLUT lut;
+          BuildCompositeLUT(&lut, tableR, tableG, tableB, quantize != 0, kBlack, 0xFFFFFFFF);
+          std::vector<uint8_t> expected(bgraSize, 0xCD);
+          std::vector<uint8_t> actual(bgraSize, 0xCD);
+          ConvertClearType_Scalar(rgb.data(), expected.data(), width,
+                                  tableR, tableG, tableB, quantize != 0);
+          ConvertClearTypeCompiled(rgb.data(), actual.data(), width, lut);
+          if (actual != expected) {
+            printf("FAIL: ConvertClearTypeCompiled differs from scalar, %s\n", caseName.c_str());
+            ok = false;
+          }
+        }
+
+        ok &= CompareVersions("PackLCD16", pack, (size_t)width * 2 + 16, tableCase,
+                              [&](PackLCD16Proc aProc, uint8_t* aOut) {
+          aProc(rgb.data(), (uint16_t*)aOut, width, tableR, tableG, tableB);
+        });
+
+        for (uint32_t foreground : foregrounds) {
+          for (MaskBlendMode mode : modes) {
+            for (int quantize = 0; quantize < 2; quantize++) {
+              MaskBlendParams params;
+              params.fForeground = foreground;
+              params.fTableR = tableR;
+              params.fTableG = tableG;
+              params.fTableB = tableB;
+              params.fQuantize = quantize != 0;
+              params.fMode = mode;
+              char colors[64];
+              snprintf(colors, sizeof(colors), " %08X mode %d%s", foreground, (int)mode,
+                       quantize ? " quantize" : "");
+              const std::string caseName = tableCase + colors;
+
+              for (uint32_t background : backgrounds) {
+                ok &= CompareVersions("BlendClearType on color", blendClearType, bgraSize,
+                                      caseName, [&](BlendClearTypeProc aProc, uint8_t* aOut) {
+                  aProc(rgb.data(), nullptr, aOut, width, params, background);
+                });
+              }
+              ok &= CompareVersions("BlendClearType onto", blendClearType, bgraSize, caseName,
+                                    [&](BlendClearTypeProc aProc, uint8_t* aOut) {
+                memcpy(aOut, dest.data(), dest.size());
+                aProc(rgb.data(), aOut, aOut, width, params, 0);
+              });
+              ok &= CompareVersions("BlendLCD16 onto", blendLCD16, bgraSize, caseName,
+                                    [&](BlendLCD16Proc aProc, uint8_t* aOut) {
+                memcpy(aOut, dest.data(), dest.size());
+                aProc(lcd16.data(), aOut, aOut, width, params, 0);
+              });
+              ok &= CompareVersions("BlendLCD16 on color", blendLCD16, bgraSize, caseName,
+                                    [&](BlendLCD16Proc aProc, uint8_t* aOut) {
+                aProc(lcd16.data(), nullptr, aOut, width, params, kBackground);
+              });
+              if (mode == MASK_BLEND_SRC_OVER && !quantize) {
+                ok &= CompareVersions("BlendA8", blendA8, bgraSize, caseName,
+                                      [&](BlendA8Proc aProc, uint8_t* aOut) {
+                  memcpy(aOut, dest.data(), dest.size());
+                  aProc(a8.data(), aOut, width, params);
+                });
+              }
+            }
+          }
+        }
+      }
+
+      ok &= CompareVersions("ConvertLCD16", convertLCD16, bgraSize, widthCase,
+                            [&](ConvertLCD16Proc aProc, uint8_t* aOut) {
+        aProc(lcd16.data(), aOut, width);
+      });
+      ok &= CompareVersions("LuminanceToAlpha", luminance, (size_t)width + 16, widthCase,
+                            [&](LuminanceToAlphaProc aProc, uint8_t* aOut) {
+        aProc(layer.data(), aOut, width);
+      });
+      ok &= CompareVersions("BlendLayer", blendLayer, bgraSize, widthCase,
+                            [&](BlendLayerProc aProc, uint8_t* aOut) {
+        memcpy(aOut, dest.data(), dest.size());
+        aProc(layer.data(), a8.data(), aOut, width);
+      });
+    }
+  }
+
+  printf("Kernel parity with the scalar versions: %s\n\n", ok ? "ok" : "FAILED");
+  return ok;
+}
+
+static void
+BenchConvert(BenchRunner& aRunner)
+{
+  SkMaskGammaRef gamma = MaskGammaRegistry::Get(kContrast, kGamma, kGamma);
+  SkMaskGammaRef gdiGamma = MaskGammaRegistry::Get(kContrast, kGdiGamma, kGdiGamma);
+  SkMaskGamma::PreBlend preBlend = SkMaskGamma::preBlend(gamma, kBlack);
+  SkMaskGamma::PreBlend gdiPreBlend = SkMaskGamma::preBlend(gdiGamma, kBlack);
+  SkMaskGamma::PreBlend colorPreBlend = SkMaskGamma::preBlend(gamma, kTextColor);
+  CompositeLUTCache compiled;
+  BlendClearTypeProc blendProc = GetBlendClearTypeProc();
+
+  for (const MaskSize& size : kMaskSizes) {
+    const int pixels = size.fWidth * size.fHeight;
+    std::vector<uint8_t> rgb;
+    FillCoverage(rgb, (size_t)pixels * 3, 1);
+    std::vector<uint8_t> bgra((size_t)pixels * 4);
+    const uint64_t bytes = (uint64_t)pixels * (3 + 4);
+
+    // ConvertToBGRA's flags: useLUT, useGDILUT (only with useLUT) and
+    // convert, each through the kernels and through compiled tables.
+    for (int compiledTables = 0; compiledTables < 2; compiledTables++) {
+      for (int lut = 0; lut < 3; lut++) {
+        for (int quantize = 0; quantize < 2; quantize++) {
+          const SkMaskGamma::PreBlend* tables = lut == 0 ? nullptr : lut == 1 ? &preBlend : &gdiPreBlend;
+          std::string name = std::string("ConvertToBGRA ") + size.fName +
+                             (lut == 0 ? " nolut" : lut == 1 ? " lut" : " gdilut") +
+                             (quantize ? " convert" : "") +
+                             (compiledTables ? " compiled" : "");
+          aRunner.Run(name, bytes, pixels, [&]() {
+            ConvertClearTypeRect(rgb.data(), size.fWidth * 3, size.fWidth, size.fHeight,
+                                 bgra.data(), size.fWidth * 4,
+                                 tables ? tables->fR : nullptr, tables ? tables->fG : nullptr,
+                                 tables ? tables->fB : nullptr, quantize != 0,
+                                 compiledTables ? &compiled : nullptr);
+            BenchDoNotOptimize(bgra.data());
+          });
+        }
+      }
+    }
+
+    // What the compiled mode cost without tables before ConvertClearTypeRect
+    // fell through to the kernels, next to the "nolut" lines above.
+    for (int quantize = 0; quantize < 2; quantize++) {
+      const CompositeLUT& lut = compiled.Get(nullptr, nullptr, nullptr, quantize != 0,
+                                             0xFF000000, 0xFFFFFFFF);
+      std::string name = std::string("ConvertClearTypeCompiled ") + size.fName + " nolut" +
+                         (quantize ? " convert" : "");
+      aRunner.Run(name, bytes, pixels, [&]() {
+        ConvertClearTypeCompiled(rgb.data(), bgra.data(), pixels, lut);
+        BenchDoNotOptimize(bgra.data());
+      });
+    }
+
+    // Quantized black on white through the LCD16 atlas: packed once with
+    // the LUT when a glyph is added, expanded on every page upload.
+    std::vector<uint16_t> lcd16((size_t)pixels);
+    PackLCD16Proc packProc = GetPackLCD16Proc();
+    aRunner.Run(std::string("PackLCD16 ") + size.fName + " lut", (uint64_t)pixels * (3 + 2), pixels, [&]() {
+      packProc(rgb.data(), lcd16.data(), pixels, preBlend.fR, preBlend.fG, preBlend.fB);
+      BenchDoNotOptimize(lcd16.data());
+    });
+    aRunner.Run(std::string("ConvertLCD16 ") + size.fName, (uint64_t)pixels * (2 + 4), pixels, [&]() {
+      ConvertLCD16Rect(lcd16.data(), size.fWidth * 2, size.fWidth, size.fHeight,
+                       bgra.data(), size.fWidth * 4);
+      BenchDoNotOptimize(bgra.data());
+    });
+
+    // Text that is not black on white goes through BlendToBGRA.
+    MaskBlendParams params;
+    params.fForeground = kTextColor;
+    params.fTableR = colorPreBlend.fR;
+    params.fTableG = colorPreBlend.fG;
+    params.fTableB = colorPreBlend.fB;
+    params.fQuantize = false;
+    const MaskBlendMode modes[] = { MASK_BLEND_SRC_OVER, MASK_BLEND_SKIA_LCD16 };
+    for (MaskBlendMode mode : modes) {
+      params.fMode = mode;
+      std::string name = std::string("ConvertToBGRA ") + size.fName +
+                         (mode == MASK_BLEND_SRC_OVER ? " color" : " color lcd16");
+      aRunner.Run(name, bytes, pixels, [&]() {
+        for (int y = 0; y < size.fHeight; y++) {
+          blendProc(rgb.data() + y * size.fWidth * 3, nullptr,
+                    bgra.data() + y * size.fWidth * 4, size.fWidth, params, kBackground);
+        }
+        BenchDoNotOptimize(bgra.data());
+      });
+    }
+
+    aRunner.Run(std::string("BlendSkiaGrayscale ") + size.fName, bytes, pixels, [&]() {
+      BlendGrayscaleRect(rgb.data(), size.fWidth * 3, size.fWidth, size.fHeight,
+                         bgra.data(), size.fWidth * 4, colorPreBlend.fG,
+                         kTextColor, kBackground);
+      BenchDoNotOptimize(bgra.data());
+    });
+
+    // The A8 path grayscale text takes instead: one byte in, one byte out,
+    // blended in the text color by D2D.
+    std::vector<uint8_t> a8;
+    FillCoverage(a8, (size_t)pixels, 3);
+    std::vector<uint8_t> a8Out((size_t)pixels);
+    aRunner.Run(std::string("ApplyTableA8 ") + size.fName, (uint64_t)pixels * 2, pixels, [&]() {
+      ApplyTableA8(a8.data(), a8Out.data(), pixels, colorPreBlend.fG);
+      BenchDoNotOptimize(a8Out.data());
+    });
+
+    std::vector<uint8_t> bgrx;
+    FillCoverage(bgrx, (size_t)pixels * 4, 2);
+    aRunner.Run(std::string("BlitDirectly ") + size.fName, (uint64_t)pixels * 8, pixels, [&]() {
+      BlitOpaqueRect(bgrx.data(), size.fWidth * 4, size.fWidth, size.fHeight,
+                     bgra.data(), size.fWidth * 4);
+      BenchDoNotOptimize(bgra.data());
+    });
+  }
+}
+
+static void
+BenchComposite(BenchRunner& aRunner)
+{
+  SkMaskGammaRef gamma = MaskGammaRegistry::Get(kContrast, kGamma, kGamma);
+  SkMaskGamma::PreBlend colorPreBlend = SkMaskGamma::preBlend(gamma, kTextColor);
+  MaskBlendParams params;
+  params.fForeground = kTextColor;
+  params.fTableR = colorPreBlend.fR;
+  params.fTableG = colorPreBlend.fG;
+  params.fTableB = colorPreBlend.fB;
+  params.fQuantize = true;
+  params.fMode = MASK_BLEND_SRC_OVER;
+
+  // Blending onto what is already in the destination, every mask format the
+  // CPU surface draws. The scalar 3x1 row is the baseline for the kernels.
+  const CoverageMaskFormat formats[] = { COVERAGE_MASK_CLEARTYPE_3x1, COVERAGE_MASK_LCD16,
+                                         COVERAGE_MASK_A8 };
+  for (const MaskSize& size : kMaskSizes) {
+    const int pixels = size.fWidth * size.fHeight;
+    std::vector<uint8_t> dest;
+    FillCoverage(dest, (size_t)pixels * 4, 4);
+    const IntRect clip = IntRect::Make(0, 0, size.fWidth, size.fHeight);
+
+    for (CoverageMaskFormat format : formats) {
+      const int32_t maskBytesPerPixel = CoverageMaskBytesPerPixel(format);
+      std::vector<uint8_t> bits;
+      FillCoverage(bits, (size_t)pixels * maskBytesPerPixel, 5);
+      CoverageMask mask = { bits.data(), size.fWidth * maskBytesPerPixel,
+                            size.fWidth, size.fHeight, format };
+      const char* formatName = format == COVERAGE_MASK_A8 ? " A8" :
+                               format == COVERAGE_MASK_LCD16 ? " LCD16" : " 3x1";
+      const uint64_t bytes = (uint64_t)pixels * (maskBytesPerPixel + 4 + 4);
+      aRunner.Run(std::string("CompositeMask ") + size.fName + formatName, bytes, pixels, [&]() {
+        CompositeMask(mask, 0, 0, params, dest.data(), size.fWidth * 4, clip);
+        BenchDoNotOptimize(dest.data());
+      });
+
+      if (format == COVERAGE_MASK_CLEARTYPE_3x1) {
+        aRunner.Run(std::string("CompositeMask ") + size.fName + formatName + " scalar",
+                    bytes, pixels, [&]() {
+          for (int y = 0; y < size.fHeight; y++) {
+            uint8_t* row = dest.data() + y * size.fWidth * 4;
+            BlendClearType_Scalar(bits.data() + y * mask.fStride, row, row, size.fWidth,
+                                  params, 0);
+          }
+          BenchDoNotOptimize(dest.data());
+        });
+      }
+    }
+  }
+}
+
+static void
+BenchLayers(BenchRunner& aRunner)
+{
+  for (const MaskSize& size : kMaskSizes) {
+    const int pixels = size.fWidth * size.fHeight;
+    std::vector<uint8_t> image, layer, mask, dest;
+    FillCoverage(image, (size_t)pixels * 4, 6);
+    FillCoverage(layer, (size_t)pixels * 4, 7);
+    FillCoverage(mask, (size_t)pixels, 8);
+    FillCoverage(dest, (size_t)pixels * 4, 9);
+    std::vector<uint8_t> a8((size_t)pixels);
+
+    const LuminanceToAlphaProc luminance[] = { LuminanceToAlpha_Scalar, GetLuminanceToAlphaProc() };
+    const BlendLayerProc blend[] = { BlendLayer_Scalar, GetBlendLayerProc() };
+    for (int fast = 0; fast < 2; fast++) {
+      const char* suffix = fast ? "" : " scalar";
+      aRunner.Run(std::string("LuminanceToAlpha ") + size.fName + suffix,
+                  (uint64_t)pixels * 5, pixels, [&]() {
+        luminance[fast](image.data(), a8.data(), pixels);
+        BenchDoNotOptimize(a8.data());
+      });
+      aRunner.Run(std::string("BlendLayer ") + size.fName + suffix,
+                  (uint64_t)pixels * 13, pixels, [&]() {
+        blend[fast](layer.data(), mask.data(), dest.data(), pixels);
+        BenchDoNotOptimize(dest.data());
+      });
+    }
+
+    // A block filled through its own luminance, push to pop. The layer
+    // only clears and composites the block.
+    CpuRenderSurface surface(size.fWidth, size.fHeight, SURFACE_FORMAT_B8G8R8A8);
+    aRunner.Run(std::string("Luminance layer ") + size.fName, (uint64_t)pixels * 16, pixels,
+                [&]() {
+      surface.PushLuminanceLayer(image.data(), size.fWidth * 4, size.fWidth, size.fHeight, 0, 0);
+      surface.Clear(kTextColor);
+      surface.PopLayer();
+      BenchDoNotOptimize(surface.Pixels());
+    });
+  }
+}
+
+static void
+BenchMaskGamma(BenchRunner& aRunner)
+{
+  // The full set of 8 luminance tables for one contrast and gamma pair.
+  const uint64_t tableBytes = (uint64_t)8 * 256;
+  aRunner.Run("SkTMaskGamma construct", tableBytes, 0, [&]() {
+    SkMaskGamma gamma(kContrast, kGamma, kGamma);
+    BenchDoNotOptimize(gamma.getGammaTables());
+  });
+  aRunner.Run("SkTMaskGamma construct gdi", tableBytes, 0, [&]() {
+    SkMaskGamma gamma(kContrast, kGdiGamma, kGdiGamma);
+    BenchDoNotOptimize(gamma.getGammaTables());
+  });
+  aRunner.Run("MaskGammaRegistry Get", 0, 0, [&]() {
+    SkMaskGammaRef gamma = MaskGammaRegistry::Get(kContrast, kGamma, kGamma);
+    BenchDoNotOptimize(gamma.get());
+  });
+
+  // GetPreBlend runs once per draw, with the text color changing as often
+  // as the content does.
+  SkMaskGammaRef gamma = MaskGammaRegistry::Get(kContrast, kGamma, kGamma);
+  uint32_t color = 0;
+  aRunner.Run("preBlend", 0, 0, [&]() {
+    SkMaskGamma::PreBlend preBlend =
+      SkMaskGamma::preBlend(gamma, 0xFF000000 | (color++ * 0x10101u));
+    BenchDoNotOptimize(preBlend.fG);
+  });
+}
+
+static void
+BenchGlyphRuns(BenchRunner& aRunner)
+{
+  const uint32_t count = (uint32_t)strlen(kRunText);
+  std::vector<uint32_t> codePoints(kRunText, kRunText + count);
+  std::vector<uint16_t> glyphs(count);
+  std::vector<float> advances(count);
+
+  // What GlyphRunBuilder::AddRun does once the font's pages are loaded.
+  FontGlyphMap glyphMap(std::unique_ptr<GlyphMapSource>(new SyntheticGlyphSource()),
+                        SyntheticGlyphSource::kGlyphCount, SyntheticGlyphSource::kUnitsPerEm);
+  aRunner.Run("GlyphRun map", 0, 0, [&]() {
+    glyphMap.GetGlyphIndices(codePoints.data(), count, glyphs.data());
+    glyphMap.GetAdvances(glyphs.data(), count, 16.0f, advances.data());
+    BenchDoNotOptimize(advances.data());
+  });
+
+  SkMaskGammaRef gamma = MaskGammaRegistry::Get(kContrast, kGamma, kGamma);
+  SkMaskGamma::PreBlend colorPreBlend = SkMaskGamma::preBlend(gamma, kTextColor);
+
+  // Placing the cached masks of a run and compositing them into the mask
+  // that goes to ConvertToBGRA, like GetAlphaTexture.
+  // Mapped here too so the glyphs are right when --filter skips the case above.
+  glyphMap.GetGlyphIndices(codePoints.data(), count, glyphs.data());
+  const GlyphMaskFormat formats[] = { GLYPH_MASK_A8, GLYPH_MASK_CLEARTYPE_3x1 };
+  for (float emSize : kRunEmSizes) {
+    glyphMap.GetAdvances(glyphs.data(), count, emSize, advances.data());
+    for (GlyphMaskFormat format : formats) {
+      GlyphCache cache(16 * 1024 * 1024);
+      SyntheticRasterizer rasterizer(emSize);
+      std::vector<PlacedGlyph> placed;
+      GetGlyphRunMasks(rasterizer, cache, format, glyphs.data(), advances.data(), nullptr,
+                       count, false, placed);
+      IntRect bounds = GetGlyphRunBounds(placed);
+      const int32_t bytesPerPixel = GlyphMaskBytesPerPixel(format);
+      const uint64_t pixels = (uint64_t)bounds.Width() * bounds.Height();
+      std::vector<uint8_t> run(pixels * bytesPerPixel);
+
+      char name[64];
+      snprintf(name, sizeof(name), "GlyphRun composite %s %gpx",
+               format == GLYPH_MASK_A8 ? "A8" : "3x1", emSize);
+      aRunner.Run(name, pixels * bytesPerPixel, pixels, [&]() {
+        GetGlyphRunMasks(rasterizer, cache, format, glyphs.data(), advances.data(), nullptr,
+                         count, false, placed);
+        IntRect runBounds = GetGlyphRunBounds(placed);
+        CompositeGlyphRun(placed, runBounds, bytesPerPixel, run.data());
+        BenchDoNotOptimize(run.data());
+      });
+
+      // The same run drawn in color through the CPU backend: composite,
+      // PreBlend and blend onto the surface.
+      CpuRenderSurface surface(bounds.Width(), bounds.Height(), SURFACE_FORMAT_B8G8R8A8);
+      surface.Clear(kBackground);
+      GlyphRunPaint paint;
+      paint.fMaskFormat = format;
+      paint.fBlend.fForeground = kTextColor;
+      paint.fBlend.fTableR = colorPreBlend.fR;
+      paint.fBlend.fTableG = colorPreBlend.fG;
+      paint.fBlend.fTableB = colorPreBlend.fB;
+      paint.fBlend.fQuantize = false;
+      paint.fBlend.fMode = MASK_BLEND_SRC_OVER;
+      paint.fBackground = kBackground;
+      snprintf(name, sizeof(name), "CpuRenderSurface DrawGlyphRun %s %gpx",
+               format == GLYPH_MASK_A8 ? "A8" : "3x1", emSize);
+      aRunner.Run(name, pixels * (bytesPerPixel + 8), pixels, [&]() {
+        GetGlyphRunMasks(rasterizer, cache, format, glyphs.data(), advances.data(), nullptr,
+                         count, false, placed);
+        surface.DrawGlyphRun(placed, -bounds.fLeft, -bounds.fTop, paint);
+        BenchDoNotOptimize(surface.Pixels());
+      });
+    }
+  }
+}
+
+// Draws the page BenchTiles times into a TiledCompositor or, for the
+// reference it is checked against, a CpuRenderSurface.
+template <typename Target>
+static void
+DrawTextPage(Target& aTarget, const std::vector<PlacedGlyph>& aPlaced, int32_t aRunWidth,
+             int32_t aPageSize, int32_t aLineHeight, const GlyphRunPaint& aPaint)
+{
+  aTarget.Clear(kBackground);
+  for (int32_t y = aLineHeight; y < aPageSize; y += aLineHeight) {
+    for (int32_t x = 0; x < aPageSize; x += aRunWidth) {
+      aTarget.DrawGlyphRun(aPlaced, x, y, aPaint);
+    }
+  }
+}
+
+// Returns false if a thread count composites different pixels than a
+// CpuRenderSurface.
+static bool
+BenchTiles(BenchRunner& aRunner)
+{
+  // A full screen page of 16px text on the 2048x2048 back buffer, a run per
+  // line segment, composited in tiles on 1 to 16 threads.
+  const int32_t kPageSize = 2048;
+  const float kEmSize = 16;
+  const int32_t kLineHeight = 20;
+  const uint32_t count = (uint32_t)strlen(kRunText);
+  std::vector<uint32_t> codePoints(kRunText, kRunText + count);
+  std::vector<uint16_t> glyphs(count);
+  std::vector<float> advances(count);
+  FontGlyphMap glyphMap(std::unique_ptr<GlyphMapSource>(new SyntheticGlyphSource()),
+                        SyntheticGlyphSource::kGlyphCount, SyntheticGlyphSource::kUnitsPerEm);
+  glyphMap.GetGlyphIndices(codePoints.data(), count, glyphs.data());
+  glyphMap.GetAdvances(glyphs.data(), count, kEmSize, advances.data());
+
+  GlyphCache cache(16 * 1024 * 1024);
+  SyntheticRasterizer rasterizer(kEmSize);
+  std::vector<PlacedGlyph> placed;
+  GetGlyphRunMasks(rasterizer, cache, GLYPH_MASK_CLEARTYPE_3x1, glyphs.data(), advances.data(),
+                   nullptr, count, false, placed);
+  const int32_t runWidth = GetGlyphRunBounds(placed).fRight;
+
+  SkMaskGammaRef gamma = MaskGammaRegistry::Get(kContrast, kGamma, kGamma);
+  SkMaskGamma::PreBlend colorPreBlend = SkMaskGamma::preBlend(gamma, kTextColor);
+  GlyphRunPaint paint;
+  paint.fMaskFormat = GLYPH_MASK_CLEARTYPE_3x1;
+  paint.fBlend.fForeground = kTextColor;
+  paint.fBlend.fTableR = colorPreBlend.fR;
+  paint.fBlend.fTableG = colorPreBlend.fG;
+  paint.fBlend.fTableB = colorPreBlend.fB;
+  paint.fBlend.fQuantize = false;
+  paint.fBlend.fMode = MASK_BLEND_SRC_OVER;
+  paint.fBackground = kBackground;
+
+  CpuRenderSurface reference(kPageSize, kPageSize, SURFACE_FORMAT_B8G8R8A8);
+  DrawTextPage(reference, placed, runWidth, kPageSize, kLineHeight, paint);
+
+  bool ok = true;
+  std::vector<uint8_t> pixels((size_t)kPageSize * kPageSize * 4);
+  const uint64_t pagePixels = (uint64_t)kPageSize * kPageSize;
+  const int maxThreads = std::max(1, std::min(16, (int)std::thread::hardware_concurrency()));
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    WorkStealingPool pool(threads);
+    TiledCompositor compositor(&pool);
+    char name[64];
+    snprintf(name, sizeof(name), "TiledCompositor page %dx%d %d threads",
+             kPageSize, kPageSize, threads);
+    aRunner.Run(name, pagePixels * 4, pagePixels, [&]() {
+      compositor.BeginFrame(pixels.data(), kPageSize, kPageSize, kPageSize * 4);
+      DrawTextPage(compositor, placed, runWidth, kPageSize, kLineHeight, paint);
+      compositor.Flush();
+      BenchDoNotOptimize(pixels.data());
+    });
+
+    // One more frame onto garbage, drawn even when the filter skips timing.
+    memset(pixels.data(), 0xCD, pixels.size());
+    compositor.BeginFrame(pixels.data(), kPageSize, kPageSize, kPageSize * 4);
+    DrawTextPage(compositor, placed, runWidth, kPageSize, kLineHeight, paint);
+    compositor.Flush();
+    for (int32_t y = 0; y < kPageSize; y++) {
+      if (memcmp(pixels.data() + (size_t)y * kPageSize * 4,
+                 reference.Pixels() + (size_t)y * reference.Stride(), (size_t)kPageSize * 4)) {
+        printf("FAIL: TiledCompositor on %d threads differs from CpuRenderSurface in row %d\n",
+               threads, y);
+        ok = false;
+        break;
+      }
+    }
+    // Where the time went on the widest pool.
+    if (threads * 2 > maxThreads) {
+      compositor.WriteTileReport(std::cout);
+    }
+  }
+  return ok;
+}
+
+static void
+BenchTrace(BenchRunner& aRunner)
+{
+  // Budget is about 20ns per zone while recording, most of it the two reads
+  // of the clock.
+  aRunner.Run("TraceTicks", 0, 0, [&]() {
+    uint64_t ticks = TraceTicks();
+    BenchDoNotOptimize(&ticks);
+  });
+  Tracer::SetEnabled(true);
+  aRunner.Run("TraceZone enabled", 0, 0, [&]() {
+    TraceZone zone("bench");
+    BenchDoNotOptimize(&zone);
+  });
+  Tracer::SetEnabled(false);
+  aRunner.Run("TraceZone disabled", 0, 0, [&]() {
+    TraceZone zone("bench");
+    BenchDoNotOptimize(&zone);
+  });
+}
+
+int
+main(int argc, char** argv)
+{
+  BenchOptions options;
+  if (!options.Parse(argc, argv) || argc != 1) {
+    fprintf(stderr, "usage: PipelineBench %s\n", BenchOptions::Usage());
+    return 1;
+  }
+
+  printf("%d warmup and %d timed samples per case, times per iteration\n\n",
+         options.fWarmup, options.fRepetitions);
+  bool ok = CheckKernels();
+
+  BenchRunner runner(options);
+  BenchRunner::PrintHeader();
+  BenchConvert(runner);
+  BenchComposite(runner);
+  BenchLayers(runner);
+  BenchMaskGamma(runner);
+  BenchGlyphRuns(runner);
+  ok &= BenchTiles(runner);
+  BenchTrace(runner);
+
+  if (!runner.WriteJson("PipelineBench")) {
+    fprintf(stderr, "cannot write %s\n", options.fJsonPath);
+    return 1;
+  }
+  if (!ok) {
+    printf("FAILED\n");
+    return 1;
+  }
+  return 0;
+}
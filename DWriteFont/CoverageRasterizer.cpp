@@ -0,0 +1,273 @@
+#include "CoverageRasterizer.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(DW_CPU_X86)
+#include <immintrin.h>
+#endif
+
+// How far flattened curves may stray from the real ones, in pixels. Chords
+// always cut inside a curve, so this is also about how much coverage edge
+// pixels lose.
+static const float kFlatness = 1.0f / 32;
+
+CoverageRasterizer::CoverageRasterizer()
+  : mWidth(0)
+  , mHeight(0)
+{
+}
+
+void
+CoverageRasterizer::Reset(int32_t aWidth, int32_t aHeight)
+{
+  assert(aWidth >= 0 && aHeight >= 0);
+  mWidth = aWidth;
+  mHeight = aHeight;
+  mArea.assign((size_t)aWidth * aHeight + 2, 0.0f);
+}
+
+void
+CoverageRasterizer::DrawLine(float aX0, float aY0, float aX1, float aY1)
+{
+  if (aY0 == aY1) {
+    return;
+  }
+
+  // Walk down, remembering which way the line went.
+  float dir = 1.0f;
+  if (aY0 > aY1) {
+    std::swap(aX0, aX1);
+    std::swap(aY0, aY1);
+    dir = -1.0f;
+  }
+
+  const float dxdy = (aX1 - aX0) / (aY1 - aY0);
+  float x = aX0;
+  int32_t yStart = aY0 < 0.0f ? 0 : (int32_t)aY0;
+  if (aY0 < 0.0f) {
+    x -= aY0 * dxdy;
+  }
+  int32_t yEnd = std::min(mHeight, (int32_t)ceilf(aY1));
+
+  float* area = mArea.data();
+  for (int32_t y = yStart; y < yEnd; y++) {
+    float* row = area + (size_t)y * mWidth;
+    float dy = std::min((float)(y + 1), aY1) - std::max((float)y, aY0);
+    // Clamped so rounding in the walk cannot step outside the buffer.
+    float xNext = std::min(std::max(x + dxdy * dy, 0.0f), (float)mWidth);
+    float d = dy * dir;
+
+    float x0 = std::min(x, xNext);
+    float x1 = std::max(x, xNext);
+    float x0Floor = floorf(x0);
+    int32_t x0i = (int32_t)x0Floor;
+    float x1Ceil = ceilf(x1);
+    int32_t x1i = (int32_t)x1Ceil;
+    assert(x0i >= 0 && x1i <= mWidth + 1);
+
+    if (x1i <= x0i + 1) {
+      // Within one pixel, split by where the line crosses it on average.
+      float xMid = 0.5f * (x + xNext) - x0Floor;
+      row[x0i] += d - d * xMid;
+      row[x0i + 1] += d * xMid;
+    } else {
+      float s = 1.0f / (x1 - x0);
+      float x0f = x0 - x0Floor;
+      float a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+      float x1f = x1 - x1Ceil + 1.0f;
+      float am = 0.5f * s * x1f * x1f;
+      row[x0i] += d * a0;
+      if (x1i == x0i + 2) {
+        row[x0i + 1] += d * (1.0f - a0 - am);
+      } else {
+        float a1 = s * (1.5f - x0f);
+        row[x0i + 1] += d * (a1 - a0);
+        for (int32_t xi = x0i + 2; xi < x1i - 1; xi++) {
+          row[xi] += d * s;
+        }
+        float a2 = a1 + (float)(x1i - x0i - 3) * s;
+        row[x1i - 1] += d * (1.0f - a2 - am);
+      }
+      row[x1i] += d * am;
+    }
+    x = xNext;
+  }
+}
+
+void
+CoverageRasterizer::DrawQuad(float aX0, float aY0, float aX1, float aY1, float aX2, float aY2)
+{
+  // A quadratic strays at most a quarter of its second difference over n^2
+  // from its n segment chord path.
+  float devX = aX0 - 2.0f * aX1 + aX2;
+  float devY = aY0 - 2.0f * aY1 + aY2;
+  float dev = sqrtf(devX * devX + devY * devY);
+  int32_t segments = (int32_t)ceilf(sqrtf(dev / (4.0f * kFlatness)));
+  if (segments <= 1) {
+    DrawLine(aX0, aY0, aX2, aY2);
+    return;
+  }
+
+  float step = 1.0f / segments;
+  float t = 0.0f;
+  float x = aX0;
+  float y = aY0;
+  for (int32_t i = 0; i < segments - 1; i++) {
+    t += step;
+    float mt = 1.0f - t;
+    float nextX = mt * mt * aX0 + 2.0f * mt * t * aX1 + t * t * aX2;
+    float nextY = mt * mt * aY0 + 2.0f * mt * t * aY1 + t * t * aY2;
+    DrawLine(x, y, nextX, nextY);
+    x = nextX;
+    y = nextY;
+  }
+  DrawLine(x, y, aX2, aY2);
+}
+
+void
+CoverageRasterizer::DrawCubic(float aX0, float aY0, float aX1, float aY1,
+                              float aX2, float aY2, float aX3, float aY3)
+{
+  // For a cubic it is at most 3/4 of the larger second difference over n^2.
+  float devX = std::max(fabsf(aX0 - 2.0f * aX1 + aX2), fabsf(aX1 - 2.0f * aX2 + aX3));
+  float devY = std::max(fabsf(aY0 - 2.0f * aY1 + aY2), fabsf(aY1 - 2.0f * aY2 + aY3));
+  float dev = sqrtf(devX * devX + devY * devY);
+  int32_t segments = (int32_t)ceilf(sqrtf(0.75f * dev / kFlatness));
+  if (segments <= 1) {
+    DrawLine(aX0, aY0, aX3, aY3);
+    return;
+  }
+
+  float step = 1.0f / segments;
+  float t = 0.0f;
+  float x = aX0;
+  float y = aY0;
+  for (int32_t i = 0; i < segments - 1; i++) {
+    t += step;
+    float mt = 1.0f - t;
+    float a = mt * mt * mt;
+    float b = 3.0f * mt * mt * t;
+    float c = 3.0f * mt * t * t;
+    float d = t * t * t;
+    float nextX = a * aX0 + b * aX1 + c * aX2 + d * aX3;
+    float nextY = a * aY0 + b * aY1 + c * aY2 + d * aY3;
+    DrawLine(x, y, nextX, nextY);
+    x = nextX;
+    y = nextY;
+  }
+  DrawLine(x, y, aX3, aY3);
+}
+
+void
+CoverageRasterizer::Accumulate(uint8_t* aOut, int32_t aStride) const
+{
+  GetAccumulateCoverageProc()(mArea.data(), mWidth, mHeight, aOut, aStride);
+}
+
+static inline uint8_t
+CoverageToByte(float aSum)
+{
+  float coverage = std::min(fabsf(aSum), 1.0f);
+  return (uint8_t)(coverage * 255.0f + 0.5f);
+}
+
+// Sums aCount (at most 4) entries as one block in the order the SIMD
+// versions use: neighbours, then pairs, then the total so far.
+static inline void
+AccumulateBlock(const float* aArea, int32_t aCount, float* aTotal, uint8_t* aOut)
+{
+  float x[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for (int32_t i = 0; i < aCount; i++) {
+    x[i] = aArea[i];
+  }
+
+  float s1 = x[1] + x[0];
+  float s2 = x[2] + x[1];
+  float s3 = x[3] + x[2];
+  float sums[4] = { x[0] + *aTotal, s1 + *aTotal, (s2 + x[0]) + *aTotal, (s3 + s1) + *aTotal };
+  for (int32_t i = 0; i < aCount; i++) {
+    aOut[i] = CoverageToByte(sums[i]);
+  }
+  *aTotal = sums[3];
+}
+
+void
+AccumulateCoverage_Scalar(const float* aArea, int32_t aWidth, int32_t aHeight,
+                          uint8_t* aOut, int32_t aStride)
+{
+  float total = 0.0f;
+  for (int32_t y = 0; y < aHeight; y++) {
+    const float* area = aArea + (size_t)y * aWidth;
+    uint8_t* out = aOut + (size_t)y * aStride;
+    for (int32_t x = 0; x < aWidth; x += 4) {
+      AccumulateBlock(area + x, std::min(aWidth - x, 4), &total, out + x);
+    }
+  }
+}
+
+#if defined(DW_CPU_X86)
+static inline __m128
+PrefixSum_SSE2(__m128 aValue)
+{
+  aValue = _mm_add_ps(aValue, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(aValue), 4)));
+  return _mm_add_ps(aValue, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(aValue), 8)));
+}
+
+static inline __m128i
+CoverageToInt_SSE2(__m128 aSum)
+{
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  __m128 coverage = _mm_min_ps(_mm_andnot_ps(signMask, aSum), _mm_set1_ps(1.0f));
+  return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(coverage, _mm_set1_ps(255.0f)),
+                                     _mm_set1_ps(0.5f)));
+}
+
+void
+AccumulateCoverage_SSE2(const float* aArea, int32_t aWidth, int32_t aHeight,
+                        uint8_t* aOut, int32_t aStride)
+{
+  __m128 total = _mm_setzero_ps();
+  for (int32_t y = 0; y < aHeight; y++) {
+    const float* area = aArea + (size_t)y * aWidth;
+    uint8_t* out = aOut + (size_t)y * aStride;
+
+    int32_t x = 0;
+    for (; x + 4 <= aWidth; x += 4) {
+      __m128 sums = _mm_add_ps(PrefixSum_SSE2(_mm_loadu_ps(area + x)), total);
+      total = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(3, 3, 3, 3));
+
+      __m128i bytes = CoverageToInt_SSE2(sums);
+      bytes = _mm_packs_epi32(bytes, bytes);
+      bytes = _mm_packus_epi16(bytes, bytes);
+      int32_t packed = _mm_cvtsi128_si32(bytes);
+      memcpy(out + x, &packed, 4);
+    }
+
+    if (x < aWidth) {
+      float rowTotal = _mm_cvtss_f32(total);
+      AccumulateBlock(area + x, aWidth - x, &rowTotal, out + x);
+      total = _mm_set1_ps(rowTotal);
+    }
+  }
+}
+#endif
+
+static AccumulateCoverageProc
+SelectAccumulateCoverageProc()
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_SSE2)) {
+    return AccumulateCoverage_SSE2;
+  }
+#endif
+  return AccumulateCoverage_Scalar;
+}
+
+AccumulateCoverageProc
+GetAccumulateCoverageProc()
+{
+  static const AccumulateCoverageProc sProc = SelectAccumulateCoverageProc();
+  return sProc;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "CpuFeatures.h"
+
+/**
+ * Turns the signed areas CoverageRasterizer collected into 0..255 coverage.
+ * aArea has aWidth entries per row, the running sum carries from the end of
+ * each row to the start of the next. aStride is in bytes.
+ *
+ * The sum is taken in blocks of four entries from the start of each row, as
+ * a prefix sum within the block added to the total so far, the last block of
+ * a row padded with zeros. Every version adds in that order, so they all give
+ * the same bytes.
+ */
+typedef void (*AccumulateCoverageProc)(const float* aArea, int32_t aWidth, int32_t aHeight,
+                                       uint8_t* aOut, int32_t aStride);
+
+void AccumulateCoverage_Scalar(const float* aArea, int32_t aWidth, int32_t aHeight,
+                               uint8_t* aOut, int32_t aStride);
+
+#if defined(DW_CPU_X86)
+// One block per iteration. Each block needs the total of the one before, so
+// wider vectors do not help: an AVX2 version that does two blocks per
+// iteration has to carry the total across 128 bit lanes twice and is slower.
+void AccumulateCoverage_SSE2(const float* aArea, int32_t aWidth, int32_t aHeight,
+                             uint8_t* aOut, int32_t aStride);
+#endif
+
+// Returns the fastest version the running CPU supports. Picked once from cpuid.
+AccumulateCoverageProc GetAccumulateCoverageProc();
+
+/**
+ * Antialiased path filler for glyph outlines, the signed area accumulation
+ * of font-rs. Every line adds, for each pixel it crosses, the area it covers
+ * to the right of it within the pixel, signed by direction. A running sum
+ * over the buffer then gives the exact coverage under the non-zero rule for
+ * paths that do not overlap themselves, and a good approximation for glyphs
+ * whose contours do.
+ *
+ * Curves are flattened finely enough to stay within a fraction of a pixel.
+ * Points are in pixels with y down and have to lie within the size passed to
+ * Reset. Not thread safe.
+ */
+class CoverageRasterizer {
+public:
+  CoverageRasterizer();
+
+  // Clears the accumulation buffer for a new path of the given size.
+  void Reset(int32_t aWidth, int32_t aHeight);
+
+  void DrawLine(float aX0, float aY0, float aX1, float aY1);
+  // Quadratic Bezier, as in glyf outlines.
+  void DrawQuad(float aX0, float aY0, float aX1, float aY1, float aX2, float aY2);
+  // Cubic Bezier, as in CFF outlines.
+  void DrawCubic(float aX0, float aY0, float aX1, float aY1,
+                 float aX2, float aY2, float aX3, float aY3);
+
+  // Writes 0..255 coverage for every pixel, aStride bytes per row.
+  void Accumulate(uint8_t* aOut, int32_t aStride) const;
+
+  int32_t Width() const { return mWidth; }
+  int32_t Height() const { return mHeight; }
+  // The signed areas, Width() entries per row.
+  const float* Area() const { return mArea.data(); }
+
+private:
+  int32_t mWidth;
+  int32_t mHeight;
+  // Lines on the right edge add to the first entries of the next row, which
+  // is where the running sum wants them. Two spare entries at the end take
+  // what the last row adds past its edge.
+  std::vector<float> mArea;
+};
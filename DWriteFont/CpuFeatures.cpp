@@ -0,0 +1,81 @@
+#include "CpuFeatures.h"
+
+#if defined(DW_CPU_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(DW_CPU_X86)
+static void
+CpuId(int aLeaf, int aSubLeaf, unsigned aRegs[4])
+{
+#if defined(_MSC_VER)
+  int regs[4];
+  __cpuidex(regs, aLeaf, aSubLeaf);
+  for (int i = 0; i < 4; i++) {
+    aRegs[i] = (unsigned)regs[i];
+  }
+#else
+  __cpuid_count(aLeaf, aSubLeaf, aRegs[0], aRegs[1], aRegs[2], aRegs[3]);
+#endif
+}
+
+// True if the OS saves the YMM registers on a context switch.
+static bool
+OSSupportsAVX()
+{
+#if defined(_MSC_VER)
+  return (_xgetbv(0) & 0x6) == 0x6;
+#else
+  unsigned eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (eax & 0x6) == 0x6;
+#endif
+}
+
+static unsigned
+DetectCpuFeatures()
+{
+  unsigned features = 0;
+  unsigned regs[4];
+
+  CpuId(0, 0, regs);
+  unsigned maxLeaf = regs[0];
+
+  CpuId(1, 0, regs);
+  unsigned ecx = regs[2];
+  unsigned edx = regs[3];
+  if (edx & (1 << 26)) features |= CPU_FEATURE_SSE2;
+  if (ecx & (1 << 9))  features |= CPU_FEATURE_SSSE3;
+  if (ecx & (1 << 19)) features |= CPU_FEATURE_SSE41;
+
+  bool osxsave = (ecx & (1 << 27)) != 0;
+  if (maxLeaf >= 7 && osxsave && OSSupportsAVX()) {
+    CpuId(7, 0, regs);
+    if (regs[1] & (1 << 5)) features |= CPU_FEATURE_AVX2;
+  }
+  return features;
+}
+#else
+static unsigned
+DetectCpuFeatures()
+{
+#if defined(DW_CPU_NEON)
+  // NEON is part of the base AArch64 ISA.
+  return CPU_FEATURE_NEON;
+#else
+  return 0;
+#endif
+}
+#endif
+
+unsigned
+GetCpuFeatures()
+{
+  static const unsigned sFeatures = DetectCpuFeatures();
+  return sFeatures;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// Runtime CPU feature detection used to pick SIMD kernels. Kept free of
+// windows.h so the mask pipeline can be compiled on any platform.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DW_CPU_X86 1
+#endif
+
+#if defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define DW_CPU_NEON 1
+#endif
+
+// MSVC lets any translation unit use AVX2 intrinsics, GCC and Clang need the
+// function to be tagged with the target it was written for.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define DW_TARGET_SSSE3
+#define DW_TARGET_AVX2
+#else
+#define DW_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define DW_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+enum CpuFeature {
+  CPU_FEATURE_SSE2  = 1 << 0,
+  CPU_FEATURE_SSSE3 = 1 << 1,
+  CPU_FEATURE_SSE41 = 1 << 2,
+  CPU_FEATURE_AVX2  = 1 << 3,
+  CPU_FEATURE_NEON  = 1 << 4,
+};
+
+// Bitmask of CpuFeature flags supported by both the CPU and the OS.
+// Computed once and cached.
+unsigned GetCpuFeatures();
+
+static inline bool HasCpuFeature(CpuFeature aFeature) {
+  return (GetCpuFeatures() & aFeature) != 0;
+}
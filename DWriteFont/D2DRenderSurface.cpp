@@ -0,0 +1,153 @@
+#include "stdafx.h"
+#include "D2DRenderSurface.h"
+#include <assert.h>
+#include "Trace.h"
+
+static D2D1_COLOR_F
+ToColorF(uint32_t aColor)
+{
+  return D2D1::ColorF(aColor & 0x00FFFFFF, (aColor >> 24) / 255.0f);
+}
+
+D2DRenderSurface::D2DRenderSurface(ID2D1RenderTarget* aTarget)
+  : mTarget(aTarget)
+  , mBrush(nullptr)
+{
+  mTarget->AddRef();
+  mTarget->GetDpi(&mDpiX, &mDpiY);
+  HRESULT hr = mTarget->CreateSolidColorBrush(ToColorF(0xFF000000), &mBrush);
+  assert(hr == S_OK);
+}
+
+D2DRenderSurface::~D2DRenderSurface()
+{
+  mBrush->Release();
+  mTarget->Release();
+}
+
+int32_t
+D2DRenderSurface::Width() const
+{
+  return (int32_t)mTarget->GetPixelSize().width;
+}
+
+int32_t
+D2DRenderSurface::Height() const
+{
+  return (int32_t)mTarget->GetPixelSize().height;
+}
+
+void
+D2DRenderSurface::BeginDraw()
+{
+  mTarget->BeginDraw();
+}
+
+void
+D2DRenderSurface::EndDraw()
+{
+  TRACE_ZONE("EndDraw");
+  HRESULT hr = mTarget->EndDraw();
+  assert(hr == S_OK);
+}
+
+void
+D2DRenderSurface::Clear(uint32_t aColor)
+{
+  mTarget->Clear(ToColorF(aColor));
+}
+
+D2D1_RECT_F
+D2DRenderSurface::ToDips(int32_t aX, int32_t aY, int32_t aWidth, int32_t aHeight) const
+{
+  float scaleX = mDpiX / 96.0f;
+  float scaleY = mDpiY / 96.0f;
+  return D2D1::RectF(aX / scaleX, aY / scaleY, (aX + aWidth) / scaleX, (aY + aHeight) / scaleY);
+}
+
+ID2D1Bitmap*
+D2DRenderSurface::CreateBitmap(const uint8_t* aPixels, int32_t aStride, int32_t aWidth,
+                               int32_t aHeight, DXGI_FORMAT aFormat)
+{
+  D2D1_BITMAP_PROPERTIES properties = { aFormat, D2D1_ALPHA_MODE_PREMULTIPLIED };
+  properties.dpiX = mDpiX;
+  properties.dpiY = mDpiY;
+
+  ID2D1Bitmap* bitmap = nullptr;
+  TRACE_ZONE("UploadBitmap");
+  HRESULT hr = mTarget->CreateBitmap(D2D1::SizeU(aWidth, aHeight), aPixels, aStride,
+                                     properties, &bitmap);
+  assert(hr == S_OK);
+  return bitmap;
+}
+
+void
+D2DRenderSurface::DrawBitmap(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                             int32_t aX, int32_t aY)
+{
+  ID2D1Bitmap* bitmap = CreateBitmap(aBGRA, aStride, aWidth, aHeight, DXGI_FORMAT_B8G8R8A8_UNORM);
+  D2D1_RECT_F destRect = ToDips(aX, aY, aWidth, aHeight);
+  mTarget->DrawBitmap(bitmap, &destRect, 1.0f);
+  bitmap->Release();
+}
+
+void
+D2DRenderSurface::FillOpacityMask(const uint8_t* aA8, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                                  int32_t aX, int32_t aY, uint32_t aColor)
+{
+  ID2D1Bitmap* bitmap = CreateBitmap(aA8, aStride, aWidth, aHeight, DXGI_FORMAT_A8_UNORM);
+  mBrush->SetColor(ToColorF(aColor));
+
+  D2D1_RECT_F destRect = ToDips(aX, aY, aWidth, aHeight);
+
+  // FillOpacityMask only works with aliased geometry.
+  D2D1_ANTIALIAS_MODE antialiasMode = mTarget->GetAntialiasMode();
+  mTarget->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+  mTarget->FillOpacityMask(bitmap, mBrush, D2D1_OPACITY_MASK_CONTENT_TEXT_GRAYSCALE,
+                           &destRect, nullptr);
+  mTarget->SetAntialiasMode(antialiasMode);
+
+  bitmap->Release();
+}
+
+void
+D2DRenderSurface::DrawGlyphRun(const std::vector<PlacedGlyph>& aGlyphs, int32_t aX, int32_t aY,
+                               const GlyphRunPaint& aPaint)
+{
+  TRACE_ZONE("D2DRenderSurface::DrawGlyphRun");
+  IntRect bounds = GetGlyphRunBounds(aGlyphs);
+  if (bounds.IsEmpty()) {
+    return;
+  }
+
+  const int32_t width = bounds.Width();
+  const int32_t height = bounds.Height();
+  const int32_t maskBytesPerPixel = GlyphMaskBytesPerPixel(aPaint.fMaskFormat);
+  mCoverage.resize((size_t)width * height * maskBytesPerPixel);
+  CompositeGlyphRun(aGlyphs, bounds, maskBytesPerPixel, mCoverage.data());
+
+  const MaskBlendParams& params = aPaint.fBlend;
+  if (aPaint.fMaskFormat == GLYPH_MASK_A8) {
+    // D2D blends the coverage in the text color.
+    if (params.fTableG) {
+      ApplyTableA8(mCoverage.data(), mCoverage.data(), width * height, params.fTableG);
+    }
+    FillOpacityMask(mCoverage.data(), width, width, height,
+                    aX + bounds.fLeft, aY + bounds.fTop, params.fForeground);
+    return;
+  }
+
+  mPixels.resize((size_t)width * height * 4);
+  BlendClearTypeProc blendProc = GetBlendClearTypeProc();
+  for (int32_t y = 0; y < height; y++) {
+    blendProc(mCoverage.data() + y * width * 3, nullptr, mPixels.data() + y * width * 4,
+              width, params, aPaint.fBackground);
+  }
+  DrawBitmap(mPixels.data(), width * 4, width, height, aX + bounds.fLeft, aY + bounds.fTop);
+}
+
+bool
+D2DRenderSurface::Readback(const IntRect& aRect, uint8_t* aOut, int32_t aStride)
+{
+  return false;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <d2d1.h>
+#include <vector>
+#include "RenderSurface.h"
+
+/**
+ * RenderSurface drawing through a D2D render target, normally the window's.
+ * Pixel coordinates are turned into DIPs with the target's DPI, so bitmaps
+ * land on whole device pixels.
+ *
+ * D2D blends bitmaps with one alpha per pixel, so ClearType runs are blended
+ * onto GlyphRunPaint::fBackground on the CPU and drawn as opaque boxes, like
+ * D2DSetup::DrawWithBitmap does. Window targets cannot be read back.
+ */
+class D2DRenderSurface : public RenderSurface {
+public:
+  // Holds a reference to aTarget.
+  explicit D2DRenderSurface(ID2D1RenderTarget* aTarget);
+  ~D2DRenderSurface();
+
+  int32_t Width() const override;
+  int32_t Height() const override;
+  SurfaceFormat Format() const override { return SURFACE_FORMAT_B8G8R8A8; }
+
+  void BeginDraw() override;
+  void EndDraw() override;
+
+  void Clear(uint32_t aColor) override;
+  void DrawBitmap(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                  int32_t aX, int32_t aY) override;
+  void FillOpacityMask(const uint8_t* aA8, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                       int32_t aX, int32_t aY, uint32_t aColor) override;
+  void DrawGlyphRun(const std::vector<PlacedGlyph>& aGlyphs, int32_t aX, int32_t aY,
+                    const GlyphRunPaint& aPaint) override;
+  bool Readback(const IntRect& aRect, uint8_t* aOut, int32_t aStride) override;
+
+private:
+  D2DRenderSurface(const D2DRenderSurface&);
+  D2DRenderSurface& operator=(const D2DRenderSurface&);
+
+  ID2D1Bitmap* CreateBitmap(const uint8_t* aPixels, int32_t aStride, int32_t aWidth,
+                            int32_t aHeight, DXGI_FORMAT aFormat);
+  // A rect in pixels as DIPs.
+  D2D1_RECT_F ToDips(int32_t aX, int32_t aY, int32_t aWidth, int32_t aHeight) const;
+
+  ID2D1RenderTarget* mTarget;
+  // FillOpacityMask's brush, recolored for every fill.
+  ID2D1SolidColorBrush* mBrush;
+  float mDpiX;
+  float mDpiY;
+  // Composited run coverage and its blended pixels for DrawGlyphRun.
+  std::vector<uint8_t> mCoverage;
+  std::vector<uint8_t> mPixels;
+};
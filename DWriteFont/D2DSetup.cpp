@@ -8,6 +8,8 @@
 #include <d3d10_1.h>
 #include <D2d1_1.h>
 #include "d2d1effects.h";
+#include "MaskConvert.h"
+#include "Trace.h"
 
 
 #define SK_A32_SHIFT 24
@@ -33,6 +35,13 @@ HMONITOR GetPrimaryMonitorHandle()
 
 void D2DSetup::Init()
 {
+  // Debug builds check the precomputed gamma tables against this compiler's
+  // powf once per process, release builds use them as is.
+#ifndef NDEBUG
+  static const bool presetsMatch = MaskGammaRegistry::VerifyPresets();
+  assert(presetsMatch);
+#endif
+
   InitD3D();
 
   HRESULT hr = CoCreateInstance(
@@ -73,6 +82,24 @@ D2DSetup::CreateHardwareRenderTarget()
   HRESULT hr = mFactory->CreateHwndRenderTarget(&properties, &hwndProperties,
                       &mRenderTarget);
   assert(hr == S_OK);
+
+  delete mSurface;
+  mSurface = new D2DRenderSurface(mRenderTarget);
+
+  if (mRenderTargetContext) {
+    mRenderTargetContext->Release();
+    mRenderTargetContext = nullptr;
+  }
+  hr = mRenderTarget->QueryInterface(__uuidof(ID2D1DeviceContext), (void**)&mRenderTargetContext);
+  if (hr != S_OK) {
+    mRenderTargetContext = nullptr;
+  }
+
+  if (mTextBrush) {
+    mTextBrush->Release();
+  }
+  hr = mRenderTarget->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::Black, 1.0f), &mTextBrush);
+  assert(hr == S_OK);
 }
 
 void
@@ -197,6 +224,7 @@ D2DSetup::InitDWrite()
 {
   HRESULT hr = DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED, __uuidof(IDWriteFactory), reinterpret_cast<IUnknown**>(&mDwriteFactory));
   assert(hr == S_OK);
+  mFontFaces.Init(mDwriteFactory);
 
   mFontSize = 13.0f;
   hr = mDwriteFactory->CreateTextFormat(L"Georgia", nullptr, DWRITE_FONT_WEIGHT_NORMAL, DWRITE_FONT_STYLE_NORMAL, DWRITE_FONT_STRETCH_NORMAL, mFontSize, L"", &mTextFormat);
@@ -234,6 +262,7 @@ D2DSetup::InitDWrite()
 void
 D2DSetup::ReleaseDWrite()
 {
+  mFontFaces.Clear();
   mTextFormat->Release();
   mDwriteFactory->Release();
   mDefaultParams->Release();
@@ -245,6 +274,7 @@ D2DSetup::ReleaseDWrite()
 void
 D2DSetup::ReleaseD2D()
 {
+  ReleaseGlyphAtlas();
   mDC->Release();
   mFactory->Release();
   mTargetBitmap->Release();
@@ -295,6 +325,13 @@ D2DSetup::SetD2DToBackBuffer()
 
 D2DSetup::~D2DSetup()
 {
+  delete mSurface;
+  if (mRenderTargetContext) {
+    mRenderTargetContext->Release();
+  }
+  if (mTextBrush) {
+    mTextBrush->Release();
+  }
   ReleaseBrushes();
   ReleaseDWrite();
   ReleaseD2D();
@@ -365,107 +402,16 @@ void D2DSetup::PrintFonts(IDWriteFontCollection* aFontCollection)
   }
 }
 
-static int
-Blend(float src, float dst, float alpha) {
-  float floatAlpha = alpha / 255;
-  //return dst + ((src - dst) * alpha >> 8);
-  float result = (src * floatAlpha) + (dst * (1 - floatAlpha));
-  return (int) result;
-}
-
-static inline int SkBlend32(int src, int dst, int alpha) {
-  return dst + ((src - dst) * alpha >> 5);
-}
-
 IDWriteFontFace* D2DSetup::GetFontFace()
 {
   static const WCHAR fontFamilyName[] = L"Georgia";
 
-  IDWriteFontCollection* systemFonts;
-  mDwriteFactory->GetSystemFontCollection(&systemFonts, TRUE);
-  //PrintFonts(systemFonts);
-
-  UINT32 fontIndex;
-  BOOL exists;
-  HRESULT hr = systemFonts->FindFamilyName(fontFamilyName, &fontIndex, &exists);
-  assert(exists);
-
-  IDWriteFontFamily* fontFamily;
-  systemFonts->GetFontFamily(fontIndex, &fontFamily);
-
-  IDWriteFont* actualFont;
-  fontFamily->GetFirstMatchingFont(DWRITE_FONT_WEIGHT_NORMAL, DWRITE_FONT_STRETCH_NORMAL, DWRITE_FONT_STYLE_NORMAL, &actualFont);
-
-  IDWriteLocalizedStrings* names;
-  BOOL info_string_exists = false;
-  hr = actualFont->GetInformationalStrings(DWRITE_INFORMATIONAL_STRING_FULL_NAME, &names, &info_string_exists);
-  assert(hr == S_OK);
-
-  int count = names->GetCount();
-
-  uint32_t length;
-  names->GetStringLength(0, &length);
-  assert(hr == S_OK);
-
-  /*
-  length += 1; // Need for null terminating char
-  WCHAR* buffer = new WCHAR[length];
-  hr = names->GetString(0, buffer, length);
-  assert(hr == S_OK);
-
-  wprintf(L"String is: %s\n", buffer);
-
-  printf("Stretch: %d, Style: %d, Weight: %d\n",
-    actualFont->GetStretch(), actualFont->GetStyle(), actualFont->GetWeight());
-    */
-
-  IDWriteFontFace* fontFace;
-  actualFont->CreateFontFace(&fontFace);
-
-  return fontFace;
-}
-
-void D2DSetup::CreateGlyphRun(DWRITE_GLYPH_RUN& glyphRun, IDWriteFontFace* fontFace, WCHAR message[], float aScale)
-{
-  //static const WCHAR message[] = L"Hello World Glyph";
-  const int length = wcslen(message);
-
-  UINT16* glyphIndices = new UINT16[length];
-  UINT32* codePoints = new UINT32[length];
-  DWRITE_GLYPH_METRICS* glyphMetrics = new DWRITE_GLYPH_METRICS[length];
-  FLOAT* advances = new FLOAT[length];
-  float fontSize = mFontSize * aScale;
-
-  for (int i = 0; i < length; i++) {
-    codePoints[i] = message[i];
-  }
-
-  fontFace->GetGlyphIndicesW(codePoints, length, glyphIndices);
-  fontFace->GetDesignGlyphMetrics(glyphIndices, length, glyphMetrics);
-
-  DWRITE_FONT_METRICS fontMetrics;
-  fontFace->GetMetrics(&fontMetrics);
-
-  for (int i = 0; i < length; i++) {
-    int advance = glyphMetrics[i].advanceWidth;
-    float realAdvance = ((float) advance * fontSize) / fontMetrics.designUnitsPerEm;
-    advances[i] = realAdvance;
-  }
-
-  DWRITE_GLYPH_OFFSET* offset = new DWRITE_GLYPH_OFFSET[length];
-  for (int i = 0; i < length; i++) {
-    offset[i].advanceOffset = 0;
-    offset[i].ascenderOffset = 0;
-  }
-
-  glyphRun.glyphCount = length;
-  glyphRun.glyphAdvances = advances;
-  glyphRun.fontFace = fontFace;
-  glyphRun.fontEmSize = fontSize;
-  glyphRun.bidiLevel = 0;
-  glyphRun.glyphIndices = glyphIndices;
-  glyphRun.isSideways = FALSE;
-  glyphRun.glyphOffsets = offset;
+  // mFontFaces keeps the face alive, only the first call resolves it.
+  FontFaceRef fontFace = mFontFaces.GetFontFace(fontFamilyName, DWRITE_FONT_WEIGHT_NORMAL,
+                                                DWRITE_FONT_STRETCH_NORMAL,
+                                                DWRITE_FONT_STYLE_NORMAL);
+  assert(fontFace);
+  return fontFace.get();
 }
 
 void D2DSetup::DrawTextWithD2D(DWRITE_GLYPH_RUN& glyphRun, int x, int y,
@@ -489,186 +435,122 @@ void D2DSetup::DrawTextWithD2D(DWRITE_GLYPH_RUN& glyphRun, int x, int y,
   mRenderTarget->EndDraw();
 }
 
-static inline int SkUpscale31To32(int value) {
-  return value + (value >> 4);
-}
-
 // Converts the given rgb 3x1 cleartype alpha mask to the required RGBA_UNOM as required by bitmaps
 // Also blends to draw black text on white
 BYTE* D2DSetup::ConvertToBGRA(BYTE* aRGB, int width, int height, bool useLUT, bool convert, bool useGDILUT)
 {
+  // Every byte is written by the kernel, no need to clear it first.
   int size = width * height * 4;
   BYTE* bitmapImage = (BYTE*)malloc(size);
-  memset(bitmapImage, 0x00, size);
+  ConvertToBGRA(aRGB, width * 3, width, height, bitmapImage, width * 4, 0, 0,
+                useLUT, convert, useGDILUT);
+  return bitmapImage;
+}
 
-  const uint8_t* tableR = this->fPreBlend.fR;
-  const uint8_t* tableG = this->fPreBlend.fG;
-  const uint8_t* tableB = this->fPreBlend.fB;
+// Same as above, but writes into aDest at (aDestX, aDestY), for example an
+// atlas page or a mapped surface. Rows are aSrcStride and aDestStride bytes
+// apart. Makes no allocations and touches every pixel once.
+void D2DSetup::ConvertToBGRA(const BYTE* aRGB, int aSrcStride, int width, int height,
+                             BYTE* aDest, int aDestStride, int aDestX, int aDestY,
+                             bool useLUT, bool convert, bool useGDILUT)
+{
+  TRACE_ZONE("ConvertToBGRA");
+  BYTE* dest = aDest + aDestY * aDestStride + aDestX * 4;
 
-  if (useGDILUT) {
-    tableR = this->fGdiPreBlend.fR;
-    tableG = this->fGdiPreBlend.fG;
-    tableB = this->fGdiPreBlend.fB;
+  if (!IsBlackOnWhite()) {
+    BlendToBGRA(aRGB, aSrcStride, width, height, dest, aDestStride, false,
+                mTextColor, mBackgroundColor, useLUT, convert, useGDILUT);
+    return;
   }
 
-  printf("Final output\n\n");
+  const uint8_t* tableR = nullptr;
+  const uint8_t* tableG = nullptr;
+  const uint8_t* tableB = nullptr;
 
-  for (int y = 0; y < height; y++) {
-    int sourceHeight = y * width * 3;  // expect 3 bytes per pixel
-    int destHeight = y * width * 4;    // convert to 4 bytes per pixel to add alpha opaque channel
-
-    for (int i = 0; i < width; i++) {
-      int destIndex = destHeight + (4 * i);
-      int srcIndex = sourceHeight + (i * 3);
-
-      BYTE r = aRGB[srcIndex];
-      BYTE g = aRGB[srcIndex + 1];
-      BYTE b = aRGB[srcIndex + 2];
-
-      BYTE orig_r = r;
-      BYTE orig_g = g;
-      BYTE orig_b = b;
-
-      BYTE lut_r;
-      BYTE lut_g;
-      BYTE lut_b;
-
-      BYTE short_r;
-      BYTE short_g;
-      BYTE short_b;
-
-      if (useLUT) {
-        lut_r = sk_apply_lut_if<true>(r, tableR);
-        lut_g = sk_apply_lut_if<true>(g, tableG);
-        lut_b = sk_apply_lut_if<true>(b, tableB);
-
-        r = sk_apply_lut_if<true>(r, tableR);
-        g = sk_apply_lut_if<true>(g, tableG);
-        b = sk_apply_lut_if<true>(b, tableB);
-      }
+  if (useLUT) {
+    const SkMaskGamma::PreBlend& preBlend = useGDILUT ? this->fGdiPreBlend : this->fPreBlend;
+    tableR = preBlend.fR;
+    tableG = preBlend.fG;
+    tableB = preBlend.fB;
+  }
 
-      if (convert) {
-        // Taken from http://searchfox.org/mozilla-central/source/gfx/skia/skia/include/core/SkColorPriv.h#654
-        short_r = r >> 3;
-        short_g = g >> 3;
-        short_b = b >> 3;
+  // We always draw black text on white.
+  ConvertClearTypeRect(aRGB, aSrcStride, width, height, dest, aDestStride,
+                       tableR, tableG, tableB, convert,
+                       mCompiledConversion ? &mCompositeLUTs : nullptr);
+}
 
-        r = short_r << 3;
-        g = short_g << 3;
-        b = short_b << 3;
-      }
+// Blends the rgb 3x1 cleartype alpha mask in aTextColor onto aBackground, or
+// onto the pixels already in aOut if aOntoOut is set, and writes BGRA to aOut.
+// Unlike the compiled tables in ConvertToBGRA nothing is built per color, so
+// text in many colors costs the same as black text.
+void D2DSetup::BlendToBGRA(const BYTE* aRGB, int aSrcStride, int width, int height,
+                           BYTE* aOut, int aOutStride, bool aOntoOut,
+                           SkColor aTextColor, SkColor aBackground,
+                           bool useLUT, bool convert, bool useGDILUT)
+{
+  TRACE_ZONE("BlendToBGRA");
+  SkMaskGamma::PreBlend preBlend;
+  if (useLUT) {
+    preBlend = GetPreBlend(aTextColor, useGDILUT);
+  }
 
-      r = Blend(0x00, 0xFF, r);
-      g = Blend(0x00, 0xFF, g);
-      b = Blend(0x00, 0xFF, b);
-
-      // Assume bgr8
-      bitmapImage[destIndex] = b;
-      bitmapImage[destIndex + 1] = g;
-      bitmapImage[destIndex + 2] = r;
-      bitmapImage[destIndex + 3] = 0xFF;
-
-      /*
-      BYTE upscale_r = SkUpscale31To32(short_r);
-      BYTE upscale_g = SkUpscale31To32(short_g);
-      BYTE upscale_b = SkUpscale31To32(short_b);
-
-      BYTE skia_blend_r = SkBlend32(0, 255, upscale_r);
-      BYTE skia_blend_g = SkBlend32(0, 255, upscale_g);
-      BYTE skia_blend_b = SkBlend32(0, 255, upscale_b);
-
-      bitmapImage[destIndex] = skia_blend_r;
-      bitmapImage[destIndex + 1] = skia_blend_g;
-      bitmapImage[destIndex + 2] = skia_blend_b;
-      bitmapImage[destIndex + 3] = 0xFF;
-
-      /*
-      printf("Orig (%u, %u, %u) => LUT (%u, %u, %u) => Short (%u, %u, %u) => Upscale (%u, %u, %u) => final (%u, %u, %u)\n",
-        orig_r, orig_g, orig_b,
-        lut_r, lut_g, lut_b,
-        short_r, short_g, short_b,
-        upscale_r, upscale_g, upscale_b,
-        skia_blend_r, skia_blend_g, skia_blend_b);
-        */
-    }
-    //printf("\n");
+  MaskBlendParams params;
+  params.fForeground = aTextColor;
+  params.fTableR = preBlend.fR;
+  params.fTableG = preBlend.fG;
+  params.fTableB = preBlend.fB;
+  params.fQuantize = convert;
+  params.fMode = mBlendMode;
 
+  BlendClearTypeProc blendProc = GetBlendClearTypeProc();
+  for (int y = 0; y < height; y++) {
+    BYTE* out = aOut + y * aOutStride;
+    blendProc(aRGB + y * aSrcStride, aOntoOut ? out : nullptr, out, width, params, aBackground);
   }
-  return bitmapImage;
 }
 
 BYTE* D2DSetup::BlitDirectly(BYTE* aBGR, int width, int height)
 {
   int size = width * height * 4;
   BYTE* bitmapImage = (BYTE*)malloc(size);
-  memset(bitmapImage, 0x00, size);
-
-  for (int y = 0; y < height; y++) {
-      int sourceHeight = y * width * 4;  // expect 4 bytes per pixel
-      int destHeight = y * width * 4;    // convert to 4 bytes per pixel to add alpha opaque channel
-
-      for (int i = 0; i < width; i++) {
-          int srcIndex = sourceHeight + (4 * i);
-          int destIndex = destHeight + (4 * i);
-
-          // Assuming a BGR format
-          BYTE b = aBGR[srcIndex];
-          BYTE g = aBGR[srcIndex + 1];
-          BYTE r = aBGR[srcIndex + 2];
-
-          // Assume BGR8
-          bitmapImage[destIndex] = b;
-          bitmapImage[destIndex + 1] = g;
-          bitmapImage[destIndex + 2] = r;
-          bitmapImage[destIndex + 3] = 0xFF;
-      }
-  }
-
+  BlitDirectly(aBGR, width * 4, width, height, bitmapImage, width * 4, 0, 0);
   return bitmapImage;
 }
 
-// This is what SKia does to convert Cleartype to Grayscale.
-// Basically takes each channel, averages it, and gamma corrects with the G channel.
+void D2DSetup::BlitDirectly(const BYTE* aBGR, int aSrcStride, int width, int height,
+                            BYTE* aDest, int aDestStride, int aDestX, int aDestY)
+{
+  // Expects 4 bytes per pixel.
+  BlitOpaqueRect(aBGR, aSrcStride, width, height,
+                 aDest + aDestY * aDestStride + aDestX * 4, aDestStride);
+}
+
 BYTE* D2DSetup::BlendSkiaGrayscale(BYTE* aBGR, int width, int height)
 {
   int size = width * height * 4;
   BYTE* bitmapImage = (BYTE*)malloc(size);
-  memset(bitmapImage, 0x00, size);
-
-  const uint8_t* tableG = this->fPreBlend.fG;
-
-  for (int y = 0; y < height; y++) {
-    int sourceHeight = y * width * 3;  // expect 3 bytes per pixel
-    int destHeight = y * width * 4;    // convert to 4 bytes per pixel to add alpha opaque channel
-
-    for (int i = 0; i < width; i++) {
-      int destIndex = destHeight + (4 * i);
-      int srcIndex = sourceHeight + (i * 3);
-
-      BYTE r = aBGR[srcIndex];
-      BYTE g = aBGR[srcIndex + 1];
-      BYTE b = aBGR[srcIndex + 2];
-
-      // This is what Skia does
-      int average = (r + g + b) / 3;
-      BYTE pixel = sk_apply_lut_if<true>(r, tableG);
-      pixel = Blend(0x00, 0xFF, pixel);
-
-      bitmapImage[destIndex] = pixel;
-      bitmapImage[destIndex + 1] = pixel;
-      bitmapImage[destIndex + 2] = pixel;
-      bitmapImage[destIndex + 3] = 0xFF;
-    }
-  }
-
+  BlendSkiaGrayscale(aBGR, width * 3, width, height, bitmapImage, width * 4, 0, 0);
   return bitmapImage;
 }
 
+// This is what SKia does to convert Cleartype to Grayscale.
+// Basically takes each channel, averages it, and gamma corrects with the G channel.
+void D2DSetup::BlendSkiaGrayscale(const BYTE* aBGR, int aSrcStride, int width, int height,
+                                  BYTE* aDest, int aDestStride, int aDestX, int aDestY)
+{
+  TRACE_ZONE("BlendSkiaGrayscale");
+  SkMaskGamma::PreBlend preBlend = GetPreBlend(mTextColor, false);
+  BlendGrayscaleRect(aBGR, aSrcStride, width, height,
+                     aDest + aDestY * aDestStride + aDestX * 4, aDestStride,
+                     preBlend.fG, mTextColor, mBackgroundColor);
+}
+
 void D2DSetup::CreateBitmap(ID2D1RenderTarget* aRenderTarget, ID2D1Bitmap** aOutBitmap,
                             int width, int height,
-                            BYTE* aSource, uint32_t aStride)
+                            BYTE* aSource, uint32_t aStride, DXGI_FORMAT aFormat)
 {
-  D2D1_BITMAP_PROPERTIES properties = { DXGI_FORMAT_B8G8R8A8_UNORM,  D2D1_ALPHA_MODE_PREMULTIPLIED };
+  D2D1_BITMAP_PROPERTIES properties = { aFormat,  D2D1_ALPHA_MODE_PREMULTIPLIED };
   properties.dpiX = mDpiX;
   properties.dpiY = mDpiY;
 
@@ -676,6 +558,7 @@ void D2DSetup::CreateBitmap(ID2D1RenderTarget* aRenderTarget, ID2D1Bitmap** aOut
   HRESULT hr;
   
   if (aSource) {
+    TRACE_ZONE("UploadBitmap");
     hr = aRenderTarget->CreateBitmap(bitmapSize, aSource, aStride, properties, aOutBitmap);
   } else {
     hr = aRenderTarget->CreateBitmap(bitmapSize, properties, aOutBitmap);
@@ -686,23 +569,24 @@ void D2DSetup::CreateBitmap(ID2D1RenderTarget* aRenderTarget, ID2D1Bitmap** aOut
 
 void D2DSetup::DrawBitmap(BYTE* image, float width, float height, int x, int y, RECT bounds)
 {
-  ID2D1Bitmap* bitmap = nullptr;
-  uint32_t stride = (uint32_t)width * 4;
-  CreateBitmap(mRenderTarget, &bitmap, width, height, image, width * 4);
-
-  D2D1_SIZE_F bitmapSize = bitmap->GetSize();
-
-  // Finally draw the bitmap somewhere
-  D2D1_RECT_F destRect;
-  destRect.left = x;
-  destRect.right = x + bitmapSize.width;
-  destRect.top = y;
-  destRect.bottom = y + bitmapSize.height;
+  // x and y are in DIPs, the surface works in pixels.
+  float scale = GetScaleFactor();
+  mSurface->DrawBitmap(image, (int32_t)width * 4, (int32_t)width, (int32_t)height,
+                       (int32_t)(x * scale + 0.5f), (int32_t)(y * scale + 0.5f));
+}
 
-  float opacity = 1.0;
-  mRenderTarget->DrawBitmap(bitmap, &destRect, opacity);
+ID2D1SolidColorBrush* D2DSetup::GetTextBrush()
+{
+  D2D1::ColorF color(mTextColor & 0x00FFFFFF, SkColorGetA(mTextColor) / 255.0f);
+  mTextBrush->SetColor(color);
+  return mTextBrush;
+}
 
-  bitmap->Release();
+void D2DSetup::DrawOpacityMask(BYTE* aMask, int width, int height, int x, int y)
+{
+  float scale = GetScaleFactor();
+  mSurface->FillOpacityMask(aMask, width, width, height,
+                            (int32_t)(x * scale + 0.5f), (int32_t)(y * scale + 0.5f), mTextColor);
 }
 
 void D2DSetup::DrawGrayscaleWithBitmap(DWRITE_GLYPH_RUN& glyphRun, int x, int y)
@@ -713,8 +597,7 @@ void D2DSetup::DrawGrayscaleWithBitmap(DWRITE_GLYPH_RUN& glyphRun, int x, int y)
   QueryPerformanceCounter(&start);
 
   RECT bounds;
-  IDWriteGlyphRunAnalysis* analysis;
-  GetGlyphBounds(glyphRun, bounds, &analysis);
+  GetCachedGlyphBounds(glyphRun, bounds);
 
   float width = bounds.right - bounds.left;
   float height = bounds.bottom - bounds.top;
@@ -812,94 +695,473 @@ void D2DSetup::DrawGrayscaleWithBitmap(DWRITE_GLYPH_RUN& glyphRun, int x, int y)
   mRenderTarget->EndDraw();
 }
 
+// Grayscale text stays one byte per pixel from the rasterizer to the GPU:
+// A8 masks in the glyph cache, the G PreBlend applied in place and an A8
+// bitmap that D2D fills in the text color.
 void D2DSetup::DrawGrayscaleWithLUT(DWRITE_GLYPH_RUN& glyphRun, int x, int y) {
+  TRACE_ZONE("DrawGrayscaleWithLUT");
   mRenderTarget->BeginDraw();
 
+  if (mUseGlyphAtlas && DrawGrayscaleWithAtlas(glyphRun, x, y)) {
+    TRACE_ZONE("EndDraw");
+    mRenderTarget->EndDraw();
+    return;
+  }
+
   LARGE_INTEGER start;
   QueryPerformanceCounter(&start);
 
   RECT bounds;
-  BYTE* bits = GetAlphaTexture(glyphRun, bounds,
-                               DWRITE_RENDERING_MODE_CLEARTYPE_NATURAL,
-                               DWRITE_MEASURING_MODE_NATURAL);
-  float width = bounds.right - bounds.left;
-  float height = bounds.bottom - bounds.top;
+  BYTE* coverage = GetAlphaTexture(glyphRun, bounds,
+                                   DWRITE_RENDERING_MODE_CLEARTYPE_NATURAL,
+                                   DWRITE_MEASURING_MODE_NATURAL,
+                                   GLYPH_MASK_A8);
+  int pixelWidth = bounds.right - bounds.left;
+  int pixelHeight = bounds.bottom - bounds.top;
 
-  BYTE* bitmapImage = BlendSkiaGrayscale(bits, width, height);
+  {
+    TRACE_ZONE("ApplyTableA8");
+    SkMaskGamma::PreBlend preBlend = GetPreBlend(mTextColor, false);
+    ApplyTableA8(coverage, coverage, pixelWidth * pixelHeight, preBlend.fG);
+  }
 
   LARGE_INTEGER end;
   QueryPerformanceCounter(&end);
   PrintElapsedTime(start, end, "Grayscale LUT");
 
-  DrawBitmap(bitmapImage, width, height, x, y, bounds);
+  DrawOpacityMask(coverage, pixelWidth, pixelHeight, x, y);
 
-  free(bits);
-  free(bitmapImage);
+  TRACE_ZONE("EndDraw");
   mRenderTarget->EndDraw();
 }
 
 void D2DSetup::GetGlyphBounds(DWRITE_GLYPH_RUN& aRun, RECT& aOutBounds,
                               IDWriteGlyphRunAnalysis** aOutAnalysis,
                               DWRITE_RENDERING_MODE aRenderMode,
-                              DWRITE_MEASURING_MODE aMeasureMode)
+                              DWRITE_MEASURING_MODE aMeasureMode,
+                              float aOriginX)
 {
   // Surprisingly, we don't have to account for the dpi here in the glyph run analysis,
   // we do that in the bitmap and render target instead.
   HRESULT hr = mDwriteFactory->CreateGlyphRunAnalysis(&aRun, 1.0f, nullptr, aRenderMode,
-                                                      aMeasureMode, 0.0f, 0.0f, aOutAnalysis);
+                                                      aMeasureMode, aOriginX, 0.0f, aOutAnalysis);
   assert(hr == S_OK);
 
   hr = (*aOutAnalysis)->GetAlphaTextureBounds(DWRITE_TEXTURE_CLEARTYPE_3x1, &aOutBounds);
   assert(hr == S_OK);
 }
 
+void D2DSetup::GetGlyphMasks(DWRITE_GLYPH_RUN& aRun, std::vector<PlacedGlyph>& aOutGlyphs,
+                             DWRITE_RENDERING_MODE aRenderMode,
+                             DWRITE_MEASURING_MODE aMeasureMode,
+                             GlyphMaskFormat aFormat,
+                             std::vector<GlyphKey>* aOutKeys)
+{
+  static_assert(sizeof(GlyphOffset) == sizeof(DWRITE_GLYPH_OFFSET),
+                "GlyphOffset must match DWRITE_GLYPH_OFFSET");
+
+  DWriteGlyphRasterizer rasterizer(mDwriteFactory, aRun.fontFace,
+                                   mFontFaces.GetFontFaceId(aRun.fontFace), aRun.fontEmSize,
+                                   aRenderMode, aMeasureMode);
+  const bool rightToLeft = (aRun.bidiLevel & 1) != 0;
+  mRasterBatch.AddRun(rasterizer, mGlyphCache, aFormat, aRun.glyphIndices, aRun.glyphAdvances,
+                      (const GlyphOffset*)aRun.glyphOffsets, aRun.glyphCount, rightToLeft);
+  RasterizeQueuedGlyphs();
+  GetGlyphRunMasks(rasterizer, mGlyphCache, aFormat, aRun.glyphIndices, aRun.glyphAdvances,
+                   (const GlyphOffset*)aRun.glyphOffsets, aRun.glyphCount,
+                   rightToLeft, aOutGlyphs, aOutKeys);
+}
+
+void D2DSetup::QueueGlyphMasks(DWRITE_GLYPH_RUN& aRun, DWRITE_RENDERING_MODE aRenderMode,
+                               DWRITE_MEASURING_MODE aMeasureMode,
+                               GlyphMaskFormat aFormat)
+{
+  DWriteGlyphRasterizer rasterizer(mDwriteFactory, aRun.fontFace,
+                                   mFontFaces.GetFontFaceId(aRun.fontFace), aRun.fontEmSize,
+                                   aRenderMode, aMeasureMode);
+  if (mQueuedRasterizerCount < mQueuedRasterizers.size()) {
+    *mQueuedRasterizers[mQueuedRasterizerCount] = rasterizer;
+  } else {
+    mQueuedRasterizers.push_back(
+      std::unique_ptr<DWriteGlyphRasterizer>(new DWriteGlyphRasterizer(rasterizer)));
+  }
+
+  size_t pending = mRasterBatch.PendingCount();
+  mRasterBatch.AddRun(*mQueuedRasterizers[mQueuedRasterizerCount], mGlyphCache, aFormat,
+                      aRun.glyphIndices, aRun.glyphAdvances,
+                      (const GlyphOffset*)aRun.glyphOffsets, aRun.glyphCount,
+                      (aRun.bidiLevel & 1) != 0);
+  // Runs that are all cached leave the rasterizer free for the next one.
+  if (mRasterBatch.PendingCount() != pending) {
+    mQueuedRasterizerCount++;
+  }
+}
+
+void D2DSetup::RasterizeQueuedGlyphs()
+{
+  mRasterBatch.Rasterize(mGlyphCache);
+  mQueuedRasterizerCount = 0;
+}
+
+void D2DSetup::GetCachedGlyphBounds(DWRITE_GLYPH_RUN& aRun, RECT& aOutBounds,
+                                    DWRITE_RENDERING_MODE aRenderMode,
+                                    DWRITE_MEASURING_MODE aMeasureMode)
+{
+  std::vector<PlacedGlyph>& glyphs = mRunGlyphs;
+  GetGlyphMasks(aRun, glyphs, aRenderMode, aMeasureMode);
+
+  IntRect bounds = GetGlyphRunBounds(glyphs);
+  aOutBounds.left = bounds.fLeft;
+  aOutBounds.top = bounds.fTop;
+  aOutBounds.right = bounds.fRight;
+  aOutBounds.bottom = bounds.fBottom;
+  glyphs.clear();
+}
+
 BYTE* D2DSetup::GetAlphaTexture(DWRITE_GLYPH_RUN& aRun, RECT& aOutBounds,
                                 DWRITE_RENDERING_MODE aRenderMode,
-                                DWRITE_MEASURING_MODE aMeasureMode)
+                                DWRITE_MEASURING_MODE aMeasureMode,
+                                GlyphMaskFormat aFormat)
 {
-  IDWriteGlyphRunAnalysis* analysis;
-  GetGlyphBounds(aRun, aOutBounds, &analysis, aRenderMode, aMeasureMode);
+  // Composite the run from per glyph masks, only glyphs we have not seen yet
+  // go through IDWriteGlyphRunAnalysis.
+  std::vector<PlacedGlyph>& glyphs = mRunGlyphs;
+  GetGlyphMasks(aRun, glyphs, aRenderMode, aMeasureMode, aFormat);
 
-  float scale = GetScaleFactor();
+  IntRect bounds = GetGlyphRunBounds(glyphs);
+  aOutBounds.left = bounds.fLeft;
+  aOutBounds.top = bounds.fTop;
+  aOutBounds.right = bounds.fRight;
+  aOutBounds.bottom = bounds.fBottom;
 
-  long width = aOutBounds.right - aOutBounds.left;
-  long height = aOutBounds.bottom - aOutBounds.top;
+  // DWRITE_TEXTURE_CLEARTYPE uses RGB, but we use BGR everywhere else.
+  const int32_t bytesPerPixel = GlyphMaskBytesPerPixel(aFormat);
+  size_t bufferSize = (size_t)bounds.Width() * bounds.Height() * bytesPerPixel;
+  BYTE* image = mFrameArena.AllocateArray<BYTE>(bufferSize);
+  {
+    TRACE_ZONE("CompositeGlyphRun");
+    CompositeGlyphRun(glyphs, bounds, bytesPerPixel, image);
+  }
+  glyphs.clear();
+  return image;
+}
 
-  int bufferSize = width * height * 3;
-  BYTE* image = (BYTE*)malloc(bufferSize);
-  memset(image, 0xFF, bufferSize);
+void D2DSetup::PrintGlyphCacheStats()
+{
+  printf("Glyph cache: %llu hits, %llu misses, %llu evictions, %zu glyphs, %zu / %zu bytes\n",
+         (unsigned long long)mGlyphCache.Hits(),
+         (unsigned long long)mGlyphCache.Misses(),
+         (unsigned long long)mGlyphCache.Evictions(),
+         mGlyphCache.Count(), mGlyphCache.ByteSize(), mGlyphCache.ByteBudget());
+}
 
-  // DWRITE_TEXTURE_CLEARTYPE uses RGB, but we use BGR everywhere else.
-  HRESULT hr = analysis->CreateAlphaTexture(DWRITE_TEXTURE_TYPE::DWRITE_TEXTURE_CLEARTYPE_3x1, &aOutBounds, image, bufferSize);
-  assert(hr == S_OK);
+static void
+PrintAtlasStats(const char* aName, const GlyphAtlas& aAtlas)
+{
+  printf("%s: %zu glyphs on %d pages, %.1f%% packed, %u evictions this frame\n",
+         aName, aAtlas.EntryCount(), aAtlas.PageCount(),
+         aAtlas.PackingEfficiency() * 100.0, aAtlas.Stats().fFrameEvictions);
+}
 
-  analysis->Release();
-  return image;
+void D2DSetup::PrintGlyphAtlasStats()
+{
+  PrintAtlasStats("Glyph atlas", mGlyphAtlas);
+  PrintAtlasStats("Glyph atlas (LCD16)", mLcd16Atlas);
+  PrintAtlasStats("Glyph atlas (A8)", mGrayscaleAtlas);
+}
+
+void D2DSetup::PrintFrameArenaStats()
+{
+  printf("Frame arena: %zu bytes this frame, %zu high water, %zu bytes in %zu chunks, %llu chunk allocations\n",
+         mFrameArena.BytesUsed(), mFrameArena.HighWaterMark(),
+         mFrameArena.Capacity(), mFrameArena.ChunkCount(),
+         (unsigned long long)mFrameArena.ChunkAllocations());
+}
+
+void D2DSetup::EndFrame()
+{
+  mRunBuilder.Clear();
+  mFrameArena.Reset();
 }
 
 void D2DSetup::DrawWithBitmap(DWRITE_GLYPH_RUN& glyphRun, int x, int y, bool useLUT, bool convert,
                 DWRITE_RENDERING_MODE aRenderMode, DWRITE_MEASURING_MODE aMeasureMode,
                 bool aClear, bool useGDILUT)
 {
+  TRACE_ZONE("DrawWithBitmap");
   mRenderTarget->BeginDraw();
 
   if (aClear) {
     mRenderTarget->Clear(D2D1::ColorF(D2D1::ColorF::White));
   }
 
+  if (mUseGlyphAtlas &&
+      DrawWithAtlas(glyphRun, x, y, useLUT, convert, aRenderMode, aMeasureMode, useGDILUT)) {
+    TRACE_ZONE("EndDraw");
+    mRenderTarget->EndDraw();
+    return;
+  }
+
   RECT bounds;
   BYTE* bits = GetAlphaTexture(glyphRun, bounds, aRenderMode, aMeasureMode);
   long width = bounds.right - bounds.left;
   long height = bounds.bottom - bounds.top;
 
-  BYTE* bitmapImage = ConvertToBGRA(bits, width, height, useLUT, convert, useGDILUT);
+  BYTE* bitmapImage = mFrameArena.AllocateArray<BYTE>((size_t)width * height * 4);
+  ConvertToBGRA(bits, width * 3, width, height, bitmapImage, width * 4, 0, 0,
+                useLUT, convert, useGDILUT);
   DrawBitmap(bitmapImage, width, height, x, y, bounds);
 
-  free(bitmapImage);
-  free(bits);
+  TRACE_ZONE("EndDraw");
   mRenderTarget->EndDraw();
 }
 
+bool D2DSetup::DrawWithAtlas(DWRITE_GLYPH_RUN& glyphRun, int x, int y, bool useLUT, bool convert,
+                DWRITE_RENDERING_MODE aRenderMode, DWRITE_MEASURING_MODE aMeasureMode,
+                bool useGDILUT)
+{
+  // Glyph boxes are drawn with a MIN blend below, which only keeps the text
+  // when it is darker than the background box around the neighbouring
+  // glyph. Anything else is composited into one box by the caller, as is
+  // everything on a target without the device context for the blend.
+  if (!IsDarkOnLight() || !mRenderTargetContext) {
+    return false;
+  }
+
+  // Quantized black on white only depends on the 5 bits of coverage per
+  // channel LCD16 keeps, so those glyphs are stored packed.
+  bool lcd16 = convert && IsBlackOnWhite();
+  GlyphAtlas& atlas = lcd16 ? mLcd16Atlas : mGlyphAtlas;
+  std::vector<ID2D1Bitmap*>& atlasPages = lcd16 ? mLcd16AtlasPages : mAtlasPages;
+
+  // Every draw is its own frame. The previous draw has already been flushed
+  // by EndDraw, so its glyphs are free to be evicted.
+  atlas.BeginFrame();
+
+  // Reused between draws so steady state drawing does not allocate.
+  std::vector<PlacedGlyph>& glyphs = mRunGlyphs;
+  std::vector<GlyphKey>& keys = mRunGlyphKeys;
+  GetGlyphMasks(glyphRun, glyphs, aRenderMode, aMeasureMode,
+                GLYPH_MASK_CLEARTYPE_3x1, &keys);
+  IntRect runBounds = GetGlyphRunBounds(glyphs);
+
+  // The stored pixels depend on how ConvertToBGRA was asked to convert them.
+  uint32_t variant = (useLUT ? 1 : 0) | (convert ? 2 : 0) | (useGDILUT ? 4 : 0) |
+                     (mCompiledConversion ? 8 : 0) | ((uint32_t)mBlendMode << 4);
+
+  SkMaskGamma::PreBlend preBlend;
+  if (lcd16 && useLUT) {
+    preBlend = useGDILUT ? fGdiPreBlend : fPreBlend;
+  }
+
+  AtlasEntry* entries = mFrameArena.AllocateArray<AtlasEntry>(glyphs.size());
+  for (size_t i = 0; i < glyphs.size(); i++) {
+    const GlyphMask* mask = glyphs[i].fMask.get();
+    if (mask->IsEmpty()) {
+      continue;
+    }
+
+    AtlasKey key;
+    key.fGlyph = keys[i];
+    key.fVariant = variant;
+    key.fForeground = mTextColor;
+    key.fBackground = mBackgroundColor;
+    if (atlas.Lookup(key, &entries[i])) {
+      continue;
+    }
+
+    // Convert straight into the atlas page, no staging copy.
+    BYTE* pixels;
+    if (!atlas.Reserve(key, mask->fWidth, mask->fHeight, &entries[i], &pixels)) {
+      glyphs.clear();
+      return false;
+    }
+    if (lcd16) {
+      TRACE_ZONE("PackLCD16");
+      PackLCD16Proc packProc = GetPackLCD16Proc();
+      for (int32_t row = 0; row < mask->fHeight; row++) {
+        packProc(mask->fBits + row * mask->fWidth * 3,
+                 (uint16_t*)(pixels + row * atlas.PageStride()), mask->fWidth,
+                 preBlend.fR, preBlend.fG, preBlend.fB);
+      }
+    } else {
+      ConvertToBGRA(mask->fBits, mask->fWidth * 3, mask->fWidth, mask->fHeight,
+                    pixels, atlas.PageStride(), 0, 0, useLUT, convert, useGDILUT);
+    }
+  }
+
+  UploadAtlasPages(atlas, atlasPages, DXGI_FORMAT_B8G8R8A8_UNORM);
+
+  // Glyph boxes are the opaque background around darker text, so
+  // overlapping boxes keep the darker pixel instead of painting over their
+  // neighbours.
+  ID2D1DeviceContext* context = mRenderTargetContext;
+  context->SetPrimitiveBlend(D2D1_PRIMITIVE_BLEND_MIN);
+
+  // The atlas works in pixels, D2D in DIPs.
+  float scale = GetScaleFactor();
+  for (size_t i = 0; i < glyphs.size(); i++) {
+    if (glyphs[i].fMask->IsEmpty()) {
+      continue;
+    }
+
+    const AtlasEntry& entry = entries[i];
+    IntRect glyphBounds = glyphs[i].Bounds();
+
+    D2D1_RECT_F destRect;
+    destRect.left = x + (glyphBounds.fLeft - runBounds.fLeft) / scale;
+    destRect.top = y + (glyphBounds.fTop - runBounds.fTop) / scale;
+    destRect.right = destRect.left + entry.fRect.Width() / scale;
+    destRect.bottom = destRect.top + entry.fRect.Height() / scale;
+
+    D2D1_RECT_F sourceRect = D2D1::RectF(entry.fRect.fLeft / scale, entry.fRect.fTop / scale,
+                                         entry.fRect.fRight / scale, entry.fRect.fBottom / scale);
+
+    context->DrawBitmap(atlasPages[entry.fPage], destRect, 1.0f,
+                        D2D1_INTERPOLATION_MODE_NEAREST_NEIGHBOR, sourceRect);
+  }
+
+  context->SetPrimitiveBlend(D2D1_PRIMITIVE_BLEND_SOURCE_OVER);
+  glyphs.clear();
+  return true;
+}
+
+bool D2DSetup::DrawGrayscaleWithAtlas(DWRITE_GLYPH_RUN& glyphRun, int x, int y)
+{
+  mGrayscaleAtlas.BeginFrame();
+
+  std::vector<PlacedGlyph>& glyphs = mRunGlyphs;
+  std::vector<GlyphKey>& keys = mRunGlyphKeys;
+  GetGlyphMasks(glyphRun, glyphs, DWRITE_RENDERING_MODE_CLEARTYPE_NATURAL,
+                DWRITE_MEASURING_MODE_NATURAL, GLYPH_MASK_A8, &keys);
+  IntRect runBounds = GetGlyphRunBounds(glyphs);
+
+  // The stored coverage only depends on the table picked for the text
+  // color, the color itself is applied when drawing.
+  SkMaskGamma::PreBlend preBlend = GetPreBlend(mTextColor, false);
+
+  AtlasEntry* entries = mFrameArena.AllocateArray<AtlasEntry>(glyphs.size());
+  for (size_t i = 0; i < glyphs.size(); i++) {
+    const GlyphMask* mask = glyphs[i].fMask.get();
+    if (mask->IsEmpty()) {
+      continue;
+    }
+
+    AtlasKey key;
+    key.fGlyph = keys[i];
+    key.fVariant = 0;
+    key.fForeground = SkMaskGamma::CanonicalColor(mTextColor);
+    key.fBackground = 0;
+    if (mGrayscaleAtlas.Lookup(key, &entries[i])) {
+      continue;
+    }
+
+    BYTE* pixels;
+    if (!mGrayscaleAtlas.Reserve(key, mask->fWidth, mask->fHeight, &entries[i], &pixels)) {
+      glyphs.clear();
+      return false;
+    }
+    TRACE_ZONE("ApplyTableA8");
+    for (int32_t row = 0; row < mask->fHeight; row++) {
+      ApplyTableA8(mask->fBits + row * mask->fWidth, pixels + row * mGrayscaleAtlas.PageStride(),
+                   mask->fWidth, preBlend.fG);
+    }
+  }
+
+  UploadAtlasPages(mGrayscaleAtlas, mGrayscaleAtlasPages, DXGI_FORMAT_A8_UNORM);
+
+  ID2D1SolidColorBrush* brush = GetTextBrush();
+  D2D1_ANTIALIAS_MODE antialiasMode = mRenderTarget->GetAntialiasMode();
+  mRenderTarget->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+
+  // Outside the glyphs the masks are empty, so overlapping boxes need no
+  // special blending.
+  float scale = GetScaleFactor();
+  for (size_t i = 0; i < glyphs.size(); i++) {
+    if (glyphs[i].fMask->IsEmpty()) {
+      continue;
+    }
+
+    const AtlasEntry& entry = entries[i];
+    IntRect glyphBounds = glyphs[i].Bounds();
+
+    D2D1_RECT_F destRect;
+    destRect.left = x + (glyphBounds.fLeft - runBounds.fLeft) / scale;
+    destRect.top = y + (glyphBounds.fTop - runBounds.fTop) / scale;
+    destRect.right = destRect.left + entry.fRect.Width() / scale;
+    destRect.bottom = destRect.top + entry.fRect.Height() / scale;
+
+    D2D1_RECT_F sourceRect = D2D1::RectF(entry.fRect.fLeft / scale, entry.fRect.fTop / scale,
+                                         entry.fRect.fRight / scale, entry.fRect.fBottom / scale);
+
+    mRenderTarget->FillOpacityMask(mGrayscaleAtlasPages[entry.fPage], brush,
+                                   D2D1_OPACITY_MASK_CONTENT_TEXT_GRAYSCALE,
+                                   &destRect, &sourceRect);
+  }
+
+  mRenderTarget->SetAntialiasMode(antialiasMode);
+  glyphs.clear();
+  return true;
+}
+
+// Copies the parts of the atlas pages that changed since the last upload
+// into their D2D bitmaps, creating bitmaps for new pages. Pages of 2 byte
+// pixels hold LCD16 and are expanded to BGRA on the way.
+void D2DSetup::UploadAtlasPages(GlyphAtlas& aAtlas, std::vector<ID2D1Bitmap*>& aPages,
+                                DXGI_FORMAT aFormat)
+{
+  TRACE_ZONE("UploadAtlasPages");
+  for (int32_t page = 0; page < aAtlas.PageCount(); page++) {
+    if (page == (int32_t)aPages.size()) {
+      ID2D1Bitmap* bitmap = nullptr;
+      CreateBitmap(mRenderTarget, &bitmap, kAtlasPageSize, kAtlasPageSize, nullptr, 0, aFormat);
+      aPages.push_back(bitmap);
+    }
+
+    const IntRect& dirty = aAtlas.PageDirtyRect(page);
+    if (dirty.IsEmpty()) {
+      continue;
+    }
+
+    const uint8_t* source = aAtlas.PagePixels(page) +
+                            dirty.fTop * aAtlas.PageStride() +
+                            dirty.fLeft * aAtlas.BytesPerPixel();
+    int32_t sourceStride = aAtlas.PageStride();
+    if (aAtlas.BytesPerPixel() == 2) {
+      BYTE* expanded = mFrameArena.AllocateArray<BYTE>((size_t)dirty.Width() * dirty.Height() * 4);
+      ConvertLCD16Rect((const uint16_t*)source, aAtlas.PageStride(), dirty.Width(), dirty.Height(),
+                       expanded, dirty.Width() * 4);
+      source = expanded;
+      sourceStride = dirty.Width() * 4;
+    }
+    D2D1_RECT_U destRect = D2D1::RectU(dirty.fLeft, dirty.fTop, dirty.fRight, dirty.fBottom);
+    HRESULT hr = aPages[page]->CopyFromMemory(&destRect, source, sourceStride);
+    assert(hr == S_OK);
+    aAtlas.ClearDirtyRect(page);
+  }
+}
+
+void D2DSetup::ReleaseGlyphAtlas()
+{
+  for (size_t i = 0; i < mAtlasPages.size(); i++) {
+    mAtlasPages[i]->Release();
+  }
+  mAtlasPages.clear();
+  mGlyphAtlas.Clear();
+
+  for (size_t i = 0; i < mLcd16AtlasPages.size(); i++) {
+    mLcd16AtlasPages[i]->Release();
+  }
+  mLcd16AtlasPages.clear();
+  mLcd16Atlas.Clear();
+
+  for (size_t i = 0; i < mGrayscaleAtlasPages.size(); i++) {
+    mGrayscaleAtlasPages[i]->Release();
+  }
+  mGrayscaleAtlasPages.clear();
+  mGrayscaleAtlas.Clear();
+}
+
 void D2DSetup::AlternateText(int count) {
   IDWriteFontFace* fontFace = GetFontFace();
   int x = 100; int y = 100;
@@ -908,7 +1170,7 @@ void D2DSetup::AlternateText(int count) {
   {
     WCHAR d2dMessage[] = L"The Donald Trump GDI";
     DWRITE_GLYPH_RUN d2dGlyphRun;
-    CreateGlyphRun(d2dGlyphRun, fontFace, d2dMessage);
+    mRunBuilder.GetRun(mRunBuilder.AddRun(fontFace, mFontSize, d2dMessage), &d2dGlyphRun);
     DrawTextWithD2D(d2dGlyphRun, x, y, mGDIParams, true);
     break;
   }
@@ -923,7 +1185,7 @@ void D2DSetup::AlternateText(int count) {
     */
     WCHAR d2dLutChop[] = L"The Donald Trump GDI LUT";
     DWRITE_GLYPH_RUN d2dLutChopRun;
-    CreateGlyphRun(d2dLutChopRun, fontFace, d2dLutChop);
+    mRunBuilder.GetRun(mRunBuilder.AddRun(fontFace, mFontSize, d2dLutChop), &d2dLutChopRun);
     DrawWithBitmap(d2dLutChopRun, x, y, true, true,
             DWRITE_RENDERING_MODE_GDI_CLASSIC,
             DWRITE_MEASURING_MODE_NATURAL,
@@ -931,6 +1193,8 @@ void D2DSetup::AlternateText(int count) {
     break;
   }
   } // end switch
+
+  EndFrame();
 }
 
 void D2DSetup::DrawWithMask()
@@ -939,13 +1203,11 @@ void D2DSetup::DrawWithMask()
   const int x = 100;
   const int y = 100;
 
-  DWRITE_RENDERING_MODE recommendedMode = DWRITE_RENDERING_MODE_CLEARTYPE_NATURAL;
-  HRESULT hr = fontFace->GetRecommendedRenderingMode(mFontSize,
-    1.0f,
-    DWRITE_MEASURING_MODE_NATURAL, // We use this in gecko
-    mGrayscaleParams,
-    &recommendedMode);
-  assert(hr == S_OK);
+  DWRITE_RENDERING_MODE recommendedMode =
+    mFontFaces.GetRecommendedRenderingMode(fontFace, mFontSize,
+                                           1.0f,
+                                           DWRITE_MEASURING_MODE_NATURAL, // We use this in gecko
+                                           mGrayscaleParams);
   printf("Recommended mode is: %d\n", recommendedMode);
   float scale = GetScaleFactor();
 
@@ -957,8 +1219,20 @@ void D2DSetup::DrawWithMask()
   */
 
   WCHAR d2dMessage[] = L"The Donald Trump D2D";
+  WCHAR sym[] = L" T";
+
+  // Build both runs in one batch, the views stay valid until EndFrame.
+  const WCHAR* messages[] = { d2dMessage, sym };
+  uint32_t firstRun = mRunBuilder.AddRuns(fontFace, mFontSize, messages, ARRAYSIZE(messages));
   DWRITE_GLYPH_RUN d2dGlyphRun;
-  CreateGlyphRun(d2dGlyphRun, fontFace, d2dMessage);
+  DWRITE_GLYPH_RUN symRun;
+  mRunBuilder.GetRun(firstRun, &d2dGlyphRun);
+  mRunBuilder.GetRun(firstRun + 1, &symRun);
+
+  // Rasterize the glyphs of every run drawn from masks before the first
+  // draw, so they are spread over mRasterPool's threads in one go.
+  QueueGlyphMasks(symRun, DWRITE_RENDERING_MODE_GDI_CLASSIC, DWRITE_MEASURING_MODE_NATURAL);
+  RasterizeQueuedGlyphs();
 
   LARGE_INTEGER start;
   LARGE_INTEGER end;
@@ -970,15 +1244,15 @@ void D2DSetup::DrawWithMask()
   WCHAR bitmapMessage[] = L"The Donald Trump Bitmap";
   DWRITE_GLYPH_RUN bitmapGlyphRun;
   // We have to scale when we draw with bitmaps but not with d2d. D2D handles the scale for us automatically.
-  //CreateGlyphRun(bitmapGlyphRun, fontFace, bitmapMessage, scale);
+  //mRunBuilder.GetRun(mRunBuilder.AddRun(fontFace, mFontSize * scale, bitmapMessage), &bitmapGlyphRun);
   //DrawWithBitmap(bitmapGlyphRun, x, y + 20, true, true);
   //DrawGrayscaleWithBitmap(bitmapGlyphRun, x, y + 40);
   //DrawGrayscaleWithLUT(bitmapGlyphRun, x, y + 20);
 
-  WCHAR sym[] = L" T";
-  DWRITE_GLYPH_RUN symRun;
-  CreateGlyphRun(symRun, fontFace, sym);
   DrawWithBitmap(symRun, x, y + 20, true, true, DWRITE_RENDERING_MODE_GDI_CLASSIC);
+  PrintGlyphCacheStats();
+  PrintGlyphAtlasStats();
+  PrintFrameArenaStats();
 
   /*
   WCHAR gdi[] = L"The Donald Trump Sucks LUT";
@@ -986,12 +1260,16 @@ void D2DSetup::DrawWithMask()
   CreateGlyphRunAnalysis(gdiRun, fontFace, gdi);
   DrawWithBitmap(gdiRun, x, y + 60, true, true);
   */
+
+  EndFrame();
 }
 
 void
 D2DSetup::Present()
 {
+  TRACE_ZONE("Present");
   mSwapChain->Present(0, 0);
+  EndFrame();
 }
 
 void
@@ -1315,22 +1593,66 @@ D2DSetup::DrawLuminanceEffect()
   alphaBitmap->Release();
 }
 
-SkMaskGamma::PreBlend D2DSetup::CreateLUT()
+// DrawLuminanceEffect's picture without the GPU: the image's luminance
+// masks a white fill through an image sized CpuRenderSurface layer, converted
+// row by row as the layer is popped, and the result is uploaded once.
+void D2DSetup::DrawLuminanceEffectCpu()
+{
+  IWICBitmapDecoder* decoder = nullptr;
+  IWICBitmapFrameDecode* frame = nullptr;
+  IWICFormatConverter* converter = nullptr;
+  HRESULT hr = mWICFactory->CreateDecoderFromFilename(L"C:\\firefox.png", nullptr, GENERIC_READ,
+                                                      WICDecodeMetadataCacheOnLoad, &decoder);
+  if (hr != S_OK) {
+    _com_error err(hr);
+    std::wcout << err.ErrorMessage();
+    return;
+  }
+  hr = decoder->GetFrame(0, &frame);
+  assert(hr == S_OK);
+  hr = mWICFactory->CreateFormatConverter(&converter);
+  assert(hr == S_OK);
+  hr = converter->Initialize(frame, GUID_WICPixelFormat32bppPBGRA, WICBitmapDitherTypeNone,
+                             nullptr, 0.f, WICBitmapPaletteTypeMedianCut);
+  assert(hr == S_OK);
+
+  UINT width, height;
+  converter->GetSize(&width, &height);
+  std::vector<uint8_t> image((size_t)width * height * 4);
+  hr = converter->CopyPixels(nullptr, width * 4, (UINT)image.size(), image.data());
+  assert(hr == S_OK);
+
+  // Only the image's rect at 0,0 is drawn, so the layer and the upload
+  // cover that and not the whole target.
+  CpuRenderSurface surface(width, height, SURFACE_FORMAT_B8G8R8A8);
+  {
+    TRACE_ZONE("LuminanceLayer");
+    surface.Clear(0);
+    surface.PushLuminanceLayer(image.data(), width * 4, width, height, 0, 0);
+    surface.Clear(0xFFFFFFFF);
+    surface.PopLayer();
+  }
+
+  mSurface->BeginDraw();
+  mSurface->Clear(0xFF000000);
+  mSurface->DrawBitmap(surface.Pixels(), surface.Stride(), surface.Width(), surface.Height(), 0, 0);
+  mSurface->EndDraw();
+
+  converter->Release();
+  frame->Release();
+  decoder->Release();
+}
+
+SkMaskGammaRef D2DSetup::CreateMaskGamma()
 {
   const float contrast = 1.0;
   const float paintGamma = 1.8f;
   const float deviceGamma = 1.8f;
-  SkMaskGamma* gamma = new SkMaskGamma(contrast, paintGamma, deviceGamma);
-
-  // Gecko is always setting the preblend to black background.
-  SkColor blackLuminanceColor = SkColorSetARGBInline(255, 0, 0, 0);
-  SkColor whiteLuminance = SkColorSetARGBInline(255, 255, 255, 255);
-  SkColor mozillaColor = SkColorSetARGBInline(255, 0x40, 0x40, 0x40);
-  return gamma->preBlend(blackLuminanceColor);
+  return MaskGammaRegistry::Get(contrast, paintGamma, deviceGamma);
 }
 
 // See http://searchfox.org/mozilla-central/source/gfx/skia/skia/src/ports/SkFontHost_win.cpp#1080
-SkMaskGamma::PreBlend D2DSetup::CreateGdiLUT()
+SkMaskGammaRef D2DSetup::CreateGdiMaskGamma()
 {
   UINT level = 0;
   if (!SystemParametersInfo(SPI_GETFONTSMOOTHINGCONTRAST, 0, &level, 0) || !level) {
@@ -1344,11 +1666,53 @@ SkMaskGamma::PreBlend D2DSetup::CreateGdiLUT()
 
   const float paintGamma = 2.3f;
   const float deviceGamma = 2.3f;
-  SkMaskGamma* gamma = new SkMaskGamma(contrast, paintGamma, deviceGamma);
+  return MaskGammaRegistry::Get(contrast, paintGamma, deviceGamma);
+}
 
+SkMaskGamma::PreBlend D2DSetup::CreateLUT()
+{
   // Gecko is always setting the preblend to black background.
   SkColor blackLuminanceColor = SkColorSetARGBInline(255, 0, 0, 0);
   SkColor whiteLuminance = SkColorSetARGBInline(255, 255, 255, 255);
   SkColor mozillaColor = SkColorSetARGBInline(255, 0x40, 0x40, 0x40);
-  return gamma->preBlend(blackLuminanceColor);
-}
\ No newline at end of file
+  return SkMaskGamma::preBlend(mMaskGamma, blackLuminanceColor);
+}
+
+SkMaskGamma::PreBlend D2DSetup::CreateGdiLUT()
+{
+  // Gecko is always setting the preblend to black background.
+  SkColor blackLuminanceColor = SkColorSetARGBInline(255, 0, 0, 0);
+  SkColor whiteLuminance = SkColorSetARGBInline(255, 255, 255, 255);
+  SkColor mozillaColor = SkColorSetARGBInline(255, 0x40, 0x40, 0x40);
+  return SkMaskGamma::preBlend(mGdiMaskGamma, blackLuminanceColor);
+}
+
+// Skia picks the tables for the luminance of the text color, snapped to the
+// few colors the gamma tables exist for.
+SkMaskGamma::PreBlend D2DSetup::GetPreBlend(SkColor aTextColor, bool useGDILUT)
+{
+  const SkMaskGammaRef& gamma = useGDILUT ? mGdiMaskGamma : mMaskGamma;
+  return SkMaskGamma::preBlend(gamma, SkMaskGamma::CanonicalColor(aTextColor));
+}
+
+void D2DSetup::SetTextColor(SkColor aTextColor, SkColor aBackgroundColor, MaskBlendMode aMode)
+{
+  mTextColor = aTextColor;
+  mBackgroundColor = aBackgroundColor;
+  mBlendMode = aMode;
+}
+
+bool D2DSetup::IsBlackOnWhite()
+{
+  return mTextColor == SkColorSetARGBInline(255, 0, 0, 0) &&
+         mBackgroundColor == SkColorSetARGBInline(255, 255, 255, 255) &&
+         mBlendMode == MASK_BLEND_SRC_OVER;
+}
+
+bool D2DSetup::IsDarkOnLight()
+{
+  return SkColorGetA(mBackgroundColor) == 255 &&
+         SkColorGetR(mTextColor) <= SkColorGetR(mBackgroundColor) &&
+         SkColorGetG(mTextColor) <= SkColorGetG(mBackgroundColor) &&
+         SkColorGetB(mTextColor) <= SkColorGetB(mBackgroundColor);
+}
@@ -5,23 +5,43 @@
 #include <direct.h>
 #include <d3d11.h>
 #include <d2d1.h>
-#include "SkMaskGamma.h"
+#include "MaskGammaRegistry.h"
+#include "MaskConvert.h"
+#include "GlyphCache.h"
+#include "DWriteGlyphRasterizer.h"
+#include "GlyphRasterBatch.h"
+#include "WorkStealingPool.h"
+#include "GlyphAtlas.h"
+#include "FrameArena.h"
+#include "GlyphRunBuilder.h"
+#include "FontFaceCache.h"
+#include "D2DRenderSurface.h"
 #include <Wincodec.h>
 #include <d2d1_1.h>
 
-//The following typedef hides from the rest of the implementation the number of
-//most significant bits to consider when creating mask gamma tables. Two bits
-//per channel was chosen as a balance between fidelity (more bits) and cache
-//sizes (fewer bits). Three bits per channel was chosen when #303942; (used by
-//the Chrome UI) turned out too green.
-typedef SkTMaskGamma<3, 3, 3> SkMaskGamma;
-
 class D2DSetup
 {
 public:
     D2DSetup(HWND aHWND)
-        : fPreBlend(CreateLUT())
+        : mSurface(nullptr)
+        , mRenderTargetContext(nullptr)
+        , mTextBrush(nullptr)
+        , mMaskGamma(CreateMaskGamma())
+        , mGdiMaskGamma(CreateGdiMaskGamma())
+        , fPreBlend(CreateLUT())
         , fGdiPreBlend(CreateGdiLUT())
+        , mTextColor(SkColorSetARGBInline(255, 0, 0, 0))
+        , mBackgroundColor(SkColorSetARGBInline(255, 255, 255, 255))
+        , mBlendMode(MASK_BLEND_SRC_OVER)
+        , mCompiledConversion(true)
+        , mGlyphCache(kGlyphCacheBudget)
+        , mRasterPool(0)
+        , mRasterBatch(&mRasterPool)
+        , mQueuedRasterizerCount(0)
+        , mUseGlyphAtlas(true)
+        , mGlyphAtlas(kAtlasPageSize, 4, kAtlasMaxPages)
+        , mLcd16Atlas(kAtlasPageSize, 2, kAtlasMaxPages)
+        , mGrayscaleAtlas(kAtlasPageSize, 1, kAtlasMaxPages)
     {
         mHWND = aHWND;
         Init();
@@ -39,22 +59,59 @@ public:
     void PrintFonts(IDWriteFontCollection* aFontCollection);
     void Clear();
     void DrawLuminanceEffect();
+    // The same luminance mask drawn on the CPU, needs no D3D device.
+    void DrawLuminanceEffectCpu();
     void Present();
+    // Releases the frame's glyph runs and everything drawn from mFrameArena.
+    // Present calls it.
+    void EndFrame();
     void CreateImageBrushes();
     void InitDWrite();
 
+    // Color the CPU mask paths draw text in and blend it onto. Anything but
+    // black on white goes through BlendToBGRA.
+    void SetTextColor(SkColor aTextColor, SkColor aBackgroundColor,
+                      MaskBlendMode aMode = MASK_BLEND_SRC_OVER);
+
 private:
+    SkMaskGammaRef CreateMaskGamma();
+    SkMaskGammaRef CreateGdiMaskGamma();
     SkMaskGamma::PreBlend CreateLUT();
     SkMaskGamma::PreBlend CreateGdiLUT();
+    SkMaskGamma::PreBlend GetPreBlend(SkColor aTextColor, bool useGDILUT);
+    bool IsBlackOnWhite();
+    // Text no lighter than an opaque background in any channel, so every
+    // converted pixel is at most the background.
+    bool IsDarkOnLight();
 
     IDWriteFontFace* GetFontFace();
-    void CreateGlyphRun(DWRITE_GLYPH_RUN& glyphRun, IDWriteFontFace* fontFace, WCHAR message[], float aScale = 1.0);
 
     BYTE* ConvertToBGRA(BYTE* aRGB, int width, int height, bool useLUT, bool convert = false, bool useGDILUT = false);
     BYTE* BlendSkiaGrayscale(BYTE* aRGB, int width, int height);
     BYTE* BlitDirectly(BYTE* aRGB, int width, int height);
 
+    // Versions of the above that write BGRA into aDest at (aDestX, aDestY)
+    // instead of a new buffer. Source and destination rows are aSrcStride and
+    // aDestStride bytes apart. They do not allocate.
+    void ConvertToBGRA(const BYTE* aRGB, int aSrcStride, int width, int height,
+                       BYTE* aDest, int aDestStride, int aDestX, int aDestY,
+                       bool useLUT, bool convert = false, bool useGDILUT = false);
+    void BlendSkiaGrayscale(const BYTE* aRGB, int aSrcStride, int width, int height,
+                            BYTE* aDest, int aDestStride, int aDestX, int aDestY);
+    void BlitDirectly(const BYTE* aRGB, int aSrcStride, int width, int height,
+                      BYTE* aDest, int aDestStride, int aDestX, int aDestY);
+
+    void BlendToBGRA(const BYTE* aRGB, int aSrcStride, int width, int height,
+                     BYTE* aOut, int aOutStride, bool aOntoOut,
+                     SkColor aTextColor, SkColor aBackground,
+                     bool useLUT, bool convert = false, bool useGDILUT = false);
+
     void DrawBitmap(BYTE* image, float width, float height, int x, int y, RECT bounds);
+    // Fills mTextColor through an A8 coverage mask, which D2D blends onto
+    // the target as it draws.
+    void DrawOpacityMask(BYTE* aMask, int width, int height, int x, int y);
+    // mTextBrush set to mTextColor. Not a new reference.
+    ID2D1SolidColorBrush* GetTextBrush();
 
     void DrawGrayscaleWithBitmap(DWRITE_GLYPH_RUN& glyphRun, int x, int y);
     void DrawGrayscaleWithLUT(DWRITE_GLYPH_RUN& glyphRun, int x, int y);
@@ -68,16 +125,56 @@ private:
         D2D1_TEXT_ANTIALIAS_MODE aaMode = D2D1_TEXT_ANTIALIAS_MODE_CLEARTYPE);
     void CreateBitmap(ID2D1RenderTarget* aRenderTarget, ID2D1Bitmap** aOutBitmap,
                      int width, int height,
-                     BYTE* aSource = nullptr, uint32_t aSourceStride = 0);
+                     BYTE* aSource = nullptr, uint32_t aSourceStride = 0,
+                     DXGI_FORMAT aFormat = DXGI_FORMAT_B8G8R8A8_UNORM);
 
+    // The run's coverage in aFormat, RGB 3x1 or one byte per pixel.
     BYTE* GetAlphaTexture(DWRITE_GLYPH_RUN& aRun, RECT& aOutBounds,
                         DWRITE_RENDERING_MODE aRenderMode = DWRITE_RENDERING_MODE_CLEARTYPE_NATURAL,
-                        DWRITE_MEASURING_MODE aMeasureMode = DWRITE_MEASURING_MODE_NATURAL);
+                        DWRITE_MEASURING_MODE aMeasureMode = DWRITE_MEASURING_MODE_NATURAL,
+                        GlyphMaskFormat aFormat = GLYPH_MASK_CLEARTYPE_3x1);
 
     void GetGlyphBounds(DWRITE_GLYPH_RUN& aRun, RECT& aOutBounds,
                         IDWriteGlyphRunAnalysis** aOutAnalysis,
                         DWRITE_RENDERING_MODE aRenderMode = DWRITE_RENDERING_MODE_CLEARTYPE_NATURAL,
-                        DWRITE_MEASURING_MODE aMeasureMode = DWRITE_MEASURING_MODE_NATURAL);
+                        DWRITE_MEASURING_MODE aMeasureMode = DWRITE_MEASURING_MODE_NATURAL,
+                        float aOriginX = 0.0f);
+
+    // Same bounds as GetGlyphBounds, computed from the glyph mask cache.
+    void GetCachedGlyphBounds(DWRITE_GLYPH_RUN& aRun, RECT& aOutBounds,
+                              DWRITE_RENDERING_MODE aRenderMode = DWRITE_RENDERING_MODE_CLEARTYPE_NATURAL,
+                              DWRITE_MEASURING_MODE aMeasureMode = DWRITE_MEASURING_MODE_NATURAL);
+
+    // Looks up every glyph of the run in mGlyphCache, rasterizing only the
+    // ones that are missing through DWriteGlyphRasterizer on mRasterPool's
+    // threads, and places them relative to the run origin. aOutKeys, if
+    // given, receives the cache key of each glyph.
+    void GetGlyphMasks(DWRITE_GLYPH_RUN& aRun, std::vector<PlacedGlyph>& aOutGlyphs,
+                       DWRITE_RENDERING_MODE aRenderMode, DWRITE_MEASURING_MODE aMeasureMode,
+                       GlyphMaskFormat aFormat = GLYPH_MASK_CLEARTYPE_3x1,
+                       std::vector<GlyphKey>* aOutKeys = nullptr);
+    // Queues the glyphs of aRun that mGlyphCache is missing, with the modes
+    // and format the run will be drawn with. Everything queued is rasterized
+    // in one batch by the next RasterizeQueuedGlyphs or GetGlyphMasks, so
+    // queue all the runs of a frame before drawing the first one.
+    void QueueGlyphMasks(DWRITE_GLYPH_RUN& aRun, DWRITE_RENDERING_MODE aRenderMode,
+                         DWRITE_MEASURING_MODE aMeasureMode,
+                         GlyphMaskFormat aFormat = GLYPH_MASK_CLEARTYPE_3x1);
+    void RasterizeQueuedGlyphs();
+    void PrintGlyphCacheStats();
+    void PrintGlyphAtlasStats();
+    void PrintFrameArenaStats();
+
+    // Draws the run glyph by glyph out of mGlyphAtlas. Returns false, having
+    // drawn nothing, if the glyphs do not all fit in the atlas or the text
+    // is not IsDarkOnLight or mRenderTarget has no device context.
+    bool DrawWithAtlas(DWRITE_GLYPH_RUN& glyphRun, int x, int y, bool useLUT, bool convert,
+                       DWRITE_RENDERING_MODE aRenderMode, DWRITE_MEASURING_MODE aMeasureMode,
+                       bool useGDILUT);
+    // Same for grayscale text, out of the A8 glyphs in mGrayscaleAtlas.
+    bool DrawGrayscaleWithAtlas(DWRITE_GLYPH_RUN& glyphRun, int x, int y);
+    void UploadAtlasPages(GlyphAtlas& aAtlas, std::vector<ID2D1Bitmap*>& aPages, DXGI_FORMAT aFormat);
+    void ReleaseGlyphAtlas();
     float GetScaleFactor() { return mDpiX / 96.0f; }
     void PrintElapsedTime(LARGE_INTEGER aStart, LARGE_INTEGER aEnd, const char* aMsg);
 
@@ -100,12 +197,21 @@ private:
 
     ID2D1Factory1* mFactory;
     ID2D1HwndRenderTarget* mRenderTarget;
+    // Draws the CPU made bitmaps and masks into mRenderTarget. Created with it.
+    D2DRenderSurface* mSurface;
+    // mRenderTarget's device context for the MIN blend DrawWithAtlas draws
+    // with, null if the target has none. Created with it.
+    ID2D1DeviceContext* mRenderTargetContext;
+    // Brush in the text color for the grayscale atlas, created with
+    // mRenderTarget.
+    ID2D1SolidColorBrush* mTextBrush;
     ID2D1RenderTarget* mBitmapRenderTarget;
 
     ID2D1Device* md2d_device;
     ID2D1DeviceContext* mDC;
 
     IDWriteFactory* mDwriteFactory;
+    FontFaceCache mFontFaces;
     IDWriteTextFormat* mTextFormat;
     IDWriteRenderingParams* mCustomParams;
     IDWriteRenderingParams* mDefaultParams;
@@ -120,9 +226,58 @@ private:
 
     float mFontSize;
 
+    // Declared before the preblends, which point into their tables.
+    SkMaskGammaRef mMaskGamma;
+    SkMaskGammaRef mGdiMaskGamma;
     SkMaskGamma::PreBlend fPreBlend;
     SkMaskGamma::PreBlend fGdiPreBlend;
 
+    SkColor mTextColor;
+    SkColor mBackgroundColor;
+    MaskBlendMode mBlendMode;
+
+    // When set, ConvertToBGRA runs gamma corrected conversions through tables
+    // from mCompositeLUTs instead of the step by step kernels. Both give identical output, the flag is
+    // here so the two can be A/B'ed.
+    bool mCompiledConversion;
+    CompositeLUTCache mCompositeLUTs;
+
+    static const size_t kGlyphCacheBudget = 4 * 1024 * 1024;
+    GlyphCache mGlyphCache;
+    // Rasterizes the glyphs mGlyphCache is missing on every core. Only the
+    // DWrite factory, which is shared and free threaded, is used off the
+    // paint thread, the D2D factory stays single threaded.
+    WorkStealingPool mRasterPool;
+    GlyphRasterBatch mRasterBatch;
+    // Rasterizers of the runs queued in mRasterBatch, which have to outlive
+    // its Rasterize. The first mQueuedRasterizerCount are in use, the rest
+    // are kept for later frames so steady state queueing does not allocate.
+    std::vector<std::unique_ptr<DWriteGlyphRasterizer>> mQueuedRasterizers;
+    size_t mQueuedRasterizerCount;
+
+    // Converted BGRA glyphs for DrawWithBitmap. The CPU pages live in
+    // mGlyphAtlas, mAtlasPages holds the matching D2D bitmap for each page.
+    static const int32_t kAtlasPageSize = 1024;
+    static const int32_t kAtlasMaxPages = 4;
+    bool mUseGlyphAtlas;
+    GlyphAtlas mGlyphAtlas;
+    std::vector<ID2D1Bitmap*> mAtlasPages;
+    // Quantized black on white glyphs, kept as LCD16 at half the size of
+    // BGRA and expanded by UploadAtlasPages.
+    GlyphAtlas mLcd16Atlas;
+    std::vector<ID2D1Bitmap*> mLcd16AtlasPages;
+    // Gamma corrected A8 glyphs for DrawGrayscaleWithLUT, drawn through A8
+    // bitmaps in the text color.
+    GlyphAtlas mGrayscaleAtlas;
+    std::vector<ID2D1Bitmap*> mGrayscaleAtlasPages;
+
+    // Per frame scratch memory for composited masks and converted pixels,
+    // and the frame's glyph runs. Both are reset by EndFrame.
+    FrameArena mFrameArena;
+    GlyphRunBuilder mRunBuilder;
+    std::vector<PlacedGlyph> mRunGlyphs;
+    std::vector<GlyphKey> mRunGlyphKeys;
+
     IWICImagingFactory* mWICFactory;
     IWICBitmap* mWICBitmap;
 
@@ -5,6 +5,7 @@
 #include "DWriteFont.h"
 #include <stdio.h>
 #include "D2DSetup.h"
+#include "Trace.h"
 
 static void InitConsole()
 {
@@ -20,6 +21,7 @@ static void InitConsole()
 HINSTANCE hInst;                                // current instance
 WCHAR szTitle[MAX_LOADSTRING];                  // The title bar text
 WCHAR szWindowClass[MAX_LOADSTRING];            // the main window class name
+static bool luminanceCpu;                       // paint the luminance effect on the CPU
 
 // Forward declarations of functions included in this code module:
 ATOM                MyRegisterClass(HINSTANCE hInstance);
@@ -33,9 +35,20 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 	InitConsole();
 
+    // --trace records trace zones and writes them as Chrome trace JSON on
+    // exit, load the file in chrome://tracing or ui.perfetto.dev.
+    const bool trace = wcsstr(lpCmdLine, L"--trace") != nullptr;
+    if (trace) {
+        Tracer::SetThreadName("Main");
+        Tracer::SetEnabled(true);
+    }
+
+    // --luminance-cpu paints DrawLuminanceEffectCpu instead of the D3D
+    // backed DrawLuminanceEffect.
+    luminanceCpu = wcsstr(lpCmdLine, L"--luminance-cpu") != nullptr;
+
     // TODO: Place code here.
 
     // Initialize global strings
@@ -63,6 +76,12 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
         }
     }
 
+    if (trace) {
+        if (Tracer::WriteChromeTrace("DWriteFont.trace.json")) {
+            printf("Wrote DWriteFont.trace.json\n");
+        }
+    }
+
     return (int) msg.wParam;
 }
 
@@ -141,7 +160,11 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 
 static void PaintText(HWND aHWND, HDC aHDC)
 {
-  GetPaintWindow(aHWND)->DrawLuminanceEffect();
+  if (luminanceCpu) {
+    GetPaintWindow(aHWND)->DrawLuminanceEffectCpu();
+  } else {
+    GetPaintWindow(aHWND)->DrawLuminanceEffect();
+  }
 	//D2DSetup d2d(aHWND, aHDC);
 	//d2d.Clear();
   //d2d.DrawLuminanceEffect();
@@ -191,6 +214,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             PAINTSTRUCT ps;
             HDC hdc = BeginPaint(hWnd, &ps);
             // TODO: Add any drawing code that uses hdc here...
+            TRACE_ZONE("Paint");
             PaintText(hWnd, hdc);
             EndPaint(hWnd, &ps);
         }
@@ -0,0 +1,100 @@
+#include "stdafx.h"
+#include "DWriteGlyphRasterizer.h"
+#include <assert.h>
+
+DWriteGlyphRasterizer::DWriteGlyphRasterizer(IDWriteFactory* aFactory, IDWriteFontFace* aFontFace,
+                                             uint64_t aFaceId, float aEmSize,
+                                             DWRITE_RENDERING_MODE aRenderMode,
+                                             DWRITE_MEASURING_MODE aMeasureMode)
+  : mFactory(aFactory)
+  , mFontFace(aFontFace)
+  , mFaceId(aFaceId)
+  , mEmSize(aEmSize)
+  , mRenderMode(aRenderMode)
+  , mMeasureMode(aMeasureMode)
+{
+}
+
+GlyphRasterizer*
+DWriteGlyphRasterizer::Clone() const
+{
+  return new DWriteGlyphRasterizer(mFactory, mFontFace, mFaceId, mEmSize,
+                                   mRenderMode, mMeasureMode);
+}
+
+void
+DWriteGlyphRasterizer::GetKeyTemplate(GlyphMaskFormat aFormat, GlyphKey* aOutKey)
+{
+  aOutKey->fFaceId = mFaceId;
+  aOutKey->fEmSize = mEmSize;
+  aOutKey->fPixelsPerDip = 1.0f;
+  aOutKey->fGlyphIndex = 0;
+  aOutKey->fRenderingMode = (uint8_t)mRenderMode;
+  aOutKey->fMeasuringMode = (uint8_t)mMeasureMode;
+  aOutKey->fTextureType = (uint8_t)aFormat;
+  aOutKey->fSubpixelX = 0;
+}
+
+GlyphMask*
+DWriteGlyphRasterizer::RasterizeGlyph(uint16_t aGlyph, float aOriginX, GlyphMaskFormat aFormat)
+{
+  UINT16 glyphIndex = aGlyph;
+  FLOAT advance = 0.0f;
+  DWRITE_GLYPH_RUN glyphRun;
+  glyphRun.fontFace = mFontFace;
+  glyphRun.fontEmSize = mEmSize;
+  glyphRun.glyphCount = 1;
+  glyphRun.glyphIndices = &glyphIndex;
+  glyphRun.glyphAdvances = &advance;
+  glyphRun.glyphOffsets = nullptr;
+  glyphRun.isSideways = FALSE;
+  glyphRun.bidiLevel = 0;
+
+  IDWriteGlyphRunAnalysis* analysis;
+  HRESULT hr = mFactory->CreateGlyphRunAnalysis(&glyphRun, 1.0f, nullptr, mRenderMode,
+                                                mMeasureMode, aOriginX, 0.0f, &analysis);
+  assert(hr == S_OK);
+
+  const bool aliased = mRenderMode == DWRITE_RENDERING_MODE_ALIASED;
+  DWRITE_TEXTURE_TYPE textureType = aliased ? DWRITE_TEXTURE_ALIASED_1x1
+                                            : DWRITE_TEXTURE_CLEARTYPE_3x1;
+  RECT bounds;
+  hr = analysis->GetAlphaTextureBounds(textureType, &bounds);
+  assert(hr == S_OK);
+
+  GlyphMask* mask = new GlyphMask();
+  mask->fLeft = bounds.left;
+  mask->fTop = bounds.top;
+  mask->fWidth = bounds.right - bounds.left;
+  mask->fHeight = bounds.bottom - bounds.top;
+  mask->fBytesPerPixel = GlyphMaskBytesPerPixel(aFormat);
+
+  if (!mask->IsEmpty()) {
+    const int32_t textureBytesPerPixel = aliased ? 1 : 3;
+    UINT32 textureSize = (UINT32)((size_t)mask->fWidth * mask->fHeight * textureBytesPerPixel);
+    uint8_t* texture = (uint8_t*)malloc(textureSize);
+    hr = analysis->CreateAlphaTexture(textureType, &bounds, texture, textureSize);
+    assert(hr == S_OK);
+
+    if (textureBytesPerPixel == mask->fBytesPerPixel) {
+      mask->fBits = texture;
+    } else {
+      // Aliased coverage is 0 or 255 and widens by repeating it, ClearType
+      // narrows to the average of its channels.
+      size_t pixelCount = (size_t)mask->fWidth * mask->fHeight;
+      mask->fBits = (uint8_t*)malloc(mask->ByteSize());
+      for (size_t i = 0; i < pixelCount; i++) {
+        if (aliased) {
+          mask->fBits[3 * i] = mask->fBits[3 * i + 1] = mask->fBits[3 * i + 2] = texture[i];
+        } else {
+          mask->fBits[i] = (uint8_t)((texture[3 * i] + texture[3 * i + 1] +
+                                      texture[3 * i + 2] + 1) / 3);
+        }
+      }
+      free(texture);
+    }
+  }
+
+  analysis->Release();
+  return mask;
+}
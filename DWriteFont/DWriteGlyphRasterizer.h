@@ -0,0 +1,37 @@
+#pragma once
+
+#include <dwrite.h>
+#include "GlyphRasterizer.h"
+
+/**
+ * Rasterizes through IDWriteGlyphRunAnalysis::CreateAlphaTexture, one glyph
+ * run analysis per glyph.
+ *
+ * DWrite only hands out aliased 1x1 textures for the aliased rendering mode,
+ * so in every other mode A8 masks are the ClearType mask with the three
+ * channels averaged.
+ *
+ * Cheap to create, set one up per run. Holds no references, the factory and
+ * the face have to outlive it. The shared DWrite factory and font faces are
+ * free threaded, so clones rasterize on other threads.
+ */
+class DWriteGlyphRasterizer : public GlyphRasterizer {
+public:
+  // aFaceId identifies aFontFace in the glyph keys, see FontFaceCache::GetFontFaceId.
+  DWriteGlyphRasterizer(IDWriteFactory* aFactory, IDWriteFontFace* aFontFace, uint64_t aFaceId,
+                        float aEmSize, DWRITE_RENDERING_MODE aRenderMode,
+                        DWRITE_MEASURING_MODE aMeasureMode);
+
+  virtual void GetKeyTemplate(GlyphMaskFormat aFormat, GlyphKey* aOutKey) override;
+  virtual GlyphMask* RasterizeGlyph(uint16_t aGlyph, float aOriginX,
+                                    GlyphMaskFormat aFormat) override;
+  virtual GlyphRasterizer* Clone() const override;
+
+private:
+  IDWriteFactory* mFactory;
+  IDWriteFontFace* mFontFace;
+  uint64_t mFaceId;
+  float mEmSize;
+  DWRITE_RENDERING_MODE mRenderMode;
+  DWRITE_MEASURING_MODE mMeasureMode;
+};
@@ -0,0 +1,193 @@
+#include "stdafx.h"
+#include "FontFaceCache.h"
+#include "GlyphCache.h"
+#include <assert.h>
+#include <vector>
+
+static void
+ReleaseFontFace(IDWriteFontFace* aFontFace)
+{
+  aFontFace->Release();
+}
+
+size_t
+FontFaceCache::FaceKeyHash::operator()(const FaceKey& aKey) const
+{
+  uint64_t hash = kHashSeed;
+  hash = HashBytes(hash, aKey.fFamilyName.data(), aKey.fFamilyName.size() * sizeof(WCHAR));
+  int32_t fields[3] = { (int32_t)aKey.fWeight, (int32_t)aKey.fStretch, (int32_t)aKey.fStyle };
+  hash = HashBytes(hash, fields, sizeof(fields));
+  return (size_t)hash;
+}
+
+size_t
+FontFaceCache::ModeKeyHash::operator()(const ModeKey& aKey) const
+{
+  // Field by field, the struct has padding.
+  uint64_t hash = kHashSeed;
+  hash = HashBytes(hash, &aKey.fFontFace, sizeof(aKey.fFontFace));
+  hash = HashBytes(hash, &aKey.fEmSize, sizeof(aKey.fEmSize));
+  hash = HashBytes(hash, &aKey.fPixelsPerDip, sizeof(aKey.fPixelsPerDip));
+  int32_t measuringMode = (int32_t)aKey.fMeasuringMode;
+  hash = HashBytes(hash, &measuringMode, sizeof(measuringMode));
+  hash = HashBytes(hash, &aKey.fParams, sizeof(aKey.fParams));
+  return (size_t)hash;
+}
+
+FontFaceCache::FontFaceCache()
+  : mFactory(nullptr)
+  , mSystemFonts(nullptr)
+  , mHits(0)
+  , mMisses(0)
+{
+}
+
+FontFaceCache::~FontFaceCache()
+{
+  Clear();
+}
+
+void
+FontFaceCache::Init(IDWriteFactory* aFactory)
+{
+  Clear();
+  mFactory = aFactory;
+  mFactory->AddRef();
+}
+
+void
+FontFaceCache::Clear()
+{
+  mModes.clear();
+  mFaceIds.clear();
+  mFaces.clear();
+  if (mSystemFonts) {
+    mSystemFonts->Release();
+    mSystemFonts = nullptr;
+  }
+  if (mFactory) {
+    mFactory->Release();
+    mFactory = nullptr;
+  }
+}
+
+FontFaceRef
+FontFaceCache::ResolveFontFace(const FaceKey& aKey)
+{
+  if (!mSystemFonts) {
+    HRESULT hr = mFactory->GetSystemFontCollection(&mSystemFonts, TRUE);
+    assert(hr == S_OK);
+  }
+
+  UINT32 fontIndex;
+  BOOL exists = FALSE;
+  HRESULT hr = mSystemFonts->FindFamilyName(aKey.fFamilyName.c_str(), &fontIndex, &exists);
+  assert(hr == S_OK);
+  if (!exists) {
+    return FontFaceRef();
+  }
+
+  IDWriteFontFamily* fontFamily;
+  hr = mSystemFonts->GetFontFamily(fontIndex, &fontFamily);
+  assert(hr == S_OK);
+
+  IDWriteFont* font;
+  hr = fontFamily->GetFirstMatchingFont(aKey.fWeight, aKey.fStretch, aKey.fStyle, &font);
+  assert(hr == S_OK);
+
+  IDWriteFontFace* fontFace;
+  hr = font->CreateFontFace(&fontFace);
+  assert(hr == S_OK);
+
+  font->Release();
+  fontFamily->Release();
+  return FontFaceRef(fontFace, ReleaseFontFace);
+}
+
+FontFaceRef
+FontFaceCache::GetFontFace(const WCHAR* aFamilyName, DWRITE_FONT_WEIGHT aWeight,
+                           DWRITE_FONT_STRETCH aStretch, DWRITE_FONT_STYLE aStyle)
+{
+  assert(mFactory);
+
+  FaceKey key;
+  key.fFamilyName = aFamilyName;
+  key.fWeight = aWeight;
+  key.fStretch = aStretch;
+  key.fStyle = aStyle;
+
+  auto found = mFaces.find(key);
+  if (found != mFaces.end()) {
+    mHits++;
+    return found->second;
+  }
+
+  mMisses++;
+  FontFaceRef fontFace = ResolveFontFace(key);
+  mFaces[key] = fontFace;
+  return fontFace;
+}
+
+DWRITE_RENDERING_MODE
+FontFaceCache::GetRecommendedRenderingMode(IDWriteFontFace* aFontFace, float aEmSize,
+                                           float aPixelsPerDip,
+                                           DWRITE_MEASURING_MODE aMeasuringMode,
+                                           IDWriteRenderingParams* aParams)
+{
+  ModeKey key;
+  key.fFontFace = aFontFace;
+  key.fEmSize = aEmSize;
+  key.fPixelsPerDip = aPixelsPerDip;
+  key.fMeasuringMode = aMeasuringMode;
+  key.fParams = aParams;
+
+  auto found = mModes.find(key);
+  if (found != mModes.end()) {
+    mHits++;
+    return found->second;
+  }
+
+  mMisses++;
+  DWRITE_RENDERING_MODE mode = DWRITE_RENDERING_MODE_CLEARTYPE_NATURAL;
+  HRESULT hr = aFontFace->GetRecommendedRenderingMode(aEmSize, aPixelsPerDip, aMeasuringMode,
+                                                      aParams, &mode);
+  assert(hr == S_OK);
+  mModes[key] = mode;
+  return mode;
+}
+
+uint64_t
+FontFaceCache::GetFontFaceId(IDWriteFontFace* aFontFace)
+{
+  auto found = mFaceIds.find(aFontFace);
+  if (found != mFaceIds.end()) {
+    mHits++;
+    return found->second;
+  }
+
+  mMisses++;
+  UINT32 fileCount = 0;
+  HRESULT hr = aFontFace->GetFiles(&fileCount, nullptr);
+  assert(hr == S_OK);
+
+  std::vector<IDWriteFontFile*> files(fileCount);
+  hr = aFontFace->GetFiles(&fileCount, files.data());
+  assert(hr == S_OK);
+
+  uint64_t id = kHashSeed;
+  for (UINT32 i = 0; i < fileCount; i++) {
+    const void* key;
+    UINT32 keySize;
+    hr = files[i]->GetReferenceKey(&key, &keySize);
+    assert(hr == S_OK);
+    id = HashBytes(id, key, keySize);
+    files[i]->Release();
+  }
+
+  UINT32 index = aFontFace->GetIndex();
+  UINT32 simulations = aFontFace->GetSimulations();
+  id = HashBytes(id, &index, sizeof(index));
+  id = HashBytes(id, &simulations, sizeof(simulations));
+  mFaceIds[aFontFace] = id;
+  return id;
+}
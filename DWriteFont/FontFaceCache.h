@@ -0,0 +1,102 @@
+#pragma once
+
+#include <dwrite.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// A font face shared by everyone who resolved the same font. The last
+// reference releases the COM object.
+typedef std::shared_ptr<IDWriteFontFace> FontFaceRef;
+
+/**
+ * Resolves family name, weight, stretch and style to a font face once and
+ * hands out the same face afterwards, and remembers each face's recommended
+ * rendering mode. After the first paint neither goes back to the font
+ * collection or the face.
+ *
+ * Rendering modes are remembered per face from GetFontFace and per
+ * rendering params object. Params are told apart by pointer, which is fine as
+ * they cannot change after creation, but they have to outlive the cache.
+ * Face ids are remembered per face too, so faces passed to either have to
+ * come from GetFontFace.
+ * Not thread safe.
+ */
+class FontFaceCache {
+public:
+  FontFaceCache();
+  ~FontFaceCache();
+
+  // Must be called before anything else. Takes a reference on aFactory.
+  void Init(IDWriteFactory* aFactory);
+  // Drops every face and the factory.
+  void Clear();
+
+  // Returns null if the family is not installed.
+  FontFaceRef GetFontFace(const WCHAR* aFamilyName, DWRITE_FONT_WEIGHT aWeight,
+                          DWRITE_FONT_STRETCH aStretch, DWRITE_FONT_STYLE aStyle);
+
+  DWRITE_RENDERING_MODE GetRecommendedRenderingMode(IDWriteFontFace* aFontFace, float aEmSize,
+                                                    float aPixelsPerDip,
+                                                    DWRITE_MEASURING_MODE aMeasuringMode,
+                                                    IDWriteRenderingParams* aParams);
+
+  // Identifies aFontFace by the files, index and simulations it was loaded
+  // from, as faces can be recreated for the same font. The glyph cache keys
+  // glyphs by it. Computed once per face.
+  uint64_t GetFontFaceId(IDWriteFontFace* aFontFace);
+
+  uint64_t Hits() const { return mHits; }
+  uint64_t Misses() const { return mMisses; }
+
+private:
+  struct FaceKey {
+    std::wstring fFamilyName;
+    DWRITE_FONT_WEIGHT fWeight;
+    DWRITE_FONT_STRETCH fStretch;
+    DWRITE_FONT_STYLE fStyle;
+
+    bool operator==(const FaceKey& aOther) const {
+      return fFamilyName == aOther.fFamilyName && fWeight == aOther.fWeight &&
+             fStretch == aOther.fStretch && fStyle == aOther.fStyle;
+    }
+  };
+
+  struct FaceKeyHash {
+    size_t operator()(const FaceKey& aKey) const;
+  };
+
+  struct ModeKey {
+    IDWriteFontFace* fFontFace;
+    float fEmSize;
+    float fPixelsPerDip;
+    DWRITE_MEASURING_MODE fMeasuringMode;
+    IDWriteRenderingParams* fParams;
+
+    bool operator==(const ModeKey& aOther) const {
+      return fFontFace == aOther.fFontFace && fEmSize == aOther.fEmSize &&
+             fPixelsPerDip == aOther.fPixelsPerDip &&
+             fMeasuringMode == aOther.fMeasuringMode && fParams == aOther.fParams;
+    }
+  };
+
+  struct ModeKeyHash {
+    size_t operator()(const ModeKey& aKey) const;
+  };
+
+  FontFaceRef ResolveFontFace(const FaceKey& aKey);
+
+  FontFaceCache(const FontFaceCache&);
+  FontFaceCache& operator=(const FontFaceCache&);
+
+  IDWriteFactory* mFactory;
+  IDWriteFontCollection* mSystemFonts;
+  // Faces stay alive while they are in here, so ModeKey::fFontFace and the
+  // keys of mFaceIds are never stale addresses. Unknown families are remembered as null.
+  std::unordered_map<FaceKey, FontFaceRef, FaceKeyHash> mFaces;
+  std::unordered_map<ModeKey, DWRITE_RENDERING_MODE, ModeKeyHash> mModes;
+  std::unordered_map<IDWriteFontFace*, uint64_t> mFaceIds;
+  uint64_t mHits;
+  uint64_t mMisses;
+};
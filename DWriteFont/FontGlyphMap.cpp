@@ -0,0 +1,223 @@
+#include "FontGlyphMap.h"
+#include <assert.h>
+
+#if defined(DW_CPU_X86)
+#include <immintrin.h>
+#endif
+
+const uint16_t FontGlyphMap::kNoPage;
+const int32_t FontGlyphMap::kNoAdvance;
+
+static const uint32_t kPageTableSize = (FontGlyphMap::kMaxCodePoint >> FontGlyphMap::kPageBits) + 1;
+
+FontGlyphMap::FontGlyphMap(std::unique_ptr<GlyphMapSource> aSource, uint32_t aGlyphCount,
+                           uint16_t aDesignUnitsPerEm)
+  : mSource(std::move(aSource))
+  , mGlyphCount(aGlyphCount)
+  , mDesignUnitsPerEm(aDesignUnitsPerEm)
+  , mSourceCalls(0)
+  , mPageIndex(kPageTableSize + 1, kNoPage)
+  , mGlyphPages(1, 0)
+  , mAdvances(aGlyphCount + 1, kNoAdvance)
+{
+  assert(aGlyphCount <= 0x10000);
+}
+
+const uint16_t*
+FontGlyphMap::LoadPage(uint32_t aPage)
+{
+  uint32_t codePoints[kPageSize];
+  for (uint32_t i = 0; i < kPageSize; i++) {
+    codePoints[i] = (aPage << kPageBits) + i;
+  }
+
+  // Keep the spare entry at the end.
+  size_t slot = mGlyphPages.size() - 1;
+  assert(slot / kPageSize < kNoPage);
+  mGlyphPages.resize(slot + kPageSize + 1, 0);
+  mSource->GetGlyphIndices(codePoints, kPageSize, &mGlyphPages[slot]);
+  mSourceCalls++;
+
+  mPageIndex[aPage] = (uint16_t)(slot / kPageSize);
+  return &mGlyphPages[slot];
+}
+
+void
+FontGlyphMap::LoadAdvances(uint16_t aGlyph)
+{
+  uint16_t glyphs[kPageSize];
+  uint32_t first = aGlyph & ~(kPageSize - 1);
+  uint32_t count = mGlyphCount - first < kPageSize ? mGlyphCount - first : kPageSize;
+  for (uint32_t i = 0; i < count; i++) {
+    glyphs[i] = (uint16_t)(first + i);
+  }
+
+  mSource->GetDesignAdvances(glyphs, count, &mAdvances[first]);
+  mSourceCalls++;
+}
+
+uint16_t
+FontGlyphMap::GetGlyphIndex(uint32_t aCodePoint)
+{
+  if (aCodePoint > kMaxCodePoint) {
+    return 0;
+  }
+
+  uint32_t page = aCodePoint >> kPageBits;
+  uint16_t slot = mPageIndex[page];
+  const uint16_t* glyphs = slot != kNoPage ? &mGlyphPages[slot * kPageSize] : LoadPage(page);
+  return glyphs[aCodePoint & (kPageSize - 1)];
+}
+
+int32_t
+FontGlyphMap::GetDesignAdvance(uint16_t aGlyph)
+{
+  if (aGlyph >= mGlyphCount) {
+    return 0;
+  }
+
+  if (mAdvances[aGlyph] == kNoAdvance) {
+    LoadAdvances(aGlyph);
+  }
+  return mAdvances[aGlyph];
+}
+
+void
+FontGlyphMap::GetGlyphIndices_Scalar(const uint32_t* aCodePoints, uint32_t aCount, uint16_t* aOutGlyphs)
+{
+  // Text mostly stays within a page, so only go through the page index when
+  // the page changes.
+  uint32_t currentPage = kPageTableSize;
+  const uint16_t* glyphs = nullptr;
+  for (uint32_t i = 0; i < aCount; i++) {
+    uint32_t codePoint = aCodePoints[i];
+    if (codePoint > kMaxCodePoint) {
+      aOutGlyphs[i] = 0;
+      continue;
+    }
+
+    uint32_t page = codePoint >> kPageBits;
+    if (page != currentPage) {
+      uint16_t slot = mPageIndex[page];
+      glyphs = slot != kNoPage ? &mGlyphPages[slot * kPageSize] : LoadPage(page);
+      currentPage = page;
+    }
+    aOutGlyphs[i] = glyphs[codePoint & (kPageSize - 1)];
+  }
+}
+
+void
+FontGlyphMap::GetAdvances_Scalar(const uint16_t* aGlyphs, uint32_t aCount, float aEmSize,
+                                 float* aOutAdvances)
+{
+  for (uint32_t i = 0; i < aCount; i++) {
+    int32_t advance = GetDesignAdvance(aGlyphs[i]);
+    aOutAdvances[i] = ((float)advance * aEmSize) / mDesignUnitsPerEm;
+  }
+}
+
+#if defined(DW_CPU_X86)
+DW_TARGET_AVX2 void
+FontGlyphMap::GetGlyphIndices_AVX2(const uint32_t* aCodePoints, uint32_t aCount, uint16_t* aOutGlyphs)
+{
+  const int* pageIndex = (const int*)mPageIndex.data();
+  const __m256i maxCodePoint = _mm256_set1_epi32(kMaxCodePoint);
+  const __m256i noPage = _mm256_set1_epi32(kNoPage);
+  const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+  const __m256i offsetMask = _mm256_set1_epi32(kPageSize - 1);
+
+  uint32_t i = 0;
+  for (; i + 8 <= aCount; i += 8) {
+    __m256i codePoints = _mm256_loadu_si256((const __m256i*)(aCodePoints + i));
+
+    // The compare is signed, code points with the top bit set are caught by
+    // the shift.
+    __m256i outOfRange = _mm256_or_si256(_mm256_cmpgt_epi32(codePoints, maxCodePoint),
+                                         _mm256_srai_epi32(codePoints, 31));
+    if (!_mm256_testz_si256(outOfRange, outOfRange)) {
+      GetGlyphIndices_Scalar(aCodePoints + i, 8, aOutGlyphs + i);
+      continue;
+    }
+
+    // 16 bit entries, gathered as 32 bits and masked.
+    __m256i pages = _mm256_srli_epi32(codePoints, kPageBits);
+    __m256i slots = _mm256_and_si256(_mm256_i32gather_epi32(pageIndex, pages, 2), lowMask);
+    __m256i missing = _mm256_cmpeq_epi32(slots, noPage);
+    if (!_mm256_testz_si256(missing, missing)) {
+      GetGlyphIndices_Scalar(aCodePoints + i, 8, aOutGlyphs + i);
+      continue;
+    }
+
+    // Pages may have been loaded by the fallback above, fetch the base now.
+    const int* glyphPages = (const int*)mGlyphPages.data();
+    __m256i entries = _mm256_add_epi32(_mm256_slli_epi32(slots, kPageBits),
+                                       _mm256_and_si256(codePoints, offsetMask));
+    __m256i glyphs = _mm256_and_si256(_mm256_i32gather_epi32(glyphPages, entries, 2), lowMask);
+
+    // Narrow to 16 bits, packus works within 128 bit lanes.
+    __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(glyphs),
+                                      _mm256_extracti128_si256(glyphs, 1));
+    _mm_storeu_si128((__m128i*)(aOutGlyphs + i), packed);
+  }
+
+  GetGlyphIndices_Scalar(aCodePoints + i, aCount - i, aOutGlyphs + i);
+}
+
+DW_TARGET_AVX2 void
+FontGlyphMap::GetAdvances_AVX2(const uint16_t* aGlyphs, uint32_t aCount, float aEmSize,
+                               float* aOutAdvances)
+{
+  const __m256i glyphCount = _mm256_set1_epi32((int)mGlyphCount);
+  const __m256i noAdvance = _mm256_set1_epi32(kNoAdvance);
+  const __m256 emSize = _mm256_set1_ps(aEmSize);
+  const __m256 unitsPerEm = _mm256_set1_ps((float)mDesignUnitsPerEm);
+
+  uint32_t i = 0;
+  for (; i + 8 <= aCount; i += 8) {
+    __m256i glyphs = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(aGlyphs + i)));
+    __m256i outOfRange = _mm256_cmpgt_epi32(_mm256_add_epi32(glyphs, _mm256_set1_epi32(1)),
+                                            glyphCount);
+    if (!_mm256_testz_si256(outOfRange, outOfRange)) {
+      GetAdvances_Scalar(aGlyphs + i, 8, aEmSize, aOutAdvances + i);
+      continue;
+    }
+
+    __m256i advances = _mm256_i32gather_epi32(mAdvances.data(), glyphs, 4);
+    __m256i missing = _mm256_cmpeq_epi32(advances, noAdvance);
+    if (!_mm256_testz_si256(missing, missing)) {
+      GetAdvances_Scalar(aGlyphs + i, 8, aEmSize, aOutAdvances + i);
+      continue;
+    }
+
+    // Same operations in the same order as the scalar version.
+    __m256 scaled = _mm256_div_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(advances), emSize), unitsPerEm);
+    _mm256_storeu_ps(aOutAdvances + i, scaled);
+  }
+
+  GetAdvances_Scalar(aGlyphs + i, aCount - i, aEmSize, aOutAdvances + i);
+}
+#endif
+
+void
+FontGlyphMap::GetGlyphIndices(const uint32_t* aCodePoints, uint32_t aCount, uint16_t* aOutGlyphs)
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_AVX2)) {
+    GetGlyphIndices_AVX2(aCodePoints, aCount, aOutGlyphs);
+    return;
+  }
+#endif
+  GetGlyphIndices_Scalar(aCodePoints, aCount, aOutGlyphs);
+}
+
+void
+FontGlyphMap::GetAdvances(const uint16_t* aGlyphs, uint32_t aCount, float aEmSize, float* aOutAdvances)
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_AVX2)) {
+    GetAdvances_AVX2(aGlyphs, aCount, aEmSize, aOutAdvances);
+    return;
+  }
+#endif
+  GetAdvances_Scalar(aGlyphs, aCount, aEmSize, aOutAdvances);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "CpuFeatures.h"
+
+// Where a FontGlyphMap gets the glyphs it has not seen yet, normally a font
+// face. Calls always cover a whole page of code points or block of glyphs.
+class GlyphMapSource {
+public:
+  virtual ~GlyphMapSource() { }
+
+  virtual void GetGlyphIndices(const uint32_t* aCodePoints, uint32_t aCount,
+                               uint16_t* aOutGlyphs) = 0;
+  // Horizontal advances in font design units.
+  virtual void GetDesignAdvances(const uint16_t* aGlyphs, uint32_t aCount,
+                                 int32_t* aOutAdvances) = 0;
+};
+
+/**
+ * Per font cmap and advance cache. Code points map to glyph indices through a
+ * two level table: the code point's 256 entry page is looked up in a page
+ * index, then the glyph is read from the page. Glyph advances are kept in a
+ * dense array indexed by glyph. Pages and 256 glyph blocks of advances are
+ * filled from the source on first touch, after that a lookup never calls out.
+ *
+ * The batch versions pick an AVX2 path when the CPU has it, which gathers 8
+ * lookups at a time and falls back to the scalar code for groups that touch
+ * anything not loaded yet. Not thread safe.
+ */
+class FontGlyphMap {
+public:
+  static const uint32_t kMaxCodePoint = 0x10FFFF;
+  static const uint32_t kPageBits = 8;
+  static const uint32_t kPageSize = 1 << kPageBits;
+
+  FontGlyphMap(std::unique_ptr<GlyphMapSource> aSource, uint32_t aGlyphCount,
+               uint16_t aDesignUnitsPerEm);
+
+  // Code points past kMaxCodePoint map to glyph 0, like unmapped ones.
+  uint16_t GetGlyphIndex(uint32_t aCodePoint);
+  void GetGlyphIndices(const uint32_t* aCodePoints, uint32_t aCount, uint16_t* aOutGlyphs);
+
+  // Glyphs past the end of the font have no advance.
+  int32_t GetDesignAdvance(uint16_t aGlyph);
+  // Advances scaled to aEmSize, computed as (advance * aEmSize) / unitsPerEm.
+  void GetAdvances(const uint16_t* aGlyphs, uint32_t aCount, float aEmSize, float* aOutAdvances);
+
+  uint32_t GlyphCount() const { return mGlyphCount; }
+  uint16_t DesignUnitsPerEm() const { return mDesignUnitsPerEm; }
+  uint32_t PageCount() const { return (uint32_t)(mGlyphPages.size() / kPageSize); }
+  // Calls made into the source so far.
+  uint64_t SourceCalls() const { return mSourceCalls; }
+
+  // The batch paths, exposed so they can be checked against each other.
+  void GetGlyphIndices_Scalar(const uint32_t* aCodePoints, uint32_t aCount, uint16_t* aOutGlyphs);
+  void GetAdvances_Scalar(const uint16_t* aGlyphs, uint32_t aCount, float aEmSize, float* aOutAdvances);
+#if defined(DW_CPU_X86)
+  void GetGlyphIndices_AVX2(const uint32_t* aCodePoints, uint32_t aCount, uint16_t* aOutGlyphs);
+  void GetAdvances_AVX2(const uint16_t* aGlyphs, uint32_t aCount, float aEmSize, float* aOutAdvances);
+#endif
+
+private:
+  static const uint16_t kNoPage = 0xFFFF;
+  static const int32_t kNoAdvance = INT32_MIN;
+
+  const uint16_t* LoadPage(uint32_t aPage);
+  void LoadAdvances(uint16_t aGlyph);
+
+  std::unique_ptr<GlyphMapSource> mSource;
+  uint32_t mGlyphCount;
+  uint16_t mDesignUnitsPerEm;
+  uint64_t mSourceCalls;
+
+  // Both tables have one spare entry at the end so 32 bit gathers of their
+  // last real entry stay in bounds.
+  std::vector<uint16_t> mPageIndex;    // Code point page -> page in mGlyphPages
+  std::vector<uint16_t> mGlyphPages;   // kPageSize glyphs per loaded page
+  std::vector<int32_t> mAdvances;      // kNoAdvance until the block is loaded
+};
@@ -0,0 +1,97 @@
+#include "FrameArena.h"
+#include <assert.h>
+#include <stdlib.h>
+
+FrameArena::FrameArena(size_t aChunkSize)
+  : mChunkSize(aChunkSize)
+  , mCurrent(0)
+  , mOffset(0)
+  , mBytesUsed(0)
+  , mHighWaterMark(0)
+  , mFrames(0)
+  , mChunkAllocations(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+  FreeChunks();
+}
+
+void*
+FrameArena::Allocate(size_t aSize, size_t aAlignment)
+{
+  assert(aAlignment && (aAlignment & (aAlignment - 1)) == 0);
+
+  for (;;) {
+    while (mCurrent < mChunks.size()) {
+      const Chunk& chunk = mChunks[mCurrent];
+      uintptr_t base = (uintptr_t)chunk.fBase;
+      uintptr_t start = (base + mOffset + aAlignment - 1) & ~(uintptr_t)(aAlignment - 1);
+      size_t end = (size_t)(start - base) + aSize;
+      if (end <= chunk.fSize) {
+        mBytesUsed += end - mOffset;
+        if (mBytesUsed > mHighWaterMark) {
+          mHighWaterMark = mBytesUsed;
+        }
+        mOffset = end;
+        return (void*)start;
+      }
+
+      // The tail of this chunk is wasted for the rest of the frame.
+      mCurrent++;
+      mOffset = 0;
+    }
+
+    // The chunk base is only malloc aligned, leave room to align inside it.
+    size_t needed = aSize + aAlignment;
+    AddChunk(needed > mChunkSize ? needed : mChunkSize);
+  }
+}
+
+void
+FrameArena::Reset()
+{
+  if (mChunks.size() > 1) {
+    // The frame spilled over. Trade the chunks for one that holds all of
+    // them so the next frame of this size is a single chunk again.
+    size_t capacity = Capacity();
+    FreeChunks();
+    AddChunk(capacity);
+  }
+
+  mCurrent = 0;
+  mOffset = 0;
+  mBytesUsed = 0;
+  mFrames++;
+}
+
+size_t
+FrameArena::Capacity() const
+{
+  size_t capacity = 0;
+  for (const Chunk& chunk : mChunks) {
+    capacity += chunk.fSize;
+  }
+  return capacity;
+}
+
+void
+FrameArena::AddChunk(size_t aSize)
+{
+  Chunk chunk;
+  chunk.fBase = (uint8_t*)malloc(aSize);
+  chunk.fSize = aSize;
+  assert(chunk.fBase);
+  mChunks.push_back(chunk);
+  mChunkAllocations++;
+}
+
+void
+FrameArena::FreeChunks()
+{
+  for (const Chunk& chunk : mChunks) {
+    free(chunk.fBase);
+  }
+  mChunks.clear();
+}
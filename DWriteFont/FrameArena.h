@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Bump allocator for scratch memory that only lives until the end of the
+ * frame: glyph run arrays, composited masks, converted BGRA pixels. Allocating
+ * is a pointer bump inside a chunk, Reset hands everything back at once.
+ *
+ * A frame that does not fit in the first chunk spills into more chunks. The
+ * next Reset replaces them with a single chunk big enough for the whole
+ * frame, so once the frame sizes settle a frame makes no calls to malloc.
+ * Nothing is destructed, only trivially destructible types go in here.
+ * Not thread safe.
+ */
+class FrameArena {
+public:
+  // Enough for AVX2 loads and stores.
+  static const size_t kDefaultAlignment = 32;
+  static const size_t kDefaultChunkSize = 256 * 1024;
+
+  explicit FrameArena(size_t aChunkSize = kDefaultChunkSize);
+  ~FrameArena();
+
+  // aAlignment must be a power of two. Never returns null.
+  void* Allocate(size_t aSize, size_t aAlignment = kDefaultAlignment);
+
+  template <typename T>
+  T* AllocateArray(size_t aCount) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "FrameArena never runs destructors");
+    size_t alignment = alignof(T) > kDefaultAlignment ? alignof(T) : kDefaultAlignment;
+    return static_cast<T*>(Allocate(aCount * sizeof(T), alignment));
+  }
+
+  // Ends the frame. Everything allocated since the last Reset is invalid.
+  void Reset();
+
+  // Bytes handed out this frame, alignment padding included.
+  size_t BytesUsed() const { return mBytesUsed; }
+  // Largest BytesUsed of any frame so far.
+  size_t HighWaterMark() const { return mHighWaterMark; }
+  size_t Capacity() const;
+  size_t ChunkCount() const { return mChunks.size(); }
+  uint64_t Frames() const { return mFrames; }
+  // Number of chunks ever malloc'ed. Stays put in steady state.
+  uint64_t ChunkAllocations() const { return mChunkAllocations; }
+
+private:
+  struct Chunk {
+    uint8_t* fBase;
+    size_t fSize;
+  };
+
+  void AddChunk(size_t aSize);
+  void FreeChunks();
+
+  FrameArena(const FrameArena&);
+  FrameArena& operator=(const FrameArena&);
+
+  std::vector<Chunk> mChunks;
+  size_t mChunkSize;
+  size_t mCurrent;   // Chunk being bumped into
+  size_t mOffset;    // Bytes used in mChunks[mCurrent]
+  size_t mBytesUsed;
+  size_t mHighWaterMark;
+  uint64_t mFrames;
+  uint64_t mChunkAllocations;
+};
@@ -0,0 +1,412 @@
+#include "GlyphAtlas.h"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+SkylinePacker::SkylinePacker(int32_t aWidth, int32_t aHeight)
+  : mWidth(aWidth)
+  , mHeight(aHeight)
+  , mUsedArea(0)
+{
+  Reset();
+}
+
+void
+SkylinePacker::Reset()
+{
+  Segment floor = { 0, 0, mWidth };
+  mSkyline.clear();
+  mSkyline.push_back(floor);
+  mUsedArea = 0;
+}
+
+int64_t
+SkylinePacker::SkylineArea() const
+{
+  int64_t area = 0;
+  for (size_t i = 0; i < mSkyline.size(); i++) {
+    area += (int64_t)mSkyline[i].fY * mSkyline[i].fWidth;
+  }
+  return area;
+}
+
+bool
+SkylinePacker::Fits(size_t aIndex, int32_t aWidth, int32_t aHeight, int32_t* aOutY) const
+{
+  int32_t x = mSkyline[aIndex].fX;
+  if (x + aWidth > mWidth) {
+    return false;
+  }
+
+  // The rect rests on the highest segment it spans.
+  int32_t y = 0;
+  int32_t remaining = aWidth;
+  for (size_t i = aIndex; remaining > 0; i++) {
+    assert(i < mSkyline.size());
+    y = std::max(y, mSkyline[i].fY);
+    if (y + aHeight > mHeight) {
+      return false;
+    }
+    remaining -= mSkyline[i].fWidth;
+  }
+
+  *aOutY = y;
+  return true;
+}
+
+void
+SkylinePacker::AddSegment(size_t aIndex, int32_t aX, int32_t aY, int32_t aWidth)
+{
+  Segment segment = { aX, aY, aWidth };
+  mSkyline.insert(mSkyline.begin() + aIndex, segment);
+
+  // Trim or drop the segments the new one now covers.
+  const int32_t right = aX + aWidth;
+  size_t i = aIndex + 1;
+  while (i < mSkyline.size() && mSkyline[i].fX < right) {
+    int32_t overlap = right - mSkyline[i].fX;
+    if (overlap >= mSkyline[i].fWidth) {
+      mSkyline.erase(mSkyline.begin() + i);
+      continue;
+    }
+    mSkyline[i].fX += overlap;
+    mSkyline[i].fWidth -= overlap;
+    break;
+  }
+
+  // Merge neighbours at the same height.
+  for (size_t j = 0; j + 1 < mSkyline.size();) {
+    if (mSkyline[j].fY == mSkyline[j + 1].fY) {
+      mSkyline[j].fWidth += mSkyline[j + 1].fWidth;
+      mSkyline.erase(mSkyline.begin() + j + 1);
+    } else {
+      j++;
+    }
+  }
+}
+
+bool
+SkylinePacker::Pack(int32_t aWidth, int32_t aHeight, int32_t* aOutX, int32_t* aOutY)
+{
+  if (aWidth <= 0 || aHeight <= 0) {
+    return false;
+  }
+
+  size_t bestIndex = 0;
+  int32_t bestBottom = INT32_MAX;
+  int32_t bestWidth = INT32_MAX;
+  int32_t bestY = 0;
+
+  for (size_t i = 0; i < mSkyline.size(); i++) {
+    int32_t y;
+    if (!Fits(i, aWidth, aHeight, &y)) {
+      continue;
+    }
+    int32_t bottom = y + aHeight;
+    if (bottom < bestBottom ||
+        (bottom == bestBottom && mSkyline[i].fWidth < bestWidth)) {
+      bestIndex = i;
+      bestBottom = bottom;
+      bestWidth = mSkyline[i].fWidth;
+      bestY = y;
+    }
+  }
+
+  if (bestBottom == INT32_MAX) {
+    return false;
+  }
+
+  *aOutX = mSkyline[bestIndex].fX;
+  *aOutY = bestY;
+  AddSegment(bestIndex, *aOutX, bestY + aHeight, aWidth);
+  mUsedArea += (int64_t)aWidth * aHeight;
+  return true;
+}
+
+GlyphAtlas::Page::Page(int32_t aPageSize, int32_t aBytesPerPixel)
+  : fPacker(aPageSize, aPageSize)
+  , fPixels((size_t)aPageSize * aPageSize * aBytesPerPixel)
+  , fDirty(IntRect::Make(0, 0, 0, 0))
+  , fLastUsedFrame(0)
+  , fGlyphArea(0)
+{
+}
+
+GlyphAtlas::GlyphAtlas(int32_t aPageSize, int32_t aBytesPerPixel, int32_t aMaxPages)
+  : mPageSize(aPageSize)
+  , mBytesPerPixel(aBytesPerPixel)
+  , mMaxPages(aMaxPages)
+  , mFrame(0)
+{
+  memset(&mStats, 0, sizeof(mStats));
+}
+
+void
+GlyphAtlas::BeginFrame()
+{
+  mFrame++;
+  mStats.fFrameEvictions = 0;
+}
+
+bool
+GlyphAtlas::Lookup(const AtlasKey& aKey, AtlasEntry* aOutEntry)
+{
+  auto found = mEntries.find(aKey);
+  if (found == mEntries.end()) {
+    return false;
+  }
+
+  AtlasEntry& entry = found->second;
+  entry.fLastUsedFrame = mFrame;
+  mPages[entry.fPage].fLastUsedFrame = mFrame;
+  *aOutEntry = entry;
+  return true;
+}
+
+void
+GlyphAtlas::SetEntryRect(AtlasEntry& aEntry, int32_t aPage, const IntRect& aRect)
+{
+  const float scale = 1.0f / mPageSize;
+  aEntry.fPage = aPage;
+  aEntry.fRect = aRect;
+  aEntry.fU0 = aRect.fLeft * scale;
+  aEntry.fV0 = aRect.fTop * scale;
+  aEntry.fU1 = aRect.fRight * scale;
+  aEntry.fV1 = aRect.fBottom * scale;
+}
+
+void
+GlyphAtlas::MarkDirty(Page& aPage, const IntRect& aRect)
+{
+  aPage.fDirty.Union(aRect);
+}
+
+bool
+GlyphAtlas::PackInto(int32_t aPage, int32_t aWidth, int32_t aHeight, IntRect* aOutRect)
+{
+  int32_t x, y;
+  if (!mPages[aPage].fPacker.Pack(aWidth + kPadding, aHeight + kPadding, &x, &y)) {
+    return false;
+  }
+  *aOutRect = IntRect::MakeXYWH(x, y, aWidth, aHeight);
+  return true;
+}
+
+void
+GlyphAtlas::ResetPage(int32_t aPage)
+{
+  Page& page = mPages[aPage];
+  for (size_t i = 0; i < page.fKeys.size(); i++) {
+    mEntries.erase(page.fKeys[i]);
+  }
+
+  mStats.fEvictions += page.fKeys.size();
+  mStats.fFrameEvictions += (uint32_t)page.fKeys.size();
+  mStats.fPageResets++;
+
+  // Stale pixels can stay, no entry points at them anymore.
+  page.fKeys.clear();
+  page.fPacker.Reset();
+  page.fGlyphArea = 0;
+}
+
+bool
+GlyphAtlas::CompactPage(int32_t aPage, uint32_t aKeepSinceFrame)
+{
+  Page& page = mPages[aPage];
+
+  std::vector<AtlasKey> keep;
+  std::vector<AtlasKey> evict;
+  for (size_t i = 0; i < page.fKeys.size(); i++) {
+    const AtlasEntry& entry = mEntries[page.fKeys[i]];
+    if (entry.fLastUsedFrame >= aKeepSinceFrame) {
+      keep.push_back(page.fKeys[i]);
+    } else {
+      evict.push_back(page.fKeys[i]);
+    }
+  }
+
+  if (evict.empty()) {
+    return false;
+  }
+
+  // Tallest first packs best on a skyline.
+  std::sort(keep.begin(), keep.end(), [this](const AtlasKey& a, const AtlasKey& b) {
+    return mEntries[a].fRect.Height() > mEntries[b].fRect.Height();
+  });
+
+  // Lay out the survivors on a trial packer first. If they do not all fit
+  // (packing is order dependent) leave the page alone, since some of them may
+  // be in use this frame.
+  SkylinePacker packer(mPageSize, mPageSize);
+  std::vector<IntRect> rects(keep.size());
+  for (size_t i = 0; i < keep.size(); i++) {
+    const IntRect& old = mEntries[keep[i]].fRect;
+    int32_t x, y;
+    if (!packer.Pack(old.Width() + kPadding, old.Height() + kPadding, &x, &y)) {
+      return false;
+    }
+    rects[i] = IntRect::MakeXYWH(x, y, old.Width(), old.Height());
+  }
+
+  std::vector<uint8_t> pixels(page.fPixels.size());
+  const int32_t stride = PageStride();
+  int64_t glyphArea = 0;
+  for (size_t i = 0; i < keep.size(); i++) {
+    AtlasEntry& entry = mEntries[keep[i]];
+    const IntRect& from = entry.fRect;
+    const IntRect& to = rects[i];
+    const size_t rowBytes = (size_t)from.Width() * mBytesPerPixel;
+    for (int32_t y = 0; y < from.Height(); y++) {
+      memcpy(&pixels[(to.fTop + y) * stride + to.fLeft * mBytesPerPixel],
+             &page.fPixels[(from.fTop + y) * stride + from.fLeft * mBytesPerPixel],
+             rowBytes);
+    }
+    SetEntryRect(entry, aPage, to);
+    glyphArea += (int64_t)to.Width() * to.Height();
+  }
+
+  for (size_t i = 0; i < evict.size(); i++) {
+    mEntries.erase(evict[i]);
+  }
+
+  mStats.fEvictions += evict.size();
+  mStats.fFrameEvictions += (uint32_t)evict.size();
+  mStats.fCompactions++;
+
+  page.fPixels.swap(pixels);
+  page.fPacker = packer;
+  page.fKeys.swap(keep);
+  page.fGlyphArea = glyphArea;
+  MarkDirty(page, IntRect::Make(0, 0, mPageSize, mPageSize));
+  return true;
+}
+
+bool
+GlyphAtlas::Allocate(int32_t aWidth, int32_t aHeight, int32_t* aOutPage, IntRect* aOutRect)
+{
+  for (int32_t i = 0; i < PageCount(); i++) {
+    if (PackInto(i, aWidth, aHeight, aOutRect)) {
+      *aOutPage = i;
+      return true;
+    }
+  }
+
+  if (PageCount() < mMaxPages) {
+    mPages.push_back(Page(mPageSize, mBytesPerPixel));
+    *aOutPage = PageCount() - 1;
+    return PackInto(*aOutPage, aWidth, aHeight, aOutRect);
+  }
+
+  // Reclaim pages nothing in this frame uses, least recently used first.
+  // Stale pages are dropped whole, otherwise keep what was used recently.
+  std::vector<int32_t> order;
+  for (int32_t i = 0; i < PageCount(); i++) {
+    order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), [this](int32_t a, int32_t b) {
+    return mPages[a].fLastUsedFrame < mPages[b].fLastUsedFrame;
+  });
+
+  const uint32_t keepSince = mFrame >= kStaleFrames ? mFrame - kStaleFrames + 1 : 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    int32_t index = order[i];
+    uint32_t lastUsed = mPages[index].fLastUsedFrame;
+    if (lastUsed == mFrame) {
+      continue;
+    }
+    if (mFrame - lastUsed >= kStaleFrames || !CompactPage(index, keepSince)) {
+      ResetPage(index);
+    }
+    if (PackInto(index, aWidth, aHeight, aOutRect)) {
+      *aOutPage = index;
+      return true;
+    }
+  }
+
+  // Every page has glyphs from this frame. Repacking them would move
+  // entries handed out earlier in the frame, so the glyph does not fit.
+  return false;
+}
+
+bool
+GlyphAtlas::Insert(const AtlasKey& aKey, int32_t aWidth, int32_t aHeight,
+                   const uint8_t* aBits, int32_t aStride, AtlasEntry* aOutEntry)
+{
+  uint8_t* pixels;
+  if (!Reserve(aKey, aWidth, aHeight, aOutEntry, &pixels)) {
+    return false;
+  }
+
+  const int32_t stride = PageStride();
+  const size_t rowBytes = (size_t)aWidth * mBytesPerPixel;
+  for (int32_t y = 0; y < aHeight; y++) {
+    memcpy(pixels + y * stride, aBits + y * aStride, rowBytes);
+  }
+  return true;
+}
+
+bool
+GlyphAtlas::Reserve(const AtlasKey& aKey, int32_t aWidth, int32_t aHeight,
+                    AtlasEntry* aOutEntry, uint8_t** aOutPixels)
+{
+  assert(mEntries.find(aKey) == mEntries.end());
+
+  int32_t pageIndex;
+  IntRect rect;
+  if (aWidth + kPadding > mPageSize || aHeight + kPadding > mPageSize ||
+      !Allocate(aWidth, aHeight, &pageIndex, &rect)) {
+    mStats.fFailedInserts++;
+    return false;
+  }
+
+  Page& page = mPages[pageIndex];
+  *aOutPixels = &page.fPixels[rect.fTop * PageStride() + rect.fLeft * mBytesPerPixel];
+  MarkDirty(page, rect);
+
+  AtlasEntry entry;
+  SetEntryRect(entry, pageIndex, rect);
+  entry.fLastUsedFrame = mFrame;
+  mEntries[aKey] = entry;
+
+  page.fKeys.push_back(aKey);
+  page.fLastUsedFrame = mFrame;
+  page.fGlyphArea += (int64_t)aWidth * aHeight;
+  mStats.fInserts++;
+
+  *aOutEntry = entry;
+  return true;
+}
+
+void
+GlyphAtlas::Clear()
+{
+  mPages.clear();
+  mEntries.clear();
+}
+
+double
+GlyphAtlas::PackingEfficiency() const
+{
+  if (mPages.empty()) {
+    return 0.0;
+  }
+
+  int64_t glyphArea = 0;
+  for (size_t i = 0; i < mPages.size(); i++) {
+    glyphArea += mPages[i].fGlyphArea;
+  }
+  return (double)glyphArea / ((double)mPageSize * mPageSize * mPages.size());
+}
+
+double
+GlyphAtlas::PackedDensity() const
+{
+  int64_t glyphArea = 0;
+  int64_t skylineArea = 0;
+  for (size_t i = 0; i < mPages.size(); i++) {
+    glyphArea += mPages[i].fGlyphArea;
+    skylineArea += mPages[i].fPacker.SkylineArea();
+  }
+  return skylineArea ? (double)glyphArea / skylineArea : 0.0;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "GlyphCache.h"
+#include "IntRect.h"
+
+/**
+ * Skyline bottom-left rectangle packer. The skyline is the list of segments
+ * making up the top edge of everything packed so far; a new rectangle goes at
+ * the position that keeps its bottom edge lowest.
+ */
+class SkylinePacker {
+public:
+  SkylinePacker(int32_t aWidth, int32_t aHeight);
+
+  void Reset();
+
+  // Finds room for a aWidth x aHeight rect. Returns false if the page is full.
+  bool Pack(int32_t aWidth, int32_t aHeight, int32_t* aOutX, int32_t* aOutY);
+
+  int32_t Width() const { return mWidth; }
+  int32_t Height() const { return mHeight; }
+  // Sum of the packed rect areas.
+  int64_t UsedArea() const { return mUsedArea; }
+  // Area under the skyline, packed rects plus the gaps trapped below them.
+  int64_t SkylineArea() const;
+
+private:
+  struct Segment {
+    int32_t fX;
+    int32_t fY;
+    int32_t fWidth;
+  };
+
+  bool Fits(size_t aIndex, int32_t aWidth, int32_t aHeight, int32_t* aOutY) const;
+  void AddSegment(size_t aIndex, int32_t aX, int32_t aY, int32_t aWidth);
+
+  std::vector<Segment> mSkyline;
+  int32_t mWidth;
+  int32_t mHeight;
+  int64_t mUsedArea;
+};
+
+// A glyph in the atlas is the glyph mask key plus which conversion produced
+// the stored pixels (for example ConvertToBGRA with a given LUT setup) and
+// the ARGB colors it was blended in.
+struct AtlasKey {
+  GlyphKey fGlyph;
+  uint32_t fVariant;
+  uint32_t fForeground;
+  uint32_t fBackground;
+
+  bool operator==(const AtlasKey& aOther) const {
+    return fGlyph == aOther.fGlyph && fVariant == aOther.fVariant &&
+           fForeground == aOther.fForeground && fBackground == aOther.fBackground;
+  }
+};
+
+struct AtlasKeyHash {
+  size_t operator()(const AtlasKey& aKey) const {
+    size_t hash = GlyphKeyHash()(aKey.fGlyph) ^ ((size_t)aKey.fVariant * 0x9E3779B9u);
+    hash ^= (size_t)aKey.fForeground * 0x85EBCA6Bu;
+    return hash ^ ((size_t)aKey.fBackground * 0xC2B2AE35u);
+  }
+};
+
+// Where a glyph lives in the atlas. fRect excludes the padding around it.
+struct AtlasEntry {
+  int32_t fPage;
+  IntRect fRect;
+  float fU0, fV0, fU1, fV1;  // fRect normalized to the page size
+  uint32_t fLastUsedFrame;
+};
+
+struct AtlasStats {
+  uint64_t fInserts;
+  uint64_t fEvictions;        // Entries dropped, by page reset or compaction
+  uint64_t fPageResets;
+  uint64_t fCompactions;
+  uint64_t fFailedInserts;    // Glyphs that did not fit even after eviction
+  uint32_t fFrameEvictions;   // fEvictions during the current frame
+};
+
+/**
+ * Glyph atlas made of fixed size pages. Glyph pixels are packed into pages
+ * with a SkylinePacker and kept in a CPU copy of each page; whoever owns the
+ * GPU surfaces uploads each page's dirty rect. Platform neutral.
+ *
+ * When nothing fits, space is reclaimed by frame age: a page no glyph of the
+ * current frame is on is reset if it has gone unused for kStaleFrames,
+ * otherwise the page is compacted, keeping only recently used glyphs and
+ * repacking them. Glyphs used in the current frame are never evicted, so
+ * entries looked up earlier in the frame stay valid until the next BeginFrame.
+ */
+class GlyphAtlas {
+public:
+  static const int32_t kPadding = 1;
+  static const uint32_t kStaleFrames = 8;
+
+  GlyphAtlas(int32_t aPageSize, int32_t aBytesPerPixel, int32_t aMaxPages);
+
+  void BeginFrame();
+  uint32_t Frame() const { return mFrame; }
+
+  // Fills aOutEntry and marks the glyph used this frame if it is in the atlas.
+  bool Lookup(const AtlasKey& aKey, AtlasEntry* aOutEntry);
+
+  // Copies a aWidth x aHeight glyph into the atlas. aBits has aBytesPerPixel
+  // bytes per pixel, aStride bytes per row. Returns false if there is no room
+  // even after evicting everything not used in this frame.
+  bool Insert(const AtlasKey& aKey, int32_t aWidth, int32_t aHeight,
+              const uint8_t* aBits, int32_t aStride, AtlasEntry* aOutEntry);
+
+  // Like Insert, but leaves the pixels to the caller: *aOutPixels points at
+  // the glyph's top left pixel in the page, rows are PageStride() apart. The
+  // pointer is valid until the next Insert, Reserve or Clear.
+  bool Reserve(const AtlasKey& aKey, int32_t aWidth, int32_t aHeight,
+               AtlasEntry* aOutEntry, uint8_t** aOutPixels);
+
+  void Clear();
+
+  int32_t PageSize() const { return mPageSize; }
+  int32_t BytesPerPixel() const { return mBytesPerPixel; }
+  int32_t PageCount() const { return (int32_t)mPages.size(); }
+  const uint8_t* PagePixels(int32_t aPage) const { return mPages[aPage].fPixels.data(); }
+  int32_t PageStride() const { return mPageSize * mBytesPerPixel; }
+
+  // Area touched since the last ClearDirtyRect, which the GPU copy lacks.
+  const IntRect& PageDirtyRect(int32_t aPage) const { return mPages[aPage].fDirty; }
+  void ClearDirtyRect(int32_t aPage) { mPages[aPage].fDirty = IntRect::Make(0, 0, 0, 0); }
+
+  // Glyph area over the area of all pages, in [0, 1].
+  double PackingEfficiency() const;
+  // Glyph area over the area below each page's skyline, in [0, 1].
+  double PackedDensity() const;
+  size_t EntryCount() const { return mEntries.size(); }
+  const AtlasStats& Stats() const { return mStats; }
+
+private:
+  struct Page {
+    Page(int32_t aPageSize, int32_t aBytesPerPixel);
+
+    SkylinePacker fPacker;
+    std::vector<uint8_t> fPixels;
+    std::vector<AtlasKey> fKeys;
+    IntRect fDirty;
+    uint32_t fLastUsedFrame;
+    int64_t fGlyphArea;
+  };
+
+  bool Allocate(int32_t aWidth, int32_t aHeight, int32_t* aOutPage, IntRect* aOutRect);
+  bool PackInto(int32_t aPage, int32_t aWidth, int32_t aHeight, IntRect* aOutRect);
+  void ResetPage(int32_t aPage);
+  bool CompactPage(int32_t aPage, uint32_t aKeepSinceFrame);
+  void MarkDirty(Page& aPage, const IntRect& aRect);
+  void SetEntryRect(AtlasEntry& aEntry, int32_t aPage, const IntRect& aRect);
+
+  std::vector<Page> mPages;
+  std::unordered_map<AtlasKey, AtlasEntry, AtlasKeyHash> mEntries;
+  int32_t mPageSize;
+  int32_t mBytesPerPixel;
+  int32_t mMaxPages;
+  uint32_t mFrame;
+  AtlasStats mStats;
+};
@@ -0,0 +1,125 @@
+#include "GlyphCache.h"
+#include <string.h>
+
+size_t
+GlyphKeyHash::operator()(const GlyphKey& aKey) const
+{
+  // Hash field by field, the struct has padding.
+  uint64_t hash = kHashSeed;
+  hash = HashBytes(hash, &aKey.fFaceId, sizeof(aKey.fFaceId));
+  hash = HashBytes(hash, &aKey.fEmSize, sizeof(aKey.fEmSize));
+  hash = HashBytes(hash, &aKey.fPixelsPerDip, sizeof(aKey.fPixelsPerDip));
+  hash = HashBytes(hash, &aKey.fGlyphIndex, sizeof(aKey.fGlyphIndex));
+  uint8_t modes[4] = { aKey.fRenderingMode, aKey.fMeasuringMode,
+                       aKey.fTextureType, aKey.fSubpixelX };
+  hash = HashBytes(hash, modes, sizeof(modes));
+  return (size_t)hash;
+}
+
+GlyphCache::GlyphCache(size_t aByteBudget)
+  : mByteBudget(aByteBudget)
+  , mByteSize(0)
+  , mHits(0)
+  , mMisses(0)
+  , mEvictions(0)
+{
+}
+
+GlyphMaskRef
+GlyphCache::Lookup(const GlyphKey& aKey)
+{
+  auto found = mMap.find(aKey);
+  if (found == mMap.end()) {
+    mMisses++;
+    return GlyphMaskRef();
+  }
+
+  mHits++;
+  mLRU.splice(mLRU.begin(), mLRU, found->second);
+  return found->second->second;
+}
+
+GlyphMaskRef
+GlyphCache::Insert(const GlyphKey& aKey, GlyphMask* aMask)
+{
+  GlyphMaskRef mask(aMask);
+
+  auto found = mMap.find(aKey);
+  if (found != mMap.end()) {
+    mByteSize -= found->second->second->ByteSize() + kEntryOverhead;
+    mLRU.erase(found->second);
+    mMap.erase(found);
+  }
+
+  mLRU.push_front(std::make_pair(aKey, mask));
+  mMap[aKey] = mLRU.begin();
+  mByteSize += mask->ByteSize() + kEntryOverhead;
+
+  EvictToBudget();
+  return mask;
+}
+
+void
+GlyphCache::EvictToBudget()
+{
+  // Never evict the entry that was just inserted.
+  while (mByteSize > mByteBudget && mLRU.size() > 1) {
+    LRUList::iterator last = --mLRU.end();
+    mByteSize -= last->second->ByteSize() + kEntryOverhead;
+    mMap.erase(last->first);
+    mLRU.erase(last);
+    mEvictions++;
+  }
+}
+
+void
+GlyphCache::Clear()
+{
+  mLRU.clear();
+  mMap.clear();
+  mByteSize = 0;
+}
+
+IntRect
+GetGlyphRunBounds(const std::vector<PlacedGlyph>& aGlyphs)
+{
+  IntRect bounds = IntRect::Make(0, 0, 0, 0);
+  for (size_t i = 0; i < aGlyphs.size(); i++) {
+    bounds.Union(aGlyphs[i].Bounds());
+  }
+  return bounds;
+}
+
+void
+CompositeGlyphRun(const std::vector<PlacedGlyph>& aGlyphs, const IntRect& aBounds,
+                  int32_t aBytesPerPixel, uint8_t* aOut)
+{
+  const int32_t outStride = aBounds.Width() * aBytesPerPixel;
+  memset(aOut, 0, (size_t)outStride * aBounds.Height());
+
+  for (size_t i = 0; i < aGlyphs.size(); i++) {
+    const GlyphMask* mask = aGlyphs[i].fMask.get();
+    if (mask->IsEmpty()) {
+      continue;
+    }
+
+    IntRect glyphBounds = aGlyphs[i].Bounds();
+    IntRect clipped = glyphBounds;
+    if (!clipped.Intersect(aBounds)) {
+      continue;
+    }
+
+    const int32_t maskStride = mask->fWidth * mask->fBytesPerPixel;
+    const int32_t rowBytes = clipped.Width() * aBytesPerPixel;
+    for (int32_t y = clipped.fTop; y < clipped.fBottom; y++) {
+      const uint8_t* src = mask->fBits + (y - glyphBounds.fTop) * maskStride +
+                           (clipped.fLeft - glyphBounds.fLeft) * aBytesPerPixel;
+      uint8_t* dst = aOut + (y - aBounds.fTop) * outStride +
+                     (clipped.fLeft - aBounds.fLeft) * aBytesPerPixel;
+      for (int32_t x = 0; x < rowBytes; x++) {
+        int sum = dst[x] + src[x];
+        dst[x] = sum > 0xFF ? 0xFF : (uint8_t)sum;
+      }
+    }
+  }
+}
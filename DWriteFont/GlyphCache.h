@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "IntRect.h"
+
+// Everything that changes the pixels a rasterizer produces for a single glyph.
+struct GlyphKey {
+  uint64_t fFaceId;        // Identity of the font face, see FontFaceCache::GetFontFaceId
+  float fEmSize;
+  float fPixelsPerDip;
+  uint16_t fGlyphIndex;
+  uint8_t fRenderingMode;  // DWRITE_RENDERING_MODE
+  uint8_t fMeasuringMode;  // DWRITE_MEASURING_MODE
+  uint8_t fTextureType;    // GlyphMaskFormat, numbered like DWRITE_TEXTURE_TYPE
+  uint8_t fSubpixelX;      // Horizontal origin in 1/kSubpixelSteps of a pixel
+
+  // Glyph origins are snapped to this many horizontal positions per pixel so
+  // runs composited from cached masks keep their fractional advances.
+  static const int kSubpixelSteps = 4;
+
+  bool operator==(const GlyphKey& aOther) const {
+    return fFaceId == aOther.fFaceId &&
+           fEmSize == aOther.fEmSize &&
+           fPixelsPerDip == aOther.fPixelsPerDip &&
+           fGlyphIndex == aOther.fGlyphIndex &&
+           fRenderingMode == aOther.fRenderingMode &&
+           fMeasuringMode == aOther.fMeasuringMode &&
+           fTextureType == aOther.fTextureType &&
+           fSubpixelX == aOther.fSubpixelX;
+  }
+};
+
+// FNV-1a, used for the cache keys and font face identities.
+static inline uint64_t
+HashBytes(uint64_t aHash, const void* aData, size_t aLength)
+{
+  const uint8_t* bytes = (const uint8_t*)aData;
+  for (size_t i = 0; i < aLength; i++) {
+    aHash ^= bytes[i];
+    aHash *= 0x100000001b3ULL;
+  }
+  return aHash;
+}
+
+static const uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+
+struct GlyphKeyHash {
+  size_t operator()(const GlyphKey& aKey) const;
+};
+
+// A rasterized glyph. Bounds are in pixels relative to the glyph origin
+// rounded down to a whole pixel, fBits holds fBytesPerPixel bytes per pixel
+// with rows packed tightly. Empty glyphs (spaces) have no bits.
+struct GlyphMask {
+  GlyphMask() : fLeft(0), fTop(0), fWidth(0), fHeight(0), fBytesPerPixel(0), fBits(nullptr) { }
+  ~GlyphMask() { free(fBits); }
+
+  size_t ByteSize() const { return (size_t)fWidth * fHeight * fBytesPerPixel; }
+  bool IsEmpty() const { return fWidth <= 0 || fHeight <= 0; }
+
+  int32_t fLeft;
+  int32_t fTop;
+  int32_t fWidth;
+  int32_t fHeight;
+  int32_t fBytesPerPixel;
+  uint8_t* fBits;  // malloc'ed, owned by the mask
+
+private:
+  GlyphMask(const GlyphMask&);
+  GlyphMask& operator=(const GlyphMask&);
+};
+
+typedef std::shared_ptr<const GlyphMask> GlyphMaskRef;
+
+/**
+ * LRU cache of per glyph masks bounded by the total size of the mask bits.
+ * Masks are handed out as shared references so a run being composited keeps
+ * its glyphs alive even if inserting later glyphs of the same run evicts them.
+ * Not thread safe.
+ */
+class GlyphCache {
+public:
+  explicit GlyphCache(size_t aByteBudget);
+
+  // Returns the cached mask and marks it most recently used, or null.
+  GlyphMaskRef Lookup(const GlyphKey& aKey);
+
+  // Whether aKey is cached, without counting a hit or a miss or touching
+  // the LRU order.
+  bool Contains(const GlyphKey& aKey) const { return mMap.count(aKey) != 0; }
+
+  // Takes ownership of aMask and evicts least recently used masks until the
+  // cache fits its budget again.
+  GlyphMaskRef Insert(const GlyphKey& aKey, GlyphMask* aMask);
+
+  void Clear();
+
+  size_t ByteBudget() const { return mByteBudget; }
+  size_t ByteSize() const { return mByteSize; }
+  size_t Count() const { return mMap.size(); }
+  uint64_t Hits() const { return mHits; }
+  uint64_t Misses() const { return mMisses; }
+  uint64_t Evictions() const { return mEvictions; }
+
+private:
+  // Overhead charged per entry on top of the mask bits so a flood of empty
+  // glyphs cannot grow the cache without bound.
+  static const size_t kEntryOverhead = 64;
+
+  typedef std::list<std::pair<GlyphKey, GlyphMaskRef> > LRUList;
+
+  void EvictToBudget();
+
+  LRUList mLRU;  // Most recently used at the front
+  std::unordered_map<GlyphKey, LRUList::iterator, GlyphKeyHash> mMap;
+  size_t mByteBudget;
+  size_t mByteSize;
+  uint64_t mHits;
+  uint64_t mMisses;
+  uint64_t mEvictions;
+};
+
+// A cached glyph mask placed at a whole pixel position in a run.
+struct PlacedGlyph {
+  GlyphMaskRef fMask;
+  int32_t fX;
+  int32_t fY;
+
+  IntRect Bounds() const {
+    return IntRect::MakeXYWH(fX + fMask->fLeft, fY + fMask->fTop,
+                             fMask->fWidth, fMask->fHeight);
+  }
+};
+
+// Union of the bounds of every non empty glyph in the run.
+IntRect GetGlyphRunBounds(const std::vector<PlacedGlyph>& aGlyphs);
+
+/**
+ * Composites the placed glyphs into aOut, which covers aBounds with
+ * aBytesPerPixel bytes per pixel and rows packed tightly. Overlapping glyphs
+ * add their coverage, saturating at 255.
+ */
+void CompositeGlyphRun(const std::vector<PlacedGlyph>& aGlyphs, const IntRect& aBounds,
+                       int32_t aBytesPerPixel, uint8_t* aOut);
@@ -0,0 +1,102 @@
+#include "GlyphRasterBatch.h"
+#include <algorithm>
+#include "Trace.h"
+
+GlyphRasterBatch::GlyphRasterBatch(WorkStealingPool* aPool)
+  : mPool(aPool)
+{
+}
+
+uint32_t
+GlyphRasterBatch::GetSource(GlyphRasterizer& aRasterizer, const GlyphKey& aTemplate)
+{
+  for (size_t i = 0; i < mSources.size(); i++) {
+    if (mSources[i].fTemplate == aTemplate) {
+      return (uint32_t)i;
+    }
+  }
+
+  mSources.emplace_back();
+  Source& source = mSources.back();
+  source.fTemplate = aTemplate;
+  source.fRasterizer = &aRasterizer;
+  source.fClones.resize(mPool->ThreadCount());
+  // The first clone tells whether the backend can clone at all, and is the
+  // calling thread's.
+  source.fClones[0].reset(aRasterizer.Clone());
+  source.fSerial = !source.fClones[0];
+  return (uint32_t)(mSources.size() - 1);
+}
+
+void
+GlyphRasterBatch::AddRun(GlyphRasterizer& aRasterizer, const GlyphCache& aCache,
+                         GlyphMaskFormat aFormat, const uint16_t* aGlyphs, const float* aAdvances,
+                         const GlyphOffset* aOffsets, uint32_t aCount, bool aRightToLeft)
+{
+  GetGlyphRunKeys(aRasterizer, aFormat, aGlyphs, aAdvances, aOffsets, aCount, aRightToLeft, mKeys);
+
+  uint32_t source = UINT32_MAX;
+  for (const GlyphKey& key : mKeys) {
+    if (aCache.Contains(key) || !mQueued.insert(key).second) {
+      continue;
+    }
+    if (source == UINT32_MAX) {
+      GlyphKey keyTemplate = key;
+      keyTemplate.fGlyphIndex = 0;
+      keyTemplate.fSubpixelX = 0;
+      source = GetSource(aRasterizer, keyTemplate);
+    }
+    Pending pending = { key, source, nullptr };
+    mPending.push_back(pending);
+  }
+}
+
+void
+GlyphRasterBatch::Rasterize(GlyphCache& aCache)
+{
+  if (mPending.empty()) {
+    mSources.clear();
+    return;
+  }
+
+  TRACE_ZONE("GlyphRasterBatch::Rasterize");
+  std::vector<uint32_t> parallel;
+  for (uint32_t i = 0; i < mPending.size(); i++) {
+    Pending& pending = mPending[i];
+    Source& source = mSources[pending.fSource];
+    if (!source.fSerial) {
+      parallel.push_back(i);
+      continue;
+    }
+    TRACE_ZONE("RasterizeGlyph");
+    pending.fMask = source.fRasterizer->RasterizeGlyph(
+      pending.fKey.fGlyphIndex, (float)pending.fKey.fSubpixelX / GlyphKey::kSubpixelSteps,
+      (GlyphMaskFormat)pending.fKey.fTextureType);
+  }
+
+  const int batches = (int)((parallel.size() + kBatchSize - 1) / kBatchSize);
+  mPool->ParallelFor(batches, [&](int aBatch, int aThread) {
+    TRACE_ZONE("RasterizeGlyphBatch");
+    size_t end = std::min(parallel.size(), (size_t)(aBatch + 1) * kBatchSize);
+    for (size_t i = (size_t)aBatch * kBatchSize; i < end; i++) {
+      Pending& pending = mPending[parallel[i]];
+      Source& source = mSources[pending.fSource];
+      std::unique_ptr<GlyphRasterizer>& rasterizer = source.fClones[aThread];
+      if (!rasterizer) {
+        rasterizer.reset(source.fRasterizer->Clone());
+      }
+      pending.fMask = rasterizer->RasterizeGlyph(
+        pending.fKey.fGlyphIndex, (float)pending.fKey.fSubpixelX / GlyphKey::kSubpixelSteps,
+        (GlyphMaskFormat)pending.fKey.fTextureType);
+    }
+  });
+
+  // Publish on this thread, the cache is not thread safe.
+  for (const Pending& pending : mPending) {
+    aCache.Insert(pending.fKey, pending.fMask);
+  }
+  mPending.clear();
+  mQueued.clear();
+  // The runs' rasterizers may be gone before the next batch.
+  mSources.clear();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+#include "GlyphCache.h"
+#include "GlyphRasterizer.h"
+#include "WorkStealingPool.h"
+
+/**
+ * The parallel rasterization stage in front of GetGlyphRunMasks. Runs are
+ * added first and only their glyphs missing from the cache are queued,
+ * each key once. Rasterize then splits the queue into batches of
+ * kBatchSize glyphs that the WorkStealingPool's threads rasterize, each
+ * through its own Clone of the run's rasterizer, and finally publishes the
+ * masks into the cache from the calling thread. The cache itself is never
+ * touched off that thread, and GetGlyphRunMasks finds every glyph cached
+ * afterwards.
+ *
+ * Runs whose rasterizer cannot Clone are rasterized on the calling thread.
+ * Runs with the same key template share clones, so a page of one font
+ * clones its rasterizer once per thread.
+ */
+class GlyphRasterBatch {
+public:
+  // Glyphs per task. Big enough to pay for taking the task, small enough
+  // that a run of large glyphs still spreads over the threads.
+  static const int kBatchSize = 8;
+
+  explicit GlyphRasterBatch(WorkStealingPool* aPool);
+
+  // Queues the glyphs of the run that aCache does not have. aRasterizer
+  // has to stay alive until Rasterize.
+  void AddRun(GlyphRasterizer& aRasterizer, const GlyphCache& aCache, GlyphMaskFormat aFormat,
+              const uint16_t* aGlyphs, const float* aAdvances, const GlyphOffset* aOffsets,
+              uint32_t aCount, bool aRightToLeft);
+
+  // Rasterizes everything queued, inserts the masks into aCache in the
+  // order they were queued and empties the batch.
+  void Rasterize(GlyphCache& aCache);
+
+  size_t PendingCount() const { return mPending.size(); }
+
+private:
+  GlyphRasterBatch(const GlyphRasterBatch&);
+  GlyphRasterBatch& operator=(const GlyphRasterBatch&);
+
+  // The rasterizer runs with one key template go through.
+  struct Source {
+    GlyphKey fTemplate;
+    GlyphRasterizer* fRasterizer;
+    bool fSerial;   // Cannot Clone, rasterize on the calling thread
+    // Clone per pool thread, made on that thread when it first needs one.
+    std::vector<std::unique_ptr<GlyphRasterizer>> fClones;
+  };
+
+  struct Pending {
+    GlyphKey fKey;
+    uint32_t fSource;
+    GlyphMask* fMask;
+  };
+
+  uint32_t GetSource(GlyphRasterizer& aRasterizer, const GlyphKey& aTemplate);
+
+  WorkStealingPool* mPool;
+  std::vector<Source> mSources;
+  std::vector<Pending> mPending;
+  std::unordered_set<GlyphKey, GlyphKeyHash> mQueued;
+  std::vector<GlyphKey> mKeys;
+};
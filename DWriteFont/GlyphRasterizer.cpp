@@ -0,0 +1,98 @@
+#include "GlyphRasterizer.h"
+#include "Trace.h"
+#include <assert.h>
+#include <math.h>
+
+// Walks the pen along a run and calls aVisit(i, wholeX, y, subpixel) for
+// every glyph: the whole pixel position of its mask and the subpixel origin
+// the mask is cached for.
+template <typename Visit>
+static void
+WalkGlyphRun(const float* aAdvances, const GlyphOffset* aOffsets, uint32_t aCount,
+             bool aRightToLeft, Visit aVisit)
+{
+  float penX = 0.0f;
+  for (uint32_t i = 0; i < aCount; i++) {
+    if (aRightToLeft) {
+      penX -= aAdvances[i];
+    }
+
+    float x = penX;
+    float y = 0.0f;
+    if (aOffsets) {
+      x += aRightToLeft ? -aOffsets[i].fAdvanceOffset : aOffsets[i].fAdvanceOffset;
+      y -= aOffsets[i].fAscenderOffset;
+    }
+
+    // Masks are cached for a few horizontal subpixel origins, the whole pixel
+    // part of the position is applied when compositing.
+    float wholeX = floorf(x);
+    int subpixel = (int)((x - wholeX) * GlyphKey::kSubpixelSteps + 0.5f);
+    if (subpixel == GlyphKey::kSubpixelSteps) {
+      subpixel = 0;
+      wholeX += 1.0f;
+    }
+
+    aVisit(i, (int32_t)wholeX, (int32_t)floorf(y + 0.5f), (uint8_t)subpixel);
+
+    if (!aRightToLeft) {
+      penX += aAdvances[i];
+    }
+  }
+}
+
+void
+GetGlyphRunMasks(GlyphRasterizer& aRasterizer, GlyphCache& aCache, GlyphMaskFormat aFormat,
+                 const uint16_t* aGlyphs, const float* aAdvances, const GlyphOffset* aOffsets,
+                 uint32_t aCount, bool aRightToLeft,
+                 std::vector<PlacedGlyph>& aOutGlyphs, std::vector<GlyphKey>* aOutKeys)
+{
+  assert(aAdvances || !aCount);
+  TRACE_ZONE("GetGlyphRunMasks");
+
+  GlyphKey key;
+  aRasterizer.GetKeyTemplate(aFormat, &key);
+
+  aOutGlyphs.resize(aCount);
+  if (aOutKeys) {
+    aOutKeys->resize(aCount);
+  }
+
+  WalkGlyphRun(aAdvances, aOffsets, aCount, aRightToLeft,
+               [&](uint32_t i, int32_t aX, int32_t aY, uint8_t aSubpixel) {
+    key.fGlyphIndex = aGlyphs[i];
+    key.fSubpixelX = aSubpixel;
+
+    GlyphMaskRef mask = aCache.Lookup(key);
+    if (!mask) {
+      TRACE_ZONE("RasterizeGlyph");
+      float originX = (float)aSubpixel / GlyphKey::kSubpixelSteps;
+      mask = aCache.Insert(key, aRasterizer.RasterizeGlyph(key.fGlyphIndex, originX, aFormat));
+    }
+
+    aOutGlyphs[i].fMask = mask;
+    aOutGlyphs[i].fX = aX;
+    aOutGlyphs[i].fY = aY;
+    if (aOutKeys) {
+      (*aOutKeys)[i] = key;
+    }
+  });
+}
+
+void
+GetGlyphRunKeys(GlyphRasterizer& aRasterizer, GlyphMaskFormat aFormat,
+                const uint16_t* aGlyphs, const float* aAdvances, const GlyphOffset* aOffsets,
+                uint32_t aCount, bool aRightToLeft, std::vector<GlyphKey>& aOutKeys)
+{
+  assert(aAdvances || !aCount);
+  GlyphKey key;
+  aRasterizer.GetKeyTemplate(aFormat, &key);
+
+  aOutKeys.resize(aCount);
+  WalkGlyphRun(aAdvances, aOffsets, aCount, aRightToLeft,
+               [&](uint32_t i, int32_t, int32_t, uint8_t aSubpixel) {
+    key.fGlyphIndex = aGlyphs[i];
+    key.fSubpixelX = aSubpixel;
+    aOutKeys[i] = key;
+  });
+}
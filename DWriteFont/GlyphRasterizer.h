@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "GlyphCache.h"
+
+// The coverage a rasterizer produces. Numbered like DWRITE_TEXTURE_TYPE so
+// GlyphKey::fTextureType means the same thing for every backend.
+enum GlyphMaskFormat {
+  GLYPH_MASK_A8 = 0,              // 1 byte of coverage per pixel
+  GLYPH_MASK_CLEARTYPE_3x1 = 1,   // R, G and B coverage per pixel, like DWRITE_TEXTURE_CLEARTYPE_3x1
+};
+
+static inline int32_t
+GlyphMaskBytesPerPixel(GlyphMaskFormat aFormat)
+{
+  return aFormat == GLYPH_MASK_CLEARTYPE_3x1 ? 3 : 1;
+}
+
+// Same layout as DWRITE_GLYPH_OFFSET.
+struct GlyphOffset {
+  float fAdvanceOffset;
+  float fAscenderOffset;
+};
+
+/**
+ * Turns glyphs of one font face at one size into coverage masks. A
+ * rasterizer is set up for everything that changes the pixels except the
+ * glyph and its horizontal origin, so runs are rasterized by one rasterizer.
+ *
+ * DWriteGlyphRasterizer goes through IDWriteGlyphRunAnalysis,
+ * TrueTypeRasterizer reads the outlines from the font file itself and runs
+ * anywhere.
+ *
+ * A rasterizer is used by one thread at a time. Backends that can rasterize
+ * on several threads at once hand each extra thread its own Clone.
+ */
+class GlyphRasterizer {
+public:
+  virtual ~GlyphRasterizer() { }
+
+  // Fills in every field of aOutKey except the glyph index and the subpixel
+  // origin.
+  virtual void GetKeyTemplate(GlyphMaskFormat aFormat, GlyphKey* aOutKey) = 0;
+
+  // Returns a new mask for aGlyph with its origin aOriginX pixels right of
+  // the whole pixel the mask bounds are relative to. aOriginX is in [0, 1).
+  virtual GlyphMask* RasterizeGlyph(uint16_t aGlyph, float aOriginX, GlyphMaskFormat aFormat) = 0;
+
+  // Returns a new rasterizer with the same settings that another thread can
+  // use alongside this one, or nullptr if the backend only runs on one
+  // thread. Called from any thread, so it may only read this rasterizer.
+  virtual GlyphRasterizer* Clone() const { return nullptr; }
+};
+
+/**
+ * Looks up every glyph of a run in aCache, rasterizing only the ones that are
+ * missing, and places them relative to the run origin. Pen positions follow
+ * DWrite: right to left runs advance to the left and their advance offsets
+ * point left, ascender offsets point up.
+ *
+ * @param aOffsets Per glyph offsets, or nullptr.
+ * @param aOutKeys If given, receives the cache key of each glyph.
+ */
+void GetGlyphRunMasks(GlyphRasterizer& aRasterizer, GlyphCache& aCache, GlyphMaskFormat aFormat,
+                      const uint16_t* aGlyphs, const float* aAdvances, const GlyphOffset* aOffsets,
+                      uint32_t aCount, bool aRightToLeft,
+                      std::vector<PlacedGlyph>& aOutGlyphs, std::vector<GlyphKey>* aOutKeys = nullptr);
+
+/**
+ * The cache key GetGlyphRunMasks looks up for every glyph of a run, without
+ * looking them up.
+ */
+void GetGlyphRunKeys(GlyphRasterizer& aRasterizer, GlyphMaskFormat aFormat,
+                     const uint16_t* aGlyphs, const float* aAdvances, const GlyphOffset* aOffsets,
+                     uint32_t aCount, bool aRightToLeft, std::vector<GlyphKey>& aOutKeys);
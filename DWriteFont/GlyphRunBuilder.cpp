@@ -0,0 +1,204 @@
+#include "stdafx.h"
+#include "GlyphRunBuilder.h"
+#include "Trace.h"
+#include <assert.h>
+#include <string.h>
+#include <wchar.h>
+
+namespace {
+
+// Fills FontGlyphMaps from a DWrite font face, which it keeps alive.
+class FontFaceGlyphSource : public GlyphMapSource {
+public:
+  explicit FontFaceGlyphSource(IDWriteFontFace* aFontFace)
+    : mFontFace(aFontFace)
+  {
+    mFontFace->AddRef();
+  }
+
+  ~FontFaceGlyphSource()
+  {
+    mFontFace->Release();
+  }
+
+  void GetGlyphIndices(const uint32_t* aCodePoints, uint32_t aCount, uint16_t* aOutGlyphs) override
+  {
+    HRESULT hr = mFontFace->GetGlyphIndicesW(aCodePoints, aCount, aOutGlyphs);
+    assert(hr == S_OK);
+  }
+
+  void GetDesignAdvances(const uint16_t* aGlyphs, uint32_t aCount, int32_t* aOutAdvances) override
+  {
+    DWRITE_GLYPH_METRICS metrics[FontGlyphMap::kPageSize];
+    assert(aCount <= FontGlyphMap::kPageSize);
+    HRESULT hr = mFontFace->GetDesignGlyphMetrics(aGlyphs, aCount, metrics);
+    assert(hr == S_OK);
+    for (uint32_t i = 0; i < aCount; i++) {
+      aOutAdvances[i] = (int32_t)metrics[i].advanceWidth;
+    }
+  }
+
+private:
+  IDWriteFontFace* mFontFace;
+};
+
+} // namespace
+
+GlyphRunBuilder::GlyphRunBuilder()
+  : mHeapBlock(nullptr)
+  , mCapacity(0)
+  , mGlyphCount(0)
+{
+  SetArrays(mInlineBlock, kInlineGlyphs);
+}
+
+GlyphRunBuilder::~GlyphRunBuilder()
+{
+  free(mHeapBlock);
+}
+
+void
+GlyphRunBuilder::Clear()
+{
+  mGlyphCount = 0;
+  mRuns.clear();
+}
+
+void
+GlyphRunBuilder::SetArrays(uint8_t* aBlock, uint32_t aCapacity)
+{
+  uint8_t* cursor = aBlock;
+  mCodePoints = (UINT32*)cursor;
+  cursor += aCapacity * sizeof(UINT32);
+  mAdvances = (FLOAT*)cursor;
+  cursor += aCapacity * sizeof(FLOAT);
+  mOffsets = (DWRITE_GLYPH_OFFSET*)cursor;
+  cursor += aCapacity * sizeof(DWRITE_GLYPH_OFFSET);
+  mGlyphIndices = (UINT16*)cursor;
+  mCapacity = aCapacity;
+}
+
+void
+GlyphRunBuilder::Reserve(uint32_t aGlyphCount)
+{
+  if (aGlyphCount <= mCapacity) {
+    return;
+  }
+
+  uint32_t capacity = mCapacity * 2;
+  if (capacity < aGlyphCount) {
+    capacity = aGlyphCount;
+  }
+
+  // Each array moves to its own spot in the new block.
+  uint8_t* block = (uint8_t*)malloc(capacity * kBytesPerGlyph);
+  assert(block);
+  UINT32* codePoints = mCodePoints;
+  FLOAT* advances = mAdvances;
+  DWRITE_GLYPH_OFFSET* offsets = mOffsets;
+  UINT16* glyphIndices = mGlyphIndices;
+
+  SetArrays(block, capacity);
+  memcpy(mCodePoints, codePoints, mGlyphCount * sizeof(UINT32));
+  memcpy(mAdvances, advances, mGlyphCount * sizeof(FLOAT));
+  memcpy(mOffsets, offsets, mGlyphCount * sizeof(DWRITE_GLYPH_OFFSET));
+  memcpy(mGlyphIndices, glyphIndices, mGlyphCount * sizeof(UINT16));
+
+  free(mHeapBlock);
+  mHeapBlock = block;
+}
+
+FontGlyphMap*
+GlyphRunBuilder::GetGlyphMap(IDWriteFontFace* aFontFace)
+{
+  std::unique_ptr<FontGlyphMap>& glyphMap = mGlyphMaps[aFontFace];
+  if (!glyphMap) {
+    DWRITE_FONT_METRICS fontMetrics;
+    aFontFace->GetMetrics(&fontMetrics);
+    std::unique_ptr<GlyphMapSource> source(new FontFaceGlyphSource(aFontFace));
+    glyphMap.reset(new FontGlyphMap(std::move(source), aFontFace->GetGlyphCount(),
+                                    fontMetrics.designUnitsPerEm));
+  }
+  return glyphMap.get();
+}
+
+// Fills in everything but the code points for glyphs [aStart, aStart + aCount).
+void
+GlyphRunBuilder::MapGlyphs(IDWriteFontFace* aFontFace, float aEmSize, uint32_t aStart, uint32_t aCount)
+{
+  if (!aCount) {
+    return;
+  }
+
+  FontGlyphMap* glyphMap = GetGlyphMap(aFontFace);
+  glyphMap->GetGlyphIndices(mCodePoints + aStart, aCount, mGlyphIndices + aStart);
+  glyphMap->GetAdvances(mGlyphIndices + aStart, aCount, aEmSize, mAdvances + aStart);
+
+  for (uint32_t i = aStart; i < aStart + aCount; i++) {
+    mOffsets[i].advanceOffset = 0;
+    mOffsets[i].ascenderOffset = 0;
+  }
+}
+
+uint32_t
+GlyphRunBuilder::AddRun(IDWriteFontFace* aFontFace, float aEmSize, const WCHAR* aText, uint32_t aLength)
+{
+  TRACE_ZONE("AddRun");
+  Reserve(mGlyphCount + aLength);
+
+  Run run = { aFontFace, aEmSize, mGlyphCount, aLength };
+  for (uint32_t i = 0; i < aLength; i++) {
+    mCodePoints[run.fStart + i] = aText[i];
+  }
+  mGlyphCount += aLength;
+  MapGlyphs(aFontFace, aEmSize, run.fStart, aLength);
+
+  mRuns.push_back(run);
+  return (uint32_t)mRuns.size() - 1;
+}
+
+uint32_t
+GlyphRunBuilder::AddRun(IDWriteFontFace* aFontFace, float aEmSize, const WCHAR* aText)
+{
+  return AddRun(aFontFace, aEmSize, aText, (uint32_t)wcslen(aText));
+}
+
+uint32_t
+GlyphRunBuilder::AddRuns(IDWriteFontFace* aFontFace, float aEmSize,
+                         const WCHAR* const* aTexts, uint32_t aCount)
+{
+  TRACE_ZONE("AddRuns");
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < aCount; i++) {
+    total += (uint32_t)wcslen(aTexts[i]);
+  }
+  Reserve(mGlyphCount + total);
+
+  const uint32_t firstRun = (uint32_t)mRuns.size();
+  const uint32_t batchStart = mGlyphCount;
+  for (uint32_t i = 0; i < aCount; i++) {
+    Run run = { aFontFace, aEmSize, mGlyphCount, 0 };
+    for (const WCHAR* text = aTexts[i]; *text; text++) {
+      mCodePoints[mGlyphCount++] = *text;
+    }
+    run.fCount = mGlyphCount - run.fStart;
+    mRuns.push_back(run);
+  }
+
+  MapGlyphs(aFontFace, aEmSize, batchStart, total);
+  return firstRun;
+}
+
+void
+GlyphRunBuilder::GetRun(uint32_t aIndex, DWRITE_GLYPH_RUN* aOutRun) const
+{
+  const Run& run = mRuns[aIndex];
+  aOutRun->fontFace = run.fFontFace;
+  aOutRun->fontEmSize = run.fEmSize;
+  aOutRun->glyphCount = run.fCount;
+  aOutRun->glyphIndices = mGlyphIndices + run.fStart;
+  aOutRun->glyphAdvances = mAdvances + run.fStart;
+  aOutRun->glyphOffsets = mOffsets + run.fStart;
+  aOutRun->isSideways = FALSE;
+  aOutRun->bidiLevel = 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <dwrite.h>
+#include <stdint.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "FontGlyphMap.h"
+
+/**
+ * Builds DWRITE_GLYPH_RUNs for strings in one font face, one glyph per UTF-16
+ * code unit like the CreateGlyphRun it replaces.
+ *
+ * Glyph indices and advances come from a FontGlyphMap per font face that the
+ * builder keeps for its lifetime, so strings made of characters seen before
+ * never call into the font.
+ *
+ * Every per glyph array (code points, advances, offsets and glyph indices)
+ * lives in a single block, each array contiguous over all the runs added
+ * since the last Clear. Up to kInlineGlyphs glyphs fit in storage inside the
+ * builder, so short UI strings never touch the heap, and a cleared builder
+ * keeps its block for the next strings.
+ *
+ * GetRun hands out views that point straight into the block. They stay valid
+ * until the next AddRun, AddRuns or Clear, so add a batch of strings first
+ * and then get the runs. Not thread safe.
+ */
+class GlyphRunBuilder {
+public:
+  static const uint32_t kInlineGlyphs = 32;
+
+  GlyphRunBuilder();
+  ~GlyphRunBuilder();
+
+  // Forgets all runs, keeping the storage.
+  void Clear();
+
+  // Adds a run for aText and returns its index.
+  uint32_t AddRun(IDWriteFontFace* aFontFace, float aEmSize, const WCHAR* aText, uint32_t aLength);
+  uint32_t AddRun(IDWriteFontFace* aFontFace, float aEmSize, const WCHAR* aText);
+
+  // Adds one run per null terminated string in aTexts and returns the index
+  // of the first. The glyphs of the whole batch are mapped and measured in
+  // one pass.
+  uint32_t AddRuns(IDWriteFontFace* aFontFace, float aEmSize,
+                   const WCHAR* const* aTexts, uint32_t aCount);
+
+  void GetRun(uint32_t aIndex, DWRITE_GLYPH_RUN* aOutRun) const;
+
+  uint32_t RunCount() const { return (uint32_t)mRuns.size(); }
+  uint32_t GlyphCount() const { return mGlyphCount; }
+  uint32_t Capacity() const { return mCapacity; }
+  bool IsInline() const { return !mHeapBlock; }
+
+  // The arrays for all glyphs, runs index into them from their first glyph.
+  uint32_t RunStart(uint32_t aIndex) const { return mRuns[aIndex].fStart; }
+  const UINT32* CodePoints() const { return mCodePoints; }
+  const UINT16* GlyphIndices() const { return mGlyphIndices; }
+  const FLOAT* Advances() const { return mAdvances; }
+
+  // The cmap and advance cache for aFontFace, created on first use.
+  FontGlyphMap* GetGlyphMap(IDWriteFontFace* aFontFace);
+
+private:
+  struct Run {
+    IDWriteFontFace* fFontFace;
+    float fEmSize;
+    uint32_t fStart;
+    uint32_t fCount;
+  };
+
+  // UINT16 indices go last, everything before them is 4 byte aligned.
+  static const size_t kBytesPerGlyph = sizeof(UINT32) + sizeof(FLOAT) +
+                                       sizeof(DWRITE_GLYPH_OFFSET) + sizeof(UINT16);
+
+  void Reserve(uint32_t aGlyphCount);
+  void SetArrays(uint8_t* aBlock, uint32_t aCapacity);
+  void MapGlyphs(IDWriteFontFace* aFontFace, float aEmSize, uint32_t aStart, uint32_t aCount);
+
+  GlyphRunBuilder(const GlyphRunBuilder&);
+  GlyphRunBuilder& operator=(const GlyphRunBuilder&);
+
+  UINT32* mCodePoints;
+  FLOAT* mAdvances;
+  DWRITE_GLYPH_OFFSET* mOffsets;
+  UINT16* mGlyphIndices;
+
+  uint8_t* mHeapBlock;   // nullptr while the glyphs fit in mInlineBlock
+  uint32_t mCapacity;
+  uint32_t mGlyphCount;
+  std::vector<Run> mRuns;
+
+  // Faces are held by their FontGlyphMap, so a face in here cannot go away
+  // and have its address reused by another one.
+  std::unordered_map<IDWriteFontFace*, std::unique_ptr<FontGlyphMap>> mGlyphMaps;
+
+  alignas(16) uint8_t mInlineBlock[kInlineGlyphs * kBytesPerGlyph];
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// Integer pixel rectangle, right and bottom exclusive. Same layout as a Win32
+// RECT but usable in the code that does not include windows.h.
+struct IntRect {
+  int32_t fLeft;
+  int32_t fTop;
+  int32_t fRight;
+  int32_t fBottom;
+
+  int32_t Width() const { return fRight - fLeft; }
+  int32_t Height() const { return fBottom - fTop; }
+  bool IsEmpty() const { return fRight <= fLeft || fBottom <= fTop; }
+
+  static IntRect Make(int32_t aLeft, int32_t aTop, int32_t aRight, int32_t aBottom) {
+    IntRect rect = { aLeft, aTop, aRight, aBottom };
+    return rect;
+  }
+
+  static IntRect MakeXYWH(int32_t aX, int32_t aY, int32_t aWidth, int32_t aHeight) {
+    return Make(aX, aY, aX + aWidth, aY + aHeight);
+  }
+
+  // Grows this rect to contain aOther. Empty rects are ignored.
+  void Union(const IntRect& aOther) {
+    if (aOther.IsEmpty()) {
+      return;
+    }
+    if (IsEmpty()) {
+      *this = aOther;
+      return;
+    }
+    if (aOther.fLeft < fLeft) fLeft = aOther.fLeft;
+    if (aOther.fTop < fTop) fTop = aOther.fTop;
+    if (aOther.fRight > fRight) fRight = aOther.fRight;
+    if (aOther.fBottom > fBottom) fBottom = aOther.fBottom;
+  }
+
+  // Shrinks this rect to the overlap with aOther, returns false if empty.
+  bool Intersect(const IntRect& aOther) {
+    if (aOther.fLeft > fLeft) fLeft = aOther.fLeft;
+    if (aOther.fTop > fTop) fTop = aOther.fTop;
+    if (aOther.fRight < fRight) fRight = aOther.fRight;
+    if (aOther.fBottom < fBottom) fBottom = aOther.fBottom;
+    return !IsEmpty();
+  }
+};
@@ -0,0 +1,103 @@
+#include "MaskCompositor.h"
+#include <string.h>
+#include "Trace.h"
+
+// Rounded x / 255 for x in [0, 255 * 255], same as the MaskConvert kernels.
+static inline unsigned
+Div255(unsigned aValue)
+{
+  aValue += 128;
+  return (aValue + (aValue >> 8)) >> 8;
+}
+
+void
+CompositeMask(const CoverageMask& aMask, int32_t aX, int32_t aY,
+              const MaskBlendParams& aParams, uint8_t* aDest, int32_t aDestStride,
+              const IntRect& aClip)
+{
+  IntRect rect = IntRect::MakeXYWH(aX, aY, aMask.fWidth, aMask.fHeight);
+  if (!rect.Intersect(aClip)) {
+    return;
+  }
+
+  TRACE_ZONE("CompositeMask");
+  const int32_t maskBytesPerPixel = CoverageMaskBytesPerPixel(aMask.fFormat);
+  const uint8_t* mask = aMask.fBits + (rect.fTop - aY) * aMask.fStride +
+                        (rect.fLeft - aX) * maskBytesPerPixel;
+  uint8_t* dest = aDest + rect.fTop * aDestStride + rect.fLeft * 4;
+  const int32_t width = rect.Width();
+
+  switch (aMask.fFormat) {
+    case COVERAGE_MASK_A8: {
+      BlendA8Proc blendProc = GetBlendA8Proc();
+      for (int32_t y = 0; y < rect.Height(); y++) {
+        blendProc(mask + y * aMask.fStride, dest + y * aDestStride, width, aParams);
+      }
+      break;
+    }
+    case COVERAGE_MASK_CLEARTYPE_3x1: {
+      BlendClearTypeProc blendProc = GetBlendClearTypeProc();
+      for (int32_t y = 0; y < rect.Height(); y++) {
+        uint8_t* row = dest + y * aDestStride;
+        blendProc(mask + y * aMask.fStride, row, row, width, aParams, 0);
+      }
+      break;
+    }
+    case COVERAGE_MASK_LCD16: {
+      BlendLCD16Proc blendProc = GetBlendLCD16Proc();
+      for (int32_t y = 0; y < rect.Height(); y++) {
+        uint8_t* row = dest + y * aDestStride;
+        blendProc((const uint16_t*)(mask + y * aMask.fStride), row, row, width, aParams, 0);
+      }
+      break;
+    }
+  }
+}
+
+void
+FillPixels(uint32_t aColor, uint8_t* aDest, int32_t aDestStride, const IntRect& aClip)
+{
+  if (aClip.IsEmpty()) {
+    return;
+  }
+
+  const unsigned alpha = aColor >> 24;
+  const uint8_t pixel[4] = { (uint8_t)Div255((aColor & 0xFF) * alpha),
+                             (uint8_t)Div255(((aColor >> 8) & 0xFF) * alpha),
+                             (uint8_t)Div255(((aColor >> 16) & 0xFF) * alpha),
+                             (uint8_t)alpha };
+  uint8_t* first = aDest + aClip.fTop * aDestStride + aClip.fLeft * 4;
+  for (int32_t x = 0; x < aClip.Width(); x++) {
+    memcpy(first + 4 * x, pixel, 4);
+  }
+  for (int32_t y = 1; y < aClip.Height(); y++) {
+    memcpy(first + y * aDestStride, first, (size_t)aClip.Width() * 4);
+  }
+}
+
+void
+CompositeBitmap(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                int32_t aX, int32_t aY, uint8_t* aDest, int32_t aDestStride,
+                const IntRect& aClip)
+{
+  IntRect rect = IntRect::MakeXYWH(aX, aY, aWidth, aHeight);
+  if (!rect.Intersect(aClip)) {
+    return;
+  }
+
+  for (int32_t y = rect.fTop; y < rect.fBottom; y++) {
+    const uint8_t* src = aBGRA + (y - aY) * aStride + (rect.fLeft - aX) * 4;
+    uint8_t* dst = aDest + y * aDestStride + rect.fLeft * 4;
+    for (int32_t x = 0; x < rect.Width(); x++) {
+      const unsigned srcA = src[4 * x + 3];
+      if (srcA == 0xFF) {
+        memcpy(dst + 4 * x, src + 4 * x, 4);
+        continue;
+      }
+      for (int c = 0; c < 4; c++) {
+        unsigned value = src[4 * x + c] + Div255(dst[4 * x + c] * (255 - srcA));
+        dst[4 * x + c] = (uint8_t)(value > 0xFF ? 0xFF : value);
+      }
+    }
+  }
+}
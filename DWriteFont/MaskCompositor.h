@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include "IntRect.h"
+#include "MaskConvert.h"
+
+// Coverage layouts CompositeMask blends.
+enum CoverageMaskFormat {
+  COVERAGE_MASK_A8,               // One byte per pixel, blended by BlendA8
+  COVERAGE_MASK_CLEARTYPE_3x1,    // R, G, B bytes per pixel, blended by BlendClearType
+  COVERAGE_MASK_LCD16,            // PackLCD16 words, blended by BlendLCD16
+};
+
+static inline int32_t
+CoverageMaskBytesPerPixel(CoverageMaskFormat aFormat)
+{
+  return aFormat == COVERAGE_MASK_A8 ? 1 : aFormat == COVERAGE_MASK_LCD16 ? 2 : 3;
+}
+
+// A fWidth x fHeight coverage mask in memory, rows fStride bytes apart.
+// LCD16 rows start on a 2 byte boundary.
+struct CoverageMask {
+  const uint8_t* fBits;
+  int32_t fStride;
+  int32_t fWidth;
+  int32_t fHeight;
+  CoverageMaskFormat fFormat;
+};
+
+/**
+ * Blends aMask in aParams' text color onto premultiplied BGRA pixels that
+ * are already in aDest, rows aDestStride bytes apart, with per channel
+ * src-over. The mask's top left lands on pixel (aX, aY) of aDest and only
+ * the pixels inside aClip are written, so overlapping runs and backgrounds
+ * that are not white come out right and a caller can draw a run in pieces.
+ *
+ * aClip is in aDest's pixels and must lie inside it. The PreBlend tables in
+ * aParams apply to A8 (fTableG only) and 3x1 masks; LCD16 words were packed
+ * after them. Each row goes through the fastest BlendA8, BlendClearType or
+ * BlendLCD16 kernel the CPU has, reading and writing aDest in place.
+ */
+void CompositeMask(const CoverageMask& aMask, int32_t aX, int32_t aY,
+                   const MaskBlendParams& aParams, uint8_t* aDest, int32_t aDestStride,
+                   const IntRect& aClip);
+
+// Fills the pixels of aDest inside aClip with aColor, 0xAARRGGBB, made
+// premultiplied.
+void FillPixels(uint32_t aColor, uint8_t* aDest, int32_t aDestStride, const IntRect& aClip);
+
+// Draws a aWidth x aHeight premultiplied BGRA bitmap, rows aStride bytes
+// apart, source over with its top left on pixel (aX, aY) of aDest. Only the
+// pixels inside aClip are written.
+void CompositeBitmap(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                     int32_t aX, int32_t aY, uint8_t* aDest, int32_t aDestStride,
+                     const IntRect& aClip);
@@ -0,0 +1,1427 @@
+#include "MaskConvert.h"
+#include <string.h>
+#include "SkMaskGamma.h"
+
+#if defined(DW_CPU_X86)
+#include <immintrin.h>
+#endif
+#if defined(DW_CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+void
+ConvertClearType_Scalar(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                        const uint8_t* aTableR, const uint8_t* aTableG,
+                        const uint8_t* aTableB, bool aQuantize)
+{
+  for (int i = 0; i < aCount; i++) {
+    uint8_t r = aRGB[3 * i];
+    uint8_t g = aRGB[3 * i + 1];
+    uint8_t b = aRGB[3 * i + 2];
+
+    if (aTableR) {
+      r = aTableR[r];
+      g = aTableG[g];
+      b = aTableB[b];
+    }
+
+    if (aQuantize) {
+      // Taken from http://searchfox.org/mozilla-central/source/gfx/skia/skia/include/core/SkColorPriv.h#654
+      r = (r >> 3) << 3;
+      g = (g >> 3) << 3;
+      b = (b >> 3) << 3;
+    }
+
+    r = Blend(0x00, 0xFF, r);
+    g = Blend(0x00, 0xFF, g);
+    b = Blend(0x00, 0xFF, b);
+
+    // Assume bgr8
+    aBGRA[4 * i] = b;
+    aBGRA[4 * i + 1] = g;
+    aBGRA[4 * i + 2] = r;
+    aBGRA[4 * i + 3] = 0xFF;
+  }
+}
+
+// Integer version of the scalar kernel, used for the tails of the SIMD loops.
+static inline void
+ConvertClearTypeTail(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                     const uint8_t* aTableR, const uint8_t* aTableG,
+                     const uint8_t* aTableB, bool aQuantize)
+{
+  const uint8_t mask = aQuantize ? 0xF8 : 0xFF;
+  for (int i = 0; i < aCount; i++) {
+    uint8_t r = aRGB[3 * i];
+    uint8_t g = aRGB[3 * i + 1];
+    uint8_t b = aRGB[3 * i + 2];
+
+    if (aTableR) {
+      r = aTableR[r];
+      g = aTableG[g];
+      b = aTableB[b];
+    }
+
+    aBGRA[4 * i] = BlendBlackOnWhite(b & mask);
+    aBGRA[4 * i + 1] = BlendBlackOnWhite(g & mask);
+    aBGRA[4 * i + 2] = BlendBlackOnWhite(r & mask);
+    aBGRA[4 * i + 3] = 0xFF;
+  }
+}
+
+// The PreBlend lookups are byte gathers, which no SIMD level we target can do
+// faster than scalar loads. Run them into a small block on the stack and let
+// the vector code do the rest.
+static inline void
+ApplyTables(const uint8_t* aRGB, uint8_t* aOut, int aCount,
+            const uint8_t* aTableR, const uint8_t* aTableG, const uint8_t* aTableB)
+{
+  for (int i = 0; i < aCount; i++) {
+    aOut[3 * i] = aTableR[aRGB[3 * i]];
+    aOut[3 * i + 1] = aTableG[aRGB[3 * i + 1]];
+    aOut[3 * i + 2] = aTableB[aRGB[3 * i + 2]];
+  }
+}
+
+#if defined(DW_CPU_X86)
+// See BlendBlackOnWhite. Operates on every byte independently, so it can run
+// before the channels are shuffled into place.
+DW_TARGET_SSSE3 static inline __m128i
+BlendBlackOnWhite_SSE(__m128i aAlpha)
+{
+  const __m128i ff = _mm_set1_epi8((char)0xFF);
+  const __m128i one = _mm_set1_epi8(1);
+  __m128i ge128 = _mm_cmpgt_epi8(_mm_setzero_si128(), aAlpha);
+  __m128i ge65 = _mm_cmpeq_epi8(_mm_max_epu8(aAlpha, _mm_set1_epi8(65)), aAlpha);
+  __m128i odd = _mm_cmpeq_epi8(_mm_and_si128(aAlpha, one), one);
+  __m128i correction = _mm_or_si128(ge128, _mm_and_si128(ge65, odd));
+  correction = _mm_andnot_si128(_mm_cmpeq_epi8(aAlpha, ff), correction);
+  return _mm_sub_epi8(_mm_xor_si128(aAlpha, ff), _mm_and_si128(correction, one));
+}
+
+// Picks 4 RGB pixels out of the low 12 bytes and writes them as BGR_, the
+// alpha byte is zeroed so it can be or'ed in.
+#define RGB_TO_BGRX_SHUFFLE 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1
+
+DW_TARGET_SSSE3 void
+ConvertClearType_SSSE3(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                       const uint8_t* aTableR, const uint8_t* aTableG,
+                       const uint8_t* aTableB, bool aQuantize)
+{
+  const __m128i shuffle = _mm_setr_epi8(RGB_TO_BGRX_SHUFFLE);
+  const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+  const __m128i mask = _mm_set1_epi8(aQuantize ? (char)0xF8 : (char)0xFF);
+  uint8_t block[48];
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    const uint8_t* src = aRGB + 3 * i;
+    if (aTableR) {
+      ApplyTables(src, block, 16, aTableR, aTableG, aTableB);
+      src = block;
+    }
+
+    __m128i v0 = _mm_loadu_si128((const __m128i*)src);
+    __m128i v1 = _mm_loadu_si128((const __m128i*)(src + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i*)(src + 32));
+
+    v0 = BlendBlackOnWhite_SSE(_mm_and_si128(v0, mask));
+    v1 = BlendBlackOnWhite_SSE(_mm_and_si128(v1, mask));
+    v2 = BlendBlackOnWhite_SSE(_mm_and_si128(v2, mask));
+
+    // Pixels 0-3 live in bytes 0..11, 4-7 in 12..23, 8-11 in 24..35 and
+    // 12-15 in 36..47.
+    __m128i p0 = v0;
+    __m128i p1 = _mm_alignr_epi8(v1, v0, 12);
+    __m128i p2 = _mm_alignr_epi8(v2, v1, 8);
+    __m128i p3 = _mm_srli_si128(v2, 4);
+
+    __m128i* dst = (__m128i*)(aBGRA + 4 * i);
+    _mm_storeu_si128(dst, _mm_or_si128(_mm_shuffle_epi8(p0, shuffle), alpha));
+    _mm_storeu_si128(dst + 1, _mm_or_si128(_mm_shuffle_epi8(p1, shuffle), alpha));
+    _mm_storeu_si128(dst + 2, _mm_or_si128(_mm_shuffle_epi8(p2, shuffle), alpha));
+    _mm_storeu_si128(dst + 3, _mm_or_si128(_mm_shuffle_epi8(p3, shuffle), alpha));
+  }
+
+  ConvertClearTypeTail(aRGB + 3 * i, aBGRA + 4 * i, aCount - i,
+                       aTableR, aTableG, aTableB, aQuantize);
+}
+
+DW_TARGET_AVX2 static inline __m256i
+BlendBlackOnWhite_AVX2(__m256i aAlpha)
+{
+  const __m256i ff = _mm256_set1_epi8((char)0xFF);
+  const __m256i one = _mm256_set1_epi8(1);
+  __m256i ge128 = _mm256_cmpgt_epi8(_mm256_setzero_si256(), aAlpha);
+  __m256i ge65 = _mm256_cmpeq_epi8(_mm256_max_epu8(aAlpha, _mm256_set1_epi8(65)), aAlpha);
+  __m256i odd = _mm256_cmpeq_epi8(_mm256_and_si256(aAlpha, one), one);
+  __m256i correction = _mm256_or_si256(ge128, _mm256_and_si256(ge65, odd));
+  correction = _mm256_andnot_si256(_mm256_cmpeq_epi8(aAlpha, ff), correction);
+  return _mm256_sub_epi8(_mm256_xor_si256(aAlpha, ff), _mm256_and_si256(correction, one));
+}
+
+// Loads 8 RGB pixels as two 12 byte groups, one per 128 bit lane, so the
+// in-lane byte shuffle can do the 3->4 expansion. Reads 4 bytes past the 24
+// it converts.
+DW_TARGET_AVX2 static inline __m256i
+LoadRGBx8(const uint8_t* aSrc)
+{
+  __m128i lo = _mm_loadu_si128((const __m128i*)aSrc);
+  __m128i hi = _mm_loadu_si128((const __m128i*)(aSrc + 12));
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+DW_TARGET_AVX2 void
+ConvertClearType_AVX2(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                      const uint8_t* aTableR, const uint8_t* aTableG,
+                      const uint8_t* aTableB, bool aQuantize)
+{
+  const __m256i shuffle = _mm256_setr_epi8(RGB_TO_BGRX_SHUFFLE, RGB_TO_BGRX_SHUFFLE);
+  const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+  const __m256i mask = _mm256_set1_epi8(aQuantize ? (char)0xF8 : (char)0xFF);
+  // 96 bytes converted plus the 4 bytes the last LoadRGBx8 overreads.
+  uint8_t block[100];
+
+  int i = 0;
+  // Keep 2 spare source pixels so the overread stays inside aRGB.
+  for (; i + 34 <= aCount; i += 32) {
+    const uint8_t* src = aRGB + 3 * i;
+    if (aTableR) {
+      ApplyTables(src, block, 32, aTableR, aTableG, aTableB);
+      src = block;
+    }
+
+    __m256i* dst = (__m256i*)(aBGRA + 4 * i);
+    for (int k = 0; k < 4; k++) {
+      __m256i v = LoadRGBx8(src + 24 * k);
+      v = BlendBlackOnWhite_AVX2(_mm256_and_si256(v, mask));
+      v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+      _mm256_storeu_si256(dst + k, v);
+    }
+  }
+
+  ConvertClearType_SSSE3(aRGB + 3 * i, aBGRA + 4 * i, aCount - i,
+                         aTableR, aTableG, aTableB, aQuantize);
+}
+#endif // DW_CPU_X86
+
+#if defined(DW_CPU_NEON)
+static inline uint8x16_t
+BlendBlackOnWhite_NEON(uint8x16_t aAlpha)
+{
+  const uint8x16_t ff = vdupq_n_u8(0xFF);
+  const uint8x16_t one = vdupq_n_u8(1);
+  uint8x16_t ge128 = vcgeq_u8(aAlpha, vdupq_n_u8(128));
+  uint8x16_t ge65 = vcgeq_u8(aAlpha, vdupq_n_u8(65));
+  uint8x16_t odd = vtstq_u8(aAlpha, one);
+  uint8x16_t correction = vorrq_u8(ge128, vandq_u8(ge65, odd));
+  correction = vbicq_u8(correction, vceqq_u8(aAlpha, ff));
+  return vsubq_u8(vsubq_u8(ff, aAlpha), vandq_u8(correction, one));
+}
+
+void
+ConvertClearType_NEON(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                      const uint8_t* aTableR, const uint8_t* aTableG,
+                      const uint8_t* aTableB, bool aQuantize)
+{
+  const uint8x16_t mask = vdupq_n_u8(aQuantize ? 0xF8 : 0xFF);
+  uint8_t block[48];
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    const uint8_t* src = aRGB + 3 * i;
+    if (aTableR) {
+      ApplyTables(src, block, 16, aTableR, aTableG, aTableB);
+      src = block;
+    }
+
+    uint8x16x3_t rgb = vld3q_u8(src);
+    uint8x16x4_t bgra;
+    bgra.val[0] = BlendBlackOnWhite_NEON(vandq_u8(rgb.val[2], mask));
+    bgra.val[1] = BlendBlackOnWhite_NEON(vandq_u8(rgb.val[1], mask));
+    bgra.val[2] = BlendBlackOnWhite_NEON(vandq_u8(rgb.val[0], mask));
+    bgra.val[3] = vdupq_n_u8(0xFF);
+    vst4q_u8(aBGRA + 4 * i, bgra);
+  }
+
+  ConvertClearTypeTail(aRGB + 3 * i, aBGRA + 4 * i, aCount - i,
+                       aTableR, aTableG, aTableB, aQuantize);
+}
+#endif // DW_CPU_NEON
+
+static ConvertClearTypeProc
+SelectConvertClearTypeProc()
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_AVX2)) {
+    return ConvertClearType_AVX2;
+  }
+  if (HasCpuFeature(CPU_FEATURE_SSSE3)) {
+    return ConvertClearType_SSSE3;
+  }
+#endif
+#if defined(DW_CPU_NEON)
+  if (HasCpuFeature(CPU_FEATURE_NEON)) {
+    return ConvertClearType_NEON;
+  }
+#endif
+  return ConvertClearType_Scalar;
+}
+
+ConvertClearTypeProc
+GetConvertClearTypeProc()
+{
+  static const ConvertClearTypeProc sProc = SelectConvertClearTypeProc();
+  return sProc;
+}
+
+void
+PackLCD16_Scalar(const uint8_t* aRGB, uint16_t* aLCD16, int aCount,
+                 const uint8_t* aTableR, const uint8_t* aTableG,
+                 const uint8_t* aTableB)
+{
+  for (int i = 0; i < aCount; i++) {
+    uint8_t r = aRGB[3 * i];
+    uint8_t g = aRGB[3 * i + 1];
+    uint8_t b = aRGB[3 * i + 2];
+    if (aTableR) {
+      r = aTableR[r];
+      g = aTableG[g];
+      b = aTableB[b];
+    }
+    aLCD16[i] = PackLCD16(r, g, b);
+  }
+}
+
+void
+ConvertLCD16_Scalar(const uint16_t* aLCD16, uint8_t* aBGRA, int aCount)
+{
+  for (int i = 0; i < aCount; i++) {
+    uint16_t pixel = aLCD16[i];
+    // Quantizing keeps 5 bits of green, drop the sixth.
+    aBGRA[4 * i] = BlendBlackOnWhite((uint8_t)((pixel & 0x1F) << 3));
+    aBGRA[4 * i + 1] = BlendBlackOnWhite((uint8_t)(((pixel >> 6) & 0x1F) << 3));
+    aBGRA[4 * i + 2] = BlendBlackOnWhite((uint8_t)((pixel >> 11) << 3));
+    aBGRA[4 * i + 3] = 0xFF;
+  }
+}
+
+void
+UnpackLCD16(const uint16_t* aLCD16, uint8_t* aRGB, int aCount)
+{
+  for (int i = 0; i < aCount; i++) {
+    uint16_t pixel = aLCD16[i];
+    aRGB[3 * i] = (uint8_t)((pixel >> 11) << 3);
+    aRGB[3 * i + 1] = (uint8_t)(((pixel >> 5) & 0x3F) << 2);
+    aRGB[3 * i + 2] = (uint8_t)((pixel & 0x1F) << 3);
+  }
+}
+
+#if defined(DW_CPU_X86)
+// Gathers every third byte, starting at the given one, out of 16 RGB pixels
+// split over three registers.
+#define GATHER_CHANNEL_SHUFFLES(c)                                            \
+  _mm_setr_epi8(c, c + 3, c + 6, c + 9, c + 12, c < 1 ? 15 : -1,              \
+                -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),                      \
+  _mm_setr_epi8(-1, -1, -1, -1, -1, c < 1 ? -1 : c - 1, c + 2, c + 5, c + 8,  \
+                c + 11, c < 2 ? c + 14 : -1, -1, -1, -1, -1, -1),             \
+  _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, c < 2 ? -1 : c - 2,   \
+                c + 1, c + 4, c + 7, c + 10, c + 13)
+
+DW_TARGET_SSSE3 static inline __m128i
+GatherChannel(__m128i aV0, __m128i aV1, __m128i aV2,
+              __m128i aShuffle0, __m128i aShuffle1, __m128i aShuffle2)
+{
+  return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(aV0, aShuffle0),
+                                   _mm_shuffle_epi8(aV1, aShuffle1)),
+                      _mm_shuffle_epi8(aV2, aShuffle2));
+}
+
+// PackLCD16 on 8 pixels, one channel per 16 bit lane.
+static inline __m128i
+Pack565_SSE2(__m128i aR, __m128i aG, __m128i aB)
+{
+  __m128i r = _mm_slli_epi16(_mm_and_si128(aR, _mm_set1_epi16(0xF8)), 8);
+  __m128i g = _mm_slli_epi16(_mm_and_si128(aG, _mm_set1_epi16(0xFC)), 3);
+  return _mm_or_si128(_mm_or_si128(r, g), _mm_srli_epi16(aB, 3));
+}
+
+DW_TARGET_SSSE3 void
+PackLCD16_SSSE3(const uint8_t* aRGB, uint16_t* aLCD16, int aCount,
+                const uint8_t* aTableR, const uint8_t* aTableG,
+                const uint8_t* aTableB)
+{
+  const __m128i shuffleR[3] = { GATHER_CHANNEL_SHUFFLES(0) };
+  const __m128i shuffleG[3] = { GATHER_CHANNEL_SHUFFLES(1) };
+  const __m128i shuffleB[3] = { GATHER_CHANNEL_SHUFFLES(2) };
+  const __m128i zero = _mm_setzero_si128();
+  uint8_t block[48];
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    const uint8_t* src = aRGB + 3 * i;
+    if (aTableR) {
+      ApplyTables(src, block, 16, aTableR, aTableG, aTableB);
+      src = block;
+    }
+
+    __m128i v0 = _mm_loadu_si128((const __m128i*)src);
+    __m128i v1 = _mm_loadu_si128((const __m128i*)(src + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i*)(src + 32));
+    __m128i r = GatherChannel(v0, v1, v2, shuffleR[0], shuffleR[1], shuffleR[2]);
+    __m128i g = GatherChannel(v0, v1, v2, shuffleG[0], shuffleG[1], shuffleG[2]);
+    __m128i b = GatherChannel(v0, v1, v2, shuffleB[0], shuffleB[1], shuffleB[2]);
+
+    __m128i* dst = (__m128i*)(aLCD16 + i);
+    _mm_storeu_si128(dst, Pack565_SSE2(_mm_unpacklo_epi8(r, zero),
+                                       _mm_unpacklo_epi8(g, zero),
+                                       _mm_unpacklo_epi8(b, zero)));
+    _mm_storeu_si128(dst + 1, Pack565_SSE2(_mm_unpackhi_epi8(r, zero),
+                                           _mm_unpackhi_epi8(g, zero),
+                                           _mm_unpackhi_epi8(b, zero)));
+  }
+
+  PackLCD16_Scalar(aRGB + 3 * i, aLCD16 + i, aCount - i, aTableR, aTableG, aTableB);
+}
+
+DW_TARGET_SSSE3 void
+ConvertLCD16_SSSE3(const uint16_t* aLCD16, uint8_t* aBGRA, int aCount)
+{
+  const __m128i low5 = _mm_set1_epi16(0x1F);
+  const __m128i ff = _mm_set1_epi8((char)0xFF);
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    __m128i p0 = _mm_loadu_si128((const __m128i*)(aLCD16 + i));
+    __m128i p1 = _mm_loadu_si128((const __m128i*)(aLCD16 + i + 8));
+
+    // Every channel as 5 bits in the top of a byte, green losing its sixth
+    // bit like the quantized 3x1 path.
+    __m128i r = _mm_packus_epi16(_mm_slli_epi16(_mm_srli_epi16(p0, 11), 3),
+                                 _mm_slli_epi16(_mm_srli_epi16(p1, 11), 3));
+    __m128i g = _mm_packus_epi16(_mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(p0, 6), low5), 3),
+                                 _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(p1, 6), low5), 3));
+    __m128i b = _mm_packus_epi16(_mm_slli_epi16(_mm_and_si128(p0, low5), 3),
+                                 _mm_slli_epi16(_mm_and_si128(p1, low5), 3));
+    r = BlendBlackOnWhite_SSE(r);
+    g = BlendBlackOnWhite_SSE(g);
+    b = BlendBlackOnWhite_SSE(b);
+
+    __m128i bgLo = _mm_unpacklo_epi8(b, g);
+    __m128i bgHi = _mm_unpackhi_epi8(b, g);
+    __m128i raLo = _mm_unpacklo_epi8(r, ff);
+    __m128i raHi = _mm_unpackhi_epi8(r, ff);
+    __m128i* dst = (__m128i*)(aBGRA + 4 * i);
+    _mm_storeu_si128(dst, _mm_unpacklo_epi16(bgLo, raLo));
+    _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(bgLo, raLo));
+    _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(bgHi, raHi));
+    _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(bgHi, raHi));
+  }
+
+  ConvertLCD16_Scalar(aLCD16 + i, aBGRA + 4 * i, aCount - i);
+}
+#endif // DW_CPU_X86
+
+static PackLCD16Proc
+SelectPackLCD16Proc()
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_SSSE3)) {
+    return PackLCD16_SSSE3;
+  }
+#endif
+  return PackLCD16_Scalar;
+}
+
+PackLCD16Proc
+GetPackLCD16Proc()
+{
+  static const PackLCD16Proc sProc = SelectPackLCD16Proc();
+  return sProc;
+}
+
+static ConvertLCD16Proc
+SelectConvertLCD16Proc()
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_SSSE3)) {
+    return ConvertLCD16_SSSE3;
+  }
+#endif
+  return ConvertLCD16_Scalar;
+}
+
+ConvertLCD16Proc
+GetConvertLCD16Proc()
+{
+  static const ConvertLCD16Proc sProc = SelectConvertLCD16Proc();
+  return sProc;
+}
+
+void
+ConvertLCD16Rect(const uint16_t* aLCD16, int aSrcStride, int aWidth, int aHeight,
+                 uint8_t* aDest, int aDestStride)
+{
+  int rows = aHeight;
+  int count = aWidth;
+  if (aSrcStride == aWidth * 2 && aDestStride == aWidth * 4) {
+    rows = 1;
+    count = aWidth * aHeight;
+  }
+
+  ConvertLCD16Proc convertProc = GetConvertLCD16Proc();
+  for (int y = 0; y < rows; y++) {
+    convertProc((const uint16_t*)((const uint8_t*)aLCD16 + y * aSrcStride),
+                aDest + y * aDestStride, count);
+  }
+}
+
+void
+BuildCompositeLUT(CompositeLUT* aOut,
+                  const uint8_t* aTableR, const uint8_t* aTableG, const uint8_t* aTableB,
+                  bool aQuantize, uint32_t aForeground, uint32_t aBackground)
+{
+  const uint8_t* tables[3] = { aTableR, aTableG, aTableB };
+  uint8_t* outs[3] = { aOut->fR, aOut->fG, aOut->fB };
+  const int shifts[3] = { 16, 8, 0 };
+
+  for (int c = 0; c < 3; c++) {
+    float src = (float)((aForeground >> shifts[c]) & 0xFF);
+    float dst = (float)((aBackground >> shifts[c]) & 0xFF);
+    for (int x = 0; x < 256; x++) {
+      // Same steps and types as ConvertClearType_Scalar so the table matches it exactly.
+      uint8_t value = (uint8_t)x;
+      if (tables[c]) {
+        value = tables[c][value];
+      }
+      if (aQuantize) {
+        value = (value >> 3) << 3;
+      }
+      outs[c][x] = (uint8_t)Blend(src, dst, value);
+    }
+  }
+}
+
+void
+ConvertClearTypeCompiled(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                         const CompositeLUT& aLUT)
+{
+  for (int i = 0; i < aCount; i++) {
+    const uint8_t* src = aRGB + 3 * i;
+    uint8_t* dst = aBGRA + 4 * i;
+    dst[0] = aLUT.fB[src[2]];
+    dst[1] = aLUT.fG[src[1]];
+    dst[2] = aLUT.fR[src[0]];
+    dst[3] = 0xFF;
+  }
+}
+
+void
+ConvertClearTypeRect(const uint8_t* aRGB, int aSrcStride, int aWidth, int aHeight,
+                     uint8_t* aDest, int aDestStride,
+                     const uint8_t* aTableR, const uint8_t* aTableG,
+                     const uint8_t* aTableB, bool aQuantize,
+                     CompositeLUTCache* aCompiled)
+{
+  // The kernels work on runs of pixels. Tightly packed rows are one run.
+  int rows = aHeight;
+  int count = aWidth;
+  if (aSrcStride == aWidth * 3 && aDestStride == aWidth * 4) {
+    rows = 1;
+    count = aWidth * aHeight;
+  }
+
+  // Without tables the SIMD kernels beat the scalar table lookup, so the
+  // compiled tables only pay off when there are gamma tables to fold in.
+  if (aCompiled && (aTableR || aTableG || aTableB)) {
+    const CompositeLUT& lut = aCompiled->Get(aTableR, aTableG, aTableB, aQuantize,
+                                             0xFF000000, 0xFFFFFFFF);
+    for (int y = 0; y < rows; y++) {
+      ConvertClearTypeCompiled(aRGB + y * aSrcStride, aDest + y * aDestStride, count, lut);
+    }
+    return;
+  }
+
+  // PipelineBench checks the SIMD kernels against ConvertClearType_Scalar,
+  // which is the original per pixel loop.
+  ConvertClearTypeProc convertProc = GetConvertClearTypeProc();
+  for (int y = 0; y < rows; y++) {
+    convertProc(aRGB + y * aSrcStride, aDest + y * aDestStride, count,
+                aTableR, aTableG, aTableB, aQuantize);
+  }
+}
+
+void
+BlendGrayscaleRect(const uint8_t* aRGB, int aSrcStride, int aWidth, int aHeight,
+                   uint8_t* aDest, int aDestStride, const uint8_t* aTableG,
+                   uint32_t aForeground, uint32_t aBackground)
+{
+  const float textR = (float)((aForeground >> 16) & 0xFF);
+  const float textG = (float)((aForeground >> 8) & 0xFF);
+  const float textB = (float)(aForeground & 0xFF);
+  const float backgroundR = (float)((aBackground >> 16) & 0xFF);
+  const float backgroundG = (float)((aBackground >> 8) & 0xFF);
+  const float backgroundB = (float)(aBackground & 0xFF);
+
+  for (int y = 0; y < aHeight; y++) {
+    const uint8_t* source = aRGB + y * aSrcStride;
+    uint8_t* dest = aDest + y * aDestStride;
+    for (int i = 0; i < aWidth; i++) {
+      // Skia only looks at the red coverage here.
+      uint8_t pixel = aTableG ? aTableG[source[3 * i]] : source[3 * i];
+      dest[4 * i] = (uint8_t)Blend(textB, backgroundB, pixel);
+      dest[4 * i + 1] = (uint8_t)Blend(textG, backgroundG, pixel);
+      dest[4 * i + 2] = (uint8_t)Blend(textR, backgroundR, pixel);
+      dest[4 * i + 3] = 0xFF;
+    }
+  }
+}
+
+void
+ApplyTableA8(const uint8_t* aA8, uint8_t* aOut, int aCount, const uint8_t* aTable)
+{
+  int i = 0;
+  for (; i + 4 <= aCount; i += 4) {
+    uint8_t a0 = aTable[aA8[i]];
+    uint8_t a1 = aTable[aA8[i + 1]];
+    uint8_t a2 = aTable[aA8[i + 2]];
+    uint8_t a3 = aTable[aA8[i + 3]];
+    aOut[i] = a0;
+    aOut[i + 1] = a1;
+    aOut[i + 2] = a2;
+    aOut[i + 3] = a3;
+  }
+  for (; i < aCount; i++) {
+    aOut[i] = aTable[aA8[i]];
+  }
+}
+
+void
+BlitOpaqueRect(const uint8_t* aBGRX, int aSrcStride, int aWidth, int aHeight,
+               uint8_t* aDest, int aDestStride)
+{
+  for (int y = 0; y < aHeight; y++) {
+    const uint8_t* source = aBGRX + y * aSrcStride;
+    uint8_t* dest = aDest + y * aDestStride;
+    for (int i = 0; i < aWidth; i++) {
+      dest[4 * i] = source[4 * i];
+      dest[4 * i + 1] = source[4 * i + 1];
+      dest[4 * i + 2] = source[4 * i + 2];
+      dest[4 * i + 3] = 0xFF;
+    }
+  }
+}
+
+CompositeLUTCache::CompositeLUTCache()
+  : mCount(0)
+  , mClock(0)
+  , mHits(0)
+  , mMisses(0)
+{
+}
+
+const CompositeLUT&
+CompositeLUTCache::Get(const uint8_t* aTableR, const uint8_t* aTableG, const uint8_t* aTableB,
+                       bool aQuantize, uint32_t aForeground, uint32_t aBackground)
+{
+  // Only the RGB bytes take part in the blend.
+  aForeground &= 0x00FFFFFF;
+  aBackground &= 0x00FFFFFF;
+  mClock++;
+
+  for (int i = 0; i < mCount; i++) {
+    Entry& entry = mEntries[i];
+    if (entry.fTableR == aTableR && entry.fTableG == aTableG && entry.fTableB == aTableB &&
+        entry.fQuantize == aQuantize &&
+        entry.fForeground == aForeground && entry.fBackground == aBackground) {
+      entry.fLastUse = mClock;
+      mHits++;
+      return entry.fLUT;
+    }
+  }
+
+  int slot = mCount;
+  if (mCount < kMaxEntries) {
+    mCount++;
+  } else {
+    slot = 0;
+    for (int i = 1; i < kMaxEntries; i++) {
+      if (mEntries[i].fLastUse < mEntries[slot].fLastUse) {
+        slot = i;
+      }
+    }
+  }
+
+  Entry& entry = mEntries[slot];
+  entry.fTableR = aTableR;
+  entry.fTableG = aTableG;
+  entry.fTableB = aTableB;
+  entry.fQuantize = aQuantize;
+  entry.fForeground = aForeground;
+  entry.fBackground = aBackground;
+  entry.fLastUse = mClock;
+  BuildCompositeLUT(&entry.fLUT, aTableR, aTableG, aTableB, aQuantize, aForeground, aBackground);
+  mMisses++;
+  return entry.fLUT;
+}
+
+// Rounded x / 255 for x in [0, 255 * 255].
+static inline unsigned
+Div255(unsigned aValue)
+{
+  aValue += 128;
+  return (aValue + (aValue >> 8)) >> 8;
+}
+
+static inline uint8_t
+SrcOverChannel(unsigned aSrc, unsigned aDst, unsigned aCoverage)
+{
+  return (uint8_t)Div255(aSrc * aCoverage + aDst * (255 - aCoverage));
+}
+
+void
+BlendClearType_Scalar(const uint8_t* aRGB, const uint8_t* aDest, uint8_t* aBGRA,
+                      int aCount, const MaskBlendParams& aParams, uint32_t aBackground)
+{
+  const unsigned srcA = (aParams.fForeground >> 24) & 0xFF;
+  const int srcR = (aParams.fForeground >> 16) & 0xFF;
+  const int srcG = (aParams.fForeground >> 8) & 0xFF;
+  const int srcB = aParams.fForeground & 0xFF;
+  const uint8_t quantize = aParams.fQuantize ? 0xF8 : 0xFF;
+  const uint8_t background[4] = { (uint8_t)aBackground, (uint8_t)(aBackground >> 8),
+                                  (uint8_t)(aBackground >> 16), (uint8_t)(aBackground >> 24) };
+
+  for (int i = 0; i < aCount; i++) {
+    uint8_t r = aRGB[3 * i];
+    uint8_t g = aRGB[3 * i + 1];
+    uint8_t b = aRGB[3 * i + 2];
+    if (aParams.fTableR) {
+      r = aParams.fTableR[r];
+      g = aParams.fTableG[g];
+      b = aParams.fTableB[b];
+    }
+
+    const uint8_t* dst = aDest ? aDest + 4 * i : background;
+    uint8_t* out = aBGRA + 4 * i;
+
+    if (aParams.fMode == MASK_BLEND_SKIA_LCD16) {
+      // Skia leaves the pixel alone when the packed 565 mask is zero.
+      if ((r >> 3) == 0 && (g >> 2) == 0 && (b >> 3) == 0) {
+        uint32_t pixel;
+        memcpy(&pixel, dst, 4);
+        memcpy(out, &pixel, 4);
+        continue;
+      }
+      const int srcA256 = srcA + 1;
+      int maskR = SkUpscale31To32(r >> 3) * srcA256 >> 8;
+      int maskG = SkUpscale31To32(g >> 3) * srcA256 >> 8;
+      int maskB = SkUpscale31To32(b >> 3) * srcA256 >> 8;
+      uint8_t blendB = (uint8_t)SkBlend32(srcB, dst[0], maskB);
+      uint8_t blendG = (uint8_t)SkBlend32(srcG, dst[1], maskG);
+      uint8_t blendR = (uint8_t)SkBlend32(srcR, dst[2], maskR);
+      out[0] = blendB;
+      out[1] = blendG;
+      out[2] = blendR;
+      out[3] = 0xFF;
+      continue;
+    }
+
+    unsigned coverageR = Div255((r & quantize) * srcA);
+    unsigned coverageG = Div255((g & quantize) * srcA);
+    unsigned coverageB = Div255((b & quantize) * srcA);
+    uint8_t blendB = SrcOverChannel(srcB, dst[0], coverageB);
+    uint8_t blendG = SrcOverChannel(srcG, dst[1], coverageG);
+    uint8_t blendR = SrcOverChannel(srcR, dst[2], coverageR);
+    // The text is opaque where covered, use the green coverage for alpha.
+    uint8_t blendA = SrcOverChannel(0xFF, dst[3], coverageG);
+    out[0] = blendB;
+    out[1] = blendG;
+    out[2] = blendR;
+    out[3] = blendA;
+  }
+}
+
+void
+BlendA8_Scalar(const uint8_t* aA8, uint8_t* aBGRA, int aCount, const MaskBlendParams& aParams)
+{
+  const unsigned srcA = (aParams.fForeground >> 24) & 0xFF;
+  const unsigned srcR = (aParams.fForeground >> 16) & 0xFF;
+  const unsigned srcG = (aParams.fForeground >> 8) & 0xFF;
+  const unsigned srcB = aParams.fForeground & 0xFF;
+
+  for (int i = 0; i < aCount; i++) {
+    uint8_t alpha = aParams.fTableG ? aParams.fTableG[aA8[i]] : aA8[i];
+    if (!alpha) {
+      continue;
+    }
+    unsigned coverage = Div255(alpha * srcA);
+    uint8_t* pixel = aBGRA + 4 * i;
+    pixel[0] = SrcOverChannel(srcB, pixel[0], coverage);
+    pixel[1] = SrcOverChannel(srcG, pixel[1], coverage);
+    pixel[2] = SrcOverChannel(srcR, pixel[2], coverage);
+    pixel[3] = SrcOverChannel(0xFF, pixel[3], coverage);
+  }
+}
+
+#if defined(DW_CPU_X86)
+// Rounded x / 255 of every 16 bit lane, for x in [0, 255 * 255].
+static inline __m128i
+Div255_SSE2(__m128i aValue)
+{
+  aValue = _mm_add_epi16(aValue, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(aValue, _mm_srli_epi16(aValue, 8)), 8);
+}
+
+// Blends 4 BGRA pixels. aCoverage holds the B, G, R, G coverage of each
+// pixel so the alpha byte follows green like the scalar version.
+DW_TARGET_SSSE3 static inline __m128i
+BlendPixels_SSSE3(__m128i aCoverage, __m128i aSrc, __m128i aDst,
+                  const MaskBlendParams& aParams, __m128i aSrcAlpha)
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  if (aParams.fMode == MASK_BLEND_SKIA_LCD16) {
+    // B < 8, G < 4 and R < 8 is a zero 565 mask, the alpha byte always passes.
+    __m128i limits = _mm_set1_epi32((int)0xFF070307);
+    __m128i below = _mm_cmpeq_epi8(_mm_subs_epu8(aCoverage, limits), zero);
+    __m128i untouched = _mm_cmpeq_epi32(below, _mm_set1_epi32(-1));
+
+    __m128i result[2];
+    for (int half = 0; half < 2; half++) {
+      __m128i coverage = half ? _mm_unpackhi_epi8(aCoverage, zero) : _mm_unpacklo_epi8(aCoverage, zero);
+      __m128i src = half ? _mm_unpackhi_epi8(aSrc, zero) : _mm_unpacklo_epi8(aSrc, zero);
+      __m128i dst = half ? _mm_unpackhi_epi8(aDst, zero) : _mm_unpacklo_epi8(aDst, zero);
+      __m128i mask = _mm_srli_epi16(coverage, 3);
+      mask = _mm_add_epi16(mask, _mm_srli_epi16(mask, 4));
+      mask = _mm_srli_epi16(_mm_mullo_epi16(mask, aSrcAlpha), 8);
+      __m128i delta = _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(src, dst), mask), 5);
+      result[half] = _mm_add_epi16(dst, delta);
+    }
+    __m128i blended = _mm_or_si128(_mm_packus_epi16(result[0], result[1]),
+                                   _mm_set1_epi32((int)0xFF000000));
+    return _mm_or_si128(_mm_and_si128(untouched, aDst), _mm_andnot_si128(untouched, blended));
+  }
+
+  __m128i result[2];
+  for (int half = 0; half < 2; half++) {
+    __m128i coverage = half ? _mm_unpackhi_epi8(aCoverage, zero) : _mm_unpacklo_epi8(aCoverage, zero);
+    __m128i src = half ? _mm_unpackhi_epi8(aSrc, zero) : _mm_unpacklo_epi8(aSrc, zero);
+    __m128i dst = half ? _mm_unpackhi_epi8(aDst, zero) : _mm_unpacklo_epi8(aDst, zero);
+    coverage = Div255_SSE2(_mm_mullo_epi16(coverage, aSrcAlpha));
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), coverage);
+    result[half] = Div255_SSE2(_mm_add_epi16(_mm_mullo_epi16(src, coverage),
+                                             _mm_mullo_epi16(dst, inverse)));
+  }
+  return _mm_packus_epi16(result[0], result[1]);
+}
+
+// Like RGB_TO_BGRX_SHUFFLE, but repeats green in the alpha byte.
+#define RGB_TO_BGRG_SHUFFLE 2, 1, 0, 1, 5, 4, 3, 4, 8, 7, 6, 7, 11, 10, 9, 10
+
+DW_TARGET_SSSE3 void
+BlendClearType_SSSE3(const uint8_t* aRGB, const uint8_t* aDest, uint8_t* aBGRA,
+                     int aCount, const MaskBlendParams& aParams, uint32_t aBackground)
+{
+  const __m128i shuffle = _mm_setr_epi8(RGB_TO_BGRG_SHUFFLE);
+  const bool skia = aParams.fMode == MASK_BLEND_SKIA_LCD16;
+  const __m128i quantize = _mm_set1_epi8(aParams.fQuantize && !skia ? (char)0xF8 : (char)0xFF);
+  // The text color with an opaque alpha byte, blended like the scalar version.
+  const __m128i src = _mm_set1_epi32((int)(aParams.fForeground | 0xFF000000));
+  const __m128i background = _mm_set1_epi32((int)aBackground);
+  const unsigned srcA = (aParams.fForeground >> 24) & 0xFF;
+  const __m128i srcAlpha = _mm_set1_epi16((short)(skia ? srcA + 1 : srcA));
+  uint8_t block[48];
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    const uint8_t* rgb = aRGB + 3 * i;
+    if (aParams.fTableR) {
+      ApplyTables(rgb, block, 16, aParams.fTableR, aParams.fTableG, aParams.fTableB);
+      rgb = block;
+    }
+
+    __m128i v0 = _mm_and_si128(_mm_loadu_si128((const __m128i*)rgb), quantize);
+    __m128i v1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(rgb + 16)), quantize);
+    __m128i v2 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(rgb + 32)), quantize);
+
+    __m128i coverage[4];
+    coverage[0] = _mm_shuffle_epi8(v0, shuffle);
+    coverage[1] = _mm_shuffle_epi8(_mm_alignr_epi8(v1, v0, 12), shuffle);
+    coverage[2] = _mm_shuffle_epi8(_mm_alignr_epi8(v2, v1, 8), shuffle);
+    coverage[3] = _mm_shuffle_epi8(_mm_srli_si128(v2, 4), shuffle);
+
+    for (int k = 0; k < 4; k++) {
+      __m128i dst = aDest ? _mm_loadu_si128((const __m128i*)(aDest + 4 * (i + 4 * k)))
+                          : background;
+      _mm_storeu_si128((__m128i*)(aBGRA + 4 * (i + 4 * k)),
+                       BlendPixels_SSSE3(coverage[k], src, dst, aParams, srcAlpha));
+    }
+  }
+
+  BlendClearType_Scalar(aRGB + 3 * i, aDest ? aDest + 4 * i : nullptr, aBGRA + 4 * i,
+                        aCount - i, aParams, aBackground);
+}
+#endif
+
+#if defined(DW_CPU_X86)
+DW_TARGET_SSSE3 void
+BlendA8_SSSE3(const uint8_t* aA8, uint8_t* aBGRA, int aCount, const MaskBlendParams& aParams)
+{
+  MaskBlendParams params = aParams;
+  params.fMode = MASK_BLEND_SRC_OVER;
+  const __m128i src = _mm_set1_epi32((int)(aParams.fForeground | 0xFF000000));
+  const __m128i srcAlpha = _mm_set1_epi16((short)((aParams.fForeground >> 24) & 0xFF));
+  // Spreads the coverage of pixels 4k..4k+3 over all four channels.
+  const __m128i spread[4] = {
+    _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3),
+    _mm_setr_epi8(4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7),
+    _mm_setr_epi8(8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11),
+    _mm_setr_epi8(12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15),
+  };
+  uint8_t block[16];
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    const uint8_t* a8 = aA8 + i;
+    if (aParams.fTableG) {
+      for (int k = 0; k < 16; k++) {
+        block[k] = aParams.fTableG[a8[k]];
+      }
+      a8 = block;
+    }
+
+    __m128i alpha = _mm_loadu_si128((const __m128i*)a8);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, _mm_setzero_si128())) == 0xFFFF) {
+      continue;
+    }
+    for (int k = 0; k < 4; k++) {
+      __m128i coverage = _mm_shuffle_epi8(alpha, spread[k]);
+      __m128i* dst = (__m128i*)(aBGRA + 4 * (i + 4 * k));
+      _mm_storeu_si128(dst, BlendPixels_SSSE3(coverage, src, _mm_loadu_si128(dst), params, srcAlpha));
+    }
+  }
+
+  BlendA8_Scalar(aA8 + i, aBGRA + 4 * i, aCount - i, aParams);
+}
+#endif
+
+void
+BlendLCD16_Scalar(const uint16_t* aLCD16, const uint8_t* aDest, uint8_t* aBGRA,
+                  int aCount, const MaskBlendParams& aParams, uint32_t aBackground)
+{
+  // The words hold coverage after the PreBlend tables.
+  MaskBlendParams params = aParams;
+  params.fTableR = params.fTableG = params.fTableB = nullptr;
+  uint8_t block[3 * 64];
+
+  for (int i = 0; i < aCount; i += 64) {
+    int count = aCount - i < 64 ? aCount - i : 64;
+    UnpackLCD16(aLCD16 + i, block, count);
+    BlendClearType_Scalar(block, aDest ? aDest + 4 * i : nullptr, aBGRA + 4 * i,
+                          count, params, aBackground);
+  }
+}
+
+#if defined(DW_CPU_X86)
+// The coverage of 8 LCD16 pixels as the B, G, R, G bytes BlendPixels takes,
+// pixels 0-3 in aLo and 4-7 in aHi. Same bytes as UnpackLCD16.
+static inline void
+UnpackLCD16Coverage_SSE2(__m128i aPixels, __m128i* aLo, __m128i* aHi)
+{
+  __m128i r = _mm_slli_epi16(_mm_srli_epi16(aPixels, 11), 3);
+  __m128i g = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(aPixels, 5), _mm_set1_epi16(0x3F)), 2);
+  __m128i b = _mm_slli_epi16(_mm_and_si128(aPixels, _mm_set1_epi16(0x1F)), 3);
+  __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+  __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+  *aLo = _mm_unpacklo_epi16(bg, rg);
+  *aHi = _mm_unpackhi_epi16(bg, rg);
+}
+
+DW_TARGET_SSSE3 void
+BlendLCD16_SSSE3(const uint16_t* aLCD16, const uint8_t* aDest, uint8_t* aBGRA,
+                 int aCount, const MaskBlendParams& aParams, uint32_t aBackground)
+{
+  const bool skia = aParams.fMode == MASK_BLEND_SKIA_LCD16;
+  const __m128i quantize = _mm_set1_epi8(aParams.fQuantize && !skia ? (char)0xF8 : (char)0xFF);
+  const __m128i src = _mm_set1_epi32((int)(aParams.fForeground | 0xFF000000));
+  const __m128i background = _mm_set1_epi32((int)aBackground);
+  const unsigned srcA = (aParams.fForeground >> 24) & 0xFF;
+  const __m128i srcAlpha = _mm_set1_epi16((short)(skia ? srcA + 1 : srcA));
+
+  int i = 0;
+  for (; i + 8 <= aCount; i += 8) {
+    __m128i coverage[2];
+    UnpackLCD16Coverage_SSE2(_mm_loadu_si128((const __m128i*)(aLCD16 + i)),
+                             &coverage[0], &coverage[1]);
+    for (int k = 0; k < 2; k++) {
+      __m128i dst = aDest ? _mm_loadu_si128((const __m128i*)(aDest + 4 * (i + 4 * k)))
+                          : background;
+      _mm_storeu_si128((__m128i*)(aBGRA + 4 * (i + 4 * k)),
+                       BlendPixels_SSSE3(_mm_and_si128(coverage[k], quantize), src, dst,
+                                         aParams, srcAlpha));
+    }
+  }
+
+  BlendLCD16_Scalar(aLCD16 + i, aDest ? aDest + 4 * i : nullptr, aBGRA + 4 * i,
+                    aCount - i, aParams, aBackground);
+}
+
+// Div255_SSE2 on 16 lanes.
+DW_TARGET_AVX2 static inline __m256i
+Div255_AVX2(__m256i aValue)
+{
+  aValue = _mm256_add_epi16(aValue, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(aValue, _mm256_srli_epi16(aValue, 8)), 8);
+}
+
+// BlendPixels_SSSE3 on 8 pixels, 4 in each 128 bit lane. The unpacks and
+// packs stay inside a lane so the pixels come back in order.
+DW_TARGET_AVX2 static inline __m256i
+BlendPixels_AVX2(__m256i aCoverage, __m256i aSrc, __m256i aDst,
+                 const MaskBlendParams& aParams, __m256i aSrcAlpha)
+{
+  const __m256i zero = _mm256_setzero_si256();
+
+  if (aParams.fMode == MASK_BLEND_SKIA_LCD16) {
+    __m256i limits = _mm256_set1_epi32((int)0xFF070307);
+    __m256i below = _mm256_cmpeq_epi8(_mm256_subs_epu8(aCoverage, limits), zero);
+    __m256i untouched = _mm256_cmpeq_epi32(below, _mm256_set1_epi32(-1));
+
+    __m256i result[2];
+    for (int half = 0; half < 2; half++) {
+      __m256i coverage = half ? _mm256_unpackhi_epi8(aCoverage, zero) : _mm256_unpacklo_epi8(aCoverage, zero);
+      __m256i src = half ? _mm256_unpackhi_epi8(aSrc, zero) : _mm256_unpacklo_epi8(aSrc, zero);
+      __m256i dst = half ? _mm256_unpackhi_epi8(aDst, zero) : _mm256_unpacklo_epi8(aDst, zero);
+      __m256i mask = _mm256_srli_epi16(coverage, 3);
+      mask = _mm256_add_epi16(mask, _mm256_srli_epi16(mask, 4));
+      mask = _mm256_srli_epi16(_mm256_mullo_epi16(mask, aSrcAlpha), 8);
+      __m256i delta = _mm256_srai_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(src, dst), mask), 5);
+      result[half] = _mm256_add_epi16(dst, delta);
+    }
+    __m256i blended = _mm256_or_si256(_mm256_packus_epi16(result[0], result[1]),
+                                      _mm256_set1_epi32((int)0xFF000000));
+    return _mm256_or_si256(_mm256_and_si256(untouched, aDst), _mm256_andnot_si256(untouched, blended));
+  }
+
+  __m256i result[2];
+  for (int half = 0; half < 2; half++) {
+    __m256i coverage = half ? _mm256_unpackhi_epi8(aCoverage, zero) : _mm256_unpacklo_epi8(aCoverage, zero);
+    __m256i src = half ? _mm256_unpackhi_epi8(aSrc, zero) : _mm256_unpacklo_epi8(aSrc, zero);
+    __m256i dst = half ? _mm256_unpackhi_epi8(aDst, zero) : _mm256_unpacklo_epi8(aDst, zero);
+    coverage = Div255_AVX2(_mm256_mullo_epi16(coverage, aSrcAlpha));
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), coverage);
+    result[half] = Div255_AVX2(_mm256_add_epi16(_mm256_mullo_epi16(src, coverage),
+                                                _mm256_mullo_epi16(dst, inverse)));
+  }
+  return _mm256_packus_epi16(result[0], result[1]);
+}
+
+DW_TARGET_AVX2 void
+BlendClearType_AVX2(const uint8_t* aRGB, const uint8_t* aDest, uint8_t* aBGRA,
+                    int aCount, const MaskBlendParams& aParams, uint32_t aBackground)
+{
+  const __m256i shuffle = _mm256_setr_epi8(RGB_TO_BGRG_SHUFFLE, RGB_TO_BGRG_SHUFFLE);
+  const bool skia = aParams.fMode == MASK_BLEND_SKIA_LCD16;
+  const __m256i quantize = _mm256_set1_epi8(aParams.fQuantize && !skia ? (char)0xF8 : (char)0xFF);
+  const __m256i src = _mm256_set1_epi32((int)(aParams.fForeground | 0xFF000000));
+  const __m256i background = _mm256_set1_epi32((int)aBackground);
+  const unsigned srcA = (aParams.fForeground >> 24) & 0xFF;
+  const __m256i srcAlpha = _mm256_set1_epi16((short)(skia ? srcA + 1 : srcA));
+  // 48 bytes blended plus the 4 bytes the last LoadRGBx8 overreads.
+  uint8_t block[52];
+
+  int i = 0;
+  // Keep 2 spare source pixels so the overread stays inside aRGB.
+  for (; i + 18 <= aCount; i += 16) {
+    const uint8_t* rgb = aRGB + 3 * i;
+    if (aParams.fTableR) {
+      ApplyTables(rgb, block, 16, aParams.fTableR, aParams.fTableG, aParams.fTableB);
+      rgb = block;
+    }
+
+    for (int k = 0; k < 2; k++) {
+      __m256i coverage = _mm256_shuffle_epi8(_mm256_and_si256(LoadRGBx8(rgb + 24 * k), quantize),
+                                             shuffle);
+      __m256i dst = aDest ? _mm256_loadu_si256((const __m256i*)(aDest + 4 * (i + 8 * k)))
+                          : background;
+      _mm256_storeu_si256((__m256i*)(aBGRA + 4 * (i + 8 * k)),
+                          BlendPixels_AVX2(coverage, src, dst, aParams, srcAlpha));
+    }
+  }
+
+  BlendClearType_SSSE3(aRGB + 3 * i, aDest ? aDest + 4 * i : nullptr, aBGRA + 4 * i,
+                       aCount - i, aParams, aBackground);
+}
+
+DW_TARGET_AVX2 void
+BlendA8_AVX2(const uint8_t* aA8, uint8_t* aBGRA, int aCount, const MaskBlendParams& aParams)
+{
+  MaskBlendParams params = aParams;
+  params.fMode = MASK_BLEND_SRC_OVER;
+  const __m256i src = _mm256_set1_epi32((int)(aParams.fForeground | 0xFF000000));
+  const __m256i srcAlpha = _mm256_set1_epi16((short)((aParams.fForeground >> 24) & 0xFF));
+  // Spreads the coverage of pixels 8k..8k+7 over all four channels, the
+  // first four into the low lane.
+  const __m256i spread[2] = {
+    _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                     4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7),
+    _mm256_setr_epi8(8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11,
+                     12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15),
+  };
+  uint8_t block[16];
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    const uint8_t* a8 = aA8 + i;
+    if (aParams.fTableG) {
+      for (int k = 0; k < 16; k++) {
+        block[k] = aParams.fTableG[a8[k]];
+      }
+      a8 = block;
+    }
+
+    __m128i alpha = _mm_loadu_si128((const __m128i*)a8);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, _mm_setzero_si128())) == 0xFFFF) {
+      continue;
+    }
+    __m256i both = _mm256_broadcastsi128_si256(alpha);
+    for (int k = 0; k < 2; k++) {
+      __m256i coverage = _mm256_shuffle_epi8(both, spread[k]);
+      __m256i* dst = (__m256i*)(aBGRA + 4 * (i + 8 * k));
+      _mm256_storeu_si256(dst, BlendPixels_AVX2(coverage, src, _mm256_loadu_si256(dst),
+                                                params, srcAlpha));
+    }
+  }
+
+  BlendA8_Scalar(aA8 + i, aBGRA + 4 * i, aCount - i, aParams);
+}
+
+DW_TARGET_AVX2 void
+BlendLCD16_AVX2(const uint16_t* aLCD16, const uint8_t* aDest, uint8_t* aBGRA,
+                int aCount, const MaskBlendParams& aParams, uint32_t aBackground)
+{
+  const bool skia = aParams.fMode == MASK_BLEND_SKIA_LCD16;
+  const __m256i quantize = _mm256_set1_epi8(aParams.fQuantize && !skia ? (char)0xF8 : (char)0xFF);
+  const __m256i src = _mm256_set1_epi32((int)(aParams.fForeground | 0xFF000000));
+  const __m256i background = _mm256_set1_epi32((int)aBackground);
+  const unsigned srcA = (aParams.fForeground >> 24) & 0xFF;
+  const __m256i srcAlpha = _mm256_set1_epi16((short)(skia ? srcA + 1 : srcA));
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    __m256i pixels = _mm256_loadu_si256((const __m256i*)(aLCD16 + i));
+    __m256i r = _mm256_slli_epi16(_mm256_srli_epi16(pixels, 11), 3);
+    __m256i g = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(pixels, 5),
+                                                   _mm256_set1_epi16(0x3F)), 2);
+    __m256i b = _mm256_slli_epi16(_mm256_and_si256(pixels, _mm256_set1_epi16(0x1F)), 3);
+    __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+    __m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+    // The unpacks work per lane: lo holds pixels 0-3 and 8-11, hi 4-7 and
+    // 12-15. Put them back in order.
+    __m256i lo = _mm256_unpacklo_epi16(bg, rg);
+    __m256i hi = _mm256_unpackhi_epi16(bg, rg);
+    __m256i coverage[2] = { _mm256_permute2x128_si256(lo, hi, 0x20),
+                            _mm256_permute2x128_si256(lo, hi, 0x31) };
+
+    for (int k = 0; k < 2; k++) {
+      __m256i dst = aDest ? _mm256_loadu_si256((const __m256i*)(aDest + 4 * (i + 8 * k)))
+                          : background;
+      _mm256_storeu_si256((__m256i*)(aBGRA + 4 * (i + 8 * k)),
+                          BlendPixels_AVX2(_mm256_and_si256(coverage[k], quantize), src, dst,
+                                           aParams, srcAlpha));
+    }
+  }
+
+  BlendLCD16_SSSE3(aLCD16 + i, aDest ? aDest + 4 * i : nullptr, aBGRA + 4 * i,
+                   aCount - i, aParams, aBackground);
+}
+#endif // DW_CPU_X86
+
+static BlendA8Proc
+SelectBlendA8Proc()
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_AVX2)) {
+    return BlendA8_AVX2;
+  }
+  if (HasCpuFeature(CPU_FEATURE_SSSE3)) {
+    return BlendA8_SSSE3;
+  }
+#endif
+  return BlendA8_Scalar;
+}
+
+BlendA8Proc
+GetBlendA8Proc()
+{
+  static const BlendA8Proc sProc = SelectBlendA8Proc();
+  return sProc;
+}
+
+static BlendClearTypeProc
+SelectBlendClearTypeProc()
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_AVX2)) {
+    return BlendClearType_AVX2;
+  }
+  if (HasCpuFeature(CPU_FEATURE_SSSE3)) {
+    return BlendClearType_SSSE3;
+  }
+#endif
+  return BlendClearType_Scalar;
+}
+
+BlendClearTypeProc
+GetBlendClearTypeProc()
+{
+  static const BlendClearTypeProc sProc = SelectBlendClearTypeProc();
+  return sProc;
+}
+
+static BlendLCD16Proc
+SelectBlendLCD16Proc()
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_AVX2)) {
+    return BlendLCD16_AVX2;
+  }
+  if (HasCpuFeature(CPU_FEATURE_SSSE3)) {
+    return BlendLCD16_SSSE3;
+  }
+#endif
+  return BlendLCD16_Scalar;
+}
+
+BlendLCD16Proc
+GetBlendLCD16Proc()
+{
+  static const BlendLCD16Proc sProc = SelectBlendLCD16Proc();
+  return sProc;
+}
+
+// SK_LUM_COEFF_* in 1.15 fixed point. Blue takes the rounding so the weights
+// sum to exactly 1 and white stays 255.
+static const int kLumWeightR = (int)(SK_LUM_COEFF_R * 32768 + 0.5f);
+static const int kLumWeightG = (int)(SK_LUM_COEFF_G * 32768 + 0.5f);
+static const int kLumWeightB = 32768 - kLumWeightR - kLumWeightG;
+
+void
+LuminanceToAlpha_Scalar(const uint8_t* aBGRA, uint8_t* aA8, int aCount)
+{
+  for (int i = 0; i < aCount; i++) {
+    const uint8_t* pixel = aBGRA + 4 * i;
+    int luma = pixel[0] * kLumWeightB + pixel[1] * kLumWeightG + pixel[2] * kLumWeightR;
+    aA8[i] = (uint8_t)((luma + (1 << 14)) >> 15);
+  }
+}
+
+void
+BlendLayer_Scalar(const uint8_t* aLayer, const uint8_t* aMask, uint8_t* aBGRA, int aCount)
+{
+  for (int i = 0; i < aCount; i++) {
+    const unsigned mask = aMask[i];
+    if (!mask) {
+      continue;
+    }
+    const uint8_t* src = aLayer + 4 * i;
+    uint8_t* dst = aBGRA + 4 * i;
+    const unsigned inverse = 255 - Div255(src[3] * mask);
+    for (int c = 0; c < 4; c++) {
+      unsigned value = Div255(src[c] * mask) + Div255(dst[c] * inverse);
+      dst[c] = (uint8_t)(value > 0xFF ? 0xFF : value);
+    }
+  }
+}
+
+#if defined(DW_CPU_X86)
+// The three weights per pixel for _mm_madd_epi16 on B, G, R, A words.
+#define LUM_WEIGHTS kLumWeightB, kLumWeightG, kLumWeightR, 0
+
+DW_TARGET_SSSE3 void
+LuminanceToAlpha_SSSE3(const uint8_t* aBGRA, uint8_t* aA8, int aCount)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weights = _mm_setr_epi16(LUM_WEIGHTS, LUM_WEIGHTS);
+  const __m128i round = _mm_set1_epi32(1 << 14);
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    __m128i luma[4];
+    for (int k = 0; k < 4; k++) {
+      __m128i pixels = _mm_loadu_si128((const __m128i*)(aBGRA + 4 * (i + 4 * k)));
+      // B*wB + G*wG and R*wR of each pixel, then the two summed.
+      __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+      __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+      luma[k] = _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), round), 15);
+    }
+    _mm_storeu_si128((__m128i*)(aA8 + i),
+                     _mm_packus_epi16(_mm_packs_epi32(luma[0], luma[1]),
+                                      _mm_packs_epi32(luma[2], luma[3])));
+  }
+
+  LuminanceToAlpha_Scalar(aBGRA + 4 * i, aA8 + i, aCount - i);
+}
+
+// Blends 4 layer pixels onto aDst, aMask holding each pixel's mask byte in
+// all four channels.
+static inline __m128i
+BlendLayerPixels_SSE2(__m128i aMask, __m128i aSrc, __m128i aDst)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i result[2];
+  for (int half = 0; half < 2; half++) {
+    __m128i mask = half ? _mm_unpackhi_epi8(aMask, zero) : _mm_unpacklo_epi8(aMask, zero);
+    __m128i src = half ? _mm_unpackhi_epi8(aSrc, zero) : _mm_unpacklo_epi8(aSrc, zero);
+    __m128i dst = half ? _mm_unpackhi_epi8(aDst, zero) : _mm_unpacklo_epi8(aDst, zero);
+    src = Div255_SSE2(_mm_mullo_epi16(src, mask));
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)),
+                                        _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    result[half] = _mm_add_epi16(src, Div255_SSE2(_mm_mullo_epi16(dst, inverse)));
+  }
+  return _mm_packus_epi16(result[0], result[1]);
+}
+
+DW_TARGET_SSSE3 void
+BlendLayer_SSSE3(const uint8_t* aLayer, const uint8_t* aMask, uint8_t* aBGRA, int aCount)
+{
+  // Same spreads as BlendA8_SSSE3.
+  const __m128i spread[4] = {
+    _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3),
+    _mm_setr_epi8(4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7),
+    _mm_setr_epi8(8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11),
+    _mm_setr_epi8(12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15),
+  };
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    __m128i mask = _mm_loadu_si128((const __m128i*)(aMask + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(mask, _mm_setzero_si128())) == 0xFFFF) {
+      continue;
+    }
+    for (int k = 0; k < 4; k++) {
+      __m128i src = _mm_loadu_si128((const __m128i*)(aLayer + 4 * (i + 4 * k)));
+      __m128i* dst = (__m128i*)(aBGRA + 4 * (i + 4 * k));
+      _mm_storeu_si128(dst, BlendLayerPixels_SSE2(_mm_shuffle_epi8(mask, spread[k]), src,
+                                                  _mm_loadu_si128(dst)));
+    }
+  }
+
+  BlendLayer_Scalar(aLayer + 4 * i, aMask + i, aBGRA + 4 * i, aCount - i);
+}
+
+DW_TARGET_AVX2 void
+LuminanceToAlpha_AVX2(const uint8_t* aBGRA, uint8_t* aA8, int aCount)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i weights = _mm256_setr_epi16(LUM_WEIGHTS, LUM_WEIGHTS, LUM_WEIGHTS, LUM_WEIGHTS);
+  const __m256i round = _mm256_set1_epi32(1 << 14);
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    __m256i luma[2];
+    for (int k = 0; k < 2; k++) {
+      // The unpacks stay in their lane, lo holds pixels 0, 1, 4, 5 and hi
+      // 2, 3, 6, 7, which the per lane hadd puts back in order.
+      __m256i pixels = _mm256_loadu_si256((const __m256i*)(aBGRA + 4 * (i + 8 * k)));
+      __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), weights);
+      __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), weights);
+      luma[k] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(lo, hi), round), 15);
+    }
+    // packs works per lane too: pixels 0-3, 8-11 | 4-7, 12-15.
+    __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(luma[0], luma[1]),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i*)(aA8 + i),
+                     _mm_packus_epi16(_mm256_castsi256_si128(words),
+                                      _mm256_extracti128_si256(words, 1)));
+  }
+
+  LuminanceToAlpha_Scalar(aBGRA + 4 * i, aA8 + i, aCount - i);
+}
+
+DW_TARGET_AVX2 void
+BlendLayer_AVX2(const uint8_t* aLayer, const uint8_t* aMask, uint8_t* aBGRA, int aCount)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  // Same spreads as BlendA8_AVX2.
+  const __m256i spread[2] = {
+    _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                     4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7),
+    _mm256_setr_epi8(8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11,
+                     12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15),
+  };
+
+  int i = 0;
+  for (; i + 16 <= aCount; i += 16) {
+    __m128i mask = _mm_loadu_si128((const __m128i*)(aMask + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(mask, _mm_setzero_si128())) == 0xFFFF) {
+      continue;
+    }
+    __m256i both = _mm256_broadcastsi128_si256(mask);
+    for (int k = 0; k < 2; k++) {
+      __m256i spreadMask = _mm256_shuffle_epi8(both, spread[k]);
+      __m256i src = _mm256_loadu_si256((const __m256i*)(aLayer + 4 * (i + 8 * k)));
+      __m256i* dstPtr = (__m256i*)(aBGRA + 4 * (i + 8 * k));
+      __m256i dst = _mm256_loadu_si256(dstPtr);
+
+      __m256i result[2];
+      for (int half = 0; half < 2; half++) {
+        __m256i m = half ? _mm256_unpackhi_epi8(spreadMask, zero) : _mm256_unpacklo_epi8(spreadMask, zero);
+        __m256i s = half ? _mm256_unpackhi_epi8(src, zero) : _mm256_unpacklo_epi8(src, zero);
+        __m256i d = half ? _mm256_unpackhi_epi8(dst, zero) : _mm256_unpacklo_epi8(dst, zero);
+        s = Div255_AVX2(_mm256_mullo_epi16(s, m));
+        __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)),
+                                               _MM_SHUFFLE(3, 3, 3, 3));
+        __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+        result[half] = _mm256_add_epi16(s, Div255_AVX2(_mm256_mullo_epi16(d, inverse)));
+      }
+      _mm256_storeu_si256(dstPtr, _mm256_packus_epi16(result[0], result[1]));
+    }
+  }
+
+  BlendLayer_Scalar(aLayer + 4 * i, aMask + i, aBGRA + 4 * i, aCount - i);
+}
+#endif // DW_CPU_X86
+
+static LuminanceToAlphaProc
+SelectLuminanceToAlphaProc()
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_AVX2)) {
+    return LuminanceToAlpha_AVX2;
+  }
+  if (HasCpuFeature(CPU_FEATURE_SSSE3)) {
+    return LuminanceToAlpha_SSSE3;
+  }
+#endif
+  return LuminanceToAlpha_Scalar;
+}
+
+LuminanceToAlphaProc
+GetLuminanceToAlphaProc()
+{
+  static const LuminanceToAlphaProc sProc = SelectLuminanceToAlphaProc();
+  return sProc;
+}
+
+static BlendLayerProc
+SelectBlendLayerProc()
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_AVX2)) {
+    return BlendLayer_AVX2;
+  }
+  if (HasCpuFeature(CPU_FEATURE_SSSE3)) {
+    return BlendLayer_SSSE3;
+  }
+#endif
+  return BlendLayer_Scalar;
+}
+
+BlendLayerProc
+GetBlendLayerProc()
+{
+  static const BlendLayerProc sProc = SelectBlendLayerProc();
+  return sProc;
+}
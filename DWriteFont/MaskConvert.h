@@ -0,0 +1,388 @@
+#pragma once
+
+#include <stdint.h>
+#include "CpuFeatures.h"
+
+// Kernels that turn DWrite 3x1 ClearType alpha masks into the BGRA pixels we
+// hand to D2D bitmaps. Nothing here depends on windows.h so the kernels can be
+// built and checked on any platform.
+
+// Original float blend used to draw black text on white.
+static inline int
+Blend(float src, float dst, float alpha) {
+  float floatAlpha = alpha / 255;
+  //return dst + ((src - dst) * alpha >> 8);
+  float result = (src * floatAlpha) + (dst * (1 - floatAlpha));
+  return (int) result;
+}
+
+// Skia's 5 bit LCD16 blend helpers, see SkBlitter_ARGB32.cpp.
+static inline int SkUpscale31To32(int value) {
+  return value + (value >> 4);
+}
+
+static inline int SkBlend32(int src, int dst, int alpha) {
+  return dst + ((src - dst) * alpha >> 5);
+}
+
+// Integer form of Blend(0x00, 0xFF, alpha) that is bit identical to the float
+// version. The float math loses one ulp for most alphas >= 65, so truncation
+// drops the result by one for every odd alpha in [65, 127] and every alpha in
+// [128, 254].
+static inline uint8_t
+BlendBlackOnWhite(uint8_t alpha) {
+  int correction = alpha != 0xFF && (alpha >= 128 || (alpha >= 65 && (alpha & 1)));
+  return (uint8_t)(0xFF - alpha - correction);
+}
+
+/**
+ * Converts aCount pixels of a RGB 3x1 ClearType mask into opaque BGRA,
+ * drawing black text on white.
+ *
+ * @param aTableR/G/B Per channel PreBlend tables, or all nullptr to skip the
+ *                    gamma correction.
+ * @param aQuantize Mimic Skia's LCD16 quantization (>> 3 << 3) after the LUT.
+ */
+typedef void (*ConvertClearTypeProc)(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                                     const uint8_t* aTableR, const uint8_t* aTableG,
+                                     const uint8_t* aTableB, bool aQuantize);
+
+// Scalar reference, runs the exact float code the SIMD kernels are checked
+// against by Bench/PipelineBench.cpp.
+void ConvertClearType_Scalar(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                             const uint8_t* aTableR, const uint8_t* aTableG,
+                             const uint8_t* aTableB, bool aQuantize);
+
+#if defined(DW_CPU_X86)
+// 16 pixels per iteration, needs SSSE3 for the 3->4 byte shuffle.
+void ConvertClearType_SSSE3(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                            const uint8_t* aTableR, const uint8_t* aTableG,
+                            const uint8_t* aTableB, bool aQuantize);
+
+// 32 pixels per iteration.
+void ConvertClearType_AVX2(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                           const uint8_t* aTableR, const uint8_t* aTableG,
+                           const uint8_t* aTableB, bool aQuantize);
+#endif
+
+#if defined(DW_CPU_NEON)
+// 16 pixels per iteration using vld3/vst4.
+void ConvertClearType_NEON(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                           const uint8_t* aTableR, const uint8_t* aTableG,
+                           const uint8_t* aTableB, bool aQuantize);
+#endif
+
+// Returns the fastest kernel the running CPU supports. Picked once from cpuid.
+ConvertClearTypeProc GetConvertClearTypeProc();
+
+/**
+ * The whole per channel chain of ConvertClearType_Scalar (PreBlend lookup,
+ * optional LCD16 quantization and the float blend between the text and
+ * background colors) folded into one table per channel. Converting a pixel is
+ * then three byte lookups with no branches, and the output is bit identical
+ * to the step by step path, which PipelineBench checks.
+ */
+struct CompositeLUT {
+  uint8_t fR[256];
+  uint8_t fG[256];
+  uint8_t fB[256];
+};
+
+/**
+ * Fills aOut for the given chain.
+ *
+ * @param aTableR/G/B PreBlend tables, or all nullptr for no gamma correction.
+ * @param aForeground Text color as 0xAARRGGBB, the alpha byte is ignored.
+ * @param aBackground Background color as 0xAARRGGBB, the alpha byte is ignored.
+ */
+void BuildCompositeLUT(CompositeLUT* aOut,
+                       const uint8_t* aTableR, const uint8_t* aTableG, const uint8_t* aTableB,
+                       bool aQuantize, uint32_t aForeground, uint32_t aBackground);
+
+// Converts aCount RGB 3x1 pixels to opaque BGRA through a compiled table set.
+void ConvertClearTypeCompiled(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                              const CompositeLUT& aLUT);
+
+class CompositeLUTCache;
+
+/**
+ * What D2DSetup::ConvertToBGRA does for black text on white: converts a
+ * aWidth x aHeight RGB 3x1 mask to opaque BGRA, rows aSrcStride and
+ * aDestStride bytes apart. Tightly packed rows go through the kernel as one
+ * run.
+ *
+ * @param aCompiled If set and any table is given, converts through the
+ *                  cached compiled tables instead of the fastest
+ *                  ConvertClearTypeProc. Without tables the kernel is used
+ *                  either way.
+ */
+void ConvertClearTypeRect(const uint8_t* aRGB, int aSrcStride, int aWidth, int aHeight,
+                          uint8_t* aDest, int aDestStride,
+                          const uint8_t* aTableR, const uint8_t* aTableG,
+                          const uint8_t* aTableB, bool aQuantize,
+                          CompositeLUTCache* aCompiled);
+
+/**
+ * LCD16 is Skia's packed form of a 3x1 ClearType mask: one RGB565 word per
+ * pixel, red in the top 5 bits, green in the middle 6 and blue in the low 5.
+ * It is half the size of the 3x1 mask it comes from and still holds
+ * everything the quantized (>> 3 << 3) conversions look at, so quantized
+ * glyphs can be cached in it and converted later with the same output.
+ */
+static inline uint16_t
+PackLCD16(uint8_t r, uint8_t g, uint8_t b) {
+  return (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+/**
+ * Packs aCount RGB 3x1 pixels into LCD16, running them through the PreBlend
+ * tables first.
+ *
+ * @param aTableR/G/B PreBlend tables, or all nullptr to pack the raw coverage.
+ */
+typedef void (*PackLCD16Proc)(const uint8_t* aRGB, uint16_t* aLCD16, int aCount,
+                              const uint8_t* aTableR, const uint8_t* aTableG,
+                              const uint8_t* aTableB);
+
+void PackLCD16_Scalar(const uint8_t* aRGB, uint16_t* aLCD16, int aCount,
+                      const uint8_t* aTableR, const uint8_t* aTableG,
+                      const uint8_t* aTableB);
+
+/**
+ * Converts aCount LCD16 pixels into opaque BGRA, drawing black text on white.
+ * Gives the same pixels as ConvertClearType with aQuantize set on the 3x1
+ * mask the words were packed from.
+ */
+typedef void (*ConvertLCD16Proc)(const uint16_t* aLCD16, uint8_t* aBGRA, int aCount);
+
+void ConvertLCD16_Scalar(const uint16_t* aLCD16, uint8_t* aBGRA, int aCount);
+
+#if defined(DW_CPU_X86)
+// 16 pixels per iteration.
+void PackLCD16_SSSE3(const uint8_t* aRGB, uint16_t* aLCD16, int aCount,
+                     const uint8_t* aTableR, const uint8_t* aTableG,
+                     const uint8_t* aTableB);
+void ConvertLCD16_SSSE3(const uint16_t* aLCD16, uint8_t* aBGRA, int aCount);
+#endif
+
+// Fastest kernels the running CPU supports. Picked once from cpuid.
+PackLCD16Proc GetPackLCD16Proc();
+ConvertLCD16Proc GetConvertLCD16Proc();
+
+/**
+ * Expands aCount LCD16 pixels back to a 3x1 mask, each channel in the top
+ * bits of its byte (green keeps all 6). Blending the result with quantizing
+ * on, or in MASK_BLEND_SKIA_LCD16, matches blending the original mask.
+ */
+void UnpackLCD16(const uint16_t* aLCD16, uint8_t* aRGB, int aCount);
+
+// ConvertLCD16 over a aWidth x aHeight rect. Strides are in bytes.
+void ConvertLCD16Rect(const uint16_t* aLCD16, int aSrcStride, int aWidth, int aHeight,
+                      uint8_t* aDest, int aDestStride);
+
+/**
+ * Skia's ClearType to grayscale conversion, as D2DSetup::BlendSkiaGrayscale
+ * draws it: the red coverage goes through the G PreBlend table and the float
+ * Blend mixes aForeground and aBackground (both 0xAARRGGBB) per channel.
+ */
+void BlendGrayscaleRect(const uint8_t* aRGB, int aSrcStride, int aWidth, int aHeight,
+                        uint8_t* aDest, int aDestStride, const uint8_t* aTableG,
+                        uint32_t aForeground, uint32_t aBackground);
+
+/**
+ * Gamma corrects aCount pixels of an A8 coverage mask through a PreBlend
+ * table, normally the G table picked for the text color. This is all the
+ * CPU does for grayscale text: the mask stays one byte per pixel and is
+ * blended in the text color when it is drawn. aOut may equal aA8.
+ */
+void ApplyTableA8(const uint8_t* aA8, uint8_t* aOut, int aCount, const uint8_t* aTable);
+
+// Copies BGRX pixels to BGRA with the alpha set to 0xFF.
+void BlitOpaqueRect(const uint8_t* aBGRX, int aSrcStride, int aWidth, int aHeight,
+                    uint8_t* aDest, int aDestStride);
+
+/**
+ * Small cache of compiled tables, keyed by the PreBlend table pointers, the
+ * quantize flag and both colors. Drawing code asks for the same handful of
+ * combinations over and over, so this is a short list searched linearly with
+ * the least recently used entry replaced when full. Not thread safe.
+ */
+class CompositeLUTCache {
+public:
+  CompositeLUTCache();
+
+  const CompositeLUT& Get(const uint8_t* aTableR, const uint8_t* aTableG, const uint8_t* aTableB,
+                          bool aQuantize, uint32_t aForeground, uint32_t aBackground);
+
+  uint32_t Hits() const { return mHits; }
+  uint32_t Misses() const { return mMisses; }
+
+private:
+  static const int kMaxEntries = 16;
+
+  struct Entry {
+    const uint8_t* fTableR;
+    const uint8_t* fTableG;
+    const uint8_t* fTableB;
+    bool fQuantize;
+    uint32_t fForeground;
+    uint32_t fBackground;
+    uint32_t fLastUse;
+    CompositeLUT fLUT;
+  };
+
+  Entry mEntries[kMaxEntries];
+  int mCount;
+  uint32_t mClock;
+  uint32_t mHits;
+  uint32_t mMisses;
+};
+
+enum MaskBlendMode {
+  // Integer src-over of every channel with its own coverage, rounded to
+  // nearest.
+  MASK_BLEND_SRC_OVER,
+  // Bit exact with Skia's LCD16 blit: coverage is cut to 5 bits, widened to
+  // 0..32 with SkUpscale31To32 and blended with SkBlend32. The output is
+  // opaque like Skia's, which only blits LCD text onto opaque surfaces.
+  MASK_BLEND_SKIA_LCD16,
+};
+
+// How to blend a 3x1 ClearType mask in a given text color.
+struct MaskBlendParams {
+  uint32_t fForeground;      // Text color as 0xAARRGGBB, alpha is the text opacity
+  const uint8_t* fTableR;    // PreBlend tables picked for fForeground, or all nullptr
+  const uint8_t* fTableG;
+  const uint8_t* fTableB;
+  bool fQuantize;            // Skia's >> 3 << 3 before blending, MASK_BLEND_SRC_OVER only
+  MaskBlendMode fMode;
+};
+
+/**
+ * Blends aCount pixels of a RGB 3x1 ClearType mask in the text color onto a
+ * BGRA background.
+ *
+ * @param aDest Background pixels read in place of aBackground, or nullptr
+ *              for the solid aBackground. May equal aBGRA.
+ * @param aBackground Solid background as 0xAARRGGBB when aDest is nullptr.
+ */
+typedef void (*BlendClearTypeProc)(const uint8_t* aRGB, const uint8_t* aDest, uint8_t* aBGRA,
+                                   int aCount, const MaskBlendParams& aParams,
+                                   uint32_t aBackground);
+
+void BlendClearType_Scalar(const uint8_t* aRGB, const uint8_t* aDest, uint8_t* aBGRA,
+                           int aCount, const MaskBlendParams& aParams, uint32_t aBackground);
+
+#if defined(DW_CPU_X86)
+// 16 pixels per iteration, same output as the scalar version.
+void BlendClearType_SSSE3(const uint8_t* aRGB, const uint8_t* aDest, uint8_t* aBGRA,
+                          int aCount, const MaskBlendParams& aParams, uint32_t aBackground);
+// 16 pixels per iteration, needs 2 more after the last block for the 3x1 loads.
+void BlendClearType_AVX2(const uint8_t* aRGB, const uint8_t* aDest, uint8_t* aBGRA,
+                         int aCount, const MaskBlendParams& aParams, uint32_t aBackground);
+#endif
+
+// Returns the fastest blend the running CPU supports. Picked once from cpuid.
+BlendClearTypeProc GetBlendClearTypeProc();
+
+// Blends onto a solid color.
+static inline void
+BlendClearTypeOnColor(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                      const MaskBlendParams& aParams, uint32_t aBackground)
+{
+  GetBlendClearTypeProc()(aRGB, nullptr, aBGRA, aCount, aParams, aBackground);
+}
+
+// Blends onto the pixels already in aBGRA.
+static inline void
+BlendClearTypeOnto(const uint8_t* aRGB, uint8_t* aBGRA, int aCount,
+                   const MaskBlendParams& aParams)
+{
+  GetBlendClearTypeProc()(aRGB, aBGRA, aBGRA, aCount, aParams, 0);
+}
+
+/**
+ * Blends aCount pixels of an A8 coverage mask in aParams.fForeground onto the
+ * BGRA pixels in aBGRA, with the same src-over math BlendClearType uses for
+ * each channel. Only fTableG of the PreBlend tables is used, fQuantize and
+ * fMode are ignored.
+ */
+typedef void (*BlendA8Proc)(const uint8_t* aA8, uint8_t* aBGRA, int aCount,
+                            const MaskBlendParams& aParams);
+
+void BlendA8_Scalar(const uint8_t* aA8, uint8_t* aBGRA, int aCount, const MaskBlendParams& aParams);
+
+#if defined(DW_CPU_X86)
+// 16 pixels per iteration, same output as the scalar version.
+void BlendA8_SSSE3(const uint8_t* aA8, uint8_t* aBGRA, int aCount, const MaskBlendParams& aParams);
+void BlendA8_AVX2(const uint8_t* aA8, uint8_t* aBGRA, int aCount, const MaskBlendParams& aParams);
+#endif
+
+BlendA8Proc GetBlendA8Proc();
+
+static inline void
+BlendA8Onto(const uint8_t* aA8, uint8_t* aBGRA, int aCount, const MaskBlendParams& aParams)
+{
+  GetBlendA8Proc()(aA8, aBGRA, aCount, aParams);
+}
+
+/**
+ * BlendClearType for an LCD16 mask, as PackLCD16 stores it in the glyph
+ * atlas. The words already went through the PreBlend tables when they were
+ * packed, so aParams' tables are not applied again. With fQuantize on, or in
+ * MASK_BLEND_SKIA_LCD16, the result matches blending the 3x1 mask the words
+ * were packed from (see UnpackLCD16).
+ */
+typedef void (*BlendLCD16Proc)(const uint16_t* aLCD16, const uint8_t* aDest, uint8_t* aBGRA,
+                               int aCount, const MaskBlendParams& aParams,
+                               uint32_t aBackground);
+
+void BlendLCD16_Scalar(const uint16_t* aLCD16, const uint8_t* aDest, uint8_t* aBGRA,
+                       int aCount, const MaskBlendParams& aParams, uint32_t aBackground);
+
+#if defined(DW_CPU_X86)
+// 8 and 16 pixels per iteration, same output as the scalar version.
+void BlendLCD16_SSSE3(const uint16_t* aLCD16, const uint8_t* aDest, uint8_t* aBGRA,
+                      int aCount, const MaskBlendParams& aParams, uint32_t aBackground);
+void BlendLCD16_AVX2(const uint16_t* aLCD16, const uint8_t* aDest, uint8_t* aBGRA,
+                     int aCount, const MaskBlendParams& aParams, uint32_t aBackground);
+#endif
+
+BlendLCD16Proc GetBlendLCD16Proc();
+
+/**
+ * Turns aCount premultiplied BGRA pixels into A8 by their luminance, what
+ * D2D's LuminanceToAlpha effect feeds an opacity mask, with Skia's BT.709
+ * SK_LUM_COEFF_* weights. The channels are weighed as they are stored, so
+ * the result is already scaled by each pixel's alpha and transparent pixels
+ * mask everything out. aA8 may not overlap aBGRA.
+ */
+typedef void (*LuminanceToAlphaProc)(const uint8_t* aBGRA, uint8_t* aA8, int aCount);
+
+void LuminanceToAlpha_Scalar(const uint8_t* aBGRA, uint8_t* aA8, int aCount);
+
+#if defined(DW_CPU_X86)
+// 16 pixels per iteration, same output as the scalar version.
+void LuminanceToAlpha_SSSE3(const uint8_t* aBGRA, uint8_t* aA8, int aCount);
+void LuminanceToAlpha_AVX2(const uint8_t* aBGRA, uint8_t* aA8, int aCount);
+#endif
+
+LuminanceToAlphaProc GetLuminanceToAlphaProc();
+
+/**
+ * Composites aCount pixels of a premultiplied BGRA layer onto aBGRA through
+ * an A8 opacity mask: the layer pixel scaled by its mask byte, then source
+ * over. This is how a layer with an opacity brush is popped.
+ */
+typedef void (*BlendLayerProc)(const uint8_t* aLayer, const uint8_t* aMask, uint8_t* aBGRA,
+                               int aCount);
+
+void BlendLayer_Scalar(const uint8_t* aLayer, const uint8_t* aMask, uint8_t* aBGRA, int aCount);
+
+#if defined(DW_CPU_X86)
+// 16 pixels per iteration, same output as the scalar version.
+void BlendLayer_SSSE3(const uint8_t* aLayer, const uint8_t* aMask, uint8_t* aBGRA, int aCount);
+void BlendLayer_AVX2(const uint8_t* aLayer, const uint8_t* aMask, uint8_t* aBGRA, int aCount);
+#endif
+
+BlendLayerProc GetBlendLayerProc();
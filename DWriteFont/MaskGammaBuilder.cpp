@@ -0,0 +1,391 @@
+#include "MaskGammaBuilder.h"
+#include <math.h>
+#include <string.h>
+#include "SkMaskGamma.h"
+
+#if defined(DW_CPU_X86)
+#include <immintrin.h>
+#endif
+
+// Polynomials from Cephes logf and exp2f, accurate to a couple of ulps over
+// the reduced ranges used below.
+static const float kSqrt2 = 1.41421356237f;
+static const float kLog2E = 1.44269504089f;
+
+// Same as sk_t_scale255<aBits>, which is only available as a template.
+static inline unsigned
+ScaleLumTo255(unsigned aBase, int aBits)
+{
+  aBase <<= (8 - aBits);
+  unsigned lum = aBase;
+  for (int i = aBits; i < 8; i += aBits) {
+    lum |= aBase >> i;
+  }
+  return lum;
+}
+
+static inline float
+ApplyContrast(float aSrca, float aContrast)
+{
+  return aSrca + ((1.0f - aSrca) * aContrast * aSrca);
+}
+
+static inline float
+AsFloat(uint32_t aBits)
+{
+  float value;
+  memcpy(&value, &aBits, sizeof(value));
+  return value;
+}
+
+static inline uint32_t
+AsBits(float aValue)
+{
+  uint32_t bits;
+  memcpy(&bits, &aValue, sizeof(bits));
+  return bits;
+}
+
+// x^y for y > 0, computed as exp2(y * log2(x)). Zero and negative x give 0.
+static inline float
+FastPow(float aX, float aY)
+{
+  if (!(aX > 0.0f)) {
+    return 0.0f;
+  }
+
+  // log2(x) = e + log2(m) with m in [sqrt(2)/2, sqrt(2)).
+  uint32_t bits = AsBits(aX);
+  float e = (float)((int)(bits >> 23) - 127);
+  float m = AsFloat((bits & 0x007FFFFF) | 0x3F800000);
+  if (m > kSqrt2) {
+    m = m * 0.5f;
+    e = e + 1.0f;
+  }
+  float t = m - 1.0f;
+  float z = t * t;
+  float p = 7.0376836292E-2f;
+  p = p * t - 1.1514610310E-1f;
+  p = p * t + 1.1676998740E-1f;
+  p = p * t - 1.2420140846E-1f;
+  p = p * t + 1.4249322787E-1f;
+  p = p * t - 1.6668057665E-1f;
+  p = p * t + 2.0000714765E-1f;
+  p = p * t - 2.4999993993E-1f;
+  p = p * t + 3.3333331174E-1f;
+  float lnM = t + (p * t * z - 0.5f * z);
+  float log2X = e + lnM * kLog2E;
+
+  // exp2(v) = 2^n * 2^f with f in [-0.5, 0.5).
+  float v = aY * log2X;
+  v = v < -126.0f ? -126.0f : (v > 126.0f ? 126.0f : v);
+  float n = floorf(v + 0.5f);
+  float f = v - n;
+  float q = 1.535336188319500E-4f;
+  q = q * f + 1.339887440266574E-3f;
+  q = q * f + 9.618437357674640E-3f;
+  q = q * f + 5.550332471162809E-2f;
+  q = q * f + 2.402264791363012E-1f;
+  q = q * f + 6.931472028550421E-1f;
+  q = q * f + 1.0f;
+  return q * AsFloat((uint32_t)((int)n + 127) << 23);
+}
+
+// Everything in SkTMaskGamma_build_correcting_lut that does not depend on the
+// table entry.
+struct TableSetup {
+  float fSrc;
+  float fDst;
+  float fLinSrc;
+  float fLinDst;
+  float fAdjustedContrast;
+  float fInvDeviceGamma;
+};
+
+// Returns false for the tables SkTMaskGamma_build_correcting_lut fills
+// without any pow, which are then written to aTable right away.
+static bool
+SetupTable(uint8_t aTable[256], unsigned aLum, float aContrast,
+           float aPaintGamma, float aDeviceGamma, TableSetup* aOut)
+{
+  // Only a couple of powf calls per table, keep these exact.
+  aOut->fSrc = (float)aLum / 255.0f;
+  aOut->fLinSrc = powf(aOut->fSrc, aPaintGamma);
+  aOut->fDst = 1.0f - aOut->fSrc;
+  aOut->fLinDst = powf(aOut->fDst, aDeviceGamma);
+  aOut->fAdjustedContrast = aContrast * aOut->fLinDst;
+  aOut->fInvDeviceGamma = 1.0f / aDeviceGamma;
+
+  if (fabsf(aOut->fSrc - aOut->fDst) < (1.0f / 256.0f)) {
+    float ii = 0.0f;
+    for (int i = 0; i < 256; ++i, ii += 1.0f) {
+      float srca = ApplyContrast(ii / 255.0f, aOut->fAdjustedContrast);
+      aTable[i] = (uint8_t)(int)floorf(255.0f * srca + 0.5f);
+    }
+    return false;
+  }
+  return true;
+}
+
+// i / 255.0f for every entry, the same for all tables.
+static void
+GetRawSrca(float aOut[256])
+{
+  float ii = 0.0f;
+  for (int i = 0; i < 256; ++i, ii += 1.0f) {
+    aOut[i] = ii / 255.0f;
+  }
+}
+
+void
+BuildMaskGammaTablesFast_Scalar(uint8_t (*aTables)[256], int aLumBits,
+                                float aContrast, float aPaintGamma, float aDeviceGamma)
+{
+  float rawSrca[256];
+  GetRawSrca(rawSrca);
+
+  for (int table = 0; table < (1 << aLumBits); table++) {
+    TableSetup setup;
+    if (!SetupTable(aTables[table], ScaleLumTo255(table, aLumBits), aContrast,
+                    aPaintGamma, aDeviceGamma, &setup)) {
+      continue;
+    }
+
+    for (int i = 0; i < 256; ++i) {
+      float srca = ApplyContrast(rawSrca[i], setup.fAdjustedContrast);
+      float dsta = 1.0f - srca;
+      float linOut = (setup.fLinSrc * srca + dsta * setup.fLinDst);
+      float out = FastPow(linOut, setup.fInvDeviceGamma);
+      float result = (out - setup.fDst) / (setup.fSrc - setup.fDst);
+      // Wraps like SkToU8 in the exact builder.
+      aTables[table][i] = (uint8_t)(int)floorf(255.0f * result + 0.5f);
+    }
+  }
+}
+
+#if defined(DW_CPU_X86)
+static inline __m128
+Floor_SSE2(__m128 aValue)
+{
+  // Truncate, then step down where that rounded up (negative values).
+  __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(aValue));
+  __m128 roundedUp = _mm_and_ps(_mm_cmpgt_ps(truncated, aValue), _mm_set1_ps(1.0f));
+  return _mm_sub_ps(truncated, roundedUp);
+}
+
+// Four lane FastPow, operation for operation the same as the scalar version.
+static inline __m128
+FastPow_SSE2(__m128 aX, __m128 aY)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  __m128 positive = _mm_cmpgt_ps(aX, _mm_setzero_ps());
+
+  __m128i bits = _mm_castps_si128(aX);
+  __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+  __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)),
+                                           _mm_set1_epi32(0x3F800000)));
+  __m128 large = _mm_cmpgt_ps(m, _mm_set1_ps(kSqrt2));
+  m = _mm_or_ps(_mm_and_ps(large, _mm_mul_ps(m, _mm_set1_ps(0.5f))), _mm_andnot_ps(large, m));
+  e = _mm_add_ps(e, _mm_and_ps(large, one));
+
+  __m128 t = _mm_sub_ps(m, one);
+  __m128 z = _mm_mul_ps(t, t);
+  __m128 p = _mm_set1_ps(7.0376836292E-2f);
+  p = _mm_sub_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.1514610310E-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.1676998740E-1f));
+  p = _mm_sub_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.2420140846E-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.4249322787E-1f));
+  p = _mm_sub_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.6668057665E-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(2.0000714765E-1f));
+  p = _mm_sub_ps(_mm_mul_ps(p, t), _mm_set1_ps(2.4999993993E-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(3.3333331174E-1f));
+  __m128 lnM = _mm_add_ps(t, _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(p, t), z),
+                                        _mm_mul_ps(_mm_set1_ps(0.5f), z)));
+  __m128 log2X = _mm_add_ps(e, _mm_mul_ps(lnM, _mm_set1_ps(kLog2E)));
+
+  __m128 v = _mm_mul_ps(aY, log2X);
+  v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-126.0f)), _mm_set1_ps(126.0f));
+  __m128 n = Floor_SSE2(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+  __m128 f = _mm_sub_ps(v, n);
+  __m128 q = _mm_set1_ps(1.535336188319500E-4f);
+  q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(1.339887440266574E-3f));
+  q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(9.618437357674640E-3f));
+  q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(5.550332471162809E-2f));
+  q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(2.402264791363012E-1f));
+  q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(6.931472028550421E-1f));
+  q = _mm_add_ps(_mm_mul_ps(q, f), one);
+  __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n),
+                                                               _mm_set1_epi32(127)), 23));
+  return _mm_and_ps(positive, _mm_mul_ps(q, scale));
+}
+
+void
+BuildMaskGammaTablesFast_SSE2(uint8_t (*aTables)[256], int aLumBits,
+                              float aContrast, float aPaintGamma, float aDeviceGamma)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 v255 = _mm_set1_ps(255.0f);
+  float rawSrca[256];
+  GetRawSrca(rawSrca);
+
+  for (int table = 0; table < (1 << aLumBits); table++) {
+    TableSetup setup;
+    if (!SetupTable(aTables[table], ScaleLumTo255(table, aLumBits), aContrast,
+                    aPaintGamma, aDeviceGamma, &setup)) {
+      continue;
+    }
+
+    const __m128 contrast = _mm_set1_ps(setup.fAdjustedContrast);
+    const __m128 linSrc = _mm_set1_ps(setup.fLinSrc);
+    const __m128 linDst = _mm_set1_ps(setup.fLinDst);
+    const __m128 invGamma = _mm_set1_ps(setup.fInvDeviceGamma);
+    const __m128 dst = _mm_set1_ps(setup.fDst);
+    const __m128 srcMinusDst = _mm_set1_ps(setup.fSrc - setup.fDst);
+
+    // 16 entries per iteration so the bytes can be stored in one go.
+    for (int i = 0; i < 256; i += 16) {
+      __m128i quads[4];
+      for (int k = 0; k < 4; k++) {
+        __m128 srca = _mm_loadu_ps(&rawSrca[i + 4 * k]);
+        srca = _mm_add_ps(srca, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(one, srca), contrast), srca));
+        __m128 dsta = _mm_sub_ps(one, srca);
+        __m128 linOut = _mm_add_ps(_mm_mul_ps(linSrc, srca), _mm_mul_ps(dsta, linDst));
+        __m128 out = FastPow_SSE2(linOut, invGamma);
+        __m128 result = _mm_div_ps(_mm_sub_ps(out, dst), srcMinusDst);
+        __m128 rounded = Floor_SSE2(_mm_add_ps(_mm_mul_ps(v255, result), _mm_set1_ps(0.5f)));
+        // Keep the low byte of the int, SkToU8 wraps rather than clamps.
+        quads[k] = _mm_and_si128(_mm_cvttps_epi32(rounded), _mm_set1_epi32(0xFF));
+      }
+      __m128i words = _mm_packs_epi32(quads[0], quads[1]);
+      __m128i words2 = _mm_packs_epi32(quads[2], quads[3]);
+      _mm_storeu_si128((__m128i*)&aTables[table][i], _mm_packus_epi16(words, words2));
+    }
+  }
+}
+
+// Eight lane FastPow, the same operations again. No FMA, it would round
+// differently from the other versions.
+DW_TARGET_AVX2 static inline __m256
+FastPow_AVX2(__m256 aX, __m256 aY)
+{
+  const __m256 one = _mm256_set1_ps(1.0f);
+  __m256 positive = _mm256_cmp_ps(aX, _mm256_setzero_ps(), _CMP_GT_OQ);
+
+  __m256i bits = _mm256_castps_si256(aX);
+  __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+                                                 _mm256_set1_epi32(127)));
+  __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+                                                 _mm256_set1_epi32(0x3F800000)));
+  __m256 large = _mm256_cmp_ps(m, _mm256_set1_ps(kSqrt2), _CMP_GT_OQ);
+  m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), large);
+  e = _mm256_add_ps(e, _mm256_and_ps(large, one));
+
+  __m256 t = _mm256_sub_ps(m, one);
+  __m256 z = _mm256_mul_ps(t, t);
+  __m256 p = _mm256_set1_ps(7.0376836292E-2f);
+  p = _mm256_sub_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(1.1514610310E-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(1.1676998740E-1f));
+  p = _mm256_sub_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(1.2420140846E-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(1.4249322787E-1f));
+  p = _mm256_sub_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(1.6668057665E-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(2.0000714765E-1f));
+  p = _mm256_sub_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(2.4999993993E-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(3.3333331174E-1f));
+  __m256 lnM = _mm256_add_ps(t, _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(p, t), z),
+                                              _mm256_mul_ps(_mm256_set1_ps(0.5f), z)));
+  __m256 log2X = _mm256_add_ps(e, _mm256_mul_ps(lnM, _mm256_set1_ps(kLog2E)));
+
+  __m256 v = _mm256_mul_ps(aY, log2X);
+  v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(126.0f));
+  __m256 n = _mm256_floor_ps(_mm256_add_ps(v, _mm256_set1_ps(0.5f)));
+  __m256 f = _mm256_sub_ps(v, n);
+  __m256 q = _mm256_set1_ps(1.535336188319500E-4f);
+  q = _mm256_add_ps(_mm256_mul_ps(q, f), _mm256_set1_ps(1.339887440266574E-3f));
+  q = _mm256_add_ps(_mm256_mul_ps(q, f), _mm256_set1_ps(9.618437357674640E-3f));
+  q = _mm256_add_ps(_mm256_mul_ps(q, f), _mm256_set1_ps(5.550332471162809E-2f));
+  q = _mm256_add_ps(_mm256_mul_ps(q, f), _mm256_set1_ps(2.402264791363012E-1f));
+  q = _mm256_add_ps(_mm256_mul_ps(q, f), _mm256_set1_ps(6.931472028550421E-1f));
+  q = _mm256_add_ps(_mm256_mul_ps(q, f), one);
+  __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n),
+                                                                        _mm256_set1_epi32(127)), 23));
+  return _mm256_and_ps(positive, _mm256_mul_ps(q, scale));
+}
+
+DW_TARGET_AVX2 void
+BuildMaskGammaTablesFast_AVX2(uint8_t (*aTables)[256], int aLumBits,
+                              float aContrast, float aPaintGamma, float aDeviceGamma)
+{
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 v255 = _mm256_set1_ps(255.0f);
+  float rawSrca[256];
+  GetRawSrca(rawSrca);
+
+  for (int table = 0; table < (1 << aLumBits); table++) {
+    TableSetup setup;
+    if (!SetupTable(aTables[table], ScaleLumTo255(table, aLumBits), aContrast,
+                    aPaintGamma, aDeviceGamma, &setup)) {
+      continue;
+    }
+
+    const __m256 contrast = _mm256_set1_ps(setup.fAdjustedContrast);
+    const __m256 linSrc = _mm256_set1_ps(setup.fLinSrc);
+    const __m256 linDst = _mm256_set1_ps(setup.fLinDst);
+    const __m256 invGamma = _mm256_set1_ps(setup.fInvDeviceGamma);
+    const __m256 dst = _mm256_set1_ps(setup.fDst);
+    const __m256 srcMinusDst = _mm256_set1_ps(setup.fSrc - setup.fDst);
+
+    for (int i = 0; i < 256; i += 16) {
+      __m128i halves[4];
+      for (int k = 0; k < 2; k++) {
+        __m256 srca = _mm256_loadu_ps(&rawSrca[i + 8 * k]);
+        srca = _mm256_add_ps(srca, _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(one, srca), contrast),
+                                                 srca));
+        __m256 dsta = _mm256_sub_ps(one, srca);
+        __m256 linOut = _mm256_add_ps(_mm256_mul_ps(linSrc, srca), _mm256_mul_ps(dsta, linDst));
+        __m256 out = FastPow_AVX2(linOut, invGamma);
+        __m256 result = _mm256_div_ps(_mm256_sub_ps(out, dst), srcMinusDst);
+        __m256 rounded = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(v255, result),
+                                                       _mm256_set1_ps(0.5f)));
+        __m256i ints = _mm256_and_si256(_mm256_cvttps_epi32(rounded), _mm256_set1_epi32(0xFF));
+        halves[2 * k] = _mm256_castsi256_si128(ints);
+        halves[2 * k + 1] = _mm256_extracti128_si256(ints, 1);
+      }
+      // The 256 bit packs work within 128 bit lanes, pack the halves instead.
+      __m128i words = _mm_packs_epi32(halves[0], halves[1]);
+      __m128i words2 = _mm_packs_epi32(halves[2], halves[3]);
+      _mm_storeu_si128((__m128i*)&aTables[table][i], _mm_packus_epi16(words, words2));
+    }
+  }
+}
+#endif
+
+// What the SkTMaskGamma constructor does, into aTables.
+static void
+BuildMaskGammaTablesExact(uint8_t (*aTables)[256], int aLumBits,
+                          float aContrast, float aPaintGamma, float aDeviceGamma)
+{
+  const SkColorSpaceLuminance& paintConvert = SkColorSpaceLuminance::Fetch(aPaintGamma);
+  const SkColorSpaceLuminance& deviceConvert = SkColorSpaceLuminance::Fetch(aDeviceGamma);
+  for (int table = 0; table < (1 << aLumBits); table++) {
+    SkTMaskGamma_build_correcting_lut(aTables[table], ScaleLumTo255(table, aLumBits), aContrast,
+                                      paintConvert, aPaintGamma, deviceConvert, aDeviceGamma);
+  }
+}
+
+void
+BuildMaskGammaTablesFast(uint8_t (*aTables)[256], int aLumBits,
+                         float aContrast, float aPaintGamma, float aDeviceGamma)
+{
+#if defined(DW_CPU_X86)
+  if (HasCpuFeature(CPU_FEATURE_AVX2)) {
+    BuildMaskGammaTablesFast_AVX2(aTables, aLumBits, aContrast, aPaintGamma, aDeviceGamma);
+    return;
+  }
+  if (HasCpuFeature(CPU_FEATURE_SSE2)) {
+    BuildMaskGammaTablesFast_SSE2(aTables, aLumBits, aContrast, aPaintGamma, aDeviceGamma);
+    return;
+  }
+#endif
+  // One FastPow at a time is slower than powf, and not exact.
+  BuildMaskGammaTablesExact(aTables, aLumBits, aContrast, aPaintGamma, aDeviceGamma);
+}
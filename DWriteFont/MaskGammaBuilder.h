@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include "CpuFeatures.h"
+
+/**
+ * Batch builder for mask gamma table sets, for tools that build many of them
+ * such as gamma and contrast calibration. Produces the same tables as the
+ * SkTMaskGamma constructor, but replaces the per entry powf with exp2/log2
+ * approximations evaluated 4 or 8 entries at a time, and skips the virtual
+ * SkColorSpaceLuminance calls (Fetch only ever returns the pure gamma space).
+ *
+ * Every entry is within 1 of SkTMaskGamma's tables for contrast in [0, 1] and
+ * gammas in [1, 3], almost all are identical. Like the exact builder, entries
+ * wrap around when the rounded value leaves [0, 255]. Near those edges,
+ * "within 1" can show up as 0 against 255. Bench/MaskGammaBench.cpp sweeps
+ * that range and checks the bound. Use the exact builder where identical
+ * output matters, e.g. SkMaskGammaPresets.h. Without SSE2 or AVX2 there is
+ * nothing to gain from the approximations, and the exact tables are built.
+ *
+ * @param aTables Receives 1 << aLumBits tables of 256 entries, laid out like
+ *                SkTMaskGamma::fGammaTables so they can be wrapped by it.
+ * @param aLumBits SkTMaskGamma::MAX_LUM_BITS of the gamma type, in [1, 8].
+ */
+void BuildMaskGammaTablesFast(uint8_t (*aTables)[256], int aLumBits,
+                              float aContrast, float aPaintGamma, float aDeviceGamma);
+
+// The approximated versions. They run the same float operations in the same
+// order, so their output is identical. BuildMaskGammaTablesFast picks one of
+// the SIMD versions, the scalar one is their reference.
+void BuildMaskGammaTablesFast_Scalar(uint8_t (*aTables)[256], int aLumBits,
+                                     float aContrast, float aPaintGamma, float aDeviceGamma);
+
+#if defined(DW_CPU_X86)
+void BuildMaskGammaTablesFast_SSE2(uint8_t (*aTables)[256], int aLumBits,
+                                   float aContrast, float aPaintGamma, float aDeviceGamma);
+
+void BuildMaskGammaTablesFast_AVX2(uint8_t (*aTables)[256], int aLumBits,
+                                   float aContrast, float aPaintGamma, float aDeviceGamma);
+#endif
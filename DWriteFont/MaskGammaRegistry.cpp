@@ -0,0 +1,108 @@
+#include "MaskGammaRegistry.h"
+#include <string.h>
+#include <mutex>
+#include <vector>
+#include "SkMaskGammaPresets.h"
+
+namespace {
+
+struct RegistryEntry {
+  float fContrast;
+  float fPaintGamma;
+  float fDeviceGamma;
+  SkMaskGammaRef fGamma;
+};
+
+// A process only ever sees a handful of gamma settings, a list is plenty.
+struct Registry {
+  std::mutex fLock;
+  std::vector<RegistryEntry> fEntries;
+
+  SkMaskGammaRef Find(float aContrast, float aPaintGamma, float aDeviceGamma) const {
+    for (size_t i = 0; i < fEntries.size(); i++) {
+      const RegistryEntry& entry = fEntries[i];
+      if (entry.fContrast == aContrast &&
+          entry.fPaintGamma == aPaintGamma &&
+          entry.fDeviceGamma == aDeviceGamma) {
+        return entry.fGamma;
+      }
+    }
+    return nullptr;
+  }
+};
+
+Registry&
+GetRegistry()
+{
+  // Function local statics are initialized thread safely.
+  static Registry registry;
+  return registry;
+}
+
+} // namespace
+
+/*static*/ SkMaskGammaRef
+MaskGammaRegistry::Get(float aContrast, float aPaintGamma, float aDeviceGamma)
+{
+  Registry& registry = GetRegistry();
+  {
+    std::lock_guard<std::mutex> lock(registry.fLock);
+    SkMaskGammaRef gamma = registry.Find(aContrast, aPaintGamma, aDeviceGamma);
+    if (gamma) {
+      return gamma;
+    }
+  }
+
+  // The shipped settings come precomputed, wrapping them costs nothing.
+  // Anything else takes a few thousand powf calls to build, don't hold the
+  // lock and block lookups of other gammas meanwhile.
+  SkMaskGammaRef built;
+  for (size_t i = 0; i < sizeof(kMaskGammaPresets) / sizeof(kMaskGammaPresets[0]); i++) {
+    const SkMaskGammaPreset& preset = kMaskGammaPresets[i];
+    if (preset.fContrast == aContrast &&
+        preset.fPaintGamma == aPaintGamma &&
+        preset.fDeviceGamma == aDeviceGamma) {
+      built = std::make_shared<const SkMaskGamma>(preset.fTables);
+      break;
+    }
+  }
+  if (!built) {
+    built = std::make_shared<const SkMaskGamma>(aContrast, aPaintGamma, aDeviceGamma);
+  }
+
+  std::lock_guard<std::mutex> lock(registry.fLock);
+  // Another thread may have built the same set while we were, keep theirs so
+  // every caller shares one copy.
+  SkMaskGammaRef gamma = registry.Find(aContrast, aPaintGamma, aDeviceGamma);
+  if (gamma) {
+    return gamma;
+  }
+
+  RegistryEntry entry = { aContrast, aPaintGamma, aDeviceGamma, built };
+  registry.fEntries.push_back(entry);
+  return built;
+}
+
+/*static*/ size_t
+MaskGammaRegistry::Count()
+{
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.fLock);
+  return registry.fEntries.size();
+}
+
+/*static*/ bool
+MaskGammaRegistry::VerifyPresets()
+{
+  for (size_t i = 0; i < sizeof(kMaskGammaPresets) / sizeof(kMaskGammaPresets[0]); i++) {
+    const SkMaskGammaPreset& preset = kMaskGammaPresets[i];
+    SkMaskGamma built(preset.fContrast, preset.fPaintGamma, preset.fDeviceGamma);
+
+    int tableWidth, numTables;
+    built.getGammaTableDimensions(&tableWidth, &numTables);
+    if (memcmp(built.getGammaTables(), preset.fTables, tableWidth * numTables)) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include "SkMaskGamma.h"
+
+//The following typedef hides from the rest of the implementation the number of
+//most significant bits to consider when creating mask gamma tables. Two bits
+//per channel was chosen as a balance between fidelity (more bits) and cache
+//sizes (fewer bits). Three bits per channel was chosen when #303942; (used by
+//the Chrome UI) turned out too green.
+typedef SkTMaskGamma<3, 3, 3> SkMaskGamma;
+
+typedef std::shared_ptr<const SkMaskGamma> SkMaskGammaRef;
+
+/**
+ * Process wide registry of SkMaskGamma table sets keyed by (contrast,
+ * paintGamma, deviceGamma). Each distinct set is built once and kept for the
+ * life of the process, so asking for a gamma seen before is a short locked
+ * search. Settings listed in SkMaskGammaPresets.h are never built, their
+ * precomputed tables are wrapped instead. Safe to call from any thread; the
+ * tables are never modified after they are built.
+ */
+class MaskGammaRegistry {
+public:
+  static SkMaskGammaRef Get(float aContrast, float aPaintGamma, float aDeviceGamma);
+
+  // Number of distinct table sets handed out so far, built or wrapped
+  // presets.
+  static size_t Count();
+
+  // Rebuilds every table set in SkMaskGammaPresets.h with the runtime builder
+  // and returns whether they are all byte identical. Slow, for the preset
+  // generator and debugging only.
+  static bool VerifyPresets();
+};
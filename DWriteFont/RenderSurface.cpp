@@ -0,0 +1,298 @@
+#include "RenderSurface.h"
+#include <assert.h>
+#include <string.h>
+#include "Trace.h"
+
+// Rounded x / 255 for x in [0, 255 * 255], same as the MaskConvert kernels.
+static inline unsigned
+Div255(unsigned aValue)
+{
+  aValue += 128;
+  return (aValue + (aValue >> 8)) >> 8;
+}
+
+static inline uint8_t
+SrcOverChannel(unsigned aSrc, unsigned aDst, unsigned aCoverage)
+{
+  return (uint8_t)Div255(aSrc * aCoverage + aDst * (255 - aCoverage));
+}
+
+CpuRenderSurface::CpuRenderSurface(int32_t aWidth, int32_t aHeight, SurfaceFormat aFormat)
+  : mWidth(aWidth)
+  , mHeight(aHeight)
+  , mFormat(aFormat)
+  , mStride(aWidth * SurfaceBytesPerPixel(aFormat))
+  , mPixels((size_t)aWidth * aHeight * SurfaceBytesPerPixel(aFormat))
+  , mClip(IntRect::Make(0, 0, aWidth, aHeight))
+  , mLayerDepth(0)
+{
+}
+
+void
+CpuRenderSurface::SetClip(const IntRect& aClip)
+{
+  mClip = aClip;
+  if (!mClip.Intersect(IntRect::Make(0, 0, mWidth, mHeight))) {
+    mClip = IntRect::Make(0, 0, 0, 0);
+  }
+}
+
+void
+CpuRenderSurface::ResetClip()
+{
+  mClip = IntRect::Make(0, 0, mWidth, mHeight);
+}
+
+uint8_t*
+CpuRenderSurface::Target(const IntRect& aRect)
+{
+  if (!mLayerDepth) {
+    return mPixels.data();
+  }
+
+  // Layers start out transparent. Clear what aRect adds to the drawn
+  // bounds, the drawn part is never cleared twice.
+  Layer& layer = mLayers[mLayerDepth - 1];
+  IntRect drawn = layer.fDrawn;
+  drawn.Union(aRect);
+  if (drawn.fLeft == layer.fDrawn.fLeft && drawn.fTop == layer.fDrawn.fTop &&
+      drawn.fRight == layer.fDrawn.fRight && drawn.fBottom == layer.fDrawn.fBottom) {
+    return layer.fPixels.data();
+  }
+  const int32_t bytesPerPixel = SurfaceBytesPerPixel(mFormat);
+  for (int32_t y = drawn.fTop; y < drawn.fBottom; y++) {
+    uint8_t* row = layer.fPixels.data() + y * mStride;
+    const IntRect& old = layer.fDrawn;
+    if (old.IsEmpty() || y < old.fTop || y >= old.fBottom) {
+      memset(row + drawn.fLeft * bytesPerPixel, 0, (size_t)drawn.Width() * bytesPerPixel);
+      continue;
+    }
+    memset(row + drawn.fLeft * bytesPerPixel, 0, (size_t)(old.fLeft - drawn.fLeft) * bytesPerPixel);
+    memset(row + old.fRight * bytesPerPixel, 0, (size_t)(drawn.fRight - old.fRight) * bytesPerPixel);
+  }
+  layer.fDrawn = drawn;
+  return layer.fPixels.data();
+}
+
+CpuRenderSurface::Layer&
+CpuRenderSurface::PushLayer()
+{
+  if (mLayerDepth == mLayers.size()) {
+    mLayers.emplace_back();
+  }
+  Layer& layer = mLayers[mLayerDepth++];
+  layer.fPixels.resize(mPixels.size());
+  layer.fDrawn = IntRect::Make(0, 0, 0, 0);
+  return layer;
+}
+
+void
+CpuRenderSurface::PushOpacityMaskLayer(const CoverageMask& aMask, int32_t aX, int32_t aY)
+{
+  assert(aMask.fFormat == COVERAGE_MASK_A8);
+  Layer& layer = PushLayer();
+  layer.fMask = aMask.fBits;
+  layer.fMaskStride = aMask.fStride;
+  layer.fMaskRect = IntRect::MakeXYWH(aX, aY, aMask.fWidth, aMask.fHeight);
+  layer.fLuminance = false;
+}
+
+void
+CpuRenderSurface::PushLuminanceLayer(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth,
+                                     int32_t aHeight, int32_t aX, int32_t aY)
+{
+  Layer& layer = PushLayer();
+  layer.fMask = aBGRA;
+  layer.fMaskStride = aStride;
+  layer.fMaskRect = IntRect::MakeXYWH(aX, aY, aWidth, aHeight);
+  layer.fLuminance = true;
+}
+
+void
+CpuRenderSurface::PopLayer()
+{
+  TRACE_ZONE("CpuRenderSurface::PopLayer");
+  assert(mLayerDepth > 0);
+  const Layer& layer = mLayers[--mLayerDepth];
+  IntRect rect = layer.fDrawn;
+  if (rect.IsEmpty() || !rect.Intersect(layer.fMaskRect)) {
+    return;
+  }
+
+  uint8_t* dest = Target(rect);
+  const int32_t bytesPerPixel = SurfaceBytesPerPixel(mFormat);
+  const int32_t maskBytesPerPixel = layer.fLuminance ? 4 : 1;
+  const int32_t width = rect.Width();
+  if (layer.fLuminance) {
+    mLuminanceRow.resize(width);
+  }
+  const BlendLayerProc blend = GetBlendLayerProc();
+  for (int32_t y = rect.fTop; y < rect.fBottom; y++) {
+    const uint8_t* mask = layer.fMask + (y - layer.fMaskRect.fTop) * layer.fMaskStride +
+                          (rect.fLeft - layer.fMaskRect.fLeft) * maskBytesPerPixel;
+    if (layer.fLuminance) {
+      GetLuminanceToAlphaProc()(mask, mLuminanceRow.data(), width);
+      mask = mLuminanceRow.data();
+    }
+
+    const size_t offset = y * mStride + rect.fLeft * bytesPerPixel;
+    const uint8_t* src = layer.fPixels.data() + offset;
+    uint8_t* dst = dest + offset;
+    if (mFormat == SURFACE_FORMAT_B8G8R8A8) {
+      blend(src, mask, dst, width);
+      continue;
+    }
+    for (int32_t x = 0; x < width; x++) {
+      const unsigned alpha = Div255(src[x] * mask[x]);
+      dst[x] = (uint8_t)(alpha + Div255(dst[x] * (255 - alpha)));
+    }
+  }
+}
+
+void
+CpuRenderSurface::Clear(uint32_t aColor)
+{
+  uint8_t* pixels = Target(mClip);
+  if (mFormat == SURFACE_FORMAT_B8G8R8A8) {
+    FillPixels(aColor, pixels, mStride, mClip);
+    return;
+  }
+
+  for (int32_t y = mClip.fTop; y < mClip.fBottom; y++) {
+    memset(pixels + y * mStride + mClip.fLeft, (int)(aColor >> 24), mClip.Width());
+  }
+}
+
+bool
+CpuRenderSurface::ClipToSurface(int32_t aX, int32_t aY, int32_t aWidth, int32_t aHeight,
+                                IntRect* aOutRect) const
+{
+  *aOutRect = IntRect::MakeXYWH(aX, aY, aWidth, aHeight);
+  return aOutRect->Intersect(mClip);
+}
+
+void
+CpuRenderSurface::DrawBitmap(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                             int32_t aX, int32_t aY)
+{
+  TRACE_ZONE("CpuRenderSurface::DrawBitmap");
+  IntRect rect;
+  if (!ClipToSurface(aX, aY, aWidth, aHeight, &rect)) {
+    return;
+  }
+  uint8_t* pixels = Target(rect);
+  if (mFormat == SURFACE_FORMAT_B8G8R8A8) {
+    CompositeBitmap(aBGRA, aStride, aWidth, aHeight, aX, aY, pixels, mStride, mClip);
+    return;
+  }
+
+  for (int32_t y = rect.fTop; y < rect.fBottom; y++) {
+    const uint8_t* src = aBGRA + (y - aY) * aStride + (rect.fLeft - aX) * 4;
+    uint8_t* dst = pixels + y * mStride + rect.fLeft;
+    for (int32_t x = 0; x < rect.Width(); x++) {
+      const unsigned srcA = src[4 * x + 3];
+      dst[x] = (uint8_t)(srcA + Div255(dst[x] * (255 - srcA)));
+    }
+  }
+}
+
+void
+CpuRenderSurface::CoverAlphaRow(const uint8_t* aMask, CoverageMaskFormat aFormat, uint8_t* aRow,
+                                int32_t aCount, const MaskBlendParams& aParams)
+{
+  // ClearType and LCD16 cover by their green coverage like the alpha byte
+  // BlendClearType writes. LCD16 words are past the PreBlend tables.
+  const unsigned srcA = aParams.fForeground >> 24;
+  const uint8_t quantize = aParams.fQuantize ? 0xF8 : 0xFF;
+  for (int32_t x = 0; x < aCount; x++) {
+    uint8_t coverage;
+    if (aFormat == COVERAGE_MASK_A8) {
+      coverage = aParams.fTableG ? aParams.fTableG[aMask[x]] : aMask[x];
+    } else if (aFormat == COVERAGE_MASK_CLEARTYPE_3x1) {
+      uint8_t green = aMask[3 * x + 1];
+      coverage = (aParams.fTableG ? aParams.fTableG[green] : green) & quantize;
+    } else {
+      uint16_t pixel;
+      memcpy(&pixel, aMask + 2 * x, 2);
+      coverage = (uint8_t)(((pixel >> 5) & 0x3F) << 2) & quantize;
+    }
+    aRow[x] = SrcOverChannel(0xFF, aRow[x], Div255(coverage * srcA));
+  }
+}
+
+void
+CpuRenderSurface::DrawMask(const CoverageMask& aMask, int32_t aX, int32_t aY,
+                           const MaskBlendParams& aParams)
+{
+  IntRect rect;
+  if (!ClipToSurface(aX, aY, aMask.fWidth, aMask.fHeight, &rect)) {
+    return;
+  }
+  uint8_t* pixels = Target(rect);
+  if (mFormat == SURFACE_FORMAT_B8G8R8A8) {
+    CompositeMask(aMask, aX, aY, aParams, pixels, mStride, mClip);
+    return;
+  }
+
+  const int32_t maskBytesPerPixel = CoverageMaskBytesPerPixel(aMask.fFormat);
+  for (int32_t y = rect.fTop; y < rect.fBottom; y++) {
+    CoverAlphaRow(aMask.fBits + (y - aY) * aMask.fStride + (rect.fLeft - aX) * maskBytesPerPixel,
+                  aMask.fFormat, pixels + y * mStride + rect.fLeft,
+                  rect.Width(), aParams);
+  }
+}
+
+void
+CpuRenderSurface::FillOpacityMask(const uint8_t* aA8, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                                  int32_t aX, int32_t aY, uint32_t aColor)
+{
+  TRACE_ZONE("CpuRenderSurface::FillOpacityMask");
+  CoverageMask mask = { aA8, aStride, aWidth, aHeight, COVERAGE_MASK_A8 };
+  MaskBlendParams params = { aColor, nullptr, nullptr, nullptr, false, MASK_BLEND_SRC_OVER };
+  DrawMask(mask, aX, aY, params);
+}
+
+void
+CpuRenderSurface::DrawGlyphRun(const std::vector<PlacedGlyph>& aGlyphs, int32_t aX, int32_t aY,
+                               const GlyphRunPaint& aPaint)
+{
+  TRACE_ZONE("CpuRenderSurface::DrawGlyphRun");
+  IntRect runBounds = GetGlyphRunBounds(aGlyphs);
+  IntRect rect;
+  if (runBounds.IsEmpty() ||
+      !ClipToSurface(aX + runBounds.fLeft, aY + runBounds.fTop,
+                     runBounds.Width(), runBounds.Height(), &rect)) {
+    return;
+  }
+
+  // Only the visible part of the run is composited.
+  const IntRect visible = IntRect::Make(rect.fLeft - aX, rect.fTop - aY,
+                                        rect.fRight - aX, rect.fBottom - aY);
+  const int32_t maskBytesPerPixel = GlyphMaskBytesPerPixel(aPaint.fMaskFormat);
+  const int32_t coverageStride = visible.Width() * maskBytesPerPixel;
+  mCoverage.resize((size_t)coverageStride * visible.Height());
+  CompositeGlyphRun(aGlyphs, visible, maskBytesPerPixel, mCoverage.data());
+
+  CoverageMask mask = { mCoverage.data(), coverageStride, rect.Width(), rect.Height(),
+                        aPaint.fMaskFormat == GLYPH_MASK_A8 ? COVERAGE_MASK_A8
+                                                            : COVERAGE_MASK_CLEARTYPE_3x1 };
+  DrawMask(mask, rect.fLeft, rect.fTop, aPaint.fBlend);
+}
+
+bool
+CpuRenderSurface::Readback(const IntRect& aRect, uint8_t* aOut, int32_t aStride)
+{
+  IntRect rect = aRect;
+  if (aRect.IsEmpty() || !rect.Intersect(IntRect::Make(0, 0, mWidth, mHeight)) ||
+      rect.Width() != aRect.Width() || rect.Height() != aRect.Height()) {
+    return false;
+  }
+
+  const int32_t bytesPerPixel = SurfaceBytesPerPixel(mFormat);
+  for (int32_t y = aRect.fTop; y < aRect.fBottom; y++) {
+    memcpy(aOut + (y - aRect.fTop) * aStride,
+           mPixels.data() + y * mStride + aRect.fLeft * bytesPerPixel,
+           (size_t)aRect.Width() * bytesPerPixel);
+  }
+  return true;
+}
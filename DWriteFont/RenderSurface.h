@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "GlyphCache.h"
+#include "GlyphRasterizer.h"
+#include "IntRect.h"
+#include "MaskCompositor.h"
+#include "MaskConvert.h"
+
+// Pixel layouts a surface can hold. BGRA is premultiplied like D2D bitmaps.
+enum SurfaceFormat {
+  SURFACE_FORMAT_B8G8R8A8 = 0,
+  SURFACE_FORMAT_A8 = 1,
+};
+
+static inline int32_t
+SurfaceBytesPerPixel(SurfaceFormat aFormat)
+{
+  return aFormat == SURFACE_FORMAT_B8G8R8A8 ? 4 : 1;
+}
+
+// How DrawGlyphRun colors the coverage of a run.
+struct GlyphRunPaint {
+  GlyphMaskFormat fMaskFormat;  // What the placed glyphs hold, A8 or ClearType 3x1
+  MaskBlendParams fBlend;       // Text color, PreBlend tables and blend mode
+  // What ClearType text is blended onto by backends that cannot read the
+  // target back, as 0xAARRGGBB. The glyph boxes come out opaque.
+  uint32_t fBackground;
+};
+
+/**
+ * The drawing D2DSetup's mask paths need from a target: clear it, draw the
+ * BGRA bitmaps ConvertToBGRA and friends produce, fill a color through an A8
+ * mask, draw a run of cached glyph masks and read pixels back.
+ *
+ * Coordinates are whole pixels with the origin at the top left of the
+ * surface. D2DRenderSurface draws through a D2D render target and its GPU,
+ * CpuRenderSurface draws into memory and runs anywhere, so the mask pipeline
+ * can be driven and checked without a window.
+ */
+class RenderSurface {
+public:
+  virtual ~RenderSurface() { }
+
+  virtual int32_t Width() const = 0;
+  virtual int32_t Height() const = 0;
+  virtual SurfaceFormat Format() const = 0;
+
+  // Drawing calls go between BeginDraw and EndDraw.
+  virtual void BeginDraw() = 0;
+  virtual void EndDraw() = 0;
+
+  // Fills the whole surface with aColor, 0xAARRGGBB.
+  virtual void Clear(uint32_t aColor) = 0;
+
+  // Draws a aWidth x aHeight premultiplied BGRA bitmap, rows aStride bytes
+  // apart, source over with its top left at (aX, aY).
+  virtual void DrawBitmap(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                          int32_t aX, int32_t aY) = 0;
+
+  // Fills aColor (0xAARRGGBB) through a aWidth x aHeight A8 coverage mask
+  // with its top left at (aX, aY).
+  virtual void FillOpacityMask(const uint8_t* aA8, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                               int32_t aX, int32_t aY, uint32_t aColor) = 0;
+
+  // Composites the glyphs, placed relative to the run origin at (aX, aY),
+  // adding the coverage of overlapping glyphs, and draws the result in the
+  // paint's color.
+  virtual void DrawGlyphRun(const std::vector<PlacedGlyph>& aGlyphs, int32_t aX, int32_t aY,
+                            const GlyphRunPaint& aPaint) = 0;
+
+  // Copies aRect of the surface into aOut, rows aStride bytes apart, in the
+  // surface's format. Returns false if aRect is not inside the surface or
+  // the backend cannot read its pixels.
+  virtual bool Readback(const IntRect& aRect, uint8_t* aOut, int32_t aStride) = 0;
+};
+
+/**
+ * RenderSurface in system memory. Glyph runs and opacity masks go through
+ * CompositeMask, blending against the pixels already on the surface, and
+ * bitmaps are premultiplied source over. An A8 surface keeps only the alpha
+ * of everything drawn, with ClearType text covering by its green coverage.
+ * Drawing, Clear included, stays inside the clip rect. Not thread safe.
+ *
+ * Opacity mask layers redirect drawing into a transparent layer of the
+ * surface's size and format, the CPU side of D2D's PushLayer with an image
+ * brush. A layer only clears and composites the bounds drawn into it, so a
+ * masked paragraph on a large surface costs the paragraph, and its buffer is
+ * kept for the next layer pushed at the same depth.
+ */
+class CpuRenderSurface : public RenderSurface {
+public:
+  CpuRenderSurface(int32_t aWidth, int32_t aHeight, SurfaceFormat aFormat);
+
+  int32_t Width() const override { return mWidth; }
+  int32_t Height() const override { return mHeight; }
+  SurfaceFormat Format() const override { return mFormat; }
+
+  void BeginDraw() override { }
+  void EndDraw() override { }
+
+  void Clear(uint32_t aColor) override;
+  void DrawBitmap(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                  int32_t aX, int32_t aY) override;
+  void FillOpacityMask(const uint8_t* aA8, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                       int32_t aX, int32_t aY, uint32_t aColor) override;
+  void DrawGlyphRun(const std::vector<PlacedGlyph>& aGlyphs, int32_t aX, int32_t aY,
+                    const GlyphRunPaint& aPaint) override;
+  bool Readback(const IntRect& aRect, uint8_t* aOut, int32_t aStride) override;
+
+  // Blends a coverage mask of any CoverageMaskFormat, such as an LCD16 atlas
+  // page, with its top left at (aX, aY).
+  void DrawMask(const CoverageMask& aMask, int32_t aX, int32_t aY,
+                const MaskBlendParams& aParams);
+
+  // Limits drawing to aClip, cut to the surface. The whole surface until set.
+  void SetClip(const IntRect& aClip);
+  void ResetClip();
+  const IntRect& Clip() const { return mClip; }
+
+  // Starts a layer that PopLayer composites onto what is below through
+  // aMask, an A8 mask with its top left at (aX, aY). Nothing drawn outside
+  // the mask shows. Layers nest, and the mask has to stay alive until the
+  // matching PopLayer.
+  void PushOpacityMaskLayer(const CoverageMask& aMask, int32_t aX, int32_t aY);
+
+  // Same with the luminance of a aWidth x aHeight premultiplied BGRA image
+  // as the mask, what D2D's LuminanceToAlpha effect does under an image
+  // brush. PopLayer converts the mask row by row as it composites, the A8
+  // mask is never stored.
+  void PushLuminanceLayer(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                          int32_t aX, int32_t aY);
+
+  void PopLayer();
+  size_t LayerDepth() const { return mLayerDepth; }
+
+  // The pixels themselves, Stride() bytes per row, under any open layers.
+  uint8_t* Pixels() { return mPixels.data(); }
+  const uint8_t* Pixels() const { return mPixels.data(); }
+  int32_t Stride() const { return mStride; }
+
+private:
+  CpuRenderSurface(const CpuRenderSurface&);
+  CpuRenderSurface& operator=(const CpuRenderSurface&);
+
+  // Clips a aWidth x aHeight source at (aX, aY) to the clip rect. Returns
+  // false if nothing is left, otherwise the visible part in surface
+  // coordinates.
+  bool ClipToSurface(int32_t aX, int32_t aY, int32_t aWidth, int32_t aHeight,
+                     IntRect* aOutRect) const;
+
+  struct Layer {
+    std::vector<uint8_t> fPixels;
+    IntRect fDrawn;           // Cleared and drawn into, the rest is stale
+    const uint8_t* fMask;
+    int32_t fMaskStride;
+    IntRect fMaskRect;        // Where the mask lies on the surface
+    bool fLuminance;          // fMask is BGRA, masking by its luminance
+  };
+
+  Layer& PushLayer();
+
+  // The pixels drawing goes to, the top layer's or the surface's, with
+  // aRect of them ready to be drawn on.
+  uint8_t* Target(const IntRect& aRect);
+
+  // Covers aCount pixels of an A8 surface row with a row of aMask's format.
+  void CoverAlphaRow(const uint8_t* aMask, CoverageMaskFormat aFormat, uint8_t* aRow,
+                     int32_t aCount, const MaskBlendParams& aParams);
+
+  int32_t mWidth;
+  int32_t mHeight;
+  SurfaceFormat mFormat;
+  int32_t mStride;
+  std::vector<uint8_t> mPixels;
+  IntRect mClip;
+  // Run coverage of the last DrawGlyphRun, kept to save the allocation.
+  std::vector<uint8_t> mCoverage;
+  // Open layers, and past mLayerDepth the ones popped, for their buffers.
+  std::vector<Layer> mLayers;
+  size_t mLayerDepth;
+  std::vector<uint8_t> mLuminanceRow;
+};
@@ -6,7 +6,6 @@
  */
 
 
-#include "stdafx.h"
 #include <stdint.h>
 #include <math.h>
 #include "SkMaskGamma.h"
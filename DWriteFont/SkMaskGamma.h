@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include <math.h>
+#include <memory>
 
 typedef float SkScalar;
 typedef uint32_t SkColor;
@@ -36,6 +37,10 @@ template <typename D, typename S> D SkTo(S s) {
 }
 #define SkToU8(x)    SkTo<uint8_t>(x)
 
+template <typename T> static inline bool SkToBool(const T& x) {
+	return 0 != x;
+}
+
 ///@{
 /** See ITU-R Recommendation BT.709 at http://www.itu.int/rec/R-REC-BT.709/ .*/
 #define SK_ITU_BT709_LUM_COEFF_R (0.2126f)
@@ -66,6 +71,11 @@ static inline SkColor SkColorSetARGBInline(U8CPU a, U8CPU r, U8CPU g, U8CPU b)
 	return (a << 24) | (r << 16) | (g << 8) | (b << 0);
 }
 
+/** Return a SkColor value from 8 bit component values, with an implied value
+	of 0xFF for alpha (fully opaque)
+*/
+#define SkColorSetRGB(r, g, b)  SkColorSetARGBInline(0xFF, r, g, b)
+
 /**
  * SkColorSpaceLuminance is used to convert luminances to and from linear and
  * perceptual color spaces.
@@ -148,7 +158,7 @@ template <int R_LUM_BITS, int G_LUM_BITS, int B_LUM_BITS> class SkTMaskGamma {
 public:
 
     /** Creates a linear SkTMaskGamma. */
-    SkTMaskGamma() : fIsLinear(true) { }
+    SkTMaskGamma() : fGammaTables(nullptr), fIsLinear(true) { }
 
     /**
      * Creates tables to convert linear alpha values to gamma correcting alpha
@@ -159,17 +169,28 @@ public:
      * @param paint The color space in which the paint color was chosen.
      * @param device The color space of the target device.
      */
-    SkTMaskGamma(SkScalar contrast, SkScalar paintGamma, SkScalar deviceGamma) : fIsLinear(false) {
+    SkTMaskGamma(SkScalar contrast, SkScalar paintGamma, SkScalar deviceGamma)
+    : fOwnedTables(new uint8_t[1 << MAX_LUM_BITS][256])
+    , fGammaTables(fOwnedTables.get())
+    , fIsLinear(false) {
         const SkColorSpaceLuminance& paintConvert = SkColorSpaceLuminance::Fetch(paintGamma);
         const SkColorSpaceLuminance& deviceConvert = SkColorSpaceLuminance::Fetch(deviceGamma);
         for (U8CPU i = 0; i < (1 << MAX_LUM_BITS); ++i) {
             U8CPU lum = sk_t_scale255<MAX_LUM_BITS>(i);
-            SkTMaskGamma_build_correcting_lut(fGammaTables[i], lum, contrast,
+            SkTMaskGamma_build_correcting_lut(fOwnedTables[i], lum, contrast,
                                               paintConvert, paintGamma,
                                               deviceConvert, deviceGamma);
         }
     }
 
+    /**
+     * Wraps a table set built ahead of time, such as the ones in
+     * SkMaskGammaPresets.h. Nothing is computed or copied, the tables must
+     * outlive this object.
+     */
+    explicit SkTMaskGamma(const uint8_t (*tables)[256])
+    : fGammaTables(tables), fIsLinear(false) { }
+
     /** Given a color, returns the closest canonical color. */
     static SkColor CanonicalColor(SkColor color) {
         return SkColorSetRGB(
@@ -178,15 +199,18 @@ public:
                    sk_t_scale255<B_LUM_BITS>(SkColorGetB(color) >> (8 - B_LUM_BITS)));
     }
 
-    /** The type of the mask pre-blend which will be returned from preBlend(SkColor). */
+    /** The type of the mask pre-blend which will be returned from preBlend(). */
     typedef SkTMaskPreBlend<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS> PreBlend;
 
     /**
      * Provides access to the tables appropriate for converting linear alpha
      * values into gamma correcting alpha values when drawing the given color
      * through the mask. The destination color will be approximated.
+     *
+     * The returned PreBlend shares ownership of gamma, so only gammas owned
+     * by a std::shared_ptr can hand out tables.
      */
-    PreBlend preBlend(SkColor color) const;
+    static PreBlend preBlend(const std::shared_ptr<const SkTMaskGamma>& gamma, SkColor color);
 
     /**
      * Get dimensions for the full table set, so it can be allocated as a block.
@@ -207,7 +231,14 @@ public:
     static const int MAX_LUM_BITS =
           B_LUM_BITS > (R_LUM_BITS > G_LUM_BITS ? R_LUM_BITS : G_LUM_BITS)
         ? B_LUM_BITS : (R_LUM_BITS > G_LUM_BITS ? R_LUM_BITS : G_LUM_BITS);
-    uint8_t fGammaTables[1 << MAX_LUM_BITS][256];
+
+private:
+    // Set when the tables were built by this object, null when wrapping
+    // tables owned by someone else.
+    std::unique_ptr<uint8_t[][256]> fOwnedTables;
+
+public:
+    const uint8_t (*fGammaTables)[256];
     bool fIsLinear;
 };
 
@@ -215,7 +246,12 @@ public:
 /**
  * SkTMaskPreBlend is a tear-off of SkTMaskGamma. It provides the tables to
  * convert a linear alpha value for a given channel to a gamma correcting alpha
- * value for that channel. This class is immutable.
+ * value for that channel. The tables it points to are immutable.
+ *
+ * A PreBlend is a small handle: it shares ownership of the SkTMaskGamma its
+ * tables point into, so copying one only bumps a reference count and moving
+ * one is free. The tables stay valid for as long as any PreBlend using them
+ * is alive.
  *
  * If fR, fG, or fB is nullptr, all of them will be. This indicates that no mask
  * pre blend should be applied. SkTMaskPreBlend::isApplicable() is provided as
@@ -223,23 +259,34 @@ public:
  */
 template <int R_LUM_BITS, int G_LUM_BITS, int B_LUM_BITS> class SkTMaskPreBlend {
 private:
-    SkTMaskPreBlend(const SkTMaskGamma<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>* parent,
+    typedef SkTMaskGamma<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS> Parent;
+
+    SkTMaskPreBlend(std::shared_ptr<const Parent> parent,
                     const uint8_t* r, const uint8_t* g, const uint8_t* b)
-    : fParent(*parent), fR(r), fG(g), fB(b) { }
+    : fParent(std::move(parent)), fR(r), fG(g), fB(b) { }
 
-    const SkTMaskGamma<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS> fParent;
+    std::shared_ptr<const Parent> fParent;
     friend class SkTMaskGamma<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>;
 public:
     /** Creates a non applicable SkTMaskPreBlend. */
     SkTMaskPreBlend() : fParent(), fR(nullptr), fG(nullptr), fB(nullptr) { }
 
-    /**
-     * This copy contructor exists for correctness, but should never be called
-     * when return value optimization is enabled.
-     */
-    SkTMaskPreBlend(const SkTMaskPreBlend<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>& that)
+    SkTMaskPreBlend(const SkTMaskPreBlend& that)
     : fParent(that.fParent), fR(that.fR), fG(that.fG), fB(that.fB) { }
 
+    SkTMaskPreBlend(SkTMaskPreBlend&& that)
+    : fParent(std::move(that.fParent)), fR(that.fR), fG(that.fG), fB(that.fB) {
+        that.fR = that.fG = that.fB = nullptr;
+    }
+
+    SkTMaskPreBlend& operator=(SkTMaskPreBlend that) {
+        fParent.swap(that.fParent);
+        fR = that.fR;
+        fG = that.fG;
+        fB = that.fB;
+        return *this;
+    }
+
     ~SkTMaskPreBlend() { }
 
     /** True if this PreBlend should be applied. When false, fR, fG, and fB are nullptr. */
@@ -252,12 +299,13 @@ public:
 
 template <int R_LUM_BITS, int G_LUM_BITS, int B_LUM_BITS>
 SkTMaskPreBlend<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>
-SkTMaskGamma<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>::preBlend(SkColor color) const {
-    return fIsLinear ? SkTMaskPreBlend<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>()
-                     : SkTMaskPreBlend<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>(this,
-                         fGammaTables[SkColorGetR(color) >> (8 - MAX_LUM_BITS)],
-                         fGammaTables[SkColorGetG(color) >> (8 - MAX_LUM_BITS)],
-                         fGammaTables[SkColorGetB(color) >> (8 - MAX_LUM_BITS)]);
+SkTMaskGamma<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>::preBlend(
+        const std::shared_ptr<const SkTMaskGamma>& gamma, SkColor color) {
+    return gamma->fIsLinear ? SkTMaskPreBlend<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>()
+                            : SkTMaskPreBlend<R_LUM_BITS, G_LUM_BITS, B_LUM_BITS>(gamma,
+                                gamma->fGammaTables[SkColorGetR(color) >> (8 - MAX_LUM_BITS)],
+                                gamma->fGammaTables[SkColorGetG(color) >> (8 - MAX_LUM_BITS)],
+                                gamma->fGammaTables[SkColorGetB(color) >> (8 - MAX_LUM_BITS)]);
 }
 
 ///@{
@@ -0,0 +1,254 @@
+#include "TiledCompositor.h"
+#include <algorithm>
+#include <chrono>
+#include "Trace.h"
+
+TiledCompositor::TiledCompositor(WorkStealingPool* aPool)
+  : mPool(aPool)
+  , mPixels(nullptr)
+  , mWidth(0)
+  , mHeight(0)
+  , mStride(0)
+  , mTilesX(0)
+  , mTilesY(0)
+  , mScratch(aPool->ThreadCount())
+{
+}
+
+void
+TiledCompositor::BeginFrame(uint8_t* aPixels, int32_t aWidth, int32_t aHeight, int32_t aStride)
+{
+  mPixels = aPixels;
+  mWidth = aWidth;
+  mHeight = aHeight;
+  mStride = aStride;
+  mTilesX = (aWidth + kTileSize - 1) / kTileSize;
+  mTilesY = (aHeight + kTileSize - 1) / kTileSize;
+
+  mDraws.clear();
+  mRuns.clear();
+  // Keep each tile's list, and its capacity, from frame to frame.
+  mTileDraws.resize((size_t)mTilesX * mTilesY);
+  for (std::vector<uint32_t>& draws : mTileDraws) {
+    draws.clear();
+  }
+}
+
+void
+TiledCompositor::Bin(const IntRect& aRect, uint32_t aIndex)
+{
+  IntRect rect = aRect;
+  if (!rect.Intersect(IntRect::Make(0, 0, mWidth, mHeight))) {
+    return;
+  }
+
+  for (int32_t ty = rect.fTop / kTileSize; ty <= (rect.fBottom - 1) / kTileSize; ty++) {
+    for (int32_t tx = rect.fLeft / kTileSize; tx <= (rect.fRight - 1) / kTileSize; tx++) {
+      std::vector<uint32_t>& draws = mTileDraws[ty * mTilesX + tx];
+      // Neighbouring glyphs of a run land in the same tiles.
+      if (draws.empty() || draws.back() != aIndex) {
+        draws.push_back(aIndex);
+      }
+    }
+  }
+}
+
+void
+TiledCompositor::Clear(uint32_t aColor)
+{
+  Draw draw = Draw();
+  draw.fKind = DRAW_CLEAR;
+  draw.fBounds = IntRect::Make(0, 0, mWidth, mHeight);
+  draw.fColor = aColor;
+  mDraws.push_back(draw);
+  Bin(draw.fBounds, (uint32_t)mDraws.size() - 1);
+}
+
+void
+TiledCompositor::DrawBitmap(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                            int32_t aX, int32_t aY)
+{
+  Draw draw = Draw();
+  draw.fKind = DRAW_BITMAP;
+  draw.fBounds = IntRect::MakeXYWH(aX, aY, aWidth, aHeight);
+  draw.fX = aX;
+  draw.fY = aY;
+  CoverageMask bitmap = { aBGRA, aStride, aWidth, aHeight, COVERAGE_MASK_A8 };
+  draw.fMask = bitmap;
+  mDraws.push_back(draw);
+  Bin(draw.fBounds, (uint32_t)mDraws.size() - 1);
+}
+
+void
+TiledCompositor::DrawMask(const CoverageMask& aMask, int32_t aX, int32_t aY,
+                          const MaskBlendParams& aParams)
+{
+  Draw draw = Draw();
+  draw.fKind = DRAW_MASK;
+  draw.fBounds = IntRect::MakeXYWH(aX, aY, aMask.fWidth, aMask.fHeight);
+  draw.fX = aX;
+  draw.fY = aY;
+  draw.fMask = aMask;
+  draw.fParams = aParams;
+  mDraws.push_back(draw);
+  Bin(draw.fBounds, (uint32_t)mDraws.size() - 1);
+}
+
+void
+TiledCompositor::DrawGlyphRun(const std::vector<PlacedGlyph>& aGlyphs, int32_t aX, int32_t aY,
+                              const GlyphRunPaint& aPaint)
+{
+  IntRect runBounds = GetGlyphRunBounds(aGlyphs);
+  if (runBounds.IsEmpty()) {
+    return;
+  }
+
+  Draw draw = Draw();
+  draw.fKind = DRAW_GLYPH_RUN;
+  draw.fBounds = IntRect::MakeXYWH(aX + runBounds.fLeft, aY + runBounds.fTop,
+                                   runBounds.Width(), runBounds.Height());
+  draw.fX = aX;
+  draw.fY = aY;
+  draw.fParams = aPaint.fBlend;
+  draw.fRunFormat = aPaint.fMaskFormat;
+  draw.fRun = mRuns.size();
+  mRuns.push_back(aGlyphs);
+  mDraws.push_back(draw);
+
+  // Bin by glyph quad, a line of text only touches the tiles it covers.
+  const uint32_t index = (uint32_t)mDraws.size() - 1;
+  for (const PlacedGlyph& glyph : aGlyphs) {
+    if (!glyph.fMask->IsEmpty()) {
+      IntRect bounds = glyph.Bounds();
+      Bin(IntRect::MakeXYWH(aX + bounds.fLeft, aY + bounds.fTop, bounds.Width(), bounds.Height()),
+          index);
+    }
+  }
+}
+
+void
+TiledCompositor::CompositeTile(int aTile, int aThread)
+{
+  TRACE_ZONE("Tile");
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  TileStats& stats = mTileStats[aTile];
+  const IntRect& tile = stats.fRect;
+  for (uint32_t index : mTileDraws[aTile]) {
+    const Draw& draw = mDraws[index];
+    switch (draw.fKind) {
+      case DRAW_CLEAR:
+        FillPixels(draw.fColor, mPixels, mStride, tile);
+        break;
+      case DRAW_BITMAP:
+        CompositeBitmap(draw.fMask.fBits, draw.fMask.fStride, draw.fMask.fWidth, draw.fMask.fHeight,
+                        draw.fX, draw.fY, mPixels, mStride, tile);
+        break;
+      case DRAW_MASK:
+        CompositeMask(draw.fMask, draw.fX, draw.fY, draw.fParams, mPixels, mStride, tile);
+        break;
+      case DRAW_GLYPH_RUN: {
+        // Composite the run's coverage under this tile only, in run
+        // coordinates like CpuRenderSurface::DrawGlyphRun.
+        IntRect visible = draw.fBounds;
+        if (!visible.Intersect(tile)) {
+          break;
+        }
+        const IntRect runRect = IntRect::Make(visible.fLeft - draw.fX, visible.fTop - draw.fY,
+                                              visible.fRight - draw.fX, visible.fBottom - draw.fY);
+        const int32_t bytesPerPixel = GlyphMaskBytesPerPixel(draw.fRunFormat);
+        std::vector<uint8_t>& coverage = mScratch[aThread];
+        coverage.resize((size_t)runRect.Width() * runRect.Height() * bytesPerPixel);
+        CompositeGlyphRun(mRuns[draw.fRun], runRect, bytesPerPixel, coverage.data());
+
+        CoverageMask mask = { coverage.data(), runRect.Width() * bytesPerPixel,
+                              runRect.Width(), runRect.Height(),
+                              draw.fRunFormat == GLYPH_MASK_A8 ? COVERAGE_MASK_A8
+                                                               : COVERAGE_MASK_CLEARTYPE_3x1 };
+        CompositeMask(mask, visible.fLeft, visible.fTop, draw.fParams, mPixels, mStride, tile);
+        break;
+      }
+    }
+  }
+
+  stats.fThread = aThread;
+  stats.fNanoseconds = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+void
+TiledCompositor::Flush()
+{
+  TRACE_ZONE("TiledCompositor::Flush");
+  mTileStats.resize(mTileDraws.size());
+  std::vector<int> busyTiles;
+  for (int32_t ty = 0; ty < mTilesY; ty++) {
+    for (int32_t tx = 0; tx < mTilesX; tx++) {
+      const int tile = ty * mTilesX + tx;
+      TileStats& stats = mTileStats[tile];
+      stats.fRect = IntRect::MakeXYWH(tx * kTileSize, ty * kTileSize, kTileSize, kTileSize);
+      stats.fRect.Intersect(IntRect::Make(0, 0, mWidth, mHeight));
+      stats.fDraws = (uint32_t)mTileDraws[tile].size();
+      stats.fThread = -1;
+      stats.fNanoseconds = 0;
+      if (stats.fDraws) {
+        busyTiles.push_back(tile);
+      }
+    }
+  }
+
+  mPool->ParallelFor((int)busyTiles.size(), [&](int aIndex, int aThread) {
+    CompositeTile(busyTiles[aIndex], aThread);
+  });
+
+  mDraws.clear();
+  mRuns.clear();
+  for (std::vector<uint32_t>& draws : mTileDraws) {
+    draws.clear();
+  }
+}
+
+void
+TiledCompositor::WriteTileReport(std::ostream& aOut) const
+{
+  std::vector<const TileStats*> drawn;
+  std::vector<uint64_t> threadNanoseconds(mPool->ThreadCount());
+  std::vector<uint32_t> threadTiles(mPool->ThreadCount());
+  uint64_t draws = 0;
+  for (const TileStats& stats : mTileStats) {
+    if (stats.fThread < 0) {
+      continue;
+    }
+    drawn.push_back(&stats);
+    draws += stats.fDraws;
+    threadNanoseconds[stats.fThread] += stats.fNanoseconds;
+    threadTiles[stats.fThread]++;
+  }
+
+  aOut << mTileStats.size() << " tiles of " << kTileSize << "x" << kTileSize << ", "
+       << drawn.size() << " drawn, " << draws << " draws binned\n";
+  if (drawn.empty()) {
+    return;
+  }
+
+  std::sort(drawn.begin(), drawn.end(), [](const TileStats* aA, const TileStats* aB) {
+    return aA->fNanoseconds < aB->fNanoseconds;
+  });
+  auto percentile = [&](double aP) {
+    return drawn[std::min(drawn.size() - 1, (size_t)(aP * drawn.size()))]->fNanoseconds / 1000.0;
+  };
+  aOut << "per tile us: median " << percentile(0.5) << ", p90 " << percentile(0.9)
+       << ", p99 " << percentile(0.99) << ", max " << drawn.back()->fNanoseconds / 1000.0 << "\n";
+
+  aOut << "slowest:";
+  for (size_t i = 0; i < drawn.size() && i < 4; i++) {
+    const TileStats& stats = *drawn[drawn.size() - 1 - i];
+    aOut << " (" << stats.fRect.fLeft << "," << stats.fRect.fTop << ") "
+         << stats.fNanoseconds / 1000.0 << "us/" << stats.fDraws << " draws";
+  }
+  aOut << "\nthreads:";
+  for (size_t t = 0; t < threadTiles.size(); t++) {
+    aOut << " " << t << ":" << threadTiles[t] << " tiles " << threadNanoseconds[t] / 1000 << "us";
+  }
+  aOut << ", " << mPool->LastSteals() << " steals\n";
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+#include "GlyphCache.h"
+#include "IntRect.h"
+#include "MaskCompositor.h"
+#include "RenderSurface.h"
+#include "WorkStealingPool.h"
+
+/**
+ * Draws a frame into a BGRA target in parallel. The drawing calls only
+ * record: each draw is binned into the kTileSize square tiles its glyph
+ * quads, mask or bitmap touch. Flush then composites the tiles on a
+ * WorkStealingPool, every tile by one thread from start to finish and
+ * clipped to itself, so the target's pixels need no locks and the draws in
+ * a tile keep their order. The pixels come out the same as making the same
+ * calls on a CpuRenderSurface, given PreBlend tables that keep zero coverage
+ * at zero: tiles no glyph quad touches skip the run.
+ *
+ * Masks and bitmaps are referenced, not copied, and must stay alive until
+ * Flush. Glyph runs are copied, which keeps their masks alive.
+ */
+class TiledCompositor {
+public:
+  static const int32_t kTileSize = 64;
+
+  // What one tile cost in the last Flush.
+  struct TileStats {
+    IntRect fRect;
+    uint32_t fDraws;        // Draws binned into the tile
+    int32_t fThread;        // Pool thread that composited it
+    uint64_t fNanoseconds;
+  };
+
+  explicit TiledCompositor(WorkStealingPool* aPool);
+
+  // Starts a frame drawing into aWidth x aHeight premultiplied BGRA pixels,
+  // rows aStride bytes apart, and forgets the last frame's draws.
+  void BeginFrame(uint8_t* aPixels, int32_t aWidth, int32_t aHeight, int32_t aStride);
+
+  // Same as the CpuRenderSurface calls of the same name.
+  void Clear(uint32_t aColor);
+  void DrawBitmap(const uint8_t* aBGRA, int32_t aStride, int32_t aWidth, int32_t aHeight,
+                  int32_t aX, int32_t aY);
+  void DrawMask(const CoverageMask& aMask, int32_t aX, int32_t aY,
+                const MaskBlendParams& aParams);
+  void DrawGlyphRun(const std::vector<PlacedGlyph>& aGlyphs, int32_t aX, int32_t aY,
+                    const GlyphRunPaint& aPaint);
+
+  // Composites every tile and ends the frame.
+  void Flush();
+
+  // Every tile of the last Flush in row order, empty ones included.
+  const std::vector<TileStats>& LastTileStats() const { return mTileStats; }
+
+  // Writes a summary of LastTileStats: percentiles of the per tile time,
+  // the busiest tiles and how the time split over the pool's threads.
+  void WriteTileReport(std::ostream& aOut) const;
+
+private:
+  TiledCompositor(const TiledCompositor&);
+  TiledCompositor& operator=(const TiledCompositor&);
+
+  enum DrawKind {
+    DRAW_CLEAR,
+    DRAW_BITMAP,
+    DRAW_MASK,
+    DRAW_GLYPH_RUN,
+  };
+
+  struct Draw {
+    DrawKind fKind;
+    IntRect fBounds;            // What it can touch, in target pixels
+    int32_t fX;                 // Origin of the bitmap, mask or run
+    int32_t fY;
+    uint32_t fColor;            // DRAW_CLEAR
+    CoverageMask fMask;         // DRAW_MASK, and the bitmap for DRAW_BITMAP
+    MaskBlendParams fParams;    // DRAW_MASK and DRAW_GLYPH_RUN
+    GlyphMaskFormat fRunFormat; // DRAW_GLYPH_RUN
+    size_t fRun;                // DRAW_GLYPH_RUN, index into mRuns
+  };
+
+  // Adds draw aIndex to every tile aRect touches.
+  void Bin(const IntRect& aRect, uint32_t aIndex);
+  void CompositeTile(int aTile, int aThread);
+
+  WorkStealingPool* mPool;
+  uint8_t* mPixels;
+  int32_t mWidth;
+  int32_t mHeight;
+  int32_t mStride;
+  int32_t mTilesX;
+  int32_t mTilesY;
+
+  std::vector<Draw> mDraws;
+  std::vector<std::vector<PlacedGlyph>> mRuns;
+  // Indices into mDraws per tile, in drawing order.
+  std::vector<std::vector<uint32_t>> mTileDraws;
+  // Run coverage per pool thread.
+  std::vector<std::vector<uint8_t>> mScratch;
+  std::vector<TileStats> mTileStats;
+};
@@ -0,0 +1,109 @@
+// Generates SkMaskGammaPresets.h, the mask gamma tables for the gamma and
+// contrast settings we ship, so the renderer never builds them at startup.
+// Platform neutral, see ReadMe.txt for how to build and run it.
+//
+//   GenMaskGammaPresets > SkMaskGammaPresets.h   writes the header
+//   GenMaskGammaPresets --verify                 checks the compiled in
+//                                                header against the builder
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../MaskGammaRegistry.h"
+
+struct PresetSettings {
+  float fContrast;
+  float fPaintGamma;
+  float fDeviceGamma;
+};
+
+// Keep in sync with D2DSetup::CreateMaskGamma and D2DSetup::CreateGdiMaskGamma.
+static const PresetSettings kPresets[] = {
+  { 1.0f, 1.8f, 1.8f },
+  { 1.0f, 2.3f, 2.3f },
+};
+
+static void
+PrintName(const PresetSettings& aPreset)
+{
+  // 1.8 -> 1_80, so every preset gets a readable identifier.
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "kMaskGammaTables_%.2f_%.2f_%.2f",
+           aPreset.fContrast, aPreset.fPaintGamma, aPreset.fDeviceGamma);
+  for (char* c = buffer; *c; c++) {
+    if (*c == '.') {
+      *c = '_';
+    }
+  }
+  printf("%s", buffer);
+}
+
+static int
+Generate()
+{
+  printf("// Generated by Tools/GenMaskGammaPresets.cpp, do not edit.\n");
+  printf("//\n");
+  printf("// Mask gamma tables for the settings the renderer ships with, byte identical\n");
+  printf("// to what SkMaskGamma builds at runtime. MaskGammaRegistry wraps these instead\n");
+  printf("// of computing them.\n\n");
+  printf("#pragma once\n\n");
+  printf("#include <stdint.h>\n\n");
+  printf("struct SkMaskGammaPreset {\n");
+  printf("  float fContrast;\n");
+  printf("  float fPaintGamma;\n");
+  printf("  float fDeviceGamma;\n");
+  printf("  const uint8_t (*fTables)[256];\n");
+  printf("};\n");
+
+  const size_t presetCount = sizeof(kPresets) / sizeof(kPresets[0]);
+  for (size_t p = 0; p < presetCount; p++) {
+    const PresetSettings& preset = kPresets[p];
+    SkMaskGamma gamma(preset.fContrast, preset.fPaintGamma, preset.fDeviceGamma);
+
+    int tableWidth, numTables;
+    gamma.getGammaTableDimensions(&tableWidth, &numTables);
+
+    printf("\nstatic const uint8_t ");
+    PrintName(preset);
+    printf("[%d][%d] = {\n", numTables, tableWidth);
+    for (int t = 0; t < numTables; t++) {
+      printf("  {\n");
+      for (int i = 0; i < tableWidth; i++) {
+        printf("%s0x%02x,%s", (i % 16) == 0 ? "    " : " ", gamma.fGammaTables[t][i],
+               (i % 16) == 15 ? "\n" : "");
+      }
+      printf("  },\n");
+    }
+    printf("};\n");
+  }
+
+  printf("\nstatic const SkMaskGammaPreset kMaskGammaPresets[] = {\n");
+  for (size_t p = 0; p < presetCount; p++) {
+    const PresetSettings& preset = kPresets[p];
+    printf("  { %#gf, %#gf, %#gf, ", preset.fContrast, preset.fPaintGamma, preset.fDeviceGamma);
+    PrintName(preset);
+    printf(" },\n");
+  }
+  printf("};\n");
+  return 0;
+}
+
+static int
+Verify()
+{
+  if (!MaskGammaRegistry::VerifyPresets()) {
+    fprintf(stderr, "SkMaskGammaPresets.h does not match the runtime builder, regenerate it.\n");
+    return 1;
+  }
+  printf("SkMaskGammaPresets.h matches the runtime builder.\n");
+  return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc > 1 && !strcmp(argv[1], "--verify")) {
+    return Verify();
+  }
+  return Generate();
+}
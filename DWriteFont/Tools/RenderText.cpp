@@ -0,0 +1,170 @@
+// Draws a line of text with the TrueType backend into a CpuRenderSurface and
+// writes it as a PPM, or a PGM for gray A8 text. Goes through the same glyph
+// cache, run compositing, mask gamma and ClearType conversion as the app but
+// needs no DWrite or D2D, so the mask pipeline can be run and checked
+// headless. Platform neutral, see ReadMe.txt for how to build it.
+//
+//   RenderText [--a8] [--no-lut] [--color RRGGBB] [--background RRGGBB]
+//              font.ttf size "text" out.ppm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include "../FontGlyphMap.h"
+#include "../GlyphRasterizer.h"
+#include "../MaskConvert.h"
+#include "../MaskGammaRegistry.h"
+#include "../RenderSurface.h"
+#include "../TrueTypeRasterizer.h"
+
+static const size_t kGlyphCacheBudget = 4 * 1024 * 1024;
+
+// Invalid sequences come out as U+FFFD.
+static std::vector<uint32_t>
+DecodeUTF8(const char* aText)
+{
+  std::vector<uint32_t> codePoints;
+  const uint8_t* p = (const uint8_t*)aText;
+  while (*p) {
+    uint32_t c = *p++;
+    int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+    if (c >= 0x80 && !extra) {
+      codePoints.push_back(0xFFFD);
+      continue;
+    }
+    c &= 0x7F >> extra;
+    for (; extra; extra--) {
+      if ((*p & 0xC0) != 0x80) {
+        c = 0xFFFD;
+        break;
+      }
+      c = (c << 6) | (*p++ & 0x3F);
+    }
+    codePoints.push_back(c);
+  }
+  return codePoints;
+}
+
+static bool
+IsGray(uint32_t aColor)
+{
+  return ((aColor >> 16) & 0xFF) == (aColor & 0xFF) && ((aColor >> 8) & 0xFF) == (aColor & 0xFF);
+}
+
+int
+main(int argc, char** argv)
+{
+  GlyphMaskFormat format = GLYPH_MASK_CLEARTYPE_3x1;
+  bool useLUT = true;
+  SkColor textColor = SkColorSetARGBInline(255, 0, 0, 0);
+  SkColor background = SkColorSetARGBInline(255, 255, 255, 255);
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (!strcmp(argv[arg], "--a8")) {
+      format = GLYPH_MASK_A8;
+    } else if (!strcmp(argv[arg], "--no-lut")) {
+      useLUT = false;
+    } else if (!strcmp(argv[arg], "--color") && arg + 1 < argc) {
+      textColor = 0xFF000000 | (uint32_t)strtoul(argv[++arg], nullptr, 16);
+    } else if (!strcmp(argv[arg], "--background") && arg + 1 < argc) {
+      background = 0xFF000000 | (uint32_t)strtoul(argv[++arg], nullptr, 16);
+    } else {
+      break;
+    }
+  }
+  if (argc - arg != 4) {
+    fprintf(stderr, "usage: RenderText [--a8] [--no-lut] [--color RRGGBB] [--background RRGGBB] "
+                    "font.ttf size \"text\" out.ppm\n");
+    return 1;
+  }
+
+  TrueTypeFont font;
+  if (!font.LoadFile(argv[arg])) {
+    fprintf(stderr, "%s is not a TrueType font we can read\n", argv[arg]);
+    return 1;
+  }
+  float emSize = (float)atof(argv[arg + 1]);
+  std::vector<uint32_t> codePoints = DecodeUTF8(argv[arg + 2]);
+  const char* outPath = argv[arg + 3];
+  uint32_t count = (uint32_t)codePoints.size();
+
+  FontGlyphMap glyphMap(std::unique_ptr<GlyphMapSource>(new TrueTypeGlyphSource(&font)),
+                        font.GlyphCount(), font.DesignUnitsPerEm());
+  std::vector<uint16_t> glyphs(count);
+  std::vector<float> advances(count);
+  glyphMap.GetGlyphIndices(codePoints.data(), count, glyphs.data());
+  glyphMap.GetAdvances(glyphs.data(), count, emSize, advances.data());
+
+  GlyphCache cache(kGlyphCacheBudget);
+  TrueTypeRasterizer rasterizer(&font, emSize);
+  std::vector<PlacedGlyph> placed;
+  GetGlyphRunMasks(rasterizer, cache, format, glyphs.data(), advances.data(), nullptr,
+                   count, false, placed);
+
+  IntRect bounds = GetGlyphRunBounds(placed);
+  const int32_t width = bounds.Width();
+  const int32_t height = bounds.Height();
+  CpuRenderSurface surface(width, height, SURFACE_FORMAT_B8G8R8A8);
+
+  // Same tables D2DSetup::GetPreBlend picks for the text color.
+  SkMaskGammaRef gamma = MaskGammaRegistry::Get(1.0f, 1.8f, 1.8f);
+  SkMaskGamma::PreBlend preBlend =
+    SkMaskGamma::preBlend(gamma, SkMaskGamma::CanonicalColor(textColor));
+
+  surface.BeginDraw();
+  surface.Clear(background);
+  if (format == GLYPH_MASK_CLEARTYPE_3x1 &&
+      textColor == SkColorSetARGBInline(255, 0, 0, 0) &&
+      background == SkColorSetARGBInline(255, 255, 255, 255)) {
+    // Black on white is converted to an opaque bitmap like
+    // D2DSetup::DrawWithBitmap does.
+    std::vector<uint8_t> coverage((size_t)width * height * 3);
+    CompositeGlyphRun(placed, bounds, 3, coverage.data());
+    std::vector<uint8_t> bgra((size_t)width * height * 4);
+    ConvertClearTypeRect(coverage.data(), width * 3, width, height, bgra.data(), width * 4,
+                         useLUT ? preBlend.fR : nullptr, useLUT ? preBlend.fG : nullptr,
+                         useLUT ? preBlend.fB : nullptr, false, nullptr);
+    surface.DrawBitmap(bgra.data(), width * 4, width, height, 0, 0);
+  } else {
+    GlyphRunPaint paint;
+    paint.fMaskFormat = format;
+    paint.fBlend.fForeground = textColor;
+    paint.fBlend.fTableR = useLUT ? preBlend.fR : nullptr;
+    paint.fBlend.fTableG = useLUT ? preBlend.fG : nullptr;
+    paint.fBlend.fTableB = useLUT ? preBlend.fB : nullptr;
+    paint.fBlend.fQuantize = false;
+    paint.fBlend.fMode = MASK_BLEND_SRC_OVER;
+    paint.fBackground = background;
+    surface.DrawGlyphRun(placed, -bounds.fLeft, -bounds.fTop, paint);
+  }
+  surface.EndDraw();
+
+  std::vector<uint8_t> pixels((size_t)width * height * 4);
+  surface.Readback(IntRect::Make(0, 0, width, height), pixels.data(), width * 4);
+
+  FILE* out = fopen(outPath, "wb");
+  if (!out) {
+    fprintf(stderr, "cannot write %s\n", outPath);
+    return 1;
+  }
+
+  const bool gray = format == GLYPH_MASK_A8 && IsGray(textColor) && IsGray(background);
+  fprintf(out, "%s\n%d %d\n255\n", gray ? "P5" : "P6", width, height);
+  for (size_t i = 0; i < pixels.size(); i += 4) {
+    if (gray) {
+      fputc(pixels[i + 1], out);
+    } else {
+      fputc(pixels[i + 2], out);
+      fputc(pixels[i + 1], out);
+      fputc(pixels[i], out);
+    }
+  }
+  fclose(out);
+
+  printf("%u glyphs, %dx%d pixels, %llu glyph cache misses, %llu font lookups\n",
+         count, width, height, (unsigned long long)cache.Misses(),
+         (unsigned long long)glyphMap.SourceCalls());
+  return 0;
+}
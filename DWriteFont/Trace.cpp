@@ -0,0 +1,223 @@
+#include "Trace.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::atomic<bool> Tracer::sEnabled(false);
+
+namespace {
+
+struct TraceEvent {
+  const char* fName;
+  uint64_t fStart;
+  uint64_t fEnd;
+};
+
+// Written only by its thread. fHead counts every event ever recorded, the
+// slot for event n is n % kRingEvents.
+struct TraceRing {
+  TraceRing(uint32_t aThreadId)
+    : fHead(0)
+    , fCleared(0)
+    , fThreadId(aThreadId)
+    , fEvents(new TraceEvent[Tracer::kRingEvents])
+  {
+  }
+
+  std::atomic<uint64_t> fHead;
+  // Events before this were dropped by Clear. Only touched under the lock.
+  uint64_t fCleared;
+  uint32_t fThreadId;
+  std::string fThreadName;
+  std::unique_ptr<TraceEvent[]> fEvents;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// Rings outlive their threads so zones of finished threads still export.
+struct TraceState {
+  TraceState()
+    : fEpochTicks(0)
+    , fStarted(false)
+  {
+  }
+
+  std::mutex fLock;
+  std::vector<std::unique_ptr<TraceRing>> fRings;
+  // Where trace time starts, as ticks and on the reference clock.
+  uint64_t fEpochTicks;
+  Clock::time_point fEpochTime;
+  bool fStarted;
+};
+
+TraceState&
+GetState()
+{
+  static TraceState* sState = new TraceState();
+  return *sState;
+}
+
+thread_local TraceRing* tRing = nullptr;
+
+TraceRing*
+RegisterThread()
+{
+  TraceState& state = GetState();
+  std::lock_guard<std::mutex> lock(state.fLock);
+  state.fRings.emplace_back(new TraceRing((uint32_t)state.fRings.size() + 1));
+  tRing = state.fRings.back().get();
+  return tRing;
+}
+
+void
+WriteEscaped(std::ostream& aOut, const char* aText)
+{
+  for (const char* p = aText; *p; p++) {
+    char c = *p;
+    if (c == '"' || c == '\\') {
+      aOut << '\\' << c;
+    } else if ((unsigned char)c < 0x20) {
+      aOut << ' ';
+    } else {
+      aOut << c;
+    }
+  }
+}
+
+} // namespace
+
+void
+Tracer::SetEnabled(bool aEnabled)
+{
+  TraceState& state = GetState();
+  {
+    std::lock_guard<std::mutex> lock(state.fLock);
+    if (aEnabled && !state.fStarted) {
+      state.fEpochTime = Clock::now();
+      state.fEpochTicks = TraceTicks();
+      state.fStarted = true;
+    }
+  }
+  sEnabled.store(aEnabled, std::memory_order_relaxed);
+}
+
+void
+Tracer::SetThreadName(const char* aName)
+{
+  TraceRing* ring = tRing ? tRing : RegisterThread();
+  std::lock_guard<std::mutex> lock(GetState().fLock);
+  ring->fThreadName = aName;
+}
+
+void
+Tracer::Record(const char* aName, uint64_t aStartTicks, uint64_t aEndTicks)
+{
+  TraceRing* ring = tRing;
+  if (!ring) {
+    ring = RegisterThread();
+  }
+  uint64_t head = ring->fHead.load(std::memory_order_relaxed);
+  TraceEvent& event = ring->fEvents[head % kRingEvents];
+  event.fName = aName;
+  event.fStart = aStartTicks;
+  event.fEnd = aEndTicks;
+  ring->fHead.store(head + 1, std::memory_order_release);
+}
+
+void
+Tracer::Clear()
+{
+  TraceState& state = GetState();
+  std::lock_guard<std::mutex> lock(state.fLock);
+  for (size_t i = 0; i < state.fRings.size(); i++) {
+    state.fRings[i]->fCleared = state.fRings[i]->fHead.load(std::memory_order_acquire);
+  }
+}
+
+bool
+Tracer::WriteChromeTrace(std::ostream& aOut)
+{
+  TraceState& state = GetState();
+  std::lock_guard<std::mutex> lock(state.fLock);
+
+  // Ticks per microsecond, measured over at least 10ms so the rate is good
+  // to a few parts per million.
+  double ticksPerMicrosecond = 1000.0;
+#if defined(DW_CPU_X86)
+  if (state.fStarted) {
+    Clock::time_point now;
+    uint64_t ticks;
+    do {
+      now = Clock::now();
+      ticks = TraceTicks();
+    } while (now - state.fEpochTime < std::chrono::milliseconds(10));
+    double microseconds = std::chrono::duration<double, std::micro>(now - state.fEpochTime).count();
+    ticksPerMicrosecond = (ticks - state.fEpochTicks) / microseconds;
+  }
+#endif
+
+  // Microseconds to the nanosecond.
+  std::ios::fmtflags flags = aOut.flags();
+  std::streamsize precision = aOut.precision();
+  aOut.setf(std::ios::fixed, std::ios::floatfield);
+  aOut.precision(3);
+
+  aOut << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  uint64_t dropped = 0;
+  std::vector<TraceEvent> events;
+  for (size_t r = 0; r < state.fRings.size(); r++) {
+    TraceRing& ring = *state.fRings[r];
+    if (!ring.fThreadName.empty()) {
+      aOut << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+           << ring.fThreadId << ",\"args\":{\"name\":\"";
+      WriteEscaped(aOut, ring.fThreadName.c_str());
+      aOut << "\"}}";
+      first = false;
+    }
+
+    // Copy the newest events, then drop the ones the writer could have
+    // reached while we were copying.
+    uint64_t head = ring.fHead.load(std::memory_order_acquire);
+    uint64_t begin = head > kRingEvents ? head - kRingEvents : 0;
+    begin = begin > ring.fCleared ? begin : ring.fCleared;
+    events.clear();
+    for (uint64_t i = begin; i < head; i++) {
+      events.push_back(ring.fEvents[i % kRingEvents]);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = ring.fHead.load(std::memory_order_relaxed);
+    uint64_t valid = after >= kRingEvents ? after - kRingEvents + 1 : 0;
+    size_t skip = valid > begin ? (size_t)(valid - begin) : 0;
+    skip = skip < events.size() ? skip : events.size();
+    dropped += begin - ring.fCleared + skip;
+
+    for (size_t i = skip; i < events.size(); i++) {
+      const TraceEvent& event = events[i];
+      double start = (double)(int64_t)(event.fStart - state.fEpochTicks) / ticksPerMicrosecond;
+      double duration = (double)(event.fEnd - event.fStart) / ticksPerMicrosecond;
+      aOut << (first ? "" : ",") << "\n{\"name\":\"";
+      WriteEscaped(aOut, event.fName);
+      aOut << "\",\"cat\":\"dw\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring.fThreadId
+           << ",\"ts\":" << start << ",\"dur\":" << duration << "}";
+      first = false;
+    }
+  }
+  aOut << "\n],\"otherData\":{\"droppedEvents\":" << dropped << "}}\n";
+  aOut.flags(flags);
+  aOut.precision(precision);
+  return !aOut.fail();
+}
+
+bool
+Tracer::WriteChromeTrace(const char* aPath)
+{
+  std::ofstream out(aPath, std::ios::out | std::ios::trunc);
+  if (!out) {
+    return false;
+  }
+  return WriteChromeTrace(out);
+}
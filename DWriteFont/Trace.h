@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include "CpuFeatures.h"
+
+#if defined(DW_CPU_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#include <chrono>
+#endif
+
+// Build with DW_TRACE defined to 0 to compile every TRACE_ZONE out.
+#ifndef DW_TRACE
+#define DW_TRACE 1
+#endif
+
+/**
+ * Timestamps for trace zones. On x86 this is the time stamp counter, which
+ * is a single instruction to read and ticks at a constant rate on every CPU
+ * recent enough to run this. Tracer measures that rate against
+ * std::chrono::steady_clock when it exports, so ticks only become
+ * nanoseconds off the hot path. Elsewhere the ticks are steady_clock
+ * nanoseconds.
+ */
+static inline uint64_t
+TraceTicks()
+{
+#if defined(DW_CPU_X86)
+  return __rdtsc();
+#else
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * Collects scoped trace zones from every thread and writes them out as
+ * Chrome trace event JSON, which chrome://tracing and ui.perfetto.dev load.
+ *
+ * Each thread records into its own ring buffer of the most recent
+ * kRingEvents zones, registered on the thread's first zone. Recording takes
+ * no locks and makes no allocations: the owning thread fills the next slot
+ * and publishes it by bumping the ring's head. Export copies what it can see
+ * and drops any slot the writer may have overwritten meanwhile, so it can
+ * run while other threads keep tracing.
+ *
+ * Recording is off until SetEnabled(true). A disabled zone costs one relaxed
+ * load.
+ */
+class Tracer {
+public:
+  static const uint32_t kRingEvents = 1 << 14;
+
+  static bool IsEnabled() { return sEnabled.load(std::memory_order_relaxed); }
+  static void SetEnabled(bool aEnabled);
+
+  // Shows up as the thread's name in the trace. aName is copied.
+  static void SetThreadName(const char* aName);
+
+  // Adds one zone to the calling thread's ring. aName must outlive the
+  // tracer, in practice a string literal.
+  static void Record(const char* aName, uint64_t aStartTicks, uint64_t aEndTicks);
+
+  // Forgets every zone recorded so far.
+  static void Clear();
+
+  // Writes every zone still in the rings, with times in microseconds since
+  // tracing was first enabled. Returns false if the stream failed.
+  static bool WriteChromeTrace(std::ostream& aOut);
+  static bool WriteChromeTrace(const char* aPath);
+
+private:
+  static std::atomic<bool> sEnabled;
+};
+
+/**
+ * Records the time from its construction to the end of its scope under
+ * aName, if tracing was enabled when it was constructed. Use TRACE_ZONE so
+ * builds without DW_TRACE lose it entirely.
+ */
+class TraceZone {
+public:
+  explicit TraceZone(const char* aName)
+    : mName(aName)
+    , mActive(Tracer::IsEnabled())
+    , mStart(mActive ? TraceTicks() : 0)
+  {
+  }
+
+  ~TraceZone()
+  {
+    if (mActive) {
+      Tracer::Record(mName, mStart, TraceTicks());
+    }
+  }
+
+private:
+  TraceZone(const TraceZone&);
+  TraceZone& operator=(const TraceZone&);
+
+  const char* mName;
+  bool mActive;
+  uint64_t mStart;
+};
+
+#define DW_TRACE_CONCAT2(a, b) a##b
+#define DW_TRACE_CONCAT(a, b) DW_TRACE_CONCAT2(a, b)
+
+#if DW_TRACE
+#define TRACE_ZONE(aName) TraceZone DW_TRACE_CONCAT(traceZone, __LINE__)(aName)
+#else
+#define TRACE_ZONE(aName) do { } while (0)
+#endif
@@ -0,0 +1,567 @@
+#include "TrueTypeFont.h"
+#include "GlyphCache.h"
+#include <assert.h>
+#include <fstream>
+#include <iterator>
+
+// Composite glyphs nest, a damaged font could make them nest forever.
+static const int kMaxCompositeDepth = 8;
+// Each component can be another composite, so the depth limit alone still
+// lets a hostile font expand to billions of components. These cap the
+// components expanded and the points and contours of one outline, well
+// above what maxp allows a real glyph.
+static const uint32_t kMaxCompositeComponents = 0xFFFF;
+static const uint32_t kMaxOutlinePoints = 1 << 20;
+
+static inline uint32_t
+MakeTag(char a, char b, char c, char d)
+{
+  return ((uint32_t)a << 24) | ((uint32_t)b << 16) | ((uint32_t)c << 8) | (uint32_t)d;
+}
+
+static inline float
+F2Dot14(uint16_t aValue)
+{
+  return (float)(int16_t)aValue / 16384.0f;
+}
+
+TrueTypeFont::TrueTypeFont()
+  : mId(0)
+  , mUnitsPerEm(0)
+  , mGlyphCount(0)
+  , mAscender(0)
+  , mDescender(0)
+  , mLongLoca(false)
+  , mHMetricCount(0)
+  , mCmapSubtable(0)
+  , mCmapFormat(0)
+{
+  mLoca.fOffset = mLoca.fLength = 0;
+  mGlyf.fOffset = mGlyf.fLength = 0;
+  mHmtx.fOffset = mHmtx.fLength = 0;
+}
+
+bool
+TrueTypeFont::LoadFile(const char* aPath, uint32_t aIndex)
+{
+  std::ifstream file(aPath, std::ios::binary);
+  if (!file) {
+    mData.clear();
+    return false;
+  }
+
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  return Load(data.data(), data.size(), aIndex);
+}
+
+bool
+TrueTypeFont::Load(const uint8_t* aData, size_t aLength, uint32_t aIndex)
+{
+  mData.assign(aData, aData + aLength);
+  if (!Parse(aIndex)) {
+    mData.clear();
+    mGlyphCount = 0;
+    mCmapFormat = 0;
+    return false;
+  }
+
+  mId = HashBytes(kHashSeed, mData.data(), mData.size());
+  mId = HashBytes(mId, &aIndex, sizeof(aIndex));
+  return true;
+}
+
+uint16_t
+TrueTypeFont::U16(size_t aOffset) const
+{
+  if (!InBounds(aOffset, 2)) {
+    return 0;
+  }
+  return (uint16_t)((mData[aOffset] << 8) | mData[aOffset + 1]);
+}
+
+uint32_t
+TrueTypeFont::U32(size_t aOffset) const
+{
+  if (!InBounds(aOffset, 4)) {
+    return 0;
+  }
+  return ((uint32_t)mData[aOffset] << 24) | ((uint32_t)mData[aOffset + 1] << 16) |
+         ((uint32_t)mData[aOffset + 2] << 8) | (uint32_t)mData[aOffset + 3];
+}
+
+TrueTypeFont::Table
+TrueTypeFont::FindTable(uint32_t aFontOffset, uint32_t aTag) const
+{
+  Table table = { 0, 0 };
+  uint16_t tableCount = U16(aFontOffset + 4);
+  for (uint16_t i = 0; i < tableCount; i++) {
+    size_t record = aFontOffset + 12 + (size_t)i * 16;
+    if (U32(record) == aTag) {
+      uint32_t offset = U32(record + 8);
+      uint32_t length = U32(record + 12);
+      if (InBounds(offset, length)) {
+        table.fOffset = offset;
+        table.fLength = length;
+      }
+      break;
+    }
+  }
+  return table;
+}
+
+bool
+TrueTypeFont::Parse(uint32_t aIndex)
+{
+  uint32_t fontOffset = 0;
+  if (U32(0) == MakeTag('t', 't', 'c', 'f')) {
+    if (aIndex >= U32(8)) {
+      return false;
+    }
+    fontOffset = U32(12 + (size_t)aIndex * 4);
+  } else if (aIndex != 0) {
+    return false;
+  }
+
+  // 'OTTO' fonts have CFF outlines, which we do not read.
+  uint32_t version = U32(fontOffset);
+  if (version != 0x00010000 && version != MakeTag('t', 'r', 'u', 'e')) {
+    return false;
+  }
+
+  Table head = FindTable(fontOffset, MakeTag('h', 'e', 'a', 'd'));
+  Table maxp = FindTable(fontOffset, MakeTag('m', 'a', 'x', 'p'));
+  Table hhea = FindTable(fontOffset, MakeTag('h', 'h', 'e', 'a'));
+  mHmtx = FindTable(fontOffset, MakeTag('h', 'm', 't', 'x'));
+  mLoca = FindTable(fontOffset, MakeTag('l', 'o', 'c', 'a'));
+  mGlyf = FindTable(fontOffset, MakeTag('g', 'l', 'y', 'f'));
+  if (head.fLength < 54 || maxp.fLength < 6 || hhea.fLength < 36 ||
+      !mHmtx.fLength || !mLoca.fLength) {
+    return false;
+  }
+
+  mUnitsPerEm = U16(head.fOffset + 18);
+  mLongLoca = U16(head.fOffset + 50) != 0;
+  mGlyphCount = U16(maxp.fOffset + 4);
+  mAscender = (int16_t)U16(hhea.fOffset + 4);
+  mDescender = (int16_t)U16(hhea.fOffset + 6);
+  mHMetricCount = U16(hhea.fOffset + 34);
+  if (!mUnitsPerEm || !mGlyphCount || !mHMetricCount ||
+      mHmtx.fLength < (uint32_t)mHMetricCount * 4) {
+    return false;
+  }
+
+  SelectCmap(fontOffset);
+  return true;
+}
+
+bool
+TrueTypeFont::SelectCmap(uint32_t aFontOffset)
+{
+  Table cmap = FindTable(aFontOffset, MakeTag('c', 'm', 'a', 'p'));
+
+  // Full Unicode subtables beat BMP only ones.
+  mCmapFormat = 0;
+  uint16_t subtableCount = U16(cmap.fOffset + 2);
+  for (uint16_t i = 0; cmap.fLength && i < subtableCount; i++) {
+    size_t record = cmap.fOffset + 4 + (size_t)i * 8;
+    uint16_t platform = U16(record);
+    uint16_t encoding = U16(record + 2);
+    uint32_t subtable = cmap.fOffset + U32(record + 4);
+    bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+    if (!unicode || !InBounds(subtable, 2)) {
+      continue;
+    }
+
+    uint16_t format = U16(subtable);
+    if ((format == 12 && mCmapFormat != 12) || (format == 4 && mCmapFormat == 0)) {
+      mCmapFormat = format;
+      mCmapSubtable = subtable;
+    }
+  }
+  return mCmapFormat != 0;
+}
+
+uint16_t
+TrueTypeFont::GetGlyphIndexFormat4(uint32_t aCodePoint) const
+{
+  if (aCodePoint > 0xFFFF) {
+    return 0;
+  }
+
+  // Binary search for the first segment ending at or after the code point.
+  const uint32_t segCount = U16(mCmapSubtable + 6) / 2;
+  const size_t endCodes = mCmapSubtable + 14;
+  const size_t startCodes = endCodes + 2 + segCount * 2;
+  const size_t idDeltas = startCodes + segCount * 2;
+  const size_t idRangeOffsets = idDeltas + segCount * 2;
+
+  uint32_t low = 0;
+  uint32_t high = segCount;
+  while (low < high) {
+    uint32_t mid = (low + high) / 2;
+    if (U16(endCodes + mid * 2) < aCodePoint) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low == segCount || U16(startCodes + low * 2) > aCodePoint) {
+    return 0;
+  }
+
+  uint16_t idDelta = U16(idDeltas + low * 2);
+  size_t rangeOffsetAt = idRangeOffsets + low * 2;
+  uint16_t rangeOffset = U16(rangeOffsetAt);
+  if (!rangeOffset) {
+    return (uint16_t)(aCodePoint + idDelta);
+  }
+
+  // The range offset is relative to where it is stored.
+  uint16_t glyph = U16(rangeOffsetAt + rangeOffset +
+                       (aCodePoint - U16(startCodes + low * 2)) * 2);
+  return glyph ? (uint16_t)(glyph + idDelta) : 0;
+}
+
+uint16_t
+TrueTypeFont::GetGlyphIndexFormat12(uint32_t aCodePoint) const
+{
+  const uint32_t groupCount = U32(mCmapSubtable + 12);
+  const size_t groups = mCmapSubtable + 16;
+  if (!InBounds(groups, (size_t)groupCount * 12)) {
+    return 0;
+  }
+
+  uint32_t low = 0;
+  uint32_t high = groupCount;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    size_t group = groups + (size_t)mid * 12;
+    if (U32(group + 4) < aCodePoint) {
+      low = mid + 1;
+    } else if (U32(group) > aCodePoint) {
+      high = mid;
+    } else {
+      uint32_t glyph = U32(group + 8) + (aCodePoint - U32(group));
+      return glyph <= 0xFFFF ? (uint16_t)glyph : 0;
+    }
+  }
+  return 0;
+}
+
+uint16_t
+TrueTypeFont::GetGlyphIndex(uint32_t aCodePoint) const
+{
+  uint16_t glyph = 0;
+  if (mCmapFormat == 12) {
+    glyph = GetGlyphIndexFormat12(aCodePoint);
+  } else if (mCmapFormat == 4) {
+    glyph = GetGlyphIndexFormat4(aCodePoint);
+  }
+  return glyph < mGlyphCount ? glyph : 0;
+}
+
+int32_t
+TrueTypeFont::GetDesignAdvance(uint16_t aGlyph) const
+{
+  if (aGlyph >= mGlyphCount) {
+    return 0;
+  }
+
+  // Glyphs past the last long metric share its advance.
+  uint32_t metric = aGlyph < mHMetricCount ? aGlyph : mHMetricCount - 1u;
+  return U16(mHmtx.fOffset + (size_t)metric * 4);
+}
+
+bool
+TrueTypeFont::GetGlyphData(uint16_t aGlyph, uint32_t* aOutOffset, uint32_t* aOutLength) const
+{
+  if (aGlyph >= mGlyphCount) {
+    return false;
+  }
+
+  uint32_t start, end;
+  if (mLongLoca) {
+    if ((size_t)aGlyph * 4 + 8 > mLoca.fLength) {
+      return false;
+    }
+    start = U32(mLoca.fOffset + (size_t)aGlyph * 4);
+    end = U32(mLoca.fOffset + (size_t)aGlyph * 4 + 4);
+  } else {
+    if ((size_t)aGlyph * 2 + 4 > mLoca.fLength) {
+      return false;
+    }
+    start = U16(mLoca.fOffset + (size_t)aGlyph * 2) * 2u;
+    end = U16(mLoca.fOffset + (size_t)aGlyph * 2 + 2) * 2u;
+  }
+
+  if (start > end || end > mGlyf.fLength) {
+    return false;
+  }
+  *aOutOffset = mGlyf.fOffset + start;
+  *aOutLength = end - start;
+  return true;
+}
+
+bool
+TrueTypeFont::GetGlyphOutline(uint16_t aGlyph, GlyphOutline& aOutline) const
+{
+  aOutline.Clear();
+  Transform identity = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+  uint32_t componentBudget = kMaxCompositeComponents;
+  if (!AppendGlyph(aGlyph, identity, 0, &componentBudget, aOutline)) {
+    aOutline.Clear();
+    return false;
+  }
+  return true;
+}
+
+bool
+TrueTypeFont::AppendGlyph(uint16_t aGlyph, const Transform& aTransform, int aDepth,
+                          uint32_t* aComponentBudget, GlyphOutline& aOutline) const
+{
+  uint32_t offset, length;
+  if (!GetGlyphData(aGlyph, &offset, &length)) {
+    return false;
+  }
+
+  // Spaces and other blank glyphs have no data at all.
+  if (!length) {
+    return true;
+  }
+  if (length < 10) {
+    return false;
+  }
+
+  int16_t contourCount = (int16_t)U16(offset);
+  if (contourCount >= 0) {
+    return AppendSimpleGlyph(offset + 10, offset + length, contourCount, aTransform, aOutline);
+  }
+  if (aDepth >= kMaxCompositeDepth) {
+    return false;
+  }
+  return AppendCompositeGlyph(offset + 10, offset + length, aTransform, aDepth,
+                              aComponentBudget, aOutline);
+}
+
+bool
+TrueTypeFont::AppendSimpleGlyph(uint32_t aOffset, uint32_t aEnd, int16_t aContourCount,
+                                const Transform& aTransform, GlyphOutline& aOutline) const
+{
+  enum {
+    ON_CURVE = 0x01,
+    X_SHORT = 0x02,
+    Y_SHORT = 0x04,
+    REPEAT = 0x08,
+    X_SAME_OR_POSITIVE = 0x10,
+    Y_SAME_OR_POSITIVE = 0x20,
+  };
+
+  if (!aContourCount) {
+    return true;
+  }
+
+  size_t pos = aOffset;
+  if (pos + (size_t)aContourCount * 2 + 2 > aEnd ||
+      aOutline.fContourEnds.size() + aContourCount > kMaxOutlinePoints) {
+    return false;
+  }
+
+  // Contour ends are indices into this glyph's points, offset them by the
+  // points already in the outline.
+  const uint32_t firstPoint = (uint32_t)aOutline.fPoints.size();
+  uint32_t pointCount = 0;
+  for (int16_t i = 0; i < aContourCount; i++) {
+    uint32_t last = U16(pos + (size_t)i * 2);
+    if (last < pointCount) {
+      return false;
+    }
+    pointCount = last + 1;
+    aOutline.fContourEnds.push_back(firstPoint + last);
+  }
+  pos += (size_t)aContourCount * 2;
+  if (firstPoint + pointCount > kMaxOutlinePoints) {
+    return false;
+  }
+
+  // Skip the hinting instructions.
+  pos += 2 + U16(pos);
+
+  std::vector<GlyphOutline::Point>& points = aOutline.fPoints;
+  points.resize(firstPoint + pointCount);
+  GlyphOutline::Point* glyphPoints = &points[firstPoint];
+
+  // Flags, with runs of the same flag stored once.
+  std::vector<uint8_t> flags(pointCount);
+  for (uint32_t i = 0; i < pointCount; ) {
+    if (pos >= aEnd) {
+      return false;
+    }
+    uint8_t flag = mData[pos++];
+    uint32_t repeat = 1;
+    if (flag & REPEAT) {
+      if (pos >= aEnd) {
+        return false;
+      }
+      repeat += mData[pos++];
+    }
+    for (; repeat && i < pointCount; repeat--) {
+      flags[i++] = flag;
+    }
+  }
+
+  // Coordinates are deltas, x for every point first, then y.
+  int32_t x = 0;
+  for (uint32_t i = 0; i < pointCount; i++) {
+    if (flags[i] & X_SHORT) {
+      if (pos + 1 > aEnd) {
+        return false;
+      }
+      x += (flags[i] & X_SAME_OR_POSITIVE) ? mData[pos] : -(int32_t)mData[pos];
+      pos += 1;
+    } else if (!(flags[i] & X_SAME_OR_POSITIVE)) {
+      if (pos + 2 > aEnd) {
+        return false;
+      }
+      x += (int16_t)U16(pos);
+      pos += 2;
+    }
+    glyphPoints[i].fX = (float)x;
+  }
+
+  int32_t y = 0;
+  for (uint32_t i = 0; i < pointCount; i++) {
+    if (flags[i] & Y_SHORT) {
+      if (pos + 1 > aEnd) {
+        return false;
+      }
+      y += (flags[i] & Y_SAME_OR_POSITIVE) ? mData[pos] : -(int32_t)mData[pos];
+      pos += 1;
+    } else if (!(flags[i] & Y_SAME_OR_POSITIVE)) {
+      if (pos + 2 > aEnd) {
+        return false;
+      }
+      y += (int16_t)U16(pos);
+      pos += 2;
+    }
+    glyphPoints[i].fY = (float)y;
+  }
+
+  for (uint32_t i = 0; i < pointCount; i++) {
+    float px = glyphPoints[i].fX;
+    float py = glyphPoints[i].fY;
+    glyphPoints[i].fX = aTransform.fXX * px + aTransform.fYX * py + aTransform.fDX;
+    glyphPoints[i].fY = aTransform.fXY * px + aTransform.fYY * py + aTransform.fDY;
+    glyphPoints[i].fOnCurve = (flags[i] & ON_CURVE) != 0;
+  }
+  return true;
+}
+
+bool
+TrueTypeFont::AppendCompositeGlyph(uint32_t aOffset, uint32_t aEnd, const Transform& aTransform,
+                                   int aDepth, uint32_t* aComponentBudget,
+                                   GlyphOutline& aOutline) const
+{
+  enum {
+    ARG_1_AND_2_ARE_WORDS = 0x0001,
+    ARGS_ARE_XY_VALUES = 0x0002,
+    WE_HAVE_A_SCALE = 0x0008,
+    MORE_COMPONENTS = 0x0020,
+    WE_HAVE_AN_X_AND_Y_SCALE = 0x0040,
+    WE_HAVE_A_TWO_BY_TWO = 0x0080,
+  };
+
+  size_t pos = aOffset;
+  uint16_t flags;
+  do {
+    if (pos + 4 > aEnd || !*aComponentBudget) {
+      return false;
+    }
+    (*aComponentBudget)--;
+    flags = U16(pos);
+    uint16_t glyph = U16(pos + 2);
+    pos += 4;
+
+    int32_t arg1, arg2;
+    if (flags & ARG_1_AND_2_ARE_WORDS) {
+      if (pos + 4 > aEnd) {
+        return false;
+      }
+      arg1 = (int16_t)U16(pos);
+      arg2 = (int16_t)U16(pos + 2);
+      pos += 4;
+    } else {
+      if (pos + 2 > aEnd) {
+        return false;
+      }
+      arg1 = (int8_t)mData[pos];
+      arg2 = (int8_t)mData[pos + 1];
+      pos += 2;
+    }
+
+    Transform component = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+    if (flags & WE_HAVE_A_SCALE) {
+      if (pos + 2 > aEnd) {
+        return false;
+      }
+      component.fXX = component.fYY = F2Dot14(U16(pos));
+      pos += 2;
+    } else if (flags & WE_HAVE_AN_X_AND_Y_SCALE) {
+      if (pos + 4 > aEnd) {
+        return false;
+      }
+      component.fXX = F2Dot14(U16(pos));
+      component.fYY = F2Dot14(U16(pos + 2));
+      pos += 4;
+    } else if (flags & WE_HAVE_A_TWO_BY_TWO) {
+      if (pos + 8 > aEnd) {
+        return false;
+      }
+      component.fXX = F2Dot14(U16(pos));
+      component.fXY = F2Dot14(U16(pos + 2));
+      component.fYX = F2Dot14(U16(pos + 4));
+      component.fYY = F2Dot14(U16(pos + 6));
+      pos += 8;
+    }
+
+    // Components placed by matching points are rare, they are drawn
+    // unshifted.
+    if (flags & ARGS_ARE_XY_VALUES) {
+      component.fDX = (float)arg1;
+      component.fDY = (float)arg2;
+    }
+
+    // The component transform applies first, then ours.
+    const Transform& t = aTransform;
+    Transform combined;
+    combined.fXX = t.fXX * component.fXX + t.fYX * component.fXY;
+    combined.fXY = t.fXY * component.fXX + t.fYY * component.fXY;
+    combined.fYX = t.fXX * component.fYX + t.fYX * component.fYY;
+    combined.fYY = t.fXY * component.fYX + t.fYY * component.fYY;
+    combined.fDX = t.fXX * component.fDX + t.fYX * component.fDY + t.fDX;
+    combined.fDY = t.fXY * component.fDX + t.fYY * component.fDY + t.fDY;
+
+    if (!AppendGlyph(glyph, combined, aDepth + 1, aComponentBudget, aOutline)) {
+      return false;
+    }
+  } while (flags & MORE_COMPONENTS);
+  return true;
+}
+
+void
+TrueTypeGlyphSource::GetGlyphIndices(const uint32_t* aCodePoints, uint32_t aCount,
+                                     uint16_t* aOutGlyphs)
+{
+  for (uint32_t i = 0; i < aCount; i++) {
+    aOutGlyphs[i] = mFont->GetGlyphIndex(aCodePoints[i]);
+  }
+}
+
+void
+TrueTypeGlyphSource::GetDesignAdvances(const uint16_t* aGlyphs, uint32_t aCount,
+                                       int32_t* aOutAdvances)
+{
+  for (uint32_t i = 0; i < aCount; i++) {
+    aOutAdvances[i] = mFont->GetDesignAdvance(aGlyphs[i]);
+  }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "FontGlyphMap.h"
+
+// A glyph outline in font design units, y up. Contours are closed and made
+// of on curve points and quadratic control points like in the glyf table.
+struct GlyphOutline {
+  struct Point {
+    float fX;
+    float fY;
+    bool fOnCurve;
+  };
+
+  std::vector<Point> fPoints;
+  std::vector<uint32_t> fContourEnds;  // Index of the last point of each contour
+
+  void Clear() {
+    fPoints.clear();
+    fContourEnds.clear();
+  }
+};
+
+/**
+ * The parts of a TrueType font we need to draw text without DWrite: the
+ * cmap, horizontal advances and glyf outlines. Fonts with CFF outlines are
+ * rejected. Every read is bounds checked against the file, a damaged font
+ * gives empty glyphs rather than crashes. There is no hinting, outlines are
+ * only scaled.
+ */
+class TrueTypeFont {
+public:
+  TrueTypeFont();
+
+  // Both return false, leaving the font empty, if the data is not a
+  // TrueType font we can read. aIndex picks a font out of a collection.
+  bool LoadFile(const char* aPath, uint32_t aIndex = 0);
+  bool Load(const uint8_t* aData, size_t aLength, uint32_t aIndex = 0);
+
+  bool IsLoaded() const { return !mData.empty(); }
+  // Hash of the font data and index, used for GlyphKey::fFaceId.
+  uint64_t Id() const { return mId; }
+  uint16_t DesignUnitsPerEm() const { return mUnitsPerEm; }
+  uint32_t GlyphCount() const { return mGlyphCount; }
+  int16_t Ascender() const { return mAscender; }
+  int16_t Descender() const { return mDescender; }
+
+  // Unmapped code points give glyph 0.
+  uint16_t GetGlyphIndex(uint32_t aCodePoint) const;
+  int32_t GetDesignAdvance(uint16_t aGlyph) const;
+
+  // Replaces aOutline with the outline of aGlyph, composites flattened into
+  // one outline. Returns false for glyphs that cannot be read.
+  bool GetGlyphOutline(uint16_t aGlyph, GlyphOutline& aOutline) const;
+
+private:
+  struct Transform {
+    float fXX, fXY, fYX, fYY;  // x' = fXX * x + fYX * y + fDX
+    float fDX, fDY;            // y' = fXY * x + fYY * y + fDY
+  };
+
+  // A table's place in mData, empty if the font does not have it.
+  struct Table {
+    uint32_t fOffset;
+    uint32_t fLength;
+  };
+
+  uint16_t U16(size_t aOffset) const;
+  uint32_t U32(size_t aOffset) const;
+  bool InBounds(size_t aOffset, size_t aLength) const {
+    return aOffset <= mData.size() && aLength <= mData.size() - aOffset;
+  }
+
+  bool Parse(uint32_t aIndex);
+  Table FindTable(uint32_t aFontOffset, uint32_t aTag) const;
+  bool SelectCmap(uint32_t aFontOffset);
+  bool GetGlyphData(uint16_t aGlyph, uint32_t* aOutOffset, uint32_t* aOutLength) const;
+  // aComponentBudget is what is left of the composite components one
+  // GetGlyphOutline may expand, shared by every level of nesting.
+  bool AppendGlyph(uint16_t aGlyph, const Transform& aTransform, int aDepth,
+                   uint32_t* aComponentBudget, GlyphOutline& aOutline) const;
+  bool AppendSimpleGlyph(uint32_t aOffset, uint32_t aEnd, int16_t aContourCount,
+                         const Transform& aTransform, GlyphOutline& aOutline) const;
+  bool AppendCompositeGlyph(uint32_t aOffset, uint32_t aEnd, const Transform& aTransform,
+                            int aDepth, uint32_t* aComponentBudget,
+                            GlyphOutline& aOutline) const;
+  uint16_t GetGlyphIndexFormat4(uint32_t aCodePoint) const;
+  uint16_t GetGlyphIndexFormat12(uint32_t aCodePoint) const;
+
+  std::vector<uint8_t> mData;
+  uint64_t mId;
+  uint16_t mUnitsPerEm;
+  uint32_t mGlyphCount;
+  int16_t mAscender;
+  int16_t mDescender;
+  bool mLongLoca;
+  uint16_t mHMetricCount;
+  Table mLoca;
+  Table mGlyf;
+  Table mHmtx;
+  uint32_t mCmapSubtable;  // Offset of the chosen cmap subtable in mData
+  uint16_t mCmapFormat;    // 4 or 12, 0 if the font has no usable cmap
+};
+
+// Feeds a FontGlyphMap from a TrueTypeFont, which has to outlive it.
+class TrueTypeGlyphSource : public GlyphMapSource {
+public:
+  explicit TrueTypeGlyphSource(const TrueTypeFont* aFont) : mFont(aFont) { }
+
+  virtual void GetGlyphIndices(const uint32_t* aCodePoints, uint32_t aCount,
+                               uint16_t* aOutGlyphs) override;
+  virtual void GetDesignAdvances(const uint16_t* aGlyphs, uint32_t aCount,
+                                 int32_t* aOutAdvances) override;
+
+private:
+  const TrueTypeFont* mFont;
+};
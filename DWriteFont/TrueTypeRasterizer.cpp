@@ -0,0 +1,168 @@
+#include "TrueTypeRasterizer.h"
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+// Subpixels per pixel in ClearType masks, and how far the filter reaches.
+static const int32_t kSubpixels = 3;
+static const int32_t kFilterRadius = 2;
+
+TrueTypeRasterizer::TrueTypeRasterizer(const TrueTypeFont* aFont, float aEmSize)
+  : mFont(aFont)
+  , mEmSize(aEmSize)
+  , mScale(aEmSize / aFont->DesignUnitsPerEm())
+{
+}
+
+GlyphRasterizer*
+TrueTypeRasterizer::Clone() const
+{
+  return new TrueTypeRasterizer(mFont, mEmSize);
+}
+
+void
+TrueTypeRasterizer::GetKeyTemplate(GlyphMaskFormat aFormat, GlyphKey* aOutKey)
+{
+  // Outlines are only ever scaled, there are no rendering or measuring modes
+  // to tell apart.
+  aOutKey->fFaceId = mFont->Id();
+  aOutKey->fEmSize = mEmSize;
+  aOutKey->fPixelsPerDip = 1.0f;
+  aOutKey->fGlyphIndex = 0;
+  aOutKey->fRenderingMode = 0;
+  aOutKey->fMeasuringMode = 0;
+  aOutKey->fTextureType = (uint8_t)aFormat;
+  aOutKey->fSubpixelX = 0;
+}
+
+void
+TrueTypeRasterizer::FillOutline()
+{
+  // Contours alternate on curve points and control points, with an on curve
+  // point implied halfway between two control points in a row.
+  const GlyphOutline::Point* outline = mOutline.fPoints.data();
+  const Point* points = mPoints.data();
+  uint32_t first = 0;
+  for (size_t c = 0; c < mOutline.fContourEnds.size(); c++) {
+    uint32_t last = mOutline.fContourEnds[c];
+    if (last < first) {
+      continue;
+    }
+
+    // Start on an on curve point, making one up if there is none at the ends.
+    Point start;
+    uint32_t begin = first;
+    uint32_t end = last + 1;
+    if (outline[first].fOnCurve) {
+      start = points[first];
+      begin = first + 1;
+    } else if (outline[last].fOnCurve) {
+      start = points[last];
+      end = last;
+    } else {
+      start.fX = 0.5f * (points[first].fX + points[last].fX);
+      start.fY = 0.5f * (points[first].fY + points[last].fY);
+    }
+
+    Point current = start;
+    Point control = start;
+    bool hasControl = false;
+    for (uint32_t i = begin; i < end; i++) {
+      const Point& point = points[i];
+      if (outline[i].fOnCurve) {
+        if (hasControl) {
+          mCoverage.DrawQuad(current.fX, current.fY, control.fX, control.fY, point.fX, point.fY);
+        } else {
+          mCoverage.DrawLine(current.fX, current.fY, point.fX, point.fY);
+        }
+        current = point;
+        hasControl = false;
+      } else {
+        if (hasControl) {
+          Point mid = { 0.5f * (control.fX + point.fX), 0.5f * (control.fY + point.fY) };
+          mCoverage.DrawQuad(current.fX, current.fY, control.fX, control.fY, mid.fX, mid.fY);
+          current = mid;
+        }
+        control = point;
+        hasControl = true;
+      }
+    }
+
+    if (hasControl) {
+      mCoverage.DrawQuad(current.fX, current.fY, control.fX, control.fY, start.fX, start.fY);
+    } else {
+      mCoverage.DrawLine(current.fX, current.fY, start.fX, start.fY);
+    }
+    first = last + 1;
+  }
+}
+
+GlyphMask*
+TrueTypeRasterizer::RasterizeGlyph(uint16_t aGlyph, float aOriginX, GlyphMaskFormat aFormat)
+{
+  GlyphMask* mask = new GlyphMask();
+  mask->fBytesPerPixel = GlyphMaskBytesPerPixel(aFormat);
+  if (!mFont->GetGlyphOutline(aGlyph, mOutline) || mOutline.fPoints.empty()) {
+    return mask;
+  }
+
+  // To pixels, y down. Control points are included in the bounds, curves
+  // never leave the hull of their points.
+  const size_t pointCount = mOutline.fPoints.size();
+  mPoints.resize(pointCount);
+  float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+  for (size_t i = 0; i < pointCount; i++) {
+    float x = mOutline.fPoints[i].fX * mScale + aOriginX;
+    float y = -mOutline.fPoints[i].fY * mScale;
+    mPoints[i].fX = x;
+    mPoints[i].fY = y;
+    minX = std::min(minX, x);
+    maxX = std::max(maxX, x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+  }
+
+  const bool clearType = aFormat == GLYPH_MASK_CLEARTYPE_3x1;
+  const int32_t subpixels = clearType ? kSubpixels : 1;
+  const float padding = clearType ? (float)kFilterRadius / kSubpixels : 0.0f;
+  mask->fLeft = (int32_t)floorf(minX - padding);
+  mask->fTop = (int32_t)floorf(minY);
+  mask->fWidth = (int32_t)ceilf(maxX + padding) - mask->fLeft;
+  mask->fHeight = (int32_t)ceilf(maxY) - mask->fTop;
+  if (mask->IsEmpty()) {
+    mask->fWidth = mask->fHeight = 0;
+    return mask;
+  }
+
+  // Into the coverage buffer, which is subpixels times as wide.
+  for (size_t i = 0; i < pointCount; i++) {
+    mPoints[i].fX = (mPoints[i].fX - mask->fLeft) * subpixels;
+    mPoints[i].fY = mPoints[i].fY - mask->fTop;
+  }
+
+  const int32_t coverageWidth = mask->fWidth * subpixels;
+  mCoverage.Reset(coverageWidth, mask->fHeight);
+  FillOutline();
+
+  mask->fBits = (uint8_t*)malloc(mask->ByteSize());
+  if (!clearType) {
+    mCoverage.Accumulate(mask->fBits, mask->fWidth);
+    return mask;
+  }
+
+  // Zero columns on both sides let the filter run without edge checks.
+  const int32_t paddedWidth = coverageWidth + 2 * kFilterRadius;
+  mSubpixels.assign((size_t)paddedWidth * mask->fHeight, 0);
+  mCoverage.Accumulate(mSubpixels.data() + kFilterRadius, paddedWidth);
+
+  // Each subpixel becomes one byte of the RGB mask.
+  for (int32_t y = 0; y < mask->fHeight; y++) {
+    const uint8_t* src = mSubpixels.data() + (size_t)y * paddedWidth + kFilterRadius;
+    uint8_t* dst = mask->fBits + (size_t)y * coverageWidth;
+    for (int32_t x = 0; x < coverageWidth; x++) {
+      int32_t sum = src[x - 2] + 2 * src[x - 1] + 3 * src[x] + 2 * src[x + 1] + src[x + 2];
+      dst[x] = (uint8_t)((sum + 4) / 9);
+    }
+  }
+  return mask;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include "CoverageRasterizer.h"
+#include "GlyphRasterizer.h"
+#include "TrueTypeFont.h"
+
+/**
+ * Rasterizes glyf outlines of a TrueTypeFont with CoverageRasterizer, so the
+ * mask pipeline runs without DWrite. Outlines are scaled, not hinted.
+ *
+ * ClearType masks are filled at three times the horizontal resolution and
+ * run through a [1 2 3 2 1] / 9 filter across the subpixels to keep color
+ * fringes down, which widens them by up to two subpixels on either side. A8
+ * masks are plain coverage.
+ *
+ * The font has to outlive the rasterizer. Keeps its scratch buffers between
+ * glyphs, so it is not thread safe, but the font is only read and every
+ * Clone has its own buffers.
+ */
+class TrueTypeRasterizer : public GlyphRasterizer {
+public:
+  TrueTypeRasterizer(const TrueTypeFont* aFont, float aEmSize);
+
+  virtual void GetKeyTemplate(GlyphMaskFormat aFormat, GlyphKey* aOutKey) override;
+  virtual GlyphMask* RasterizeGlyph(uint16_t aGlyph, float aOriginX,
+                                    GlyphMaskFormat aFormat) override;
+  virtual GlyphRasterizer* Clone() const override;
+
+private:
+  struct Point {
+    float fX;
+    float fY;
+  };
+
+  // Fills mCoverage with the outline in mPoints, which are already in
+  // coverage buffer pixels.
+  void FillOutline();
+
+  const TrueTypeFont* mFont;
+  float mEmSize;
+  float mScale;  // Design units to pixels
+
+  GlyphOutline mOutline;
+  std::vector<Point> mPoints;
+  CoverageRasterizer mCoverage;
+  std::vector<uint8_t> mSubpixels;
+};
@@ -0,0 +1,180 @@
+#include "WorkStealingPool.h"
+#include <stdio.h>
+#include "Trace.h"
+
+static inline uint64_t
+PackRange(uint32_t aBegin, uint32_t aEnd)
+{
+  return ((uint64_t)aBegin << 32) | aEnd;
+}
+
+static inline uint32_t RangeBegin(uint64_t aRange) { return (uint32_t)(aRange >> 32); }
+static inline uint32_t RangeEnd(uint64_t aRange) { return (uint32_t)aRange; }
+
+WorkStealingPool::WorkStealingPool(int aThreadCount)
+  : mThreadCount(aThreadCount)
+  , mTask(nullptr)
+  , mSteals(0)
+  , mGeneration(0)
+  , mBusy(0)
+  , mShutdown(false)
+{
+  if (mThreadCount <= 0) {
+    mThreadCount = (int)std::thread::hardware_concurrency();
+    if (mThreadCount <= 0) {
+      mThreadCount = 1;
+    }
+  }
+
+  mSlices.reset(new Slice[mThreadCount]);
+  for (int i = 0; i < mThreadCount; i++) {
+    mSlices[i].fRange.store(0, std::memory_order_relaxed);
+  }
+  for (int i = 1; i < mThreadCount; i++) {
+    mThreads.emplace_back(&WorkStealingPool::WorkerMain, this, i);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mLock);
+    mShutdown = true;
+  }
+  mWake.notify_all();
+  for (std::thread& thread : mThreads) {
+    thread.join();
+  }
+}
+
+void
+WorkStealingPool::ParallelFor(int aCount, const std::function<void(int, int)>& aTask)
+{
+  if (aCount <= 0) {
+    return;
+  }
+  if (mThreadCount == 1 || aCount == 1) {
+    for (int i = 0; i < aCount; i++) {
+      aTask(i, 0);
+    }
+    return;
+  }
+
+  mTask = &aTask;
+  mSteals.store(0, std::memory_order_relaxed);
+  for (int i = 0; i < mThreadCount; i++) {
+    uint32_t begin = (uint32_t)((int64_t)aCount * i / mThreadCount);
+    uint32_t end = (uint32_t)((int64_t)aCount * (i + 1) / mThreadCount);
+    mSlices[i].fRange.store(PackRange(begin, end));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mLock);
+    mGeneration++;
+    mBusy = mThreadCount - 1;
+  }
+  mWake.notify_all();
+
+  RunTasks(0);
+
+  // The lock also publishes the workers' writes to the caller.
+  std::unique_lock<std::mutex> lock(mLock);
+  mDone.wait(lock, [this]() { return mBusy == 0; });
+  mTask = nullptr;
+}
+
+void
+WorkStealingPool::WorkerMain(int aThread)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "Worker %d", aThread);
+  Tracer::SetThreadName(name);
+
+  uint64_t generation = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mLock);
+      mWake.wait(lock, [&]() { return mShutdown || mGeneration != generation; });
+      if (mShutdown) {
+        return;
+      }
+      generation = mGeneration;
+    }
+
+    RunTasks(aThread);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (--mBusy == 0) {
+      mDone.notify_one();
+    }
+  }
+}
+
+void
+WorkStealingPool::RunTasks(int aThread)
+{
+  for (;;) {
+    int index;
+    if (TakeFront(aThread, &index)) {
+      (*mTask)(index, aThread);
+    } else if (!Steal(aThread)) {
+      return;
+    }
+  }
+}
+
+bool
+WorkStealingPool::TakeFront(int aThread, int* aOutIndex)
+{
+  std::atomic<uint64_t>& slice = mSlices[aThread].fRange;
+  uint64_t range = slice.load();
+  for (;;) {
+    uint32_t begin = RangeBegin(range);
+    uint32_t end = RangeEnd(range);
+    if (begin >= end) {
+      return false;
+    }
+    if (slice.compare_exchange_weak(range, PackRange(begin + 1, end))) {
+      *aOutIndex = (int)begin;
+      return true;
+    }
+  }
+}
+
+bool
+WorkStealingPool::Steal(int aThread)
+{
+  for (;;) {
+    // The fullest slice gives the most work per steal.
+    int victim = -1;
+    uint64_t victimRange = 0;
+    uint32_t most = 0;
+    for (int i = 1; i < mThreadCount; i++) {
+      int other = (aThread + i) % mThreadCount;
+      uint64_t range = mSlices[other].fRange.load();
+      uint32_t left = RangeEnd(range) - RangeBegin(range);
+      if (left > most) {
+        victim = other;
+        victimRange = range;
+        most = left;
+      }
+    }
+    if (victim < 0) {
+      return false;
+    }
+
+    uint32_t begin = RangeBegin(victimRange);
+    uint32_t end = RangeEnd(victimRange);
+    uint32_t split = end - (end - begin + 1) / 2;
+    if (!mSlices[victim].fRange.compare_exchange_strong(victimRange, PackRange(begin, split))) {
+      // The owner or another thief got there first, look again.
+      continue;
+    }
+
+    // Our own slice is empty, which thieves leave alone, so a plain store
+    // hands the stolen indices to TakeFront.
+    mSlices[aThread].fRange.store(PackRange(split, end));
+    mSteals.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of threads that run the indices of a ParallelFor between
+ * them. Each thread, the caller included, starts with an equal contiguous
+ * slice of the indices and takes them from the front. A thread whose slice
+ * runs dry steals the back half of the fullest slice left, so tasks of
+ * uneven cost even out without every thread contending on one queue, and
+ * neighbouring indices mostly stay on one thread.
+ *
+ * A slice is a begin and end packed into one 64 bit atomic: taking and
+ * stealing are a compare and swap, only starting and finishing a
+ * ParallelFor take the lock. One ParallelFor at a time, from one thread.
+ */
+class WorkStealingPool {
+public:
+  // aThreadCount counts the calling thread, 0 is one per hardware thread.
+  explicit WorkStealingPool(int aThreadCount = 0);
+  ~WorkStealingPool();
+
+  int ThreadCount() const { return mThreadCount; }
+
+  // Calls aTask(index, thread) for every index in [0, aCount) and returns
+  // once all have run. thread is in [0, ThreadCount()), 0 for the caller,
+  // so tasks can keep per thread scratch.
+  void ParallelFor(int aCount, const std::function<void(int, int)>& aTask);
+
+  // Slices stolen during the last ParallelFor.
+  uint32_t LastSteals() const { return mSteals.load(std::memory_order_relaxed); }
+
+private:
+  WorkStealingPool(const WorkStealingPool&);
+  WorkStealingPool& operator=(const WorkStealingPool&);
+
+  // Padded to a cache line so threads taking from their own slice do not
+  // fight over the line.
+  struct Slice {
+    std::atomic<uint64_t> fRange;
+    uint8_t fPad[64 - sizeof(std::atomic<uint64_t>)];
+  };
+
+  void WorkerMain(int aThread);
+  // Runs tasks until no slice has any left.
+  void RunTasks(int aThread);
+  bool TakeFront(int aThread, int* aOutIndex);
+  bool Steal(int aThread);
+
+  int mThreadCount;
+  std::unique_ptr<Slice[]> mSlices;
+  std::vector<std::thread> mThreads;
+  const std::function<void(int, int)>* mTask;
+  std::atomic<uint32_t> mSteals;
+
+  std::mutex mLock;
+  std::condition_variable mWake;
+  std::condition_variable mDone;
+  uint64_t mGeneration;
+  int mBusy;
+  bool mShutdown;
+};